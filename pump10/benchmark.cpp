@@ -0,0 +1,39 @@
+/**
+ * methods to time control path primitives on the device
+ */
+#include "benchmark.h"
+
+/**
+ * print the column names for benchmark results
+ */
+void benchmarkHeader()
+{
+  Serial.println("bench,revision,name,zones,iterations,mean_cycles,min_cycles");
+} // end benchmarkHeader()
+
+/**
+ * time a function, and print the result line
+ *
+ * @param[in] name identifies the benchmark
+ * @param[in] zones number of zones processed per iteration; 0 when not used
+ * @param[in] iterations number of times to call the function
+ * @param[in] fn the code to time
+ * @param[in] arg passed to the function
+ */
+void runBenchmark(const char * name, const size_t zones,
+  const unsigned long iterations, benchmark_fn_t fn, void * arg)
+{
+  uint64_t total = 0;
+  uint32_t fastest = UINT32_MAX;
+  fn(arg); // warm the cache
+  for (unsigned long i = 0; i < iterations; i++) {
+    uint32_t started = cycleCount();
+    fn(arg);
+    uint32_t cycles = cycleCount() - started;
+    total += cycles;
+    fastest = min(fastest, cycles);
+  }
+  Serial.printf("bench,%s,%s,%u,%lu,%lu,%lu\n", BENCHMARK_REVISION, name,
+    (unsigned int)zones, iterations, (unsigned long)(total / iterations),
+    (unsigned long)fastest);
+} // end runBenchmark()
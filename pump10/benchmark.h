@@ -0,0 +1,31 @@
+#ifndef benchmark_h
+#define benchmark_h
+
+#include <Arduino.h>
+#include "instrumentation.h"
+#include "irrigation_state.h"
+
+/**
+ * methods to time control path primitives on the device, in cpu cycles
+ *
+ * Each result is a single CSV line, so results captured from the console
+ * for different sketch revisions can be compared directly:
+ *   bench,«revision»,«name»,«zones»,«iterations»,«mean cycles»,«min cycles»
+ */
+
+/// code to be timed; called once per iteration
+typedef void (*benchmark_fn_t)(void *);
+
+/// zones to process in a benchmark iteration
+struct bench_zones_t {
+  irrigation_context_t * contexts;
+  size_t count;
+};
+
+extern const char * BENCHMARK_REVISION;
+
+void benchmarkHeader(void);
+void runBenchmark(const char *, const size_t, const unsigned long,
+  benchmark_fn_t, void *);
+
+#endif
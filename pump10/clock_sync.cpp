@@ -0,0 +1,302 @@
+/**
+ * methods to keep the wall clock synchronized with an NTP server
+ */
+#include "clock_sync.h"
+
+WiFiUDP ntpSocket;
+clock_status_t clockStatus = { 0, 0, 0, 0, 0, 0, 0 };
+bool clockSet = false;
+bool awaitingReply = false;
+uint64_t requestSent = 0; // wall clock milliseconds when the request was sent
+unsigned long requestMillis = 0;
+unsigned long nextSyncDelay = 0; // from requestMillis
+unsigned long lastSlew = 0;
+unsigned long lastMillis = 0;
+// readers use the current base while the next pass writes the other one
+clock_base_t clockBases[2] = { { 0, 0, 0 }, { 0, 0, 0 } };
+volatile uint8_t currentBase = 0;
+
+/**
+ * publish the wall clock base for readers, after the offset changed
+ *
+ * Only called from the main loop, which also owns the offset.
+ *
+ * @param[in] ticks current millis(), with any wrap folded into the offset
+ */
+void rebaseClock(const unsigned long ticks)
+{
+  clock_base_t * next = &clockBases[currentBase ^ 1];
+  if (!clockSet) {
+    *next = { ticks, 0, 0 };
+  } else {
+    uint64_t wall = clockStatus.offset + ticks;
+    unsigned long fraction = wall % 1000;
+    *next = { ticks - fraction, (unsigned long)(wall / 1000), wall - fraction };
+  }
+  currentBase ^= 1;
+} // end rebaseClock()
+
+/**
+ * set up the local time zone, and pick up a clock kept through deep sleep
+ */
+void beginClock()
+{
+  setenv("TZ", TIME_ZONE, 1);
+  tzset();
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  unsigned long ticks = millis();
+  if (now.tv_sec > CLOCK_SET_EPOCH) {
+    // the RTC keeps system time through deep sleep; millis() does not
+    clockStatus.offset = (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000 - ticks;
+    clockSet = true;
+  }
+  lastMillis = ticks;
+  lastSlew = ticks;
+  requestMillis = ticks;
+  nextSyncDelay = 0;
+  rebaseClock(ticks);
+  if (wifiConfigured()) {
+    ntpSocket.begin(NTP_PORT);
+  }
+} // end beginClock()
+
+/**
+ * read millis(), and the wall clock second it falls in
+ *
+ * Safe from any task, without a lock: the base is read before millis(), so
+ * millis() is never earlier than the base, and the difference also holds
+ * across a millis() wrap. Dividing by the constant 1000 compiles to a
+ * multiply.
+ *
+ * @param[out] ticks millis()
+ * @return epoch seconds; 0 when the clock is not set
+ */
+unsigned long clockEpoch(unsigned long * ticks)
+{
+  const clock_base_t * base = &clockBases[currentBase];
+  *ticks = millis();
+  if (base->epoch == 0) {
+    return 0;
+  }
+  return base->epoch + (uint32_t)(*ticks - base->ticks) / 1000;
+} // end clockEpoch()
+
+/**
+ * get the current wall clock time
+ *
+ * @return milliseconds since the (unix) epoch; 0 when the clock is not set
+ */
+uint64_t wallClockMillis()
+{
+  const clock_base_t * base = &clockBases[currentBase];
+  unsigned long ticks = millis();
+  return base->epoch == 0 ? 0 : base->wall + (uint32_t)(ticks - base->ticks);
+} // end wallClockMillis()
+
+/**
+ * convert an NTP timestamp to unix epoch milliseconds
+ *
+ * @param[in] field 8 byte big endian NTP timestamp
+ * @return milliseconds
+ */
+uint64_t ntpToMillis(const uint8_t * field)
+{
+  uint32_t seconds = (uint32_t)field[0] << 24 | (uint32_t)field[1] << 16 |
+    (uint32_t)field[2] << 8 | field[3];
+  uint32_t fraction = (uint32_t)field[4] << 24 | (uint32_t)field[5] << 16 |
+    (uint32_t)field[6] << 8 | field[7];
+  return (uint64_t)(seconds - NTP_UNIX_OFFSET) * 1000 + (((uint64_t)fraction * 1000) >> 32);
+} // end ntpToMillis()
+
+/**
+ * convert unix epoch milliseconds to an NTP timestamp
+ *
+ * @param[out] field 8 byte big endian NTP timestamp
+ * @param[in] wall milliseconds
+ */
+void millisToNtp(uint8_t * field, const uint64_t wall)
+{
+  uint32_t seconds = (uint32_t)(wall / 1000) + NTP_UNIX_OFFSET;
+  // rounded up, so converting back gives the same milliseconds
+  uint32_t fraction = (uint32_t)((((wall % 1000) << 32) + 999) / 1000);
+  for (int i = 0; i < 4; i++) {
+    field[i] = seconds >> (24 - 8 * i);
+    field[4 + i] = fraction >> (24 - 8 * i);
+  }
+} // end millisToNtp()
+
+/**
+ * send an NTP client request
+ *
+ * The transmit timestamp is the local wall clock, which the server returns as
+ * the originate timestamp, to match the reply to the request.
+ *
+ * @param[in] ticks current millis()
+ */
+void sendClockRequest(const unsigned long ticks)
+{
+  uint8_t packet[NTP_PACKET_SIZE] = { 0 };
+  packet[0] = 0x23; // no leap warning, version 4, client mode
+  requestSent = clockStatus.offset + ticks; // also while not set: only matched
+  millisToNtp(&packet[40], requestSent);
+  requestMillis = ticks;
+  awaitingReply = ntpSocket.beginPacket(NTP_SERVER, NTP_PORT) &&
+    ntpSocket.write(packet, sizeof(packet)) == sizeof(packet) && ntpSocket.endPacket();
+  if (!awaitingReply) {
+    clockStatus.failures++;
+    nextSyncDelay = CLOCK_RETRY_INTERVAL;
+  }
+} // end sendClockRequest()
+
+/**
+ * adjust the clock from an NTP reply
+ *
+ * @param[in] packet the reply
+ * @param[in] ticks millis() when the reply was read
+ * @return true when the reply answered the outstanding request
+ */
+bool acceptClockReply(const uint8_t * packet, const unsigned long ticks)
+{
+  uint8_t originate[8];
+  millisToNtp(originate, requestSent);
+  if ((packet[0] & 0x07) != 4 || packet[1] == 0 || (packet[0] & 0xC0) == 0xC0 ||
+      memcmp(&packet[24], originate, sizeof(originate)) != 0) {
+    return false; // not a server reply, kiss of death, unsynchronized, or stale
+  }
+  int64_t sent = requestSent;
+  int64_t received = clockStatus.offset + ticks;
+  int64_t serverReceived = ntpToMillis(&packet[32]);
+  int64_t serverSent = ntpToMillis(&packet[40]);
+  int64_t error = ((serverReceived - sent) + (serverSent - received)) / 2;
+  clockStatus.roundTrip = (received - sent) - (serverSent - serverReceived);
+  clockStatus.lastError = error;
+  if (!clockSet || error > (int64_t)CLOCK_STEP_LIMIT || error < -(int64_t)CLOCK_STEP_LIMIT) {
+    clockStatus.offset += error;
+    clockStatus.pendingSlew = 0;
+    clockSet = true;
+    uint64_t wall = clockStatus.offset + millis();
+    struct timeval now = { (time_t)(wall / 1000), (suseconds_t)(wall % 1000) * 1000 };
+    settimeofday(&now, NULL); // keep system time close, for other users
+    Serial.printf("LOG: clock stepped by %ld milliseconds\n", (long)error);
+  } else {
+    clockStatus.pendingSlew = error; // replaces what was left from the last sync
+  }
+  clockStatus.lastSync = ticks;
+  clockStatus.syncs++;
+  rebaseClock(ticks);
+  return true;
+} // end acceptClockReply()
+
+/**
+ * move part of the pending correction into the clock offset
+ *
+ * At most 1 millisecond per CLOCK_SLEW_DIVISOR milliseconds elapsed, so the
+ * wall clock keeps moving forward while the correction is applied.
+ *
+ * @param[in] ticks current millis()
+ */
+void slewClock(const unsigned long ticks)
+{
+  if (clockStatus.pendingSlew == 0) {
+    lastSlew = ticks;
+    return;
+  }
+  unsigned long allowed = (ticks - lastSlew) / CLOCK_SLEW_DIVISOR;
+  if (allowed == 0) {
+    return;
+  }
+  lastSlew += allowed * CLOCK_SLEW_DIVISOR;
+  int32_t step = min((unsigned long)abs(clockStatus.pendingSlew), allowed);
+  step = clockStatus.pendingSlew < 0 ? -step : step;
+  clockStatus.offset += step;
+  clockStatus.pendingSlew -= step;
+} // end slewClock()
+
+/**
+ * run the clock synchronization, once per pass
+ *
+ * Sends requests when a sync is due and the wifi link is up, handles replies
+ * and timeouts, and slews the clock. Does not block. Also the only place that
+ * folds a millis() wrap into the offset, so passes must come at least once per
+ * wrap (49 days).
+ */
+void disciplineClock()
+{
+  unsigned long ticks = millis();
+  if (ticks < lastMillis) {
+    clockStatus.offset += 0x100000000ULL; // millis() wrapped
+  }
+  lastMillis = ticks;
+  slewClock(ticks);
+  rebaseClock(ticks);
+  if (!wifiConfigured()) {
+    return;
+  }
+  if (awaitingReply) {
+    uint8_t packet[NTP_PACKET_SIZE];
+    while (ntpSocket.parsePacket() > 0) {
+      if (ntpSocket.read(packet, sizeof(packet)) == (int)sizeof(packet) &&
+          acceptClockReply(packet, ticks)) {
+        awaitingReply = false;
+        nextSyncDelay = CLOCK_SYNC_INTERVAL;
+        return;
+      }
+    }
+    if (ticks - requestMillis >= CLOCK_REPLY_TIMEOUT) {
+      awaitingReply = false;
+      clockStatus.failures++;
+      nextSyncDelay = CLOCK_RETRY_INTERVAL;
+    }
+    return;
+  }
+  if (ticks - requestMillis >= nextSyncDelay && wifiConnected()) {
+    sendClockRequest(ticks);
+  }
+} // end disciplineClock()
+
+/**
+ * get the time until the clock synchronization needs the processor again
+ *
+ * While a reply is outstanding, the socket has to be read on the next pass.
+ *
+ * @param[in] ticks current millis()
+ * @return milliseconds; 0 while waiting for a reply or when a request is due
+ */
+unsigned long nextClockSync(const unsigned long ticks)
+{
+  if (!wifiConfigured()) {
+    return ULONG_MAX;
+  }
+  if (awaitingReply) {
+    return 0;
+  }
+  unsigned long elapsed = ticks - requestMillis;
+  return elapsed >= nextSyncDelay ? 0 : nextSyncDelay - elapsed;
+} // end nextClockSync()
+
+/**
+ * check if an NTP reply is outstanding
+ *
+ * @return true until the reply arrives, or times out
+ */
+bool clockAwaitingReply()
+{
+  return awaitingReply;
+} // end clockAwaitingReply()
+
+/**
+ * print the clock discipline state
+ */
+void printClockStatus()
+{
+  time_t now = wallClockMillis() / 1000;
+  char local[32];
+  strftime(local, sizeof(local), "%Y-%m-%d %H:%M:%S %Z", localtime(&now));
+  Serial.printf("clock %s: %s, %lu syncs, %lu failures\n", clockSet ? "set" : "not set",
+    local, clockStatus.syncs, clockStatus.failures);
+  Serial.printf("  last error %ld ms, round trip %lu ms, %ld ms left to slew, "
+    "synced %lu ms ago\n", (long)clockStatus.lastError,
+    (unsigned long)clockStatus.roundTrip, (long)clockStatus.pendingSlew,
+    clockStatus.syncs == 0 ? 0 : millis() - clockStatus.lastSync);
+} // end printClockStatus()
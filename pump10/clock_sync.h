@@ -0,0 +1,75 @@
+#ifndef clock_sync_h
+#define clock_sync_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <limits.h>
+#include <sys/time.h>
+#include "smart_time.h"
+#include "wifi_link.h"
+
+/**
+ * data structures and methods to keep a wall clock disciplined by NTP
+ *
+ * The wall clock is `millis()` plus an offset. Each disciplineClock() pass folds
+ * millis() wraps into the offset, and publishes a base (the millis() value at
+ * the start of the current wall clock second) for readers. Reading the clock
+ * from any task is then millis() plus an add, without a lock or a 64 bit
+ * divide. The offset is set from (simple) NTP exchanges with NTP_SERVER, over UDP, every
+ * CLOCK_SYNC_INTERVAL while the wifi link is up. Errors up to CLOCK_STEP_LIMIT
+ * are slewed out gradually, so the clock never jumps or runs backwards, and
+ * time intervals stay close to true. Larger errors, and the first sync after
+ * a cold start, step the clock.
+ *
+ * The board stays awake while a reply is outstanding, and naps no longer
+ * than until the next request is due.
+ *
+ * NTP_SERVER can point to a local server, to test against a controlled time
+ * source.
+ */
+
+const uint16_t NTP_PORT = 123;
+const size_t NTP_PACKET_SIZE = 48;
+const uint32_t NTP_UNIX_OFFSET = 2208988800UL; // seconds from 1900 to 1970
+
+/// wall clock at a millis() value, for readers between disciplineClock() passes
+struct clock_base_t {
+  /// millis() at the start of the wall clock second `epoch`
+  unsigned long ticks;
+  /// epoch seconds at `ticks`; 0 while the clock is not set
+  unsigned long epoch;
+  /// wall clock milliseconds at `ticks`
+  uint64_t wall;
+};
+
+/// clock discipline state, as shown by the console `clock` command
+struct clock_status_t {
+  /// wall clock milliseconds minus millis(); 0 until the clock is set
+  uint64_t offset;
+  /// milliseconds still to be slewed into the offset
+  int32_t pendingSlew;
+  /// millis() of the latest successful sync
+  unsigned long lastSync;
+  /// error measured at the latest successful sync (milliseconds)
+  int32_t lastError;
+  /// round trip time of the latest successful sync (milliseconds)
+  uint32_t roundTrip;
+  unsigned long syncs;
+  unsigned long failures;
+};
+
+extern const unsigned long CLOCK_SYNC_INTERVAL;
+extern const unsigned long CLOCK_RETRY_INTERVAL;
+extern const unsigned long CLOCK_REPLY_TIMEOUT;
+extern const unsigned long CLOCK_STEP_LIMIT;
+extern const unsigned long CLOCK_SLEW_DIVISOR;
+
+void beginClock(void);
+unsigned long clockEpoch(unsigned long *);
+uint64_t wallClockMillis(void);
+void disciplineClock(void);
+unsigned long nextClockSync(const unsigned long);
+bool clockAwaitingReply(void);
+void printClockStatus(void);
+
+#endif
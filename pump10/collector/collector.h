@@ -0,0 +1,143 @@
+#ifndef collector_h
+#define collector_h
+
+#include <cstdint>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * data structures and methods for the host side fleet telemetry collector
+ *
+ * The collector ingests the telemetry batches that pump10 controllers publish
+ * to `irrigation/«controller»/telemetry` (see mqtt_telemetry.h for the line
+ * formats) into a columnar store on disk:
+ *   «store»/«controller»/zone«NN»/«YYYY-MM»/«table».«column»
+ *   «store»/«controller»/batch/«YYYY-MM»/batch.«column»
+ * Tables: `batch` (time, format, dropped), `rollup` (time, readings, minimum,
+ * average, maximum, below), `counter` (time, deliveries, delivered) and
+ * `event` (time, sequence, state, moisture).
+ *
+ * Each column is a file of fixed width values in host byte order, one per
+ * row, so a query reads only the columns it needs, and scans them as plain
+ * arrays. Partitions outside the queried months are skipped by their
+ * directory name.
+ * Rows are appended, so all the columns of a table partition grow together. A
+ * write cut short leaves some columns longer; readers use the shortest.
+ */
+
+const uint32_t COLLECTOR_TELEMETRY_FORMAT = 2; // newest batch format understood
+const size_t COLLECTOR_FLUSH_BYTES = 16 << 20; // buffered before writing to disk
+const unsigned long COLLECTOR_FLUSH_SECONDS = 60; // longest a live row stays buffered
+const uint32_t SECONDS_PER_DAY = 86400;
+// earlier times are from a controller clock that was not set (2024-01-01)
+const uint32_t CLOCK_SET_EPOCH = 1704067200;
+
+/// one `r` line: moisture readings of a zone during a publish window
+struct rollup_row_t {
+  uint32_t time; // window end, epoch seconds
+  uint16_t zone;
+  uint32_t readings;
+  float minimum;
+  float average;
+  float maximum;
+  uint32_t belowMillis;
+};
+
+/// one `e` line: a zone state change
+struct event_row_t {
+  uint32_t time;
+  uint16_t zone;
+  uint32_t sequence;
+  uint8_t state;
+  float moisture;
+};
+
+/// one `c` line: cumulative delivery counters of a zone
+struct counter_row_t {
+  uint32_t time; // window end
+  uint16_t zone;
+  uint32_t deliveries;
+  uint32_t deliveredMillis;
+};
+
+/// everything in one published batch
+struct telemetry_batch_t {
+  std::string controller;
+  uint32_t time; // window end, from the `t` line
+  uint32_t format;
+  uint32_t dropped; // batches the controller dropped before this one
+  std::vector<rollup_row_t> rollups;
+  std::vector<event_row_t> events;
+  std::vector<counter_row_t> counters;
+};
+
+/// new rows of one table partition, waiting to be appended
+struct table_buffer_t {
+  std::string directory;
+  std::string table;
+  const char * const * columns; // column names, in the order of values
+  std::vector<std::vector<uint8_t>> values; // per column
+};
+
+/// buffered rows for a store, written out by flushStore()
+struct column_store_t {
+  std::string root;
+  std::unordered_map<std::string, table_buffer_t> pending; // by directory and table
+  std::set<std::string> directories; // already created
+  size_t pendingBytes;
+  unsigned long rows;
+};
+
+/// result of the below threshold query for one zone
+struct below_result_t {
+  std::string controller;
+  uint16_t zone;
+  unsigned long windows;
+  uint64_t belowMillis;
+};
+
+// telemetry_batch.cpp
+bool controllerFromTopic(const std::string &, std::string *);
+bool parseBatch(const std::string &, const char *, size_t, telemetry_batch_t *);
+
+// column_store.cpp
+void openStore(column_store_t *, const std::string &);
+void storeBatch(column_store_t *, const telemetry_batch_t &);
+bool flushStore(column_store_t *);
+std::string monthPartition(const uint32_t);
+
+// query.cpp
+bool parseDate(const char *, uint32_t *);
+std::vector<below_result_t> queryBelowThreshold(const std::string &, const uint32_t,
+  const uint32_t);
+
+// fleet_bench.cpp
+int runFleetBenchmark(const std::string &, const size_t, const size_t, const size_t);
+
+/**
+ * read a whole column file
+ *
+ * @param[in] path column file
+ * @param[out] values one per row
+ * @return false when the file can not be read
+ */
+template <typename T> bool readColumn(const std::string & path, std::vector<T> * values)
+{
+  FILE * file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long bytes = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  values->resize(bytes / sizeof(T));
+  size_t read = fread(values->data(), sizeof(T), values->size(), file);
+  fclose(file);
+  values->resize(read);
+  return true;
+} // end readColumn()
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * methods to append telemetry rows to the columnar store on disk
+ */
+#include "collector.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+// column names for each table, in the order rows give their values
+const char * const BATCH_COLUMNS[] = { "time", "format", "dropped" };
+const char * const ROLLUP_COLUMNS[] = {
+  "time", "readings", "minimum", "average", "maximum", "below"
+};
+const char * const COUNTER_COLUMNS[] = { "time", "deliveries", "delivered" };
+const char * const EVENT_COLUMNS[] = { "time", "sequence", "state", "moisture" };
+
+/**
+ * get the partition directory name for a time
+ *
+ * @param[in] time epoch seconds
+ * @return `YYYY-MM`, in UTC
+ */
+std::string monthPartition(const uint32_t time)
+{
+  time_t seconds = time;
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+  char name[24];
+  snprintf(name, sizeof(name), "%04d-%02d", utc.tm_year + 1900, utc.tm_mon + 1);
+  return name;
+} // end monthPartition()
+
+/**
+ * get the buffer for new rows of a table partition
+ *
+ * @param[in,out] store the store
+ * @param[in] directory partition directory, under the store root
+ * @param[in] table table name
+ * @param[in] columns column names of the table
+ * @param[in] count number of columns
+ * @return the buffer
+ */
+table_buffer_t * tableBuffer(column_store_t * store, const std::string & directory,
+  const char * table, const char * const * columns, const size_t count)
+{
+  std::string key = directory + "/" + table;
+  auto found = store->pending.find(key);
+  if (found != store->pending.end()) {
+    return &found->second;
+  }
+  table_buffer_t & buffer = store->pending[key];
+  buffer.directory = store->root + "/" + directory;
+  buffer.table = table;
+  buffer.columns = columns;
+  buffer.values.resize(count);
+  return &buffer;
+} // end tableBuffer()
+
+/**
+ * get the partition directory for a zone
+ *
+ * @param[in] controller controller id
+ * @param[in] zone zone number, from 1
+ * @param[in] time row time, epoch seconds
+ * @return directory, under the store root
+ */
+std::string zonePartition(const std::string & controller, const uint16_t zone,
+  const uint32_t time)
+{
+  char name[16];
+  snprintf(name, sizeof(name), "zone%02u", (unsigned int)zone);
+  return controller + "/" + name + "/" + monthPartition(time);
+} // end zonePartition()
+
+/**
+ * buffer a value for a column
+ *
+ * @param[in,out] store the store
+ * @param[in,out] buffer table partition of the row
+ * @param[in] column index in the table's columns
+ * @param[in] value the value for the new row
+ */
+template <typename T> void appendValue(column_store_t * store, table_buffer_t * buffer,
+  const size_t column, const T value)
+{
+  std::vector<uint8_t> & values = buffer->values[column];
+  const uint8_t * bytes = (const uint8_t *)&value;
+  values.insert(values.end(), bytes, bytes + sizeof(T));
+  store->pendingBytes += sizeof(T);
+} // end appendValue()
+
+/**
+ * start using a store, creating its root directory when needed
+ *
+ * @param[out] store the store
+ * @param[in] root directory for the store
+ */
+void openStore(column_store_t * store, const std::string & root)
+{
+  store->root = root;
+  store->pending.clear();
+  store->directories.clear();
+  store->pendingBytes = 0;
+  store->rows = 0;
+  std::error_code error;
+  std::filesystem::create_directories(root, error);
+} // end openStore()
+
+/**
+ * add the rows of a batch to the store
+ *
+ * Rows are buffered, and written out once COLLECTOR_FLUSH_BYTES are waiting.
+ * Zone rows are partitioned by the month of their window end, events by the
+ * month they happened in.
+ *
+ * @param[in,out] store the store
+ * @param[in] batch parsed telemetry batch
+ */
+void storeBatch(column_store_t * store, const telemetry_batch_t & batch)
+{
+  table_buffer_t * table = tableBuffer(store,
+    batch.controller + "/batch/" + monthPartition(batch.time), "batch", BATCH_COLUMNS, 3);
+  appendValue(store, table, 0, batch.time);
+  appendValue(store, table, 1, batch.format);
+  appendValue(store, table, 2, batch.dropped);
+  store->rows++;
+  for (const rollup_row_t & row : batch.rollups) {
+    table = tableBuffer(store, zonePartition(batch.controller, row.zone, row.time),
+      "rollup", ROLLUP_COLUMNS, 6);
+    appendValue(store, table, 0, row.time);
+    appendValue(store, table, 1, row.readings);
+    appendValue(store, table, 2, row.minimum);
+    appendValue(store, table, 3, row.average);
+    appendValue(store, table, 4, row.maximum);
+    appendValue(store, table, 5, row.belowMillis);
+    store->rows++;
+  }
+  for (const counter_row_t & row : batch.counters) {
+    table = tableBuffer(store, zonePartition(batch.controller, row.zone, row.time),
+      "counter", COUNTER_COLUMNS, 3);
+    appendValue(store, table, 0, row.time);
+    appendValue(store, table, 1, row.deliveries);
+    appendValue(store, table, 2, row.deliveredMillis);
+    store->rows++;
+  }
+  for (const event_row_t & row : batch.events) {
+    // the batch time, when the controller clock was not set for the event
+    uint32_t time = row.time < CLOCK_SET_EPOCH ? batch.time : row.time;
+    table = tableBuffer(store, zonePartition(batch.controller, row.zone, time),
+      "event", EVENT_COLUMNS, 4);
+    appendValue(store, table, 0, row.time);
+    appendValue(store, table, 1, row.sequence);
+    appendValue(store, table, 2, row.state);
+    appendValue(store, table, 3, row.moisture);
+    store->rows++;
+  }
+  if (store->pendingBytes >= COLLECTOR_FLUSH_BYTES) {
+    flushStore(store);
+  }
+} // end storeBatch()
+
+/**
+ * append all buffered rows to their column files
+ *
+ * @param[in,out] store the store
+ * @return false when a column could not be written
+ */
+bool flushStore(column_store_t * store)
+{
+  bool written = true;
+  for (auto & pending : store->pending) {
+    table_buffer_t & buffer = pending.second;
+    if (store->directories.count(buffer.directory) == 0) {
+      std::error_code error;
+      std::filesystem::create_directories(buffer.directory, error);
+      store->directories.insert(buffer.directory);
+    }
+    for (size_t i = 0; i < buffer.values.size(); i++) {
+      std::string path = buffer.directory + "/" + buffer.table + "." + buffer.columns[i];
+      FILE * file = fopen(path.c_str(), "ab");
+      if (file == NULL || fwrite(buffer.values[i].data(), 1, buffer.values[i].size(),
+          file) != buffer.values[i].size()) {
+        fprintf(stderr, "can not write %s: %s\n", path.c_str(), strerror(errno));
+        written = false;
+      }
+      if (file != NULL) {
+        fclose(file);
+      }
+    }
+  }
+  store->pending.clear();
+  store->pendingBytes = 0;
+  return written;
+} // end flushStore()
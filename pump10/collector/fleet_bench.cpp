@@ -0,0 +1,189 @@
+/**
+ * ingest throughput benchmark, with a synthetic fleet of simulated controllers
+ */
+#include "collector.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <filesystem>
+#include <random>
+
+// the start of the simulated telemetry (2026-01-01), and its publish window
+const uint32_t FLEET_START = 1767225600;
+const uint32_t FLEET_WINDOW_SECONDS = 60; // MQTT_PUBLISH_INTERVAL
+const unsigned int FLEET_READINGS = 8; // per zone and window
+const float FLEET_TRIGGER = 40.0; // watering trigger level, in percent
+const float FLEET_WATERING_RISE = 25.0; // moisture gained by a delivery
+// irrigation_state_t values in the events
+const unsigned int MOISTURE_GOOD = 1;
+const unsigned int RESERVE_RESOURCES = 2;
+const unsigned int DELIVERING_WATER = 4;
+const unsigned int SOAKING_IN = 5;
+
+/// simulated state of one zone of a controller
+struct fleet_zone_t {
+  float moisture;
+  float dryingRate; // percent per window
+  bool soaking;
+  unsigned long deliveries;
+  unsigned long deliveredMillis;
+};
+
+/// a simulated controller, and the next batch it publishes
+struct fleet_controller_t {
+  std::string topic;
+  std::vector<fleet_zone_t> zones;
+  unsigned long nextEvent;
+  std::mt19937 random;
+};
+
+/**
+ * add a line to a batch, in the controller's format
+ *
+ * @param[in,out] batch batch text
+ * @param[in] format printf style format for the line
+ */
+void appendLine(std::string * batch, const char * format, ...)
+{
+  char line[128];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  batch->append(line, std::min((size_t)length, sizeof(line) - 1));
+} // end appendLine()
+
+/**
+ * build the next telemetry batch of a simulated controller
+ *
+ * Zones dry at their own rate, and are watered once their readings fall below
+ * the trigger level: resources, delivery and soaking in are events in that
+ * window, and the zone is back to good in the next one.
+ *
+ * @param[in,out] controller the simulated controller
+ * @param[in] time window end, epoch seconds
+ * @return batch text, as published
+ */
+std::string nextFleetBatch(fleet_controller_t * controller, const uint32_t time)
+{
+  std::string batch;
+  std::uniform_real_distribution<float> noise(-0.5, 0.5);
+  appendLine(&batch, "t,%lu,%lu,%u\n", (unsigned long)time, 0ul,
+    COLLECTOR_TELEMETRY_FORMAT);
+  std::string events;
+  for (size_t i = 0; i < controller->zones.size(); i++) {
+    fleet_zone_t * zone = &controller->zones[i];
+    unsigned int number = i + 1;
+    float start = zone->moisture;
+    zone->moisture -= zone->dryingRate;
+    float minimum = std::min(start, zone->moisture) + noise(controller->random);
+    float maximum = std::max(start, zone->moisture) + noise(controller->random);
+    unsigned long below = 0;
+    if (zone->moisture < FLEET_TRIGGER) {
+      below = start < FLEET_TRIGGER ? FLEET_WINDOW_SECONDS * 1000 :
+        (unsigned long)(FLEET_WINDOW_SECONDS * 1000 * (FLEET_TRIGGER - zone->moisture) /
+          zone->dryingRate);
+    }
+    appendLine(&batch, "r,%u,%u,%.1f,%.1f,%.1f,%lu\n", number, FLEET_READINGS, minimum,
+      (start + zone->moisture) / 2, maximum, below);
+    if (zone->soaking) {
+      appendLine(&events, "e,%lu,%lu,%lu,%u,%u,%.1f\n", controller->nextEvent++,
+        (unsigned long)time, 0ul, number, MOISTURE_GOOD, zone->moisture);
+      zone->soaking = false;
+    } else if (zone->moisture < FLEET_TRIGGER) {
+      const unsigned int states[] = { RESERVE_RESOURCES, DELIVERING_WATER, SOAKING_IN };
+      for (unsigned int state : states) {
+        appendLine(&events, "e,%lu,%lu,%lu,%u,%u,%.1f\n", controller->nextEvent++,
+          (unsigned long)time, 0ul, number, state, zone->moisture);
+      }
+      zone->moisture += FLEET_WATERING_RISE;
+      zone->soaking = true;
+      zone->deliveries++;
+      zone->deliveredMillis += 5000;
+    }
+    appendLine(&batch, "c,%u,%lu,%lu\n", number, zone->deliveries, zone->deliveredMillis);
+  }
+  return batch + events;
+} // end nextFleetBatch()
+
+/**
+ * get the seconds since a start time
+ *
+ * @param[in] started start time
+ * @return seconds
+ */
+double secondsSince(const std::chrono::steady_clock::time_point started)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+} // end secondsSince()
+
+/**
+ * time the ingest of telemetry from a synthetic fleet, and one query over it
+ *
+ * The batches are built before the timing starts. Ingest includes parsing,
+ * partitioning, and writing every column to disk.
+ *
+ * @param[in] root directory for the store; must not exist yet
+ * @param[in] controllers number of simulated controllers
+ * @param[in] zones zones per controller
+ * @param[in] windows publish windows per controller
+ * @return process exit status
+ */
+int runFleetBenchmark(const std::string & root, const size_t controllers,
+  const size_t zones, const size_t windows)
+{
+  if (std::filesystem::exists(root)) {
+    fprintf(stderr, "%s exists: the benchmark needs a new store\n", root.c_str());
+    return 1;
+  }
+  std::vector<fleet_controller_t> fleet(controllers);
+  for (size_t i = 0; i < controllers; i++) {
+    fleet[i].topic = "irrigation/pump10-" + std::to_string(i) + "/telemetry";
+    fleet[i].nextEvent = 0;
+    fleet[i].random.seed(i);
+    std::uniform_real_distribution<float> rate(0.05, 0.5);
+    for (size_t z = 0; z < zones; z++) {
+      fleet[i].zones.push_back({ 60, rate(fleet[i].random), false, 0, 0 });
+    }
+  }
+  // in arrival order: every controller publishes once per window
+  std::vector<std::pair<const std::string *, std::string>> batches;
+  size_t bytes = 0;
+  for (size_t w = 0; w < windows; w++) {
+    for (fleet_controller_t & controller : fleet) {
+      batches.emplace_back(&controller.topic,
+        nextFleetBatch(&controller, FLEET_START + (w + 1) * FLEET_WINDOW_SECONDS));
+      bytes += batches.back().second.size();
+    }
+  }
+
+  column_store_t store;
+  telemetry_batch_t batch;
+  std::string controller;
+  auto started = std::chrono::steady_clock::now();
+  openStore(&store, root);
+  for (const auto & published : batches) {
+    if (controllerFromTopic(*published.first, &controller) &&
+        parseBatch(controller, published.second.data(), published.second.size(), &batch)) {
+      storeBatch(&store, batch);
+    }
+  }
+  bool written = flushStore(&store);
+  double seconds = secondsSince(started);
+  printf("ingest: %zu controllers, %zu batches, %lu rows, %.1f MB in %.2f s: "
+    "%.0f batches/s, %.0f rows/s, %.1f MB/s\n", controllers, batches.size(), store.rows,
+    bytes / 1e6, seconds, batches.size() / seconds, store.rows / seconds,
+    bytes / 1e6 / seconds);
+
+  started = std::chrono::steady_clock::now();
+  uint32_t end = FLEET_START + (windows + 1) * FLEET_WINDOW_SECONDS;
+  std::vector<below_result_t> results = queryBelowThreshold(root, FLEET_START, end);
+  seconds = secondsSince(started);
+  unsigned long windowsScanned = 0;
+  for (const below_result_t & result : results) {
+    windowsScanned += result.windows;
+  }
+  printf("query: time below threshold for %zu zones, %lu rollups in %.3f s\n",
+    results.size(), windowsScanned, seconds);
+  return written && results.size() == controllers * zones ? 0 : 1;
+} // end runFleetBenchmark()
@@ -0,0 +1,130 @@
+/**
+ * fleet telemetry collector for pump10 controllers
+ *
+ * Usage:
+ *   mosquitto_sub -v -t 'irrigation/+/telemetry' | pump10_collector ingest «store»
+ *   pump10_collector below «store» «from YYYY-MM-DD» «to YYYY-MM-DD»
+ *   pump10_collector bench «new store» [controllers] [zones] [windows]
+ *
+ * `ingest` reads batches as `mosquitto_sub -v` prints them: the topic and the
+ * first line of the batch, separated by a space, then the rest of its lines.
+ * `below` prints the time each zone was below its watering trigger level from
+ * the start of the first day to the start of the second, as CSV.
+ */
+#include "collector.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+const size_t FLEET_CONTROLLERS = 1000;
+const size_t FLEET_ZONES = 4;
+const size_t FLEET_WINDOWS = 60; // one hour of publish windows
+
+/**
+ * parse and store one batch read from the input
+ *
+ * @param[in,out] store the store
+ * @param[in] topic topic the batch was published to
+ * @param[in] payload batch text
+ * @return false when the batch was not a telemetry batch
+ */
+bool ingestBatch(column_store_t * store, const std::string & topic,
+  const std::string & payload)
+{
+  static telemetry_batch_t batch;
+  std::string controller;
+  if (!controllerFromTopic(topic, &controller) ||
+      !parseBatch(controller, payload.data(), payload.size(), &batch)) {
+    return false;
+  }
+  if (batch.format > COLLECTOR_TELEMETRY_FORMAT) {
+    fprintf(stderr, "%s: batch format %u is newer than this collector\n",
+      controller.c_str(), (unsigned int)batch.format);
+  }
+  storeBatch(store, batch);
+  return true;
+} // end ingestBatch()
+
+/**
+ * store batches read from standard input, until it ends
+ *
+ * @param[in] root store directory
+ * @return process exit status
+ */
+int ingest(const std::string & root)
+{
+  column_store_t store;
+  openStore(&store, root);
+  std::string topic;
+  std::string payload;
+  unsigned long skipped = 0;
+  time_t flushed = time(NULL);
+  char line[1024];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    const char * space = strchr(line, ' ');
+    if (strncmp(line, "irrigation/", 11) == 0 && space != NULL) {
+      // the next batch starts: the previous one is complete
+      if (!topic.empty() && !ingestBatch(&store, topic, payload)) {
+        skipped++;
+      }
+      topic.assign(line, space - line);
+      payload.assign(space + 1);
+      if (time(NULL) - flushed >= (time_t)COLLECTOR_FLUSH_SECONDS) {
+        flushStore(&store);
+        flushed = time(NULL);
+      }
+    } else {
+      payload.append(line);
+    }
+  }
+  if (!topic.empty() && !ingestBatch(&store, topic, payload)) {
+    skipped++;
+  }
+  bool written = flushStore(&store);
+  fprintf(stderr, "%lu rows stored, %lu batches skipped\n", store.rows, skipped);
+  return written ? 0 : 1;
+} // end ingest()
+
+/**
+ * print the time each zone was below its trigger level, per day of the range
+ *
+ * @param[in] root store directory
+ * @param[in] fromText first day included, `YYYY-MM-DD`
+ * @param[in] toText first day not included
+ * @return process exit status
+ */
+int below(const std::string & root, const char * fromText, const char * toText)
+{
+  uint32_t from;
+  uint32_t to;
+  if (!parseDate(fromText, &from) || !parseDate(toText, &to) || to <= from) {
+    fprintf(stderr, "dates must be YYYY-MM-DD, from before to\n");
+    return 2;
+  }
+  double days = (double)(to - from) / SECONDS_PER_DAY;
+  printf("controller,zone,rollups,below_minutes_per_day\n");
+  for (const below_result_t & result : queryBelowThreshold(root, from, to)) {
+    printf("%s,%u,%lu,%.1f\n", result.controller.c_str(), (unsigned int)result.zone,
+      result.windows, result.belowMillis / 60000.0 / days);
+  }
+  return 0;
+} // end below()
+
+int main(int argc, char ** argv)
+{
+  if (argc == 3 && strcmp(argv[1], "ingest") == 0) {
+    return ingest(argv[2]);
+  }
+  if (argc == 5 && strcmp(argv[1], "below") == 0) {
+    return below(argv[2], argv[3], argv[4]);
+  }
+  if (argc >= 3 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+    return runFleetBenchmark(argv[2],
+      argc > 3 ? strtoul(argv[3], NULL, 10) : FLEET_CONTROLLERS,
+      argc > 4 ? strtoul(argv[4], NULL, 10) : FLEET_ZONES,
+      argc > 5 ? strtoul(argv[5], NULL, 10) : FLEET_WINDOWS);
+  }
+  fprintf(stderr, "usage: %s ingest «store» | below «store» «from» «to» | "
+    "bench «new store» [controllers] [zones] [windows]\n", argv[0]);
+  return 2;
+} // end main()
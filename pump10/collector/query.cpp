@@ -0,0 +1,117 @@
+/**
+ * methods to answer queries from the columnar store
+ */
+#include "collector.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+
+/**
+ * convert a UTC date to epoch seconds
+ *
+ * @param[in] text `YYYY-MM-DD`
+ * @param[out] time epoch seconds at the start of the day
+ * @return false when the date is not valid
+ */
+bool parseDate(const char * text, uint32_t * time)
+{
+  int year, month, day;
+  if (sscanf(text, "%4d-%2d-%2d", &year, &month, &day) != 3 || year < 1970 ||
+      month < 1 || month > 12 || day < 1 || day > 31) {
+    return false;
+  }
+  // days from civil, with March as the first month of the year
+  year -= month <= 2;
+  int era = year / 400;
+  int yearOfEra = year - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  long days = (long)era * 146097 + dayOfEra - 719468;
+  *time = (uint32_t)(days * SECONDS_PER_DAY);
+  return true;
+} // end parseDate()
+
+/**
+ * sum the time below the trigger level in one rollup partition
+ *
+ * A branch free scan over the time and below columns, that the compiler
+ * vectorizes.
+ *
+ * @param[in] directory partition directory
+ * @param[in] from first time included, epoch seconds
+ * @param[in] to first time not included
+ * @param[in,out] result windows and milliseconds to add to
+ */
+void scanRollups(const std::string & directory, const uint32_t from, const uint32_t to,
+  below_result_t * result)
+{
+  std::vector<uint32_t> times;
+  std::vector<uint32_t> below;
+  if (!readColumn(directory + "/rollup.time", &times) ||
+      !readColumn(directory + "/rollup.below", &below)) {
+    return;
+  }
+  size_t rows = std::min(times.size(), below.size());
+  const uint32_t * time = times.data();
+  const uint32_t * millis = below.data();
+  uint64_t total = 0;
+  uint32_t windows = 0;
+  for (size_t i = 0; i < rows; i++) {
+    uint32_t included = (time[i] >= from) & (time[i] < to);
+    total += (uint64_t)(millis[i] & -included);
+    windows += included;
+  }
+  result->windows += windows;
+  result->belowMillis += total;
+} // end scanRollups()
+
+/**
+ * get the time each zone spent below its watering trigger level
+ *
+ * Only the month partitions that overlap the time range are read.
+ *
+ * @param[in] root store directory
+ * @param[in] from first time included, epoch seconds
+ * @param[in] to first time not included
+ * @return one result per zone with rollups in the range, sorted by controller
+ *   and zone
+ */
+std::vector<below_result_t> queryBelowThreshold(const std::string & root,
+  const uint32_t from, const uint32_t to)
+{
+  namespace fs = std::filesystem;
+  std::vector<below_result_t> results;
+  if (to <= from) {
+    return results;
+  }
+  std::string firstMonth = monthPartition(from);
+  std::string lastMonth = monthPartition(to - 1);
+  std::error_code error;
+  for (const fs::directory_entry & controller : fs::directory_iterator(root, error)) {
+    if (!controller.is_directory()) {
+      continue;
+    }
+    for (const fs::directory_entry & zone : fs::directory_iterator(controller.path(), error)) {
+      std::string zoneName = zone.path().filename().string();
+      if (!zone.is_directory() || zoneName.compare(0, 4, "zone") != 0) {
+        continue;
+      }
+      below_result_t result = { controller.path().filename().string(),
+        (uint16_t)atoi(zoneName.c_str() + 4), 0, 0 };
+      for (const fs::directory_entry & month : fs::directory_iterator(zone.path(), error)) {
+        std::string monthName = month.path().filename().string();
+        if (monthName >= firstMonth && monthName <= lastMonth) {
+          scanRollups(month.path().string(), from, to, &result);
+        }
+      }
+      if (result.windows > 0) {
+        results.push_back(result);
+      }
+    }
+  }
+  std::sort(results.begin(), results.end(),
+    [](const below_result_t & a, const below_result_t & b) {
+      return a.controller != b.controller ? a.controller < b.controller : a.zone < b.zone;
+    });
+  return results;
+} // end queryBelowThreshold()
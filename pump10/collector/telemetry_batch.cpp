@@ -0,0 +1,123 @@
+/**
+ * methods to parse the telemetry batches published by pump10 controllers
+ */
+#include "collector.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+const char * TOPIC_PREFIX = "irrigation/";
+const char * TOPIC_SUFFIX = "/telemetry";
+const size_t MAX_LINE_FIELDS = 8;
+
+/**
+ * get the controller id from a telemetry topic
+ *
+ * The id becomes a directory name in the store, so anything other than
+ * letters, digits, '-' and '_' is replaced.
+ *
+ * @param[in] topic `irrigation/«controller»/telemetry`
+ * @param[out] controller the controller id
+ * @return false when the topic is not a telemetry topic
+ */
+bool controllerFromTopic(const std::string & topic, std::string * controller)
+{
+  size_t prefix = strlen(TOPIC_PREFIX);
+  size_t suffix = strlen(TOPIC_SUFFIX);
+  if (topic.size() <= prefix + suffix || topic.compare(0, prefix, TOPIC_PREFIX) != 0 ||
+      topic.compare(topic.size() - suffix, suffix, TOPIC_SUFFIX) != 0) {
+    return false;
+  }
+  *controller = topic.substr(prefix, topic.size() - prefix - suffix);
+  for (char & c : *controller) {
+    if (!isalnum((unsigned char)c) && c != '-' && c != '_') {
+      c = '_';
+    }
+  }
+  return true;
+} // end controllerFromTopic()
+
+/**
+ * split a batch line into comma separated numeric fields
+ *
+ * @param[in] line start of the fields, after the line type and its comma
+ * @param[in] end end of the line
+ * @param[out] fields values, as text pointers into the line
+ * @return number of fields
+ */
+size_t splitFields(const char * line, const char * end, const char ** fields)
+{
+  size_t count = 0;
+  const char * field = line;
+  while (field < end && count < MAX_LINE_FIELDS) {
+    fields[count++] = field;
+    const char * comma = (const char *)memchr(field, ',', end - field);
+    if (comma == NULL) {
+      break;
+    }
+    field = comma + 1;
+  }
+  return count;
+} // end splitFields()
+
+/**
+ * parse a telemetry batch
+ *
+ * Lines of an unknown type, and lines with the wrong field count for their
+ * type, are skipped. Format 1 batches (before the `below milliseconds`
+ * column) are read with 0 for it.
+ *
+ * @param[in] controller id of the publishing controller
+ * @param[in] payload batch text
+ * @param[in] length bytes in the payload
+ * @param[out] batch parsed rows
+ * @return false when the batch does not start with a window (`t`) line
+ */
+bool parseBatch(const std::string & controller, const char * payload, size_t length,
+  telemetry_batch_t * batch)
+{
+  batch->controller = controller;
+  batch->time = 0;
+  batch->format = 0;
+  batch->dropped = 0;
+  batch->rollups.clear();
+  batch->events.clear();
+  batch->counters.clear();
+  const char * fields[MAX_LINE_FIELDS];
+  const char * end = payload + length;
+  for (const char * line = payload; line < end; ) {
+    const char * lineEnd = (const char *)memchr(line, '\n', end - line);
+    if (lineEnd == NULL) {
+      lineEnd = end;
+    }
+    char type = line[0];
+    size_t count = lineEnd - line > 2 && line[1] == ',' ?
+      splitFields(line + 2, lineEnd, fields) : 0;
+    if (batch->format == 0 && type != 't') {
+      return false;
+    }
+    if (type == 't' && batch->format == 0 && (count == 2 || count == 3)) {
+      batch->time = strtoul(fields[0], NULL, 10);
+      batch->format = count == 3 ? strtoul(fields[2], NULL, 10) : 1;
+    } else if (type == 'd' && count == 1) {
+      batch->dropped = strtoul(fields[0], NULL, 10);
+    } else if (type == 'r' && (count == 5 || count == 6)) {
+      rollup_row_t row = { batch->time, (uint16_t)strtoul(fields[0], NULL, 10),
+        (uint32_t)strtoul(fields[1], NULL, 10), strtof(fields[2], NULL),
+        strtof(fields[3], NULL), strtof(fields[4], NULL),
+        count == 6 ? (uint32_t)strtoul(fields[5], NULL, 10) : 0 };
+      batch->rollups.push_back(row);
+    } else if (type == 'c' && count == 3) {
+      counter_row_t row = { batch->time, (uint16_t)strtoul(fields[0], NULL, 10),
+        (uint32_t)strtoul(fields[1], NULL, 10), (uint32_t)strtoul(fields[2], NULL, 10) };
+      batch->counters.push_back(row);
+    } else if (type == 'e' && count == 6) {
+      event_row_t row = { (uint32_t)strtoul(fields[1], NULL, 10),
+        (uint16_t)strtoul(fields[3], NULL, 10), (uint32_t)strtoul(fields[0], NULL, 10),
+        (uint8_t)strtoul(fields[4], NULL, 10), strtof(fields[5], NULL) };
+      batch->events.push_back(row);
+    }
+    line = lineEnd + 1;
+  }
+  return batch->format != 0;
+} // end parseBatch()
@@ -0,0 +1,144 @@
+/**
+ * tests for the fleet telemetry collector; exits non zero when any fails
+ */
+#include "collector.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+unsigned int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+// 2026-09-30 23:59:00 and 2026-10-01 00:01:00 UTC
+const uint32_t SEPTEMBER_END = 1790812740;
+const uint32_t OCTOBER_START = 1790812860;
+
+/**
+ * build a batch in the controller's format
+ *
+ * @param[in] time window end
+ * @param[in] below milliseconds zone 2 was below its trigger level
+ * @return batch text
+ */
+std::string deviceBatch(const uint32_t time, const unsigned long below)
+{
+  char text[256];
+  snprintf(text, sizeof(text),
+    "t,%lu,12345,2\nd,3\nr,2,8,35.5,38.0,41.0,%lu\nc,2,4,20000\n"
+    "e,17,%lu,12000,2,4,35.5\nx,unknown,line\n", (unsigned long)time, below,
+    (unsigned long)time - 90);
+  return text;
+} // end deviceBatch()
+
+void testTopics()
+{
+  std::string controller;
+  CHECK(controllerFromTopic("irrigation/pump10-a/telemetry", &controller));
+  CHECK(controller == "pump10-a");
+  CHECK(controllerFromTopic("irrigation/../telemetry", &controller));
+  CHECK(controller == "__");
+  CHECK(!controllerFromTopic("irrigation/telemetry", &controller));
+  CHECK(!controllerFromTopic("other/pump10-a/telemetry", &controller));
+}
+
+void testParse()
+{
+  telemetry_batch_t batch;
+  std::string text = deviceBatch(SEPTEMBER_END, 45000);
+  CHECK(parseBatch("a", text.data(), text.size(), &batch));
+  CHECK(batch.time == SEPTEMBER_END && batch.format == 2 && batch.dropped == 3);
+  CHECK(batch.rollups.size() == 1 && batch.counters.size() == 1 && batch.events.size() == 1);
+  CHECK(batch.rollups[0].zone == 2 && batch.rollups[0].readings == 8);
+  CHECK(fabs(batch.rollups[0].average - 38.0) < 0.01);
+  CHECK(batch.rollups[0].belowMillis == 45000);
+  CHECK(batch.counters[0].deliveries == 4 && batch.counters[0].deliveredMillis == 20000);
+  CHECK(batch.events[0].sequence == 17 && batch.events[0].state == 4);
+  CHECK(batch.events[0].time == SEPTEMBER_END - 90);
+
+  // format 1: no version in the window line, and no below column
+  const char * old = "t,1790812740,12345\nr,1,8,35.5,38.0,41.0\n";
+  CHECK(parseBatch("a", old, strlen(old), &batch));
+  CHECK(batch.format == 1 && batch.rollups.size() == 1 && batch.rollups[0].belowMillis == 0);
+
+  const char * headless = "r,1,8,35.5,38.0,41.0,0\n";
+  CHECK(!parseBatch("a", headless, strlen(headless), &batch));
+}
+
+void testDates()
+{
+  uint32_t time;
+  CHECK(parseDate("1970-01-01", &time) && time == 0);
+  CHECK(parseDate("2024-03-01", &time) && time == 1709251200);
+  CHECK(parseDate("2026-10-01", &time) && time == OCTOBER_START - 60);
+  CHECK(!parseDate("2026-13-01", &time));
+}
+
+void testStoreAndQuery()
+{
+  std::string root = std::filesystem::temp_directory_path().string() + "/collector_test";
+  std::filesystem::remove_all(root);
+  column_store_t store;
+  openStore(&store, root);
+  telemetry_batch_t batch;
+  std::string text = deviceBatch(SEPTEMBER_END, 45000);
+  CHECK(parseBatch("a", text.data(), text.size(), &batch));
+  storeBatch(&store, batch);
+  text = deviceBatch(OCTOBER_START, 60000);
+  CHECK(parseBatch("a", text.data(), text.size(), &batch));
+  storeBatch(&store, batch);
+  text = deviceBatch(OCTOBER_START, 30000);
+  CHECK(parseBatch("b", text.data(), text.size(), &batch));
+  storeBatch(&store, batch);
+  CHECK(flushStore(&store));
+  CHECK(store.rows == 12);
+
+  // partitioned by controller, zone and month
+  std::vector<uint32_t> below;
+  CHECK(readColumn(root + "/a/zone02/2026-09/rollup.below", &below));
+  CHECK(below.size() == 1 && below[0] == 45000);
+  CHECK(readColumn(root + "/a/zone02/2026-10/rollup.below", &below));
+  CHECK(below.size() == 1 && below[0] == 60000);
+  std::vector<uint8_t> states;
+  CHECK(readColumn(root + "/b/zone02/2026-09/event.state", &states)); // 90 s earlier
+  CHECK(states.size() == 1 && states[0] == 4);
+
+  uint32_t from;
+  uint32_t to;
+  parseDate("2026-10-01", &from);
+  parseDate("2026-11-01", &to);
+  std::vector<below_result_t> results = queryBelowThreshold(root, from, to);
+  CHECK(results.size() == 2);
+  CHECK(results[0].controller == "a" && results[0].zone == 2);
+  CHECK(results[0].windows == 1 && results[0].belowMillis == 60000);
+  CHECK(results[1].controller == "b" && results[1].belowMillis == 30000);
+
+  parseDate("2026-09-01", &from);
+  results = queryBelowThreshold(root, from, to);
+  CHECK(results.size() == 2 && results[0].windows == 2 && results[0].belowMillis == 105000);
+
+  // a cut short write leaves one column longer: the shortest one counts
+  FILE * file = fopen((root + "/a/zone02/2026-10/rollup.below").c_str(), "ab");
+  uint32_t extra = 99999;
+  fwrite(&extra, sizeof(extra), 1, file);
+  fclose(file);
+  results = queryBelowThreshold(root, from, to);
+  CHECK(results[0].windows == 2 && results[0].belowMillis == 105000);
+  std::filesystem::remove_all(root);
+}
+
+int main()
+{
+  testTopics();
+  testParse();
+  testDates();
+  testStoreAndQuery();
+  printf("%u checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
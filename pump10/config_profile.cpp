@@ -0,0 +1,247 @@
+/**
+ * methods to save, check, and lazily load zone configuration profiles
+ */
+#include "config_profile.h"
+#include "metrics.h"
+
+const char * PROFILE_NAMESPACE = "pump10prof";
+const char * ACTIVE_KEY = "active";
+const char * NAMES_KEY = "names";
+
+Preferences profileStore;
+char activeProfile[PROFILE_NAME_SIZE] = "";
+size_t profileZones = 0; // zones in the active profile
+size_t nextProfileZone = 0; // next record to load
+
+/**
+ * build the key for a profile header or record
+ *
+ * @param[out] key buffer of at least 16 characters
+ * @param[in] name profile name
+ * @param[in] record zone index, or -1 for the header
+ */
+void profileKey(char * key, const char * name, const int record)
+{
+  if (record < 0) {
+    sprintf(key, "%s/h", name);
+  } else {
+    sprintf(key, "%s/%d", name, record);
+  }
+} // end profileKey()
+
+/**
+ * check that a profile name is usable
+ *
+ * @param[in] name profile name
+ * @return true when 1 to 8 characters, without '/' or ','
+ */
+bool validProfileName(const char * name)
+{
+  size_t length = strlen(name);
+  return length > 0 && length < PROFILE_NAME_SIZE && strchr(name, '/') == NULL &&
+    strchr(name, ',') == NULL;
+} // end validProfileName()
+
+/**
+ * read and check a profile header
+ *
+ * @param[in] name profile name
+ * @param[out] header the header
+ * @return true when the header is valid for this sketch
+ */
+bool readProfileHeader(const char * name, profile_header_t * header)
+{
+  char key[16];
+  profileKey(key, name, -1);
+  if (profileStore.getBytes(key, header, sizeof(*header)) != sizeof(*header)) {
+    return false;
+  }
+  return header->magic == PROFILE_MAGIC && header->format == PROFILE_FORMAT &&
+    header->recordSize == sizeof(profile_record_t) &&
+    header->crc == crc16(0xFFFF, (const uint8_t *)header, sizeof(*header) - 2);
+} // end readProfileHeader()
+
+/**
+ * open the profile store, and load and apply the active profile
+ *
+ * Every zone is idle at startup, so the whole profile applies at once.
+ *
+ * @param[in,out] contexts array of configured irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @return true when there is a valid active profile
+ */
+bool beginProfiles(irrigation_context_t * contexts, const size_t count)
+{
+  profileStore.begin(PROFILE_NAMESPACE, false);
+  size_t length = profileStore.getBytes(ACTIVE_KEY, activeProfile, PROFILE_NAME_SIZE - 1);
+  activeProfile[length] = '\0';
+  if (!activateProfile(activeProfile)) {
+    return false;
+  }
+  while (profileLoadPending()) {
+    loadNextProfileZone();
+  }
+  applyZoneConfig(contexts, count);
+  return true;
+} // end beginProfiles()
+
+/**
+ * check if zone records of the active profile are still to be loaded
+ *
+ * @return true while loading
+ */
+bool profileLoadPending()
+{
+  return nextProfileZone < profileZones;
+} // end profileLoadPending()
+
+/**
+ * add a name to the list of saved profiles
+ *
+ * @param[in] name profile name
+ */
+void rememberProfileName(const char * name)
+{
+  char names[MAX_PROFILES * PROFILE_NAME_SIZE + 1] = "";
+  size_t length = profileStore.getBytes(NAMES_KEY, names, sizeof(names) - 1);
+  names[length] = '\0';
+  size_t count = 0;
+  for (char * entry = strtok(names, ","); entry != NULL; entry = strtok(NULL, ",")) {
+    if (strcmp(entry, name) == 0) {
+      return;
+    }
+    count++;
+  }
+  length = profileStore.getBytes(NAMES_KEY, names, sizeof(names) - 1);
+  names[length] = '\0';
+  if (count >= MAX_PROFILES) {
+    return; // saved, but not listed
+  }
+  if (length > 0) {
+    strcat(names, ",");
+  }
+  strcat(names, name);
+  profileStore.putBytes(NAMES_KEY, names, strlen(names));
+} // end rememberProfileName()
+
+/**
+ * save the current zone configuration as a named profile
+ *
+ * @param[in] name profile name
+ * @return true when saved
+ */
+bool saveProfile(const char * name)
+{
+  const zone_table_t * table = currentZoneTable();
+  if (!validProfileName(name) || table == NULL) {
+    return false;
+  }
+  char key[16];
+  // an existing profile of the same name is invalid until completely replaced
+  profileKey(key, name, -1);
+  profileStore.remove(key);
+  profile_record_t record;
+  for (size_t i = 0; i < table->count; i++) {
+    const watering_zone_t * zone = &table->zones[i];
+    memset(&record, 0, sizeof(record));
+    strncpy(record.zone.name, zone->name.c_str(), CONFIG_NAME_SIZE - 1);
+    record.zone.sensor = zone->sensor;
+    record.zone.rules = zone->rules;
+    record.zone.pump = zone->pump;
+    record.zone.valve = zone->valve;
+    record.zone.reservoir = zone->reservoir;
+    record.zone.schedule = zone->schedule;
+    record.enabled = table->enabled[i];
+    record.crc = crc16(0xFFFF, (const uint8_t *)&record, sizeof(record) - 2);
+    profileKey(key, name, i);
+    if (profileStore.putBytes(key, &record, sizeof(record)) != sizeof(record)) {
+      return false;
+    }
+  }
+  // the header last: a profile is only valid once all of its records are saved
+  profile_header_t header = { PROFILE_MAGIC, PROFILE_FORMAT, (uint8_t)table->count,
+    sizeof(profile_record_t), 0 };
+  header.crc = crc16(0xFFFF, (const uint8_t *)&header, sizeof(header) - 2);
+  profileKey(key, name, -1);
+  if (profileStore.putBytes(key, &header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  rememberProfileName(name);
+  return true;
+} // end saveProfile()
+
+/**
+ * make a profile the active one, and start loading its zones
+ *
+ * @param[in] name profile name
+ * @return true when the profile header is valid
+ */
+bool activateProfile(const char * name)
+{
+  profile_header_t header;
+  if (!validProfileName(name) || !readProfileHeader(name, &header)) {
+    profileZones = 0;
+    return false;
+  }
+  if (strcmp(name, activeProfile) != 0) {
+    strcpy(activeProfile, name);
+    profileStore.putBytes(ACTIVE_KEY, activeProfile, strlen(activeProfile));
+  }
+  profileZones = min((size_t)header.zones, MAX_CONFIG_ZONES);
+  nextProfileZone = 0;
+  Serial.printf("LOG: loading %u zones from configuration profile %s\n",
+    (unsigned int)profileZones, activeProfile);
+  return true;
+} // end activateProfile()
+
+/**
+ * load, check, and publish the next zone record of the active profile
+ *
+ * Called once per pass, until all zones are loaded.
+ *
+ * @return true when a zone was loaded
+ */
+bool loadNextProfileZone()
+{
+  if (nextProfileZone >= profileZones) {
+    return false;
+  }
+  size_t zone = nextProfileZone++;
+  char key[16];
+  profile_record_t record;
+  profileKey(key, activeProfile, zone);
+  if (profileStore.getBytes(key, &record, sizeof(record)) != sizeof(record) ||
+      record.crc != crc16(0xFFFF, (const uint8_t *)&record, sizeof(record) - 2)) {
+    Serial.printf("LOG: profile %s zone %u is damaged; keeping the sketch configuration\n",
+      activeProfile, (unsigned int)(zone + 1));
+    return false;
+  }
+  if (record.enabled) {
+    // a calibration made on this board wins over the one saved in the profile
+    moisture_calibration_t calibration = record.zone.sensor.moisture_calibration;
+    if (savedCalibration(zone, &calibration)) {
+      record.zone.sensor.moisture_calibration = calibration;
+    }
+    configureCommand(CONFIG_SET_ZONE, zone + 1, (const uint8_t *)&record.zone,
+      sizeof(record.zone));
+  } else {
+    configureCommand(CONFIG_DISABLE_ZONE, zone + 1, NULL, 0);
+  }
+  return true;
+} // end loadNextProfileZone()
+
+/**
+ * print the saved profiles, and the zone count of each
+ */
+void listProfiles()
+{
+  char names[MAX_PROFILES * PROFILE_NAME_SIZE + 1] = "";
+  size_t length = profileStore.getBytes(NAMES_KEY, names, sizeof(names) - 1);
+  names[length] = '\0';
+  profile_header_t header;
+  for (char * name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+    bool valid = readProfileHeader(name, &header);
+    Serial.printf("  %s%s: %s\n", name, strcmp(name, activeProfile) == 0 ? " (active)" : "",
+      valid ? (String((unsigned int)header.zones) + " zones").c_str() : "invalid");
+  }
+} // end listProfiles()
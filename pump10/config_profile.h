@@ -0,0 +1,58 @@
+#ifndef config_profile_h
+#define config_profile_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "zone_config.h"
+#include "sensor_calibration.h"
+
+/**
+ * data structures and methods to keep named zone configuration profiles (for
+ * example "summer" and "winter") in flash (NVS)
+ *
+ * Each profile is a header, plus one record per zone. At startup the active
+ * profile is loaded and applied completely, before zone states are restored
+ * from a checkpoint, so the restored states land on the profile's zones. A
+ * profile activated at runtime is read, checked, and published one zone record
+ * per pass instead, so a pass never waits for all of them. Until its record is
+ * loaded, a zone keeps its current configuration.
+ *
+ * A sensor calibration saved on the device (`calibrate`) wins over the one in
+ * a profile: it was measured on the sensor that is actually connected.
+ *
+ * Image format (little endian, packed):
+ *   key «name»/h: profile_header_t
+ *   key «name»/«zone index»: profile_record_t
+ * Both end with a CRC-16/CCITT-FALSE of the bytes before it. A record size
+ * that does not match this sketch rejects the whole profile.
+ */
+
+const uint32_t PROFILE_MAGIC = 0x50313050; // "P01P"
+const uint8_t PROFILE_FORMAT = 1;
+const size_t PROFILE_NAME_SIZE = 9; // 8 characters; keys are limited to 15
+const size_t MAX_PROFILES = 4;
+
+/// profile header
+struct __attribute__((packed)) profile_header_t {
+  uint32_t magic;
+  uint8_t format;
+  uint8_t zones;
+  uint16_t recordSize;
+  uint16_t crc;
+};
+
+/// one zone in a profile
+struct __attribute__((packed)) profile_record_t {
+  zone_config_frame_t zone;
+  uint8_t enabled;
+  uint16_t crc;
+};
+
+bool beginProfiles(irrigation_context_t *, const size_t);
+bool profileLoadPending(void);
+bool saveProfile(const char *);
+bool activateProfile(const char *);
+bool loadNextProfileZone(void);
+void listProfiles(void);
+
+#endif
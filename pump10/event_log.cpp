@@ -0,0 +1,64 @@
+/**
+ * methods to record, and read back, the history of zone state changes
+ */
+#include "event_log.h"
+
+zone_event_t eventRing[EVENT_LOG_SIZE];
+unsigned long eventsRecorded = 0; // total; the next event goes to this % size
+portMUX_TYPE eventLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * add a zone state change to the history
+ *
+ * @param[in] time when the change happened
+ * @param[in] zone index of the zone
+ * @param[in] state the new zone state
+ * @param[in] moisture zone moisture percentage
+ */
+void recordEvent(const smart_time_t time, const size_t zone, const uint8_t state,
+  const float moisture)
+{
+  portENTER_CRITICAL(&eventLock);
+  zone_event_t * event = &eventRing[eventsRecorded % EVENT_LOG_SIZE];
+  event->time = time;
+  event->zone = zone;
+  event->state = state;
+  event->moisture = moisture;
+  eventsRecorded++;
+  portEXIT_CRITICAL(&eventLock);
+} // end recordEvent()
+
+/**
+ * get the total number of events recorded since startup
+ *
+ * Event sequence numbers run from 0 to this count - 1. Only the latest
+ * EVENT_LOG_SIZE of them are still available.
+ *
+ * @return number of events
+ */
+unsigned long eventCount()
+{
+  portENTER_CRITICAL(&eventLock);
+  unsigned long count = eventsRecorded;
+  portEXIT_CRITICAL(&eventLock);
+  return count;
+} // end eventCount()
+
+/**
+ * get a copy of an event from the history
+ *
+ * @param[in] sequence event sequence number
+ * @param[out] event copy of the event
+ * @return false when the event has been overwritten, or not recorded yet
+ */
+bool readEvent(const unsigned long sequence, zone_event_t * event)
+{
+  bool available;
+  portENTER_CRITICAL(&eventLock);
+  available = sequence < eventsRecorded && eventsRecorded - sequence <= EVENT_LOG_SIZE;
+  if (available) {
+    *event = eventRing[sequence % EVENT_LOG_SIZE];
+  }
+  portEXIT_CRITICAL(&eventLock);
+  return available;
+} // end readEvent()
@@ -0,0 +1,32 @@
+#ifndef event_log_h
+#define event_log_h
+
+#include <Arduino.h>
+#include "smart_time.h"
+
+/**
+ * data structures and methods to keep a history of zone state changes
+ *
+ * A fixed size ring buffer in memory. The oldest events are overwritten. The
+ * control loop adds events; other tasks read them through a copy taken with
+ * the ring locked.
+ */
+
+const size_t EVENT_LOG_SIZE = 64;
+
+/// a zone state change
+struct zone_event_t {
+  smart_time_t time;
+  /// index of the zone
+  uint8_t zone;
+  /// irrigation_state_t the zone changed to
+  uint8_t state;
+  /// zone moisture percentage at the time of the change
+  float moisture;
+};
+
+void recordEvent(const smart_time_t, const size_t, const uint8_t, const float);
+unsigned long eventCount(void);
+bool readEvent(const unsigned long, zone_event_t *);
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * methods to scan moisture sensors on external converters and multiplexers
+ */
+#include "external_adc.h"
+
+// ADS1115 registers, and single shot configuration: ±4.096V range, 860 samples
+// per second, comparator disabled. The channel is added as `MUX` bits 14:12
+const uint8_t ADS1115_CONVERSION_REGISTER = 0x00;
+const uint8_t ADS1115_CONFIG_REGISTER = 0x01;
+const uint16_t ADS1115_SINGLE_SHOT = 0x8000 | 0x4000 | 0x0200 | 0x0100 | 0x00E0 | 0x0003;
+const unsigned long ADS1115_CONVERSION_MICROS = 1300; // 1/860 second plus margin
+
+/// scan progress for one external device
+struct adc_lane_t {
+  /// channel currently converting or settling
+  uint8_t channel;
+  /// micros() when the channel can be read
+  unsigned long readyAt;
+  /// all channels read for the current scan
+  bool done;
+};
+
+const external_adc_t * externalAdcs = NULL;
+size_t externalAdcCount = 0;
+adc_lane_t lanes[MAX_EXTERNAL_ADCS];
+// latest reading, and the scan it came from, for every external channel
+volatile sensor_reading_t externalReadings[MAX_EXTERNAL_ADCS][MAX_ADC_CHANNELS];
+volatile uint8_t readingScan[MAX_EXTERNAL_ADCS][MAX_ADC_CHANNELS];
+volatile uint8_t scanSerial = 0;
+volatile bool scanRunning = false;
+unsigned long scanStarted = 0;
+unsigned long externalScanMicros = 0; // time taken by the latest full scan
+esp_timer_handle_t scanTimer = NULL;
+
+/**
+ * start converting or settling a channel
+ *
+ * @param[in] adc external device configuration
+ * @param[in,out] lane scan progress for the device
+ * @param[in] channel the channel to convert
+ */
+void selectChannel(const external_adc_t * adc, adc_lane_t * lane, const uint8_t channel)
+{
+  lane->channel = channel;
+  if (adc->type == ADC_ADS1115) {
+    uint16_t config = ADS1115_SINGLE_SHOT | ((uint16_t)channel << 12);
+    Wire.beginTransmission(adc->i2c_address);
+    Wire.write(ADS1115_CONFIG_REGISTER);
+    Wire.write(config >> 8);
+    Wire.write(config & 0xFF);
+    Wire.endTransmission();
+    lane->readyAt = micros() + ADS1115_CONVERSION_MICROS;
+    return;
+  }
+  for (uint8_t bit = 0; bit < MUX_SELECT_PINS; bit++) {
+    digitalWrite(adc->select_pins[bit], (channel >> bit) & 1 ? HIGH : LOW);
+  }
+  lane->readyAt = micros() + MUX_SETTLE_MICROS;
+} // end selectChannel()
+
+/**
+ * collect the result for the channel a lane has ready
+ *
+ * @param[in] adc external device configuration
+ * @param[in] lane scan progress for the device
+ * @return raw reading
+ */
+sensor_reading_t readChannel(const external_adc_t * adc, const adc_lane_t * lane)
+{
+  if (adc->type == ADC_ADS1115) {
+    Wire.beginTransmission(adc->i2c_address);
+    Wire.write(ADS1115_CONVERSION_REGISTER);
+    Wire.endTransmission();
+    Wire.requestFrom(adc->i2c_address, (uint8_t)2);
+    int16_t value = Wire.read() << 8;
+    value |= Wire.read();
+    return value < 0 ? 0 : value; // single ended; only noise goes negative
+  }
+  return analogRead(adc->analog_pin);
+} // end readChannel()
+
+/**
+ * scan timer callback: hand the next scan step to the I/O task
+ *
+ * @param arg not used
+ */
+void scanTimerExpired(void * arg)
+{
+  requestIo(IO_SCAN_STEP);
+} // end scanTimerExpired()
+
+/**
+ * set up the external devices and the scan timer
+ *
+ * @param[in] adcs array of external device configurations; must stay in memory
+ * @param[in] count the number of devices in the array
+ * @return true when scanning is available
+ */
+bool beginExternalAdcs(const external_adc_t * adcs, const size_t count)
+{
+  externalAdcs = adcs;
+  externalAdcCount = min(count, MAX_EXTERNAL_ADCS);
+  bool needI2C = false;
+  for (size_t i = 0; i < externalAdcCount; i++) {
+    if (adcs[i].type == ADC_ADS1115) {
+      needI2C = true;
+      continue;
+    }
+    for (uint8_t bit = 0; bit < MUX_SELECT_PINS; bit++) {
+      pinMode(adcs[i].select_pins[bit], OUTPUT);
+    }
+  }
+  if (!beginIoTask()) {
+    return false;
+  }
+  if (needI2C) {
+    lockBus();
+    Wire.begin();
+    Wire.setClock(400000);
+    unlockBus();
+  }
+  if (scanTimer == NULL) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = scanTimerExpired;
+    timerArgs.name = "sensor scan";
+    if (esp_timer_create(&timerArgs, &scanTimer) != ESP_OK) {
+      scanTimer = NULL;
+    }
+  }
+  return scanTimer != NULL;
+} // end beginExternalAdcs()
+
+/**
+ * start a scan of all external channels, unless one is still running
+ */
+void startSensorScan()
+{
+  if (scanRunning || scanTimer == NULL || externalAdcCount == 0) {
+    return;
+  }
+  scanSerial++;
+  scanStarted = micros();
+  scanRunning = true;
+  lockBus();
+  for (size_t i = 0; i < externalAdcCount; i++) {
+    lanes[i].done = false;
+    selectChannel(&externalAdcs[i], &lanes[i], 0);
+  }
+  unlockBus();
+  esp_timer_start_periodic(scanTimer, SCAN_STEP_MICROS);
+} // end startSensorScan()
+
+/**
+ * advance every lane that has a reading ready
+ *
+ * Runs in the I/O task, when the scan timer asks for it. Stops the timer when
+ * all lanes have finished the scan.
+ */
+void scanStep()
+{
+  if (!scanRunning) {
+    return; // a late request, after the scan finished
+  }
+  bool allDone = true;
+  lockBus();
+  unsigned long now = micros();
+  for (size_t i = 0; i < externalAdcCount; i++) {
+    adc_lane_t * lane = &lanes[i];
+    if (lane->done) {
+      continue;
+    }
+    allDone = false;
+    if ((long)(now - lane->readyAt) < 0) {
+      continue; // still converting or settling
+    }
+    externalReadings[i][lane->channel] = readChannel(&externalAdcs[i], lane);
+    readingScan[i][lane->channel] = scanSerial;
+    if (lane->channel + 1 >= externalAdcs[i].channels) {
+      lane->done = true;
+    } else {
+      selectChannel(&externalAdcs[i], lane, lane->channel + 1);
+    }
+  }
+  unlockBus();
+  if (allDone) {
+    esp_timer_stop(scanTimer);
+    externalScanMicros = micros() - scanStarted;
+    scanRunning = false;
+  }
+} // end scanStep()
+
+/**
+ * get the latest reading for an external channel
+ *
+ * Waits (up to EXTERNAL_READING_TIMEOUT) when the running scan has not reached
+ * the channel yet. Without a running scan, the latest reading is used.
+ *
+ * @param[in] device index into the external device configurations
+ * @param[in] channel channel on the device
+ * @return raw reading
+ */
+sensor_reading_t externalAdcReading(const uint8_t device, const uint8_t channel)
+{
+  if (device >= externalAdcCount || channel >= MAX_ADC_CHANNELS) {
+    return 0;
+  }
+  unsigned long waitStart = millis();
+  while (scanRunning && readingScan[device][channel] != scanSerial &&
+      millis() - waitStart < EXTERNAL_READING_TIMEOUT) {
+    yield(); // let the scan timer task run
+  }
+  return externalReadings[device][channel];
+} // end externalAdcReading()
+
+/**
+ * get the scan serial of the latest reading for an external channel
+ *
+ * @param[in] device index into the external device configurations
+ * @param[in] channel channel on the device
+ * @return scan serial
+ */
+uint8_t externalReadingScan(const uint8_t device, const uint8_t channel)
+{
+  if (device >= externalAdcCount || channel >= MAX_ADC_CHANNELS) {
+    return 0;
+  }
+  return readingScan[device][channel];
+} // end externalReadingScan()
+
+/**
+ * wait for a reading of an external channel from a later scan
+ *
+ * Starts scans as needed. For sampling loops (calibration), where the latest
+ * reading would otherwise be counted again until the next scan reaches the
+ * channel.
+ *
+ * @param[in] device index into the external device configurations
+ * @param[in] channel channel on the device
+ * @param[in,out] scan serial of the scan of the previous sample; updated
+ * @param[out] reading raw reading
+ * @return true when a new reading arrived within EXTERNAL_READING_TIMEOUT
+ */
+bool nextExternalReading(const uint8_t device, const uint8_t channel, uint8_t * scan,
+  sensor_reading_t * reading)
+{
+  if (device >= externalAdcCount || channel >= externalAdcs[device].channels) {
+    return false;
+  }
+  unsigned long waitStart = millis();
+  while (readingScan[device][channel] == *scan &&
+      millis() - waitStart < EXTERNAL_READING_TIMEOUT) {
+    startSensorScan(); // does nothing while a scan is running
+    delay(1); // let the scan timer task run
+  }
+  if (readingScan[device][channel] == *scan) {
+    return false;
+  }
+  *scan = readingScan[device][channel];
+  *reading = externalReadings[device][channel];
+  return true;
+} // end nextExternalReading()
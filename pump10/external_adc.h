@@ -0,0 +1,64 @@
+#ifndef external_adc_h
+#define external_adc_h
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include "watering_management.h"
+#include "io_task.h"
+
+/**
+ * data structures and methods to read moisture sensors connected through
+ * external converters and multiplexers, instead of directly to ADC1 pins.
+ *
+ * Each external device is a scan `lane`. Lanes are stepped in parallel from a
+ * periodic timer, so a multiplexer channel can be settling, or a converter
+ * can be converting, while the result from another lane is read. A scan is
+ * started at the beginning of each pass over the state machines, and readings
+ * are waited for only if they have not arrived by the time they are needed.
+ * The timer only wakes the I/O task, which does the bus work (see io_task.h).
+ */
+
+/// kinds of external analog sources
+enum external_adc_type_t {
+  /// ADS1115 class I2C converter; 4 single ended channels
+  ADC_ADS1115 = 1,
+  /// CD74HC4067 class 16 channel analog multiplexer into an ADC1 pin
+  ADC_ANALOG_MUX
+};
+
+const uint8_t MUX_SELECT_PINS = 4;
+const size_t MAX_EXTERNAL_ADCS = 8;
+const uint8_t MAX_ADC_CHANNELS = 16;
+
+/**
+ * configuration for an external analog source
+ *
+ * Multiplexers each need their own select pins, since the lanes switch
+ * channels independently.
+ */
+struct external_adc_t {
+  external_adc_type_t type;
+  /// I2C address of a converter
+  uint8_t i2c_address;
+  /// ADC1 gpio pin connected to the multiplexer common output
+  gpio_pin_t analog_pin;
+  /// multiplexer channel select gpio pins, S0 to S3
+  gpio_pin_t select_pins[MUX_SELECT_PINS];
+  /// number of channels in use, starting from channel 0
+  uint8_t channels;
+};
+
+extern const unsigned long MUX_SETTLE_MICROS;
+extern const unsigned long SCAN_STEP_MICROS;
+extern const unsigned long EXTERNAL_READING_TIMEOUT;
+extern unsigned long externalScanMicros;
+
+bool beginExternalAdcs(const external_adc_t *, const size_t);
+void startSensorScan(void);
+void scanStep(void);
+sensor_reading_t externalAdcReading(const uint8_t, const uint8_t);
+uint8_t externalReadingScan(const uint8_t, const uint8_t);
+bool nextExternalReading(const uint8_t, const uint8_t, uint8_t *, sensor_reading_t *);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * methods to measure delivered water volume with the pulse counter hardware
+ */
+#include "flow_meter.h"
+
+// glitch filter, in 80MHz APB clock cycles; much shorter than any flow pulse
+const uint16_t FLOW_PULSE_FILTER = 100;
+// the hardware counter is 16 bit signed. It wraps to zero at the limit, and
+// larger volumes count the laps
+const int16_t FLOW_PULSE_LIMIT = 32767;
+
+/// progress of a volume based delivery on one pulse counter unit
+struct flow_run_t {
+  /// waiting for the target volume
+  volatile bool armed;
+  /// target volume delivered, and delivery stopped
+  volatile bool reached;
+  /// counter wraps still to come before the final lap
+  volatile unsigned long laps;
+  /// pulses in the final lap; 0 when it ends on a wrap
+  int16_t lastLap;
+  /// how to stop the delivery
+  delivery_stop_t stop;
+  void * stopArg;
+  /// millis() when the delivery was stopped
+  unsigned long stoppedAt;
+};
+
+flow_run_t flowRuns[FLOW_METER_UNITS];
+QueueHandle_t flowEvents = NULL;
+
+/**
+ * pulse counter threshold and limit interrupt handler
+ *
+ * Each counter wrap completes a lap. The delivery stops at the threshold in
+ * the final lap, or on the final wrap when the target is a whole number of
+ * laps.
+ *
+ * @param arg pulse counter unit number
+ */
+void IRAM_ATTR flowTargetIsr(void * arg)
+{
+  uint8_t unit = (uintptr_t)arg;
+  flow_run_t * run = &flowRuns[unit];
+  uint32_t status = 0;
+  pcnt_get_event_status((pcnt_unit_t)unit, &status);
+  bool done = false;
+  if ((status & PCNT_EVT_H_LIM) != 0 && run->laps > 0) {
+    run->laps--;
+    done = run->laps == 0 && run->lastLap == 0;
+  } else if ((status & PCNT_EVT_THRES_0) != 0) {
+    done = run->laps == 0;
+  }
+  if (!done) {
+    return;
+  }
+  BaseType_t wake = pdFALSE;
+  xQueueSendFromISR(flowEvents, &unit, &wake);
+  if (wake) {
+    portYIELD_FROM_ISR();
+  }
+} // end flowTargetIsr()
+
+/**
+ * stop deliveries that have reached their target volume
+ *
+ * @param arg not used
+ */
+void flowStopTask(void * arg)
+{
+  uint8_t unit;
+  for (;;) {
+    if (xQueueReceive(flowEvents, &unit, portMAX_DELAY) != pdTRUE ||
+        unit >= FLOW_METER_UNITS || !flowRuns[unit].armed) {
+      continue;
+    }
+    flowRuns[unit].stop(flowRuns[unit].stopArg);
+    flowRuns[unit].stoppedAt = millis();
+    flowRuns[unit].armed = false;
+    flowRuns[unit].reached = true;
+    pcnt_counter_pause((pcnt_unit_t)unit);
+  }
+} // end flowStopTask()
+
+/**
+ * set up the shared pulse counter interrupt service and stop task
+ *
+ * @return true when volume based delivery is available
+ */
+bool beginFlowMeters()
+{
+  if (flowEvents != NULL) {
+    return true;
+  }
+  for (uint8_t unit = 0; unit < FLOW_METER_UNITS; unit++) {
+    flowRuns[unit] = { false, false, 0, 0, NULL, NULL, 0 };
+  }
+  flowEvents = xQueueCreate(FLOW_METER_UNITS, sizeof(uint8_t));
+  if (flowEvents == NULL) {
+    return false;
+  }
+  if (pcnt_isr_service_install(0) != ESP_OK) {
+    return false;
+  }
+  return xTaskCreate(flowStopTask, "flow stop", 2048, NULL, 10, NULL) == pdPASS;
+} // end beginFlowMeters()
+
+/**
+ * check if a pump has a flow meter
+ *
+ * @param meter flow meter configuration
+ * @return true when a flow meter is configured
+ */
+bool hasFlowMeter(const flow_meter_t meter)
+{
+  return meter.pulsesPerLitre > 0 && meter.unit < FLOW_METER_UNITS &&
+    flowEvents != NULL;
+} // end hasFlowMeter()
+
+/**
+ * start counting flow pulses towards a target volume
+ *
+ * Targets beyond the 16 bit counter are split into laps, so any volume stops
+ * on its own pulse count.
+ *
+ * @param meter flow meter configuration
+ * @param millilitres volume to deliver
+ * @param stop callback that stops the delivery
+ * @param arg argument for the stop callback
+ * @return true when the flow meter will stop the delivery
+ */
+bool armFlowMeter(const flow_meter_t meter, const unsigned int millilitres,
+  delivery_stop_t stop, void * arg)
+{
+  if (meter.unit < FLOW_METER_UNITS) {
+    // a new delivery: nothing left from an earlier one may end it
+    flowRuns[meter.unit].armed = false;
+    flowRuns[meter.unit].reached = false;
+  }
+  if (!hasFlowMeter(meter) || millilitres == 0) {
+    return false;
+  }
+  pcnt_unit_t unit = (pcnt_unit_t)meter.unit;
+  uint64_t pulses = (uint64_t)millilitres * meter.pulsesPerLitre / 1000;
+  if (pulses == 0) {
+    pulses = 1;
+  }
+  unsigned long laps = pulses / FLOW_PULSE_LIMIT;
+  int16_t lastLap = pulses % FLOW_PULSE_LIMIT;
+
+  pcnt_config_t config = {};
+  config.pulse_gpio_num = meter.gpio_pin;
+  config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  config.channel = PCNT_CHANNEL_0;
+  config.unit = unit;
+  config.pos_mode = PCNT_COUNT_INC; // count rising edges only
+  config.neg_mode = PCNT_COUNT_DIS;
+  config.lctrl_mode = PCNT_MODE_KEEP;
+  config.hctrl_mode = PCNT_MODE_KEEP;
+  config.counter_h_lim = FLOW_PULSE_LIMIT;
+  config.counter_l_lim = 0;
+  if (pcnt_unit_config(&config) != ESP_OK) {
+    return false;
+  }
+  pcnt_set_filter_value(unit, FLOW_PULSE_FILTER);
+  pcnt_filter_enable(unit);
+  if (lastLap > 0) {
+    pcnt_set_event_value(unit, PCNT_EVT_THRES_0, lastLap);
+    pcnt_event_enable(unit, PCNT_EVT_THRES_0);
+  } else {
+    pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+  }
+  if (laps > 0) {
+    pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+  } else {
+    pcnt_event_disable(unit, PCNT_EVT_H_LIM);
+  }
+  pcnt_isr_handler_add(unit, flowTargetIsr, (void *)(uintptr_t)meter.unit);
+
+  flowRuns[meter.unit].laps = laps;
+  flowRuns[meter.unit].lastLap = lastLap;
+  flowRuns[meter.unit].stop = stop;
+  flowRuns[meter.unit].stopArg = arg;
+  flowRuns[meter.unit].armed = true;
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+  pcnt_counter_resume(unit);
+  return true;
+} // end armFlowMeter()
+
+/**
+ * check if the target volume has been delivered
+ *
+ * @param meter flow meter configuration
+ * @return true when the flow meter has stopped the delivery
+ */
+bool flowTargetReached(const flow_meter_t meter)
+{
+  return hasFlowMeter(meter) && flowRuns[meter.unit].reached;
+} // end flowTargetReached()
+
+/**
+ * get when the flow meter stopped the delivery
+ *
+ * @param meter flow meter configuration
+ * @return millis() at the stop
+ */
+unsigned long flowStopMillis(const flow_meter_t meter)
+{
+  return flowRuns[meter.unit].stoppedAt;
+} // end flowStopMillis()
+
+/**
+ * stop counting at the end of a delivery, however it ended
+ *
+ * Also clears a reached target, once the delivery's end has been handled.
+ *
+ * @param meter flow meter configuration
+ */
+void disarmFlowMeter(const flow_meter_t meter)
+{
+  if (!hasFlowMeter(meter)) {
+    return;
+  }
+  flowRuns[meter.unit].armed = false;
+  flowRuns[meter.unit].reached = false;
+  pcnt_counter_pause((pcnt_unit_t)meter.unit);
+} // end disarmFlowMeter()
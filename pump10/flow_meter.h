@@ -0,0 +1,31 @@
+#ifndef flow_meter_h
+#define flow_meter_h
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include "watering_management.h"
+
+/**
+ * methods to end water delivery on a measured volume, using the ESP32 pulse
+ * counter (PCNT) hardware to count flow sensor pulses
+ *
+ * The counter counts every pulse by itself. Its threshold event gives a single
+ * interrupt when the target volume has been delivered; volumes beyond the 16
+ * bit counter also take an interrupt each time it wraps. The interrupt hands the
+ * stop over to a task, since pump and valve outputs can not be changed from an
+ * interrupt handler.
+ */
+
+/// action that stops delivery; the same callbacks as the delivery timers
+typedef void (*delivery_stop_t)(void *);
+
+const uint8_t FLOW_METER_UNITS = 8;
+
+bool beginFlowMeters(void);
+bool hasFlowMeter(const flow_meter_t);
+bool armFlowMeter(const flow_meter_t, const unsigned int, delivery_stop_t, void *);
+bool flowTargetReached(const flow_meter_t);
+unsigned long flowStopMillis(const flow_meter_t);
+void disarmFlowMeter(const flow_meter_t);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * methods to collect and report hot path timings, loop jitter, and pump usage
+ */
+#include "instrumentation.h"
+
+// the order of irrigation_state_t
+const char * HANDLER_NAMES[TIMED_HANDLERS] = {
+  "disabled", "moisture good", "reserve resources", "lock timeout",
+  "delivering water", "soaking in"
+};
+const unsigned int OVERHEAD_SAMPLES = 100;
+
+section_timing_t handlerTimings[TIMED_HANDLERS];
+section_timing_t sensorReadTiming;
+// where the hot paths record: the live counters, except while benchmarking
+section_timing_t * handlerTimingRecords = handlerTimings;
+section_timing_t * sensorReadTimingRecord = &sensorReadTiming;
+// cpu cycles used by each pass over the state machines, in microseconds
+histogram_t passHistogram;
+// microseconds between the planned and the actual start of a pass
+histogram_t wakeLatenessHistogram;
+
+uint32_t passStartCycles = 0;
+uint64_t awakeCycles = 0; // cycles spent in measured passes
+uint32_t recordCycles = 0; // measured cycles for one timed section
+int64_t instrumentedSince = 0; // esp_timer_get_time() when the counters were cleared
+unsigned long plannedWake = 0; // micros(); 0 when unknown
+uint32_t cyclesPerMicro = 1;
+
+/**
+ * get the histogram bucket for a value
+ *
+ * @param[in] value to be counted
+ * @return bucket index
+ */
+size_t histogramBucket(const uint32_t value)
+{
+  size_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+  return min(bucket, HISTOGRAM_BUCKETS - 1);
+} // end histogramBucket()
+
+/**
+ * clear all counters, and measure the cost of timing a section
+ */
+void beginInstrumentation()
+{
+  memset(handlerTimings, 0, sizeof(handlerTimings));
+  memset(&sensorReadTiming, 0, sizeof(sensorReadTiming));
+  memset(&passHistogram, 0, sizeof(passHistogram));
+  memset(&wakeLatenessHistogram, 0, sizeof(wakeLatenessHistogram));
+  cyclesPerMicro = max(ESP.getCpuFreqMHz(), (uint32_t)1);
+  section_timing_t scratch = { 0, 0, 0 };
+  uint32_t started = cycleCount();
+  for (unsigned int i = 0; i < OVERHEAD_SAMPLES; i++) {
+    recordTiming(&scratch, cycleCount());
+  }
+  recordCycles = (cycleCount() - started) / OVERHEAD_SAMPLES;
+  awakeCycles = 0;
+  instrumentedSince = esp_timer_get_time();
+} // end beginInstrumentation()
+
+/**
+ * count the timing records made in the live counters
+ *
+ * Each timed section is one record, and so are the start and the end of
+ * each pass. Records made while benchmarking go to private counters.
+ *
+ * @return records made since beginInstrumentation()
+ */
+unsigned long liveTimingRecords()
+{
+  unsigned long records = sensorReadTiming.calls;
+  for (size_t i = 0; i < TIMED_HANDLERS; i++) {
+    records += handlerTimings[i].calls;
+  }
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    records += 2 * passHistogram.counts[i];
+  }
+  return records;
+} // end liveTimingRecords()
+
+/**
+ * send the handler and sensor read timings to private records, or back to the
+ * live counters
+ *
+ * Records made while private ones are in use are not counted as live
+ * instrumentation overhead.
+ *
+ * @param[out] handlers TIMED_HANDLERS records; NULL to use the live counters again
+ * @param[out] sensorRead record for sensor reads
+ */
+void useTimingRecords(section_timing_t * handlers, section_timing_t * sensorRead)
+{
+  if (handlers == NULL) {
+    handlerTimingRecords = handlerTimings;
+    sensorReadTimingRecord = &sensorReadTiming;
+    return;
+  }
+  handlerTimingRecords = handlers;
+  sensorReadTimingRecord = sensorRead;
+} // end useTimingRecords()
+
+/**
+ * count a value in a histogram
+ *
+ * @param[in,out] histogram the histogram to update
+ * @param[in] value to be counted
+ */
+void recordHistogram(histogram_t * histogram, const uint32_t value)
+{
+  histogram->counts[histogramBucket(value)]++;
+} // end recordHistogram()
+
+/**
+ * mark the start of a pass over the state machines
+ *
+ * Measures how late the pass started compared to the planned wakeup.
+ */
+void recordPassStart()
+{
+  passStartCycles = cycleCount();
+  if (plannedWake != 0) {
+    long lateness = micros() - plannedWake;
+    recordHistogram(&wakeLatenessHistogram, lateness < 0 ? 0 : lateness);
+  }
+} // end recordPassStart()
+
+/**
+ * mark the end of the work for a pass over the state machines
+ */
+void recordPassEnd()
+{
+  uint32_t cycles = cycleCount() - passStartCycles;
+  awakeCycles += cycles;
+  recordHistogram(&passHistogram, cycles / cyclesPerMicro);
+} // end recordPassEnd()
+
+/**
+ * remember when the next pass is supposed to start
+ *
+ * @param[in] wait milliseconds until the next pass
+ */
+void recordPlannedWake(const unsigned long wait)
+{
+  plannedWake = micros() + wait * 1000;
+  if (plannedWake == 0) {
+    plannedWake = 1; // 0 means unknown
+  }
+} // end recordPlannedWake()
+
+/**
+ * add a pump run to the usage counters
+ *
+ * @param[in,out] usage cumulative usage for the pump
+ * @param[in] millis milliseconds the pump ran
+ */
+void recordPumpRun(pump_usage_t * usage, const unsigned long millis)
+{
+  usage->starts++;
+  usage->onMillis += millis;
+} // end recordPumpRun()
+
+/**
+ * print a histogram, skipping empty buckets
+ *
+ * @param[in] title what the histogram counts
+ * @param[in] histogram the histogram to print
+ */
+void printHistogram(const char * title, const histogram_t * histogram)
+{
+  Serial.printf("%s (microseconds):\n", title);
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (histogram->counts[i] == 0) {
+      continue;
+    }
+    Serial.printf("  %s%lu: %lu\n", i + 1 == HISTOGRAM_BUCKETS ? ">= " : "< ",
+      1ul << (i == HISTOGRAM_BUCKETS - 1 ? i - 1 : i), histogram->counts[i]);
+  }
+} // end printHistogram()
+
+/**
+ * print a section timing
+ *
+ * @param[in] title the code section
+ * @param[in] timing accumulated timing for the section
+ */
+void printTiming(const char * title, const section_timing_t * timing)
+{
+  if (timing->calls == 0) {
+    return;
+  }
+  Serial.printf("  %s: %lu calls, average %lu, maximum %lu microseconds\n", title,
+    timing->calls, (unsigned long)(timing->totalCycles / timing->calls / cyclesPerMicro),
+    (unsigned long)(timing->maxCycles / cyclesPerMicro));
+} // end printTiming()
+
+/**
+ * print all collected timings and histograms
+ */
+void dumpInstrumentation()
+{
+  Serial.println("state handler timing:");
+  for (size_t i = 0; i < TIMED_HANDLERS; i++) {
+    printTiming(HANDLER_NAMES[i], &handlerTimings[i]);
+  }
+  printTiming("sensor read", &sensorReadTiming);
+  printHistogram("pass duration", &passHistogram);
+  printHistogram("wakeup lateness", &wakeLatenessHistogram);
+  // the loop is the time between passes, awake or asleep, since the counters started
+  uint64_t overheadCycles = (uint64_t)liveTimingRecords() * recordCycles;
+  uint64_t loopCycles = (uint64_t)(esp_timer_get_time() - instrumentedSince) * cyclesPerMicro;
+  Serial.printf("instrumentation overhead: %lu cycles per record, %.2f%% of pass time, "
+    "%.4f%% of loop time\n", (unsigned long)recordCycles,
+    awakeCycles == 0 ? 0 : 100.0 * overheadCycles / awakeCycles,
+    loopCycles == 0 ? 0 : 100.0 * overheadCycles / loopCycles);
+} // end dumpInstrumentation()
+
+/**
+ * print the usage counters for a pump
+ *
+ * @param[in] name identifies the pump
+ * @param[in] usage cumulative usage for the pump
+ */
+void printPumpUsage(const char * name, const pump_usage_t * usage)
+{
+  Serial.printf("  %s: %lu starts, %lu milliseconds on\n", name, usage->starts,
+    usage->onMillis);
+} // end printPumpUsage()
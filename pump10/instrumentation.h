@@ -0,0 +1,79 @@
+#ifndef instrumentation_h
+#define instrumentation_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+/**
+ * data structures and methods for low overhead timing of the hot paths
+ *
+ * All counters are fixed size, and updated with a few integer operations.
+ * Timings use the cpu cycle counter, which wraps after about 17 seconds at
+ * 240 MHz: long enough for any single measurement.
+ */
+
+const size_t TIMED_HANDLERS = 6; // one per irrigation_state_t
+const size_t HISTOGRAM_BUCKETS = 16;
+
+/// accumulated timing for one code section
+struct section_timing_t {
+  unsigned long calls;
+  uint64_t totalCycles;
+  uint32_t maxCycles;
+};
+
+/// power of 2 histogram: bucket n counts values from 2^(n-1) to 2^n - 1
+struct histogram_t {
+  unsigned long counts[HISTOGRAM_BUCKETS];
+};
+
+/// cumulative pump usage
+struct pump_usage_t {
+  unsigned long starts;
+  unsigned long onMillis;
+};
+
+extern section_timing_t handlerTimings[TIMED_HANDLERS];
+extern section_timing_t sensorReadTiming;
+extern section_timing_t * handlerTimingRecords;
+extern section_timing_t * sensorReadTimingRecord;
+extern histogram_t passHistogram;
+extern histogram_t wakeLatenessHistogram;
+
+/**
+ * get the current cpu cycle count, to start or end a timed section
+ *
+ * @return cycle counter
+ */
+inline uint32_t cycleCount()
+{
+  return ESP.getCycleCount();
+}
+
+/**
+ * add a measurement to the timing for a code section
+ *
+ * Inline, since it runs for every handler and sensor read.
+ *
+ * @param[in,out] timing accumulated timing for the section
+ * @param[in] started cycleCount() at the start of the section
+ */
+inline void recordTiming(section_timing_t * timing, const uint32_t started)
+{
+  uint32_t cycles = cycleCount() - started;
+  timing->calls++;
+  timing->totalCycles += cycles;
+  timing->maxCycles = max(timing->maxCycles, cycles);
+}
+
+void beginInstrumentation(void);
+void useTimingRecords(section_timing_t *, section_timing_t *);
+void recordHistogram(histogram_t *, const uint32_t);
+void recordPassStart(void);
+void recordPassEnd(void);
+void recordPlannedWake(const unsigned long);
+void recordPumpRun(pump_usage_t *, const unsigned long);
+void dumpInstrumentation(void);
+void printPumpUsage(const char *, const pump_usage_t *);
+
+#endif
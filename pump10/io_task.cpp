@@ -0,0 +1,88 @@
+/**
+ * methods to run bus work for timer callbacks, and to share the buses
+ */
+#include "io_task.h"
+#include "external_adc.h"
+#include "pwm_expander.h"
+
+SemaphoreHandle_t busLock = NULL;
+TaskHandle_t ioTaskHandle = NULL;
+volatile uint32_t ioWork = 0; // io_work_t bits requested, and not started yet
+portMUX_TYPE ioWorkLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * do the bus work requested by timer callbacks
+ *
+ * @param arg not used
+ */
+void ioTask(void * arg)
+{
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    portENTER_CRITICAL(&ioWorkLock);
+    uint32_t work = ioWork;
+    ioWork = 0;
+    portEXIT_CRITICAL(&ioWorkLock);
+    if (work & IO_SCAN_STEP) {
+      scanStep();
+    }
+    if (work & IO_PWM_FLUSH) {
+      flushPwmExpanders();
+    }
+  }
+} // end ioTask()
+
+/**
+ * create the bus lock and the I/O task
+ *
+ * @return true when both are available
+ */
+bool beginIoTask()
+{
+  if (ioTaskHandle != NULL) {
+    return true;
+  }
+  busLock = xSemaphoreCreateMutex();
+  if (busLock == NULL) {
+    return false;
+  }
+  return xTaskCreate(ioTask, "bus io", 2048, NULL, 10, &ioTaskHandle) == pdPASS;
+} // end beginIoTask()
+
+/**
+ * ask the I/O task to do some work; safe in a timer callback
+ *
+ * Requests made before the task gets to them are done once.
+ *
+ * @param[in] work io_work_t bits
+ */
+void requestIo(const uint32_t work)
+{
+  if (ioTaskHandle == NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&ioWorkLock);
+  ioWork |= work;
+  portEXIT_CRITICAL(&ioWorkLock);
+  xTaskNotifyGive(ioTaskHandle);
+} // end requestIo()
+
+/**
+ * wait for, and take, the I2C bus and ADC1
+ */
+void lockBus()
+{
+  if (busLock != NULL) {
+    xSemaphoreTake(busLock, portMAX_DELAY);
+  }
+} // end lockBus()
+
+/**
+ * let other tasks use the I2C bus and ADC1
+ */
+void unlockBus()
+{
+  if (busLock != NULL) {
+    xSemaphoreGive(busLock);
+  }
+} // end unlockBus()
@@ -0,0 +1,31 @@
+#ifndef io_task_h
+#define io_task_h
+
+#include <Arduino.h>
+
+/**
+ * methods to run bus work requested from timer callbacks in its own task, and
+ * to share the I2C bus and ADC1 between tasks
+ *
+ * All esp_timer callbacks run in one high priority task, so a callback that
+ * waits for an I2C transaction delays every other timer, including the pump
+ * stop timers. Callbacks only set a work bit, and notify the I/O task, which
+ * does the work. Every I2C transaction, and every analogRead() of a moisture
+ * sensor, is done while holding the bus lock, so the control loop and the
+ * I/O task never use a bus at the same time.
+ */
+
+/// work the I/O task can be asked to do; combined as bits
+enum io_work_t {
+  /// advance the external sensor scan
+  IO_SCAN_STEP = 1,
+  /// send pending PWM expander duty changes
+  IO_PWM_FLUSH = 2
+};
+
+bool beginIoTask(void);
+void requestIo(const uint32_t);
+void lockBus(void);
+void unlockBus(void);
+
+#endif
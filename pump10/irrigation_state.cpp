@@ -0,0 +1,465 @@
+/**
+ * irrigation state machine transition code
+ *
+ * This contains most of the processing for handling sensor based plant
+ * irrigation. It should probably be turned into a class that does the complete
+ * job. Currently, the top level state processing `switch` statement is not
+ * included.
+ *
+ * «class_instance».next()
+ * «class_instance».OnTransitionOut(callback)
+ */
+
+/**
+ * utility methods for working with individual irrigation zone state machines
+ */
+
+#include "irrigation_state.h"
+#include "reservoir.h"
+#include "power_coordinator.h"
+
+// milliamps of the shared power supply currently reserved by running pumps
+unsigned int powerReserved = 0;
+
+// fraction of the predicted time until too dry to wait before reading again
+const float PREDICTION_FRACTION = 0.5;
+// weight given to the newest measured drying rate when updating the estimate
+const float DRYING_SMOOTHING = 0.3;
+// moisture increase that is not treated as sensor noise (percentage points)
+const float MOISTURE_NOISE_BAND = 2.0;
+const unsigned long MILLIS_PER_HOUR = 3600000;
+
+/**
+ * reserve part of the globally shared power supply
+ *
+ * With several boards on one supply, the site lease must also cover it.
+ *
+ * @param[in] milliamps peak current needed
+ * @return true when the current fits within POWER_BUDGET
+ */
+bool takePowerToken(const unsigned int milliamps)
+{
+  // better to use mutex or singleton class instance
+  // for now, use a simple global total THAT NO ONE ELSE SHOULD TOUCH
+  bool gotToken = false;
+  // portENTER_CRITICAL();
+  if (powerReserved + milliamps <= POWER_BUDGET &&
+      sitePowerAvailable(powerReserved + milliamps)) {
+    powerReserved += milliamps;
+    gotToken = true;
+  }
+  // portEXIT_CRITICAL();
+  return gotToken;
+} // end takePowerToken()
+
+/**
+ * done with part of the globally shared power supply
+ *
+ * @param[in] milliamps current reserved by the matching takePowerToken()
+ */
+void releasePowerToken(const unsigned int milliamps)
+{
+  powerReserved -= min(milliamps, powerReserved);
+} // end releasePowerToken()
+
+/**
+ * reserve everything a zone needs to deliver water
+ *
+ * A zone with its own pump needs power for the pump. A manifold zone needs the
+ * manifold valve resource, which includes power for the shared pump.
+ *
+ * @param[in,out] context irrigation state machine context
+ * @return true when all resources are reserved
+ */
+bool haveAllResources(irrigation_context_t * context)
+{
+  if (context->zone.valve.manifold != NO_MANIFOLD) {
+    return takeManifoldValve(context->zone.valve);
+  }
+  unsigned int peakCurrent = pumpPeakCurrent(context->zone.pump);
+  if (!takePowerToken(peakCurrent)) {
+    return false;
+  }
+  context->reserved_power = peakCurrent;
+  return true;
+} // end haveAllResources()
+
+/**
+ * release everything reserved by haveAllResources()
+ *
+ * @param[in,out] context irrigation state machine context
+ */
+void releaseAllResources(irrigation_context_t * context)
+{
+  if (context->zone.valve.manifold != NO_MANIFOLD) {
+    releaseManifoldValve(context->zone.valve);
+    return;
+  }
+  releasePowerToken(context->reserved_power);
+  context->reserved_power = 0;
+} // end releaseAllResources()
+
+/**
+ * get the flow meter that measures water delivered to a zone
+ *
+ * @param[in] context irrigation state machine context
+ * @return flow meter configuration for the zone's own or manifold pump
+ */
+flow_meter_t deliveryFlowMeter(const irrigation_context_t * context)
+{
+  if (context->zone.valve.manifold != NO_MANIFOLD) {
+    return manifoldPump(context->zone.valve)->flow;
+  }
+  return context->zone.pump.flow;
+} // end deliveryFlowMeter()
+
+/**
+ * start delivering water to a zone that has all of its resources
+ *
+ * The timer ends the delivery after the watering time. With a flow meter and
+ * a watering volume, the flow meter normally ends it first.
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] watering_time milliseconds to deliver water
+ */
+void startDelivery(irrigation_context_t * context, const unsigned long watering_time)
+{
+  if (context->zone.valve.manifold != NO_MANIFOLD) {
+    context->timed_delivery = startManifoldDelivery(&context->zone.valve,
+      &context->pump_timer, watering_time);
+    armFlowMeter(deliveryFlowMeter(context), context->zone.rules.wateringVolume,
+      valveTimerExpired, &context->zone.valve);
+    return;
+  }
+  context->timed_delivery = startPumpFor(&context->zone.pump,
+    &context->pump_timer, watering_time);
+  armFlowMeter(deliveryFlowMeter(context), context->zone.rules.wateringVolume,
+    pumpTimerExpired, &context->zone.pump);
+} // end startDelivery()
+
+/**
+ * end a delivery before its planned time, on this pass
+ *
+ * Used when a resource is lost while pumping. The stop timer is cancelled, so
+ * it can not stop a later delivery (or a shared pump that another zone is now
+ * using), and only the time actually pumped is counted.
+ *
+ * @param[in,out] context irrigation state machine context; DELIVERING_WATER
+ * @param[in] timeTick reference time point for state processing
+ */
+void endDeliveryNow(irrigation_context_t * context, const smart_time_t timeTick)
+{
+  cancelPumpTimer(context->pump_timer);
+  context->timed_delivery = false;
+  context->target_time = timeTick; // whenDeliveringWater finishes it
+} // end endDeliveryNow()
+
+/**
+ * include a new moisture reading in the drying rate estimate
+ *
+ * The rate is only measured over windows of at least DRYING_RATE_WINDOW, so
+ * that sensor noise between closely spaced readings does not swamp the actual
+ * drying. A moisture increase (watering, rain) starts a new window.
+ *
+ * @param[in,out] model drying rate data for the zone
+ * @param[in] moisture current soil moisture percentage
+ * @param[in] timeTick time of the moisture reading
+ */
+void updateDryingModel(drying_model_t * model, const float moisture,
+  const smart_time_t timeTick)
+{
+  if (smartTimeCompare(model->baseTime, NULL_TIME) == 0 ||
+      moisture > model->baseMoisture + MOISTURE_NOISE_BAND) {
+    model->baseMoisture = moisture;
+    model->baseTime = timeTick;
+    return;
+  }
+  unsigned long elapsed = smartDeltaMillis(model->baseTime, timeTick);
+  if (elapsed < DRYING_RATE_WINDOW) {
+    return; // keep collecting
+  }
+  float loss = (model->baseMoisture - moisture) * MILLIS_PER_HOUR / elapsed;
+  if (model->samples == 0) {
+    model->lossPerHour = loss;
+  } else {
+    model->lossPerHour += DRYING_SMOOTHING * (loss - model->lossPerHour);
+  }
+  model->samples++;
+  model->baseMoisture = moisture;
+  model->baseTime = timeTick;
+} // end updateDryingModel()
+
+/**
+ * determine how long to wait before the next moisture reading is needed
+ *
+ * Waits for a fraction of the predicted time until the moisture drops to the
+ * trigger level. Close to the trigger level that is SAMPLE_INTERVAL_MIN, so
+ * dry soil is detected as quickly as when reading on every pass.
+ *
+ * @param[in] model drying rate data for the zone
+ * @param[in] moisture current soil moisture percentage
+ * @param[in] threshold moisture percentage that triggers watering
+ * @return milliseconds until the next reading
+ */
+unsigned long nextReadingDelay(const drying_model_t * model,
+  const float moisture, const float threshold)
+{
+  if (model->samples == 0) {
+    return SAMPLE_INTERVAL_MIN; // no prediction yet
+  }
+  if (model->lossPerHour <= 0) {
+    return SAMPLE_INTERVAL_MAX; // not drying out
+  }
+  float wait = (moisture - threshold) / model->lossPerHour * MILLIS_PER_HOUR *
+    PREDICTION_FRACTION;
+  if (wait >= SAMPLE_INTERVAL_MAX) {
+    return SAMPLE_INTERVAL_MAX;
+  }
+  if (wait <= SAMPLE_INTERVAL_MIN) {
+    return SAMPLE_INTERVAL_MIN;
+  }
+  return (unsigned long)wait;
+} // end nextReadingDelay()
+
+/**
+ * check if a zone's state machine will use a sensor reading on this pass
+ *
+ * Zones waiting for resources only need a reading once the resources are
+ * reserved, so they read on demand instead.
+ *
+ * @param[in] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ * @return true when the moisture is needed
+ */
+bool readingDue(const irrigation_context_t * context, const smart_time_t timeTick)
+{
+  if (context->state != MOISTURE_GOOD && context->state != SOAKING_IN) {
+    return false;
+  }
+  return smartTimeCompare(timeTick, context->target_time) >= 0;
+} // end readingDue()
+
+/**
+ * fill the reading cache for every zone that needs a reading on this pass
+ *
+ * One batched pass over the sensors, after the external sensor scan has been
+ * started. Onboard sensors are read first, giving the scan time to collect
+ * the external readings.
+ *
+ * @param[in,out] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick reference time point for state processing
+ */
+void refreshSensorCache(irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  for (int external = 0; external < 2; external++) {
+    for (size_t i = 0; i < count; i++) {
+      moisture_sensor_t sensor = contexts[i].zone.sensor;
+      if ((sensor.device != ONBOARD_ADC) == (external != 0) &&
+          readingDue(&contexts[i], timeTick)) {
+        cachedMoisture(sensor, &contexts[i].reading, timeTick);
+      }
+    }
+  }
+} // end refreshSensorCache()
+
+/**
+ * process when the state is MOISTURE_GOOD
+ *
+ * The latest information is that the soil moisture is within acceptable limits
+ * Collect new sensor readings when the drying prediction says one is needed,
+ * and transistion to new state if needed
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ */
+void whenMoistureGood(irrigation_context_t * context, smart_time_t timeTick)
+{
+  if (smartTimeCompare(timeTick, context->target_time) < 0) {
+    return; // not time for another reading yet
+  }
+  float moisture = cachedMoisture(context->zone.sensor, &context->reading, timeTick);
+  updateDryingModel(&context->drying, moisture, timeTick);
+  unsigned long watering_time = waterNeeded(&context->zone, &context->response,
+    moisture);
+  if (watering_time > 0 && !reservoirAvailable(context->zone.reservoir)) {
+    // suspended until the reservoir is refilled
+    context->target_time = smartOffsetMillis(timeTick, RESERVOIR_READING_INTERVAL);
+    return;
+  }
+  if (watering_time > 0 &&
+      !wateringAllowed(context->zone.schedule, &context->window, timeTick)) {
+    // outside of the watering windows; read again when the next one opens
+    context->target_time = context->window.nextChange;
+    return;
+  }
+  if (watering_time > 0) {
+    context->state = RESERVE_RESOURCES;
+    joinManifoldQueue(context->zone.valve);
+    context->gone_dry_time = timeTick;
+    context->target_time = smartOffsetMillis(timeTick, RESOURCE_WAIT_TIMEOUT);
+    return;
+  }
+  context->target_time = smartOffsetMillis(timeTick, nextReadingDelay(
+    &context->drying, moisture, context->zone.rules.moisturePercentage));
+} // end whenMoistureGood()
+
+/**
+ * process when the state is RESERVE_RESOURCES
+ *
+ * Wait until all needed resources have been reserved, then start delivering
+ * water. Delivery cancelled if no longer needed by the time the reservations
+ * have succeeded, if the reservoir has run low, or if the watering window has
+ * closed. If reservations fail for
+ * too long, temporarily switch states to trigger logging and/or notifications
+ *
+ * A manifold zone that finds the valve in use is staged behind it. The valve
+ * is then handed over without stopping the shared pump, and the zone picks up
+ * the delivery that was started for it.
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ */
+void whenReserveResources(irrigation_context_t * context, smart_time_t timeTick)
+{
+  manifold_handoff_t handoff;
+  if (takeManifoldHandoff(context->zone.valve, &handoff)) {
+    // the previous zone's stop timer already opened the valve, and started ours
+    context->state = DELIVERING_WATER;
+    context->timed_delivery = handoff.timed;
+    context->delivery_started = handoff.started;
+    context->target_time = smartOffsetMillis(handoff.started, handoff.duration);
+    if (!reservoirAvailable(context->zone.reservoir)) {
+      endDeliveryNow(context, timeTick);
+    }
+    return;
+  }
+  if (manifoldStaged(context->zone.valve)) {
+    return; // committed: waiting for the valve handoff
+  }
+  if (!reservoirAvailable(context->zone.reservoir)) {
+    // stop waiting; suspended until the reservoir is refilled
+    leaveManifoldQueue(context->zone.valve);
+    context->state = MOISTURE_GOOD;
+    context->target_time = smartOffsetMillis(timeTick, RESERVOIR_READING_INTERVAL);
+    return;
+  }
+  if (!wateringAllowed(context->zone.schedule, &context->window, timeTick)) {
+    // the watering window closed while waiting
+    leaveManifoldQueue(context->zone.valve);
+    context->state = MOISTURE_GOOD;
+    context->target_time = context->window.nextChange;
+    return;
+  }
+  if (haveAllResources(context)) {
+    // Safe to start pumping water
+    // recheck amount needed, in case resources have been blocked for awhile
+    unsigned long watering_time = waterNeeded(&context->zone, &context->response,
+      cachedMoisture(context->zone.sensor, &context->reading, timeTick));
+    if (watering_time > 0) {
+      context->state = DELIVERING_WATER;
+      startDelivery(context, watering_time);
+      context->delivery_started = timeTick;
+      context->target_time = smartOffsetMillis(timeTick, watering_time);
+      return;
+    }
+    // By the time got access to all needed resources, no water actually needed
+    releaseAllResources(context);
+    context->state = MOISTURE_GOOD;
+    context->target_time = timeTick; // resume normal sensor readings
+    return;
+  }
+  if (context->zone.valve.manifold != NO_MANIFOLD) {
+    // queue behind the zone using the valve, so the shared pump keeps running
+    unsigned long watering_time = waterNeeded(&context->zone, &context->response,
+      cachedMoisture(context->zone.sensor, &context->reading, timeTick));
+    if (watering_time > 0 && stageManifoldDelivery(&context->zone.valve,
+        &context->pump_timer, watering_time)) {
+      return;
+    }
+  }
+
+  if (smartTimeCompare(timeTick, context->target_time) >= 0) {
+    // PROBLEM: somebody has not released resources
+    // Or watering has been configure to run for a long time
+    context->state = RESOURCE_LOCK_TIMEOUT;
+  }
+} // end whenReserveResources()
+
+/**
+ * process when the state is RESOURCE_LOCK_TIMEOUT
+ *
+ * This is a transient state. It immediately transitions (back) to
+ * RESERVE_RESOURCES. It exists to provide a trigger for external
+ * logging and notifications.
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ */
+void whenResourceTimeout(irrigation_context_t * context, smart_time_t timeTick)
+{
+  // set when to report again if still not available
+  context->target_time = smartOffsetMillis(timeTick, RESOURCE_WAIT_TIMEOUT);
+  context->state = RESERVE_RESOURCES;
+  // Nothing to do: the state transition itself triggers external processing
+} // end whenResourceTimeout()
+
+/**
+ * process when the state is DELIVERING_WATER
+ *
+ * The pump is running. Wait until enough water has been delivered. Normally
+ * the pump timer (or flow meter) has already stopped the pump, or closed the
+ * valve, on time.
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ */
+void whenDeliveringWater(irrigation_context_t * context, smart_time_t timeTick)
+{
+  flow_meter_t meter = deliveryFlowMeter(context);
+  bool volumeDelivered = flowTargetReached(meter);
+  if (volumeDelivered || smartTimeCompare(timeTick, context->target_time) >= 0) {
+    // Water has been delivered long enough (or enough water) for now
+    if (context->zone.valve.manifold == NO_MANIFOLD) {
+      stopPump(context->zone.pump);
+    }
+    releaseAllResources(context); // not using power (or the valve) any longer
+    cancelPumpTimer(context->pump_timer); // when the delivery ended early
+    // only count the time actually pumped: until the flow meter or the timer
+    // stopped the pump, or until now when this pass stops it
+    smart_time_t stopTime = timeTick;
+    if (volumeDelivered) {
+      stopTime = { timeTick.epoch, flowStopMillis(meter) };
+    }
+    if (context->timed_delivery && smartTimeCompare(context->target_time, stopTime) < 0) {
+      stopTime = context->target_time;
+    }
+    context->response.deliveredMillis = smartDeltaMillis(context->delivery_started, stopTime);
+    disarmFlowMeter(meter); // also when the time limit was reached first
+    recordPumpRun(&context->usage, context->response.deliveredMillis);
+    // Configure interval where soil moisture is not checked
+    context->target_time = smartOffsetMillis(timeTick, context->zone.rules.soakingInterval);
+    context->state = SOAKING_IN;
+  }
+} // end whenDeliveringWater()
+
+/**
+ * process when the state is SOAKING_IN
+ *
+ * Water was just delivered. Wait for it to soak in, so that the moisture
+ * readings will be (reasonably) accurate
+ *
+ * @param[in,out] context irrigation state machine context
+ * @param[in] timeTick reference time point for state processing
+ */
+void whenSoakingIn(irrigation_context_t * context, smart_time_t timeTick)
+{
+  if (smartTimeCompare(timeTick, context->target_time) >= 0) {
+    // measure how much the watering raised the soil moisture
+    learnMoistureResponse(&context->response,
+      cachedMoisture(context->zone.sensor, &context->reading, timeTick));
+    // Might not actually be `good`, but start normal checking again
+    context->state = MOISTURE_GOOD;
+  }
+} // end whenSoakingIn()
@@ -0,0 +1,113 @@
+#ifndef irrigation_state_h
+#define irrigation_state_h
+
+#include <Arduino.h>
+#include "smart_time.h"
+#include "watering_management.h"
+#include "instrumentation.h"
+#include "valve_manifold.h"
+#include "flow_meter.h"
+
+/**
+ * watering_management state machine transition code
+ *
+ * This contains most of the processing for handling sensor based plant
+ * irrigation. It should probably be turned into a class that does the complete
+ * job. Currently, the top level state processing `switch` statement is not
+ * included, allowing it to easily access resources external to the main
+ * irrigation state code.
+ */
+
+/**
+ * data structures and utility methods for working with irrigation state
+ * machines
+ */
+
+/// watering state machine states
+enum irrigation_state_t {
+  /// ignore sensors and never water
+  ZONE_DISABLED = 0,
+  /// sensors show acceptable moisture level
+  MOISTURE_GOOD,
+  /// too dry, reserve resources needed to irrigate
+  RESERVE_RESOURCES,
+  /// irrigation resources locked too long
+  RESOURCE_LOCK_TIMEOUT,
+  /// watering is in progress
+  DELIVERING_WATER,
+  /// watering finished, but ignoring sensors
+  SOAKING_IN
+};
+
+/**
+ * learned soil drying rate
+ *
+ * Used to predict when a zone will become too dry, so that sensor readings can
+ * be spread out while the moisture is well above the trigger level.
+ */
+struct drying_model_t {
+  /// estimated moisture percentage lost per hour
+  float lossPerHour;
+  /// number of drying rate measurements included in the estimate
+  unsigned int samples;
+  /// moisture percentage at the start of the current measurement window
+  float baseMoisture;
+  /// time at the start of the current measurement window
+  smart_time_t baseTime;
+};
+
+// nothing learned yet about how fast a zone dries out
+const struct drying_model_t UNKNOWN_DRYING = { 0, 0, 0, NULL_TIME };
+
+struct irrigation_context_t {
+  irrigation_state_t state;
+  smart_time_t gone_dry_time;
+  /// time of the next state machine action. For MOISTURE_GOOD, that is the
+  /// next sensor reading
+  smart_time_t target_time;
+  watering_zone_t zone;
+  moisture_response_t response;
+  drying_model_t drying;
+  /// latest moisture sensor reading
+  sensor_cache_t reading;
+  /// whether the zone's watering window is open, and until when
+  window_state_t window;
+  /// one-shot timer that stops the pump (or closes the valve) at the end of a
+  /// delivery
+  esp_timer_handle_t pump_timer;
+  /// true when the pump timer is stopping the current delivery
+  bool timed_delivery;
+  /// time tick when the current delivery started
+  smart_time_t delivery_started;
+  /// milliamps of the shared power supply held by this zone. Manifold zones
+  /// share the power held by the manifold
+  unsigned int reserved_power;
+  /// water deliveries to the zone, and how long they ran
+  pump_usage_t usage;
+};
+
+extern unsigned int powerReserved;
+extern const unsigned int POWER_BUDGET;
+extern const unsigned long RESOURCE_WAIT_TIMEOUT;
+extern const unsigned long DRYING_RATE_WINDOW;
+extern const unsigned long SAMPLE_INTERVAL_MIN;
+extern const unsigned long SAMPLE_INTERVAL_MAX;
+
+bool takePowerToken(const unsigned int);
+void releasePowerToken(const unsigned int);
+bool readingDue(const irrigation_context_t *, const smart_time_t);
+void refreshSensorCache(irrigation_context_t *, const size_t, const smart_time_t);
+bool haveAllResources(irrigation_context_t *);
+void releaseAllResources(irrigation_context_t *);
+flow_meter_t deliveryFlowMeter(const irrigation_context_t *);
+void startDelivery(irrigation_context_t *, const unsigned long);
+void endDeliveryNow(irrigation_context_t *, const smart_time_t);
+void updateDryingModel(drying_model_t *, const float, const smart_time_t);
+unsigned long nextReadingDelay(const drying_model_t *, const float, const float);
+void whenMoistureGood(irrigation_context_t *, smart_time_t);
+void whenReserveResources(irrigation_context_t *, smart_time_t);
+void whenResourceTimeout(irrigation_context_t *, smart_time_t);
+void whenDeliveringWater(irrigation_context_t *, smart_time_t);
+void whenSoakingIn(irrigation_context_t *, smart_time_t);
+
+#endif
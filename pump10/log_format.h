@@ -0,0 +1,44 @@
+#ifndef log_format_h
+#define log_format_h
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+/**
+ * a fixed size buffer to build log lines in, without allocating
+ *
+ * Formats are checked against their arguments by the compiler (-Wformat), the
+ * same as for printf, so a format needs to be a string literal at the call.
+ * Text that does not fit is cut off; the line always stays null terminated.
+ */
+
+const size_t LOG_LINE_SIZE = 160;
+
+template <size_t SIZE>
+struct log_line_t {
+  char text[SIZE];
+  size_t length;
+
+  log_line_t() : length(0) { text[0] = '\0'; }
+
+  void append(const char * format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    va_list args;
+    va_start(args, format);
+    appendList(format, args);
+    va_end(args);
+  }
+
+  void appendList(const char * format, va_list args) __attribute__((format(printf, 2, 0)))
+  {
+    if (length >= SIZE - 1) {
+      return; // already full
+    }
+    int added = vsnprintf(text + length, SIZE - length, format, args);
+    if (added > 0) {
+      length = min(length + (size_t)added, SIZE - 1);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,186 @@
+/**
+ * methods to update the metrics registry, and export it as Prometheus text or
+ * binary frames
+ */
+#include "metrics.h"
+
+const metric_family_t METRIC_FAMILY[METRIC_FAMILIES] = {
+  { "irrigation_zone_moisture_percent", "Latest soil moisture reading", METRIC_GAUGE, true },
+  { "irrigation_zone_state", "Irrigation state machine state", METRIC_GAUGE, true },
+  { "irrigation_zone_state_seconds", "Time in the current state", METRIC_GAUGE, true },
+  { "irrigation_zone_pump_on_seconds_total", "Time spent delivering water", METRIC_COUNTER, true },
+  { "irrigation_zone_deliveries_total", "Water deliveries", METRIC_COUNTER, true },
+  { "irrigation_zone_resource_waits_total", "Resource wait timeouts", METRIC_COUNTER, true },
+  { "irrigation_power_reserved_milliamps", "Pump power currently reserved", METRIC_GAUGE, false }
+};
+
+metric_registry_t metricRegistry = {};
+portMUX_TYPE metricsLock = portMUX_INITIALIZER_UNLOCKED;
+bool metricsStarted = false;
+irrigation_state_t lastState[MAX_METRIC_ZONES];
+smart_time_t stateSince[MAX_METRIC_ZONES];
+unsigned long resourceWaits[MAX_METRIC_ZONES];
+
+/**
+ * refresh the registry from the zone contexts
+ *
+ * Called once per pass, after the state machines.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ */
+void updateMetrics(const irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  if (!metricsStarted) {
+    metricsStarted = true;
+    for (size_t i = 0; i < MAX_METRIC_ZONES; i++) {
+      lastState[i] = ZONE_DISABLED;
+      stateSince[i] = timeTick;
+      resourceWaits[i] = 0;
+    }
+  }
+  size_t zones = min(count, MAX_METRIC_ZONES);
+  for (size_t i = 0; i < zones; i++) {
+    const irrigation_context_t * context = &contexts[i];
+    if (context->state != lastState[i]) {
+      lastState[i] = context->state;
+      stateSince[i] = timeTick;
+      if (context->state == RESOURCE_LOCK_TIMEOUT) {
+        resourceWaits[i]++;
+      }
+    }
+  }
+  portENTER_CRITICAL(&metricsLock);
+  metricRegistry.zones = zones;
+  for (size_t i = 0; i < zones; i++) {
+    const irrigation_context_t * context = &contexts[i];
+    metricRegistry.enabled[i] = context->state != ZONE_DISABLED;
+    strncpy(metricRegistry.names[i], context->zone.name.c_str(), METRIC_NAME_SIZE - 1);
+    metricRegistry.names[i][METRIC_NAME_SIZE - 1] = '\0';
+    metricRegistry.slots[METRIC_MOISTURE][i] = context->reading.moisture;
+    metricRegistry.slots[METRIC_STATE][i] = context->state;
+    metricRegistry.slots[METRIC_STATE_SECONDS][i] = smartDeltaMillis(stateSince[i], timeTick) / 1000.0;
+    metricRegistry.slots[METRIC_PUMP_ON_SECONDS][i] = context->usage.onMillis / 1000.0;
+    metricRegistry.slots[METRIC_DELIVERIES][i] = context->usage.starts;
+    metricRegistry.slots[METRIC_RESOURCE_WAITS][i] = resourceWaits[i];
+  }
+  metricRegistry.slots[METRIC_POWER_RESERVED][0] = powerReserved;
+  portEXIT_CRITICAL(&metricsLock);
+} // end updateMetrics()
+
+/**
+ * take a consistent copy of the registry
+ *
+ * Exports run in other tasks (http server, console), and take their time
+ * sending; the copy keeps the lock short.
+ *
+ * @param[out] copy the registry
+ */
+void copyMetrics(metric_registry_t * copy)
+{
+  portENTER_CRITICAL(&metricsLock);
+  *copy = metricRegistry;
+  portEXIT_CRITICAL(&metricsLock);
+} // end copyMetrics()
+
+/**
+ * render the registry as Prometheus exposition text, one line at a time
+ *
+ * @param[in] sink receives each line
+ * @param[in] arg passed to the sink
+ * @return false when the sink stopped the rendering
+ */
+bool renderPrometheus(metric_sink_t sink, void * arg)
+{
+  char line[160];
+  metric_registry_t registry;
+  copyMetrics(&registry);
+  for (size_t f = 0; f < METRIC_FAMILIES; f++) {
+    const metric_family_t * family = &METRIC_FAMILY[f];
+    int length = snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n",
+      family->name, family->help, family->name,
+      family->type == METRIC_COUNTER ? "counter" : "gauge");
+    if (!sink(line, length, arg)) {
+      return false;
+    }
+    if (!family->perZone) {
+      length = snprintf(line, sizeof(line), "%s %g\n", family->name, registry.slots[f][0]);
+      if (!sink(line, length, arg)) {
+        return false;
+      }
+      continue;
+    }
+    for (size_t i = 0; i < registry.zones; i++) {
+      if (!registry.enabled[i]) {
+        continue;
+      }
+      length = snprintf(line, sizeof(line), "%s{zone=\"%u\",name=\"%s\"} %g\n",
+        family->name, (unsigned int)(i + 1), registry.names[i], registry.slots[f][i]);
+      if (!sink(line, length, arg)) {
+        return false;
+      }
+    }
+  }
+  return true;
+} // end renderPrometheus()
+
+/**
+ * update a CRC-16/CCITT-FALSE with more bytes
+ *
+ * @param[in] crc CRC so far; 0xFFFF to start
+ * @param[in] data bytes to add
+ * @param[in] length number of bytes
+ * @return updated CRC
+ */
+uint16_t crc16(uint16_t crc, const uint8_t * data, const size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+} // end crc16()
+
+/**
+ * write the registry to the console as a binary frame, one record at a time
+ *
+ * For units without a network connection.
+ */
+void writeMetricFrame()
+{
+  metric_registry_t registry;
+  copyMetrics(&registry);
+  uint8_t records = 0;
+  for (size_t f = 0; f < METRIC_FAMILIES; f++) {
+    if (!METRIC_FAMILY[f].perZone) {
+      records++;
+      continue;
+    }
+    for (size_t i = 0; i < registry.zones; i++) {
+      records += registry.enabled[i];
+    }
+  }
+  uint8_t header[4] = { 0xA5, 0x5A, METRIC_FRAME_VERSION, records };
+  Serial.write(header, sizeof(header));
+  uint16_t crc = crc16(0xFFFF, header + 2, 2);
+  uint8_t record[6];
+  for (size_t f = 0; f < METRIC_FAMILIES; f++) {
+    size_t slots = METRIC_FAMILY[f].perZone ? registry.zones : 1;
+    for (size_t i = 0; i < slots; i++) {
+      if (METRIC_FAMILY[f].perZone && !registry.enabled[i]) {
+        continue;
+      }
+      record[0] = f;
+      record[1] = METRIC_FAMILY[f].perZone ? i + 1 : 0;
+      memcpy(record + 2, &registry.slots[f][i], sizeof(float)); // esp32 is little endian
+      Serial.write(record, sizeof(record));
+      crc = crc16(crc, record, sizeof(record));
+    }
+  }
+  uint8_t trailer[2] = { (uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8) };
+  Serial.write(trailer, sizeof(trailer));
+} // end writeMetricFrame()
@@ -0,0 +1,70 @@
+#ifndef metrics_h
+#define metrics_h
+
+#include <Arduino.h>
+#include "smart_time.h"
+#include "irrigation_state.h"
+
+/**
+ * data structures and methods for a fixed slot metrics registry
+ *
+ * Every metric family has one slot per zone (or a single slot for controller
+ * wide values). The control loop updates the slots once per pass, together
+ * with a copy of the zone names, so the registry never refers to the zone
+ * contexts. Exports take a copy of the registry under a short lock, and
+ * render it one line (or record) at a time through a sink, so no buffer for
+ * the whole export text is ever needed.
+ *
+ * Binary frame, little endian:
+ *   0xA5 0x5A «version» «record count»
+ *   records: «family id» «zone number, 0 for controller» «float32 value»
+ *   CRC-16/CCITT-FALSE of everything after the sync bytes
+ */
+
+enum metric_type_t {
+  METRIC_COUNTER = 1,
+  METRIC_GAUGE
+};
+
+/// ids of the metric families; also the family id in binary frames
+enum metric_id_t {
+  METRIC_MOISTURE = 0,
+  METRIC_STATE,
+  METRIC_STATE_SECONDS,
+  METRIC_PUMP_ON_SECONDS,
+  METRIC_DELIVERIES,
+  METRIC_RESOURCE_WAITS,
+  METRIC_POWER_RESERVED,
+  METRIC_FAMILIES
+};
+
+/// description of a metric family
+struct metric_family_t {
+  const char * name;
+  const char * help;
+  metric_type_t type;
+  /// one slot per zone; otherwise a single controller wide slot
+  bool perZone;
+};
+
+const size_t MAX_METRIC_ZONES = 16;
+const size_t METRIC_NAME_SIZE = 16;
+const uint8_t METRIC_FRAME_VERSION = 1;
+
+/// everything an export needs, owned by the registry
+struct metric_registry_t {
+  float slots[METRIC_FAMILIES][MAX_METRIC_ZONES];
+  char names[MAX_METRIC_ZONES][METRIC_NAME_SIZE];
+  bool enabled[MAX_METRIC_ZONES];
+  size_t zones;
+};
+
+/// receives rendered export text or bytes; returns false to stop rendering
+typedef bool (*metric_sink_t)(const char *, size_t, void *);
+
+void updateMetrics(const irrigation_context_t *, const size_t, const smart_time_t);
+bool renderPrometheus(metric_sink_t, void *);
+void writeMetricFrame(void);
+uint16_t crc16(uint16_t, const uint8_t *, const size_t);
+
+#endif
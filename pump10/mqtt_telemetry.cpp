@@ -0,0 +1,308 @@
+/**
+ * methods to collect telemetry, and publish it to an MQTT broker with store
+ * and forward buffering
+ */
+#include "mqtt_telemetry.h"
+
+const char * TELEMETRY_NAMESPACE = "pump10mq";
+const char * TELEMETRY_TOPIC = "irrigation/" MQTT_CLIENT_ID "/telemetry";
+const moisture_rollup_t EMPTY_ROLLUP = { 0, 0, 0, 0, 0, { 0, 0 }, { 0, 0 } };
+
+WiFiClient mqttNetwork;
+PubSubClient mqtt(mqttNetwork);
+Preferences telemetryStore;
+bool telemetryRunning = false;
+moisture_rollup_t rollups[MAX_ROLLUP_ZONES];
+unsigned long nextEvent = 0; // sequence of the first event not yet published
+smart_time_t windowEnd = NULL_TIME;
+unsigned long lastConnectAttempt = 0;
+unsigned long lastMqttLoop = 0; // millis() when the connection was last served
+bool connectAttempted = false;
+// batches in the flash queue run from queueHead to queueTail - 1
+unsigned long queueHead = 0;
+unsigned long queueTail = 0;
+unsigned long droppedBatches = 0;
+char batch[TELEMETRY_BATCH_SIZE];
+
+/**
+ * set up telemetry publishing, including any batches queued before a reset
+ *
+ * @param[in] timeTick current time reference
+ * @return true when publishing is configured
+ */
+bool beginTelemetry(const smart_time_t timeTick)
+{
+  if (!wifiConfigured() || MQTT_BROKER[0] == '\0') {
+    return false;
+  }
+  for (size_t i = 0; i < MAX_ROLLUP_ZONES; i++) {
+    rollups[i] = EMPTY_ROLLUP;
+  }
+  telemetryStore.begin(TELEMETRY_NAMESPACE, false);
+  queueHead = telemetryStore.getULong("head", 0);
+  queueTail = telemetryStore.getULong("tail", 0);
+  if (telemetryStore.getULong("slots", 0) != TELEMETRY_QUEUE_SLOTS) {
+    // queued with another slot count: the keys do not map to the same batches
+    droppedBatches += queueTail - queueHead;
+    telemetryStore.clear();
+    queueHead = 0;
+    queueTail = 0;
+    telemetryStore.putULong("slots", TELEMETRY_QUEUE_SLOTS);
+  }
+  mqtt.setServer(MQTT_BROKER, MQTT_PORT);
+  mqtt.setBufferSize(TELEMETRY_BATCH_SIZE + 64); // room for the topic and header
+  mqtt.setKeepAlive(MQTT_KEEPALIVE_SECONDS);
+  windowEnd = smartOffsetMillis(timeTick, MQTT_PUBLISH_INTERVAL);
+  telemetryRunning = true;
+  if (queueTail != queueHead) {
+    Serial.printf("LOG: %lu telemetry batches queued from before the restart\n",
+      queueTail - queueHead);
+  }
+  return true;
+} // end beginTelemetry()
+
+/**
+ * get a connection to the broker, without retrying too often
+ *
+ * Connecting blocks for the tcp connection, so attempts are limited to one
+ * every MQTT_RETRY_INTERVAL.
+ *
+ * @return true when connected
+ */
+bool brokerConnected()
+{
+  if (mqtt.connected()) {
+    return true;
+  }
+  if (!wifiConnected() ||
+      (connectAttempted && millis() - lastConnectAttempt < MQTT_RETRY_INTERVAL)) {
+    return false;
+  }
+  connectAttempted = true;
+  lastConnectAttempt = millis();
+  bool connected = MQTT_USER[0] == '\0' ? mqtt.connect(MQTT_CLIENT_ID) :
+    mqtt.connect(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASSWORD);
+  if (!connected) {
+    Serial.printf("LOG: MQTT broker connection failed, state %d\n", mqtt.state());
+  }
+  return connected;
+} // end brokerConnected()
+
+/**
+ * build the flash key for a queue slot
+ *
+ * @param[out] key buffer for the key
+ * @param[in] sequence batch sequence number
+ */
+void slotKey(char * key, const unsigned long sequence)
+{
+  sprintf(key, "b%u", (unsigned int)(sequence % TELEMETRY_QUEUE_SLOTS));
+} // end slotKey()
+
+/**
+ * keep a batch in flash until it can be published
+ *
+ * @param[in] length bytes used in the batch buffer
+ */
+void queueBatch(const size_t length)
+{
+  char key[8];
+  if (queueTail - queueHead >= TELEMETRY_QUEUE_SLOTS) {
+    queueHead++; // drop the oldest
+    droppedBatches++;
+  }
+  slotKey(key, queueTail);
+  if (telemetryStore.putBytes(key, batch, length) != length) {
+    droppedBatches++; // flash full
+    return;
+  }
+  queueTail++;
+  telemetryStore.putULong("tail", queueTail);
+  telemetryStore.putULong("head", queueHead);
+} // end queueBatch()
+
+/**
+ * publish queued batches, oldest first
+ *
+ * Sends at most MQTT_DRAIN_BATCHES per pass, to bound the time taken from the
+ * control loop.
+ */
+void drainQueue()
+{
+  char key[8];
+  size_t sent = 0;
+  while (queueHead != queueTail && sent < MQTT_DRAIN_BATCHES) {
+    slotKey(key, queueHead);
+    size_t length = telemetryStore.getBytes(key, batch, sizeof(batch));
+    if (length > 0 && !mqtt.publish(TELEMETRY_TOPIC, (uint8_t *)batch, length, false)) {
+      break; // try again on the next pass
+    }
+    telemetryStore.remove(key);
+    queueHead++;
+    sent++;
+  }
+  if (sent > 0) {
+    telemetryStore.putULong("head", queueHead);
+  }
+} // end drainQueue()
+
+/**
+ * add a line to the batch, when it fits
+ *
+ * @param[in,out] used bytes used in the batch buffer
+ * @param[in] format printf style format for the line
+ * @return false when the line did not fit
+ */
+bool addLine(size_t * used, const char * format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(batch + *used, sizeof(batch) - *used, format, args);
+  va_end(args);
+  if (length < 0 || *used + length >= sizeof(batch)) {
+    batch[*used] = '\0';
+    return false;
+  }
+  *used += length;
+  return true;
+} // end addLine()
+
+/**
+ * build the batch for the publish window that just ended
+ *
+ * Events that do not fit are left for the next batch.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick end of the window
+ * @return bytes used in the batch buffer
+ */
+size_t buildBatch(const irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  size_t used = 0;
+  addLine(&used, "t,%lu,%lu,%u\n", timeTick.epoch, timeTick.millis, TELEMETRY_FORMAT);
+  if (droppedBatches > 0 && addLine(&used, "d,%lu\n", droppedBatches)) {
+    droppedBatches = 0;
+  }
+  for (size_t i = 0; i < count && i < MAX_ROLLUP_ZONES; i++) {
+    moisture_rollup_t * rollup = &rollups[i];
+    if (smartTimeCompare(rollup->belowSince, NULL_TIME) != 0) {
+      // still below: count up to the end of the window
+      rollup->belowMillis += smartDeltaMillis(rollup->belowSince, timeTick);
+      rollup->belowSince = timeTick;
+    }
+    if (rollup->readings > 0 || rollup->belowMillis > 0) {
+      addLine(&used, "r,%u,%u,%.1f,%.1f,%.1f,%lu\n", (unsigned int)(i + 1),
+        rollup->readings, rollup->minimum,
+        rollup->readings == 0 ? 0 : rollup->total / rollup->readings,
+        rollup->maximum, rollup->belowMillis);
+      moisture_rollup_t carried = *rollup;
+      *rollup = EMPTY_ROLLUP;
+      rollup->lastRead = carried.lastRead;
+      rollup->belowSince = carried.belowSince;
+    }
+    if (contexts[i].state != ZONE_DISABLED) {
+      addLine(&used, "c,%u,%lu,%lu\n", (unsigned int)(i + 1),
+        contexts[i].usage.starts, contexts[i].usage.onMillis);
+    }
+  }
+  zone_event_t event;
+  unsigned long last = eventCount();
+  for (; nextEvent < last; nextEvent++) {
+    if (!readEvent(nextEvent, &event)) {
+      continue; // overwritten before it could be published
+    }
+    if (!addLine(&used, "e,%lu,%lu,%lu,%u,%u,%.1f\n", nextEvent, event.time.epoch,
+        event.time.millis, event.zone + 1, event.state, event.moisture)) {
+      break;
+    }
+  }
+  return used;
+} // end buildBatch()
+
+/**
+ * add new sensor readings to the rollups, and publish at the end of each window
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ */
+void collectTelemetry(const irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  if (!telemetryRunning) {
+    return;
+  }
+  for (size_t i = 0; i < count && i < MAX_ROLLUP_ZONES; i++) {
+    const sensor_cache_t * reading = &contexts[i].reading;
+    moisture_rollup_t * rollup = &rollups[i];
+    if (smartTimeCompare(reading->readTime, NULL_TIME) == 0 ||
+        smartTimeCompare(reading->readTime, rollup->lastRead) == 0) {
+      continue; // no new reading
+    }
+    rollup->minimum = rollup->readings == 0 ? reading->moisture :
+      min(rollup->minimum, reading->moisture);
+    rollup->maximum = rollup->readings == 0 ? reading->moisture :
+      max(rollup->maximum, reading->moisture);
+    rollup->total += reading->moisture;
+    rollup->readings++;
+    if (smartTimeCompare(rollup->belowSince, NULL_TIME) != 0) {
+      rollup->belowMillis += smartDeltaMillis(rollup->belowSince, reading->readTime);
+    }
+    rollup->belowSince = reading->moisture < contexts[i].zone.rules.moisturePercentage ?
+      reading->readTime : NULL_TIME;
+    rollup->lastRead = reading->readTime;
+  }
+
+  bool connected = brokerConnected();
+  if (connected) {
+    mqtt.loop();
+    lastMqttLoop = millis();
+    drainQueue();
+  }
+  if (smartTimeCompare(timeTick, windowEnd) < 0) {
+    return;
+  }
+  windowEnd = smartOffsetMillis(timeTick, MQTT_PUBLISH_INTERVAL);
+  size_t length = buildBatch(contexts, count, timeTick);
+  if (!connected || queueHead != queueTail ||
+      !mqtt.publish(TELEMETRY_TOPIC, (uint8_t *)batch, length, false)) {
+    queueBatch(length); // keep the order: after anything already queued
+  }
+} // end collectTelemetry()
+
+/**
+ * find how long telemetry can be left alone
+ *
+ * The connection is served at half the keepalive interval, so the ping and its
+ * reply fit in it. A queue is drained on every pass while connected, and
+ * otherwise waits for the next connection attempt.
+ *
+ * @param[in] timeTick current time reference
+ * @return milliseconds until collectTelemetry() is needed; ULONG_MAX when not
+ *   publishing
+ */
+unsigned long nextTelemetry(const smart_time_t timeTick)
+{
+  if (!telemetryRunning) {
+    return ULONG_MAX;
+  }
+  if (smartTimeCompare(timeTick, windowEnd) >= 0) {
+    return 0;
+  }
+  unsigned long wait = smartDeltaMillis(timeTick, windowEnd);
+  bool queued = queueHead != queueTail;
+  if (mqtt.connected()) {
+    if (queued) {
+      return 0;
+    }
+    unsigned long served = timeTick.millis - lastMqttLoop;
+    unsigned long keepalive = MQTT_KEEPALIVE_SECONDS * 500UL;
+    wait = min(wait, served >= keepalive ? 0 : keepalive - served);
+  } else if (queued && connectAttempted) {
+    unsigned long tried = timeTick.millis - lastConnectAttempt;
+    wait = min(wait, tried >= MQTT_RETRY_INTERVAL ? 0 : MQTT_RETRY_INTERVAL - tried);
+  }
+  return wait;
+} // end nextTelemetry()
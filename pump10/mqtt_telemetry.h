@@ -0,0 +1,71 @@
+#ifndef mqtt_telemetry_h
+#define mqtt_telemetry_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <limits.h>
+#include "smart_time.h"
+#include "irrigation_state.h"
+#include "event_log.h"
+#include "wifi_link.h"
+
+/**
+ * data structures and methods to publish telemetry to an MQTT broker
+ *
+ * Everything collected during a publish window is sent as a single batch
+ * message of short text lines:
+ *   t,«epoch»,«millis»,«format version»             end of the window
+ *   e,«sequence»,«epoch»,«millis»,«zone»,«state»,«moisture»   state change
+ *   r,«zone»,«readings»,«minimum»,«average»,«maximum»,«below milliseconds»
+ *                                                   moisture rollup
+ *   c,«zone»,«deliveries»,«delivered milliseconds»           counters
+ *   d,«batches»                  batches dropped from a full queue
+ *
+ * While the broker can not be reached, batches are kept in a bounded queue in
+ * flash (NVS), so they survive resets and deep sleep. The oldest batch is
+ * dropped when the queue is full. Queued batches are sent, oldest first,
+ * before any new ones once the broker is back.
+ *
+ * The board wakes for the end of each window, to serve the connection before
+ * the broker's keepalive runs out, and to drain or retry while batches are
+ * queued.
+ *
+ * Every line has a fixed column count for its type, so a fleet collector can
+ * load each type straight into columns. `below milliseconds` is the time in
+ * the window that the zone's readings were below its watering trigger level.
+ */
+
+const size_t TELEMETRY_BATCH_SIZE = 1024;
+// The default NVS partition is 20 KB, about 16 KB usable, and shared with the
+// checkpoint, calibrations, zone configuration and profiles. 4 full batches
+// take about 4.3 KB of it.
+const size_t TELEMETRY_QUEUE_SLOTS = 4;
+const size_t MAX_ROLLUP_ZONES = 16;
+const uint8_t TELEMETRY_FORMAT = 2;
+
+/// moisture readings for a zone during the current publish window
+struct moisture_rollup_t {
+  unsigned int readings;
+  float minimum;
+  float maximum;
+  float total;
+  /// milliseconds spent below the trigger level
+  unsigned long belowMillis;
+  /// time of the latest reading included
+  smart_time_t lastRead;
+  /// start of the time below the trigger level not counted yet; NULL_TIME
+  /// when the latest reading was not below
+  smart_time_t belowSince;
+};
+
+extern const unsigned long MQTT_PUBLISH_INTERVAL;
+extern const unsigned long MQTT_RETRY_INTERVAL;
+extern const size_t MQTT_DRAIN_BATCHES;
+extern const uint16_t MQTT_KEEPALIVE_SECONDS;
+
+bool beginTelemetry(const smart_time_t);
+void collectTelemetry(const irrigation_context_t *, const size_t, const smart_time_t);
+unsigned long nextTelemetry(const smart_time_t);
+
+#endif
@@ -0,0 +1,475 @@
+/**
+ * methods to lease part of a site wide power budget from an elected leader
+ */
+#include "power_coordinator.h"
+
+const char * COORD_BROADCAST = "255.255.255.255";
+
+WiFiUDP coordinationSocket;
+bool coordinating = false;
+unsigned long coordinatorStarted = 0;
+// millis() each board was last heard from, indexed by board id - 1
+unsigned long peerHeard[MAX_SITE_BOARDS];
+bool peerSeen[MAX_SITE_BOARDS];
+// the latest heartbeat of each board claimed leadership, in peerLeaderTerm
+bool peerLeads[MAX_SITE_BOARDS];
+uint32_t peerLeaderTerm[MAX_SITE_BOARDS];
+uint8_t leader = 0; // 0 until the startup listening period is over
+uint32_t term = 0;
+uint32_t leaderTerm = 0; // term this board started when it became leader
+unsigned long leaderSince = 0;
+unsigned long lastHeartbeat = 0;
+
+// leader state: leases for every board, indexed by board id - 1
+power_lease_t leases[MAX_SITE_BOARDS];
+uint32_t nextToken = 1;
+
+// holder state: the lease this board holds
+unsigned int leasedMilliamps = 0;
+unsigned long leaseValidUntil = 0;
+uint32_t acceptedTerm = 0;
+uint32_t acceptedToken = 0;
+unsigned int requestedMilliamps = 0;
+unsigned long lastRequest = 0;
+unsigned long pendingSince = 0; // first request sent since the latest grant
+bool requestPending = false;
+unsigned long lastWanted = 0; // site power was last asked for
+
+/**
+ * check if a millis() time stamp has been reached
+ *
+ * @param[in] when time stamp
+ * @param[in] now current millis()
+ * @return true when `when` is now, or in the past
+ */
+bool reached(const unsigned long when, const unsigned long now)
+{
+  return (long)(now - when) >= 0;
+} // end reached()
+
+/**
+ * broadcast a coordination message
+ *
+ * @param[in] type kind of message
+ * @param[in] target board the message is for; 0 for everyone
+ * @param[in] milliamps requested or granted current
+ * @param[in] token fencing token of a grant
+ */
+void sendCoordination(const coordination_type_t type, const uint8_t target,
+  const unsigned int milliamps, const uint32_t token)
+{
+  coordination_message_t message = { COORD_MAGIC, (uint8_t)type, SITE_BOARD_ID,
+    target, term, token, (uint16_t)min(milliamps, (unsigned int)UINT16_MAX) };
+  coordinationSocket.beginPacket(COORD_BROADCAST, COORD_PORT);
+  coordinationSocket.write((const uint8_t *)&message, sizeof(message));
+  coordinationSocket.endPacket();
+} // end sendCoordination()
+
+/**
+ * start coordinating with the other boards at the site
+ *
+ * A single board site keeps using only its own POWER_BUDGET.
+ *
+ * @return true when coordination is active
+ */
+bool beginPowerCoordinator()
+{
+  if (SITE_BOARDS < 2 || !wifiConfigured() || SITE_BOARD_ID < 1 ||
+      SITE_BOARD_ID > MAX_SITE_BOARDS) {
+    return false;
+  }
+  for (size_t i = 0; i < MAX_SITE_BOARDS; i++) {
+    peerSeen[i] = false;
+    peerLeads[i] = false;
+    leases[i] = { 0, 0, 0 };
+  }
+  coordinationSocket.begin(COORD_PORT);
+  coordinatorStarted = millis();
+  coordinating = true;
+  return true;
+} // end beginPowerCoordinator()
+
+/**
+ * check if another board has been heard from recently
+ *
+ * @param[in] board board id
+ * @param[in] now current millis()
+ * @return true when the board is live
+ */
+bool peerLive(const uint8_t board, const unsigned long now)
+{
+  return peerSeen[board - 1] && now - peerHeard[board - 1] < COORD_PEER_TIMEOUT;
+} // end peerLive()
+
+/**
+ * count the boards heard from recently, including this one
+ *
+ * @param[in] now current millis()
+ * @return number of live boards
+ */
+size_t liveBoards(const unsigned long now)
+{
+  size_t live = 1;
+  for (size_t i = 0; i < MAX_SITE_BOARDS; i++) {
+    if (i + 1 != SITE_BOARD_ID && peerLive(i + 1, now)) {
+      live++;
+    }
+  }
+  return live;
+} // end liveBoards()
+
+/**
+ * switch to a different leader (or to none, until the next election)
+ *
+ * Nothing from the previous leadership is kept: leases handed out by this
+ * board are forgotten, and the lease this board holds expires now, which ends
+ * deliveries that depend on it. A new leader waits LEASE_MILLIS before
+ * granting, so no lease from before the change can still be in use by then.
+ *
+ * @param[in] board the new leader; 0 for none
+ * @param[in] now current millis()
+ */
+void changeLeader(const uint8_t board, const unsigned long now)
+{
+  for (size_t i = 0; i < MAX_SITE_BOARDS; i++) {
+    leases[i] = { 0, 0, 0 };
+  }
+  if (leasedMilliamps > 0) {
+    leaseValidUntil = now;
+  }
+  requestPending = false;
+  leader = board;
+  leaderSince = now;
+  if (leader == SITE_BOARD_ID) {
+    term++; // a new term; fences grants from the previous leader
+    leaderTerm = term;
+    lastHeartbeat = now - COORD_HEARTBEAT_INTERVAL; // announce right away
+  }
+} // end changeLeader()
+
+/**
+ * check if a board leads in the newest term this board knows about
+ *
+ * @param[in] board board id
+ * @param[in] now current millis()
+ * @return true for this board while it leads, or a live peer claiming the term
+ */
+bool holdsTerm(const uint8_t board, const unsigned long now)
+{
+  if (board == SITE_BOARD_ID) {
+    return leader == SITE_BOARD_ID;
+  }
+  return peerLive(board, now) && peerLeads[board - 1] && peerLeaderTerm[board - 1] == term;
+} // end holdsTerm()
+
+/**
+ * pick the leader
+ *
+ * A leader holding the newest term keeps it while it is live, even when a
+ * lower numbered board (re)appears: taking over would expire every lease it
+ * handed out. Without one, a live board claiming the newest term is followed,
+ * and only then does the lowest numbered live board take over.
+ *
+ * Waits for one peer timeout after startup, to hear from the other boards
+ * first.
+ *
+ * @param[in] now current millis()
+ */
+void electLeader(const unsigned long now)
+{
+  if (now - coordinatorStarted < COORD_PEER_TIMEOUT) {
+    return;
+  }
+  if (leader != 0 && holdsTerm(leader, now)) {
+    return;
+  }
+  uint8_t chosen = 0;
+  for (uint8_t board = 1; board <= MAX_SITE_BOARDS && chosen == 0; board++) {
+    if (board != SITE_BOARD_ID && holdsTerm(board, now)) {
+      chosen = board;
+    }
+  }
+  for (uint8_t board = 1; board < SITE_BOARD_ID && chosen == 0; board++) {
+    if (peerLive(board, now)) {
+      chosen = board;
+    }
+  }
+  if (chosen == 0) {
+    chosen = SITE_BOARD_ID;
+  }
+  if (chosen == leader) {
+    return;
+  }
+  changeLeader(chosen, now);
+  Serial.printf("LOG: power coordination leader is board %u, term %lu\n",
+    leader, (unsigned long)term);
+} // end electLeader()
+
+/**
+ * leader: try to grant a lease
+ *
+ * @param[in] board the requesting board
+ * @param[in] milliamps current the board needs in total
+ * @param[in] now current millis()
+ * @return fencing token of the lease; 0 when not granted
+ */
+uint32_t grantLease(const uint8_t board, const unsigned int milliamps,
+  const unsigned long now)
+{
+  if (leader != SITE_BOARD_ID || term != leaderTerm || now - leaderSince < LEASE_MILLIS ||
+      liveBoards(now) * 2 <= SITE_BOARDS) {
+    return 0; // not a leader that can safely grant
+  }
+  unsigned int others = 0;
+  for (size_t i = 0; i < MAX_SITE_BOARDS; i++) {
+    if (leases[i].milliamps > 0 && reached(leases[i].expiresAt, now)) {
+      leases[i].milliamps = 0; // expired
+    }
+    if (i + 1 != board) {
+      others += leases[i].milliamps;
+    }
+  }
+  if (others + milliamps > SITE_POWER_BUDGET) {
+    return 0;
+  }
+  leases[board - 1] = { milliamps, nextToken++, now + LEASE_MILLIS };
+  return leases[board - 1].token;
+} // end grantLease()
+
+/**
+ * holder: ask the leader for a lease of `milliamps` in total
+ *
+ * The leader is this board: the lease is granted directly.
+ *
+ * @param[in] milliamps current needed in total
+ * @param[in] now current millis()
+ */
+void requestLease(const unsigned int milliamps, const unsigned long now)
+{
+  if (leader == 0) {
+    return; // still listening for the other boards
+  }
+  if (leader == SITE_BOARD_ID) {
+    if (grantLease(SITE_BOARD_ID, milliamps, now) != 0) {
+      leasedMilliamps = milliamps;
+      leaseValidUntil = now + LEASE_MILLIS - LEASE_MARGIN;
+    }
+    return;
+  }
+  if (requestPending && milliamps == requestedMilliamps &&
+      now - lastRequest < COORD_REQUEST_INTERVAL) {
+    return; // waiting for an answer
+  }
+  if (!requestPending) {
+    pendingSince = now;
+    requestPending = true;
+  }
+  requestedMilliamps = milliamps;
+  lastRequest = now;
+  sendCoordination(COORD_REQUEST, leader, milliamps, 0);
+} // end requestLease()
+
+/**
+ * check if the site lease covers the power this board needs
+ *
+ * Asks for a bigger lease when it does not. Without coordination, always true.
+ *
+ * @param[in] milliamps current needed in total by this board
+ * @return true when the pumps can use that much current
+ */
+bool sitePowerAvailable(const unsigned int milliamps)
+{
+  if (!coordinating) {
+    return true;
+  }
+  unsigned long now = millis();
+  lastWanted = now;
+  if (leasedMilliamps >= milliamps && !reached(leaseValidUntil, now)) {
+    return true;
+  }
+  requestLease(milliamps, now);
+  return leasedMilliamps >= milliamps && !reached(leaseValidUntil, now);
+} // end sitePowerAvailable()
+
+/**
+ * hand the site lease back to the leader
+ */
+void releaseLease()
+{
+  if (leader == SITE_BOARD_ID) {
+    leases[SITE_BOARD_ID - 1].milliamps = 0;
+  } else if (leasedMilliamps > 0) {
+    sendCoordination(COORD_RELEASE, leader, 0, 0);
+  }
+  leasedMilliamps = 0;
+  requestPending = false;
+} // end releaseLease()
+
+/**
+ * give up the site lease, and stop asking for new ones
+ *
+ * Used for emergency shutdown.
+ */
+void endSiteLease()
+{
+  if (!coordinating) {
+    return;
+  }
+  releaseLease();
+  coordinating = false;
+} // end endSiteLease()
+
+/**
+ * process a received coordination message
+ *
+ * @param[in] message the message
+ * @param[in] now current millis()
+ */
+void handleCoordination(const coordination_message_t * message, const unsigned long now)
+{
+  if (message->board < 1 || message->board > MAX_SITE_BOARDS ||
+      message->board == SITE_BOARD_ID) {
+    return;
+  }
+  peerSeen[message->board - 1] = true;
+  peerHeard[message->board - 1] = now;
+  if (message->type == COORD_HEARTBEAT) {
+    peerLeads[message->board - 1] = message->target == message->board;
+    peerLeaderTerm[message->board - 1] = message->term;
+    if (leader == SITE_BOARD_ID && message->target == message->board &&
+        message->term == term && message->board < SITE_BOARD_ID) {
+      // two leaders of the same term, after a partition: the lower one stays
+      changeLeader(0, now);
+      Serial.printf("LOG: power coordination board %u stepped down for board %u\n",
+        SITE_BOARD_ID, message->board);
+    }
+  }
+  if (message->term > term) {
+    term = message->term; // a new leader always starts a higher term
+    if (leader == SITE_BOARD_ID) {
+      // another board has started a newer term: this board's leases are stale
+      changeLeader(0, now);
+      Serial.printf("LOG: power coordination board %u stepped down for term %lu\n",
+        SITE_BOARD_ID, (unsigned long)term);
+    }
+  }
+
+  switch (message->type) {
+    case COORD_REQUEST:
+      if (message->target == SITE_BOARD_ID) {
+        uint32_t token = grantLease(message->board, message->milliamps, now);
+        if (token != 0) {
+          sendCoordination(COORD_GRANT, message->board, message->milliamps, token);
+        }
+      }
+      break;
+    case COORD_RELEASE:
+      if (leader == SITE_BOARD_ID) {
+        leases[message->board - 1].milliamps = 0;
+      }
+      break;
+    case COORD_GRANT:
+      // fencing: only the current leader, newest term, and newest token count
+      if (message->target != SITE_BOARD_ID || message->board != leader ||
+          !requestPending || message->term < acceptedTerm ||
+          (message->term == acceptedTerm && message->token <= acceptedToken)) {
+        break;
+      }
+      acceptedTerm = message->term;
+      acceptedToken = message->token;
+      leasedMilliamps = message->milliamps;
+      // counted from the oldest unanswered request, so it ends before the leader's
+      leaseValidUntil = pendingSince + LEASE_MILLIS - LEASE_MARGIN;
+      requestPending = false;
+      break;
+    default:
+      break;
+  }
+} // end handleCoordination()
+
+/**
+ * get the time until the coordination needs the processor again
+ *
+ * Heartbeats keep the other boards from electing a new leader, and a leader
+ * answers requests within COORD_REQUEST_INTERVAL. A board waiting for a grant
+ * resends its request, and a held lease is renewed before it lapses.
+ *
+ * @param[in] now current millis()
+ * @return milliseconds; ULONG_MAX without coordination
+ */
+unsigned long nextCoordination(const unsigned long now)
+{
+  if (!coordinating) {
+    return ULONG_MAX;
+  }
+  unsigned long wait = COORD_HEARTBEAT_INTERVAL - min(now - lastHeartbeat,
+    COORD_HEARTBEAT_INTERVAL);
+  if (leader == 0) {
+    wait = min(wait, COORD_PEER_TIMEOUT - min(now - coordinatorStarted, COORD_PEER_TIMEOUT));
+  } else if (leader == SITE_BOARD_ID) {
+    wait = min(wait, COORD_REQUEST_INTERVAL);
+  }
+  if (requestPending) {
+    wait = min(wait, COORD_REQUEST_INTERVAL - min(now - lastRequest, COORD_REQUEST_INTERVAL));
+  }
+  if (leasedMilliamps > 0) {
+    unsigned long renewAt = leaseValidUntil - LEASE_RENEW_MILLIS;
+    wait = min(wait, reached(renewAt, now) ? 0 : renewAt - now);
+  }
+  return wait;
+} // end nextCoordination()
+
+/**
+ * exchange coordination messages, and keep the site lease matching the power
+ * this board has reserved
+ *
+ * Deliveries are ended when the lease lapses while power is still reserved.
+ *
+ * @param[in,out] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ */
+void coordinatePower(irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  if (!coordinating) {
+    return;
+  }
+  unsigned long now = millis();
+  coordination_message_t message;
+  while (coordinationSocket.parsePacket() > 0) {
+    if (coordinationSocket.read((uint8_t *)&message, sizeof(message)) == sizeof(message) &&
+        message.magic == COORD_MAGIC) {
+      handleCoordination(&message, now);
+    }
+  }
+  electLeader(now);
+  if (now - lastHeartbeat >= COORD_HEARTBEAT_INTERVAL) {
+    lastHeartbeat = now;
+    sendCoordination(COORD_HEARTBEAT, leader, 0, 0);
+  }
+
+  if (powerReserved == 0) {
+    // a new grant waits for the zone that asked for it to take it on its pass
+    if (leasedMilliamps > 0 && now - lastWanted >= COORD_HEARTBEAT_INTERVAL) {
+      releaseLease(); // hand unused power back
+    }
+    return;
+  }
+  if (leasedMilliamps > powerReserved ||
+      reached(leaseValidUntil - LEASE_RENEW_MILLIS, now)) {
+    requestLease(powerReserved, now); // shrink, or renew
+  }
+  if (leasedMilliamps == 0 || !reached(leaseValidUntil, now)) {
+    return;
+  }
+  // lease lapsed: stop pumping now
+  leasedMilliamps = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (contexts[i].state == DELIVERING_WATER) {
+      endDeliveryNow(&contexts[i], timeTick);
+    }
+  }
+  suspendManifolds(); // zones waiting on a manifold stay queued
+  Serial.println("LOG: site power lease lapsed; deliveries ended");
+} // end coordinatePower()
@@ -0,0 +1,91 @@
+#ifndef power_coordinator_h
+#define power_coordinator_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <limits.h>
+#include "smart_time.h"
+#include "irrigation_state.h"
+#include "wifi_link.h"
+
+/**
+ * data structures and methods to share one power supply between several
+ * controller boards, without a central server
+ *
+ * Boards broadcast heartbeats over UDP. The lowest numbered board heard from
+ * recently is the leader, and hands out time limited leases for part of the
+ * site power budget. A board only runs pumps while it holds a lease covering
+ * its reserved power, and renews the lease while they run.
+ *
+ * Safety:
+ * - the leader only grants while it can hear a majority of SITE_BOARDS, so a
+ *   partitioned minority can not grant the same power again
+ * - a new leader waits LEASE_MILLIS before granting, so every lease from the
+ *   previous leader has expired
+ * - lease time is counted by the holder from when it sent the request, so the
+ *   holder always stops before the leader treats the lease as expired
+ * - grants carry the leader's term and a fencing token; grants from an older
+ *   term, or older than the latest one accepted, are ignored
+ * - a leader only grants in the term it started. It steps down when it hears
+ *   a newer term, and every leader change expires the lease this board holds
+ * - a live leader keeps its term: a lower numbered board that comes back
+ *   follows it, instead of taking over and expiring every lease
+ * - the board never waits longer than COORD_HEARTBEAT_INTERVAL between passes
+ *   while coordinating, so a sleeping leader is not voted out
+ * - when a lease lapses, deliveries that depend on it end on the same pass
+ */
+
+const size_t MAX_SITE_BOARDS = 8;
+const uint8_t COORD_MAGIC = 0xC7;
+
+/// kinds of coordination messages
+enum coordination_type_t {
+  /// `target` is the leader the sender follows; itself while leading
+  COORD_HEARTBEAT = 1,
+  /// request, renew, or shrink a lease to `milliamps`
+  COORD_REQUEST,
+  COORD_GRANT,
+  COORD_RELEASE
+};
+
+/// UDP payload; the same layout on every board
+struct __attribute__((packed)) coordination_message_t {
+  uint8_t magic;
+  uint8_t type;
+  /// sending board
+  uint8_t board;
+  /// board a grant is for; 0 for everyone
+  uint8_t target;
+  /// leader term the sender knows about
+  uint32_t term;
+  /// fencing token of a granted lease
+  uint32_t token;
+  uint16_t milliamps;
+};
+
+/// a lease handed out by the leader
+struct power_lease_t {
+  unsigned int milliamps;
+  uint32_t token;
+  /// millis() when the lease ends, unless renewed
+  unsigned long expiresAt;
+};
+
+extern const uint8_t SITE_BOARD_ID;
+extern const size_t SITE_BOARDS;
+extern const unsigned int SITE_POWER_BUDGET;
+extern const uint16_t COORD_PORT;
+extern const unsigned long COORD_HEARTBEAT_INTERVAL;
+extern const unsigned long COORD_PEER_TIMEOUT;
+extern const unsigned long COORD_REQUEST_INTERVAL;
+extern const unsigned long LEASE_MILLIS;
+extern const unsigned long LEASE_RENEW_MILLIS;
+extern const unsigned long LEASE_MARGIN;
+
+bool beginPowerCoordinator(void);
+bool sitePowerAvailable(const unsigned int);
+void coordinatePower(irrigation_context_t *, const size_t, const smart_time_t);
+unsigned long nextCoordination(const unsigned long);
+void endSiteLease(void);
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * methods to sleep between irrigation state machine deadlines, and keep the
+ * state machines going across deep sleep
+ */
+#include "power_management.h"
+#include "config_profile.h"
+#include "clock_sync.h"
+#include "power_coordinator.h"
+#include "mqtt_telemetry.h"
+#include "wifi_link.h"
+
+// kept in RTC memory, so the awake time report continues across deep sleep
+RTC_DATA_ATTR power_accounting_t powerUsage = { 0, 0, 0, 0, 0 };
+unsigned long awakeSince = 0; // millis() at the latest wake up
+
+/**
+ * find how long the state machines can be left alone
+ *
+ * Zones waiting for resources are polled every READING_INTERVAL. Other zones
+ * only need attention when their target time is reached. A clock sync that
+ * is due (or waiting for its reply) also needs the next pass, and so do the
+ * heartbeats and lease renewals of site power coordination, and the telemetry
+ * publish window and broker keepalive.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ * @return milliseconds until the next pass over the state machines is needed
+ */
+unsigned long nextWakeupDelay(const irrigation_context_t * contexts,
+  const size_t count, const smart_time_t timeTick)
+{
+  unsigned long wait = SLEEP_INTERVAL_MAX;
+  for (size_t i = 0; i < count; i++) {
+    switch (contexts[i].state) {
+      case ZONE_DISABLED:
+        break;
+      case MOISTURE_GOOD:
+      case DELIVERING_WATER:
+      case SOAKING_IN:
+        if (smartTimeCompare(timeTick, contexts[i].target_time) >= 0) {
+          return READING_INTERVAL;
+        }
+        wait = min(wait, smartDeltaMillis(timeTick, contexts[i].target_time));
+        break;
+      default:
+        // waiting for resources, or transient
+        wait = min(wait, READING_INTERVAL);
+    }
+  }
+  wait = min(wait, nextClockSync(timeTick.millis));
+  wait = min(wait, nextCoordination(timeTick.millis));
+  wait = min(wait, nextTelemetry(timeTick));
+  return max(wait, READING_INTERVAL);
+} // end nextWakeupDelay()
+
+/**
+ * check if every zone can be left alone through a deep sleep
+ *
+ * A running pump, or a zone holding or waiting for resources, needs the
+ * processor (and PWM outputs) to keep running.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @return true when nothing is active
+ */
+bool zonesAtRest(const irrigation_context_t * contexts, const size_t count)
+{
+  if (powerReserved > 0) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (contexts[i].state != ZONE_DISABLED &&
+        contexts[i].state != MOISTURE_GOOD &&
+        contexts[i].state != SOAKING_IN) {
+      return false;
+    }
+  }
+  return true;
+} // end zonesAtRest()
+
+/**
+ * check if the sketch is starting after a (timed) deep sleep
+ *
+ * @return true when woken from deep sleep by the timer
+ */
+bool wokeFromDeepSleep()
+{
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER &&
+    powerUsage.deepSleepMillis > 0;
+} // end wokeFromDeepSleep()
+
+/**
+ * continue the irrigation state machines from before a deep sleep
+ *
+ * @param[in,out] contexts array of configured irrigation state machine contexts
+ * @param[in] checkpoint array of zone states saved before the deep sleep
+ * @param[in] count the number of contexts in the arrays
+ * @param[in] timeTick current time reference
+ */
+void resumeFromDeepSleep(irrigation_context_t * contexts,
+  const zone_checkpoint_t * checkpoint, const size_t count,
+  const smart_time_t timeTick)
+{
+  // millis() restarted at zero. The deep sleep length plus the time since
+  // restarting is the time since the checkpoint was saved.
+  restoreZones(contexts, checkpoint, count, timeTick,
+    powerUsage.deepSleepMillis + timeTick.millis);
+  powerUsage.deepSleepMillis = 0;
+  // time since restarting is counted as awake
+  awakeSince = 0;
+} // end resumeFromDeepSleep()
+
+/**
+ * report the fraction of time spent awake once per reporting period
+ */
+void reportPowerUsage()
+{
+  unsigned long total = powerUsage.awakeMillis + powerUsage.sleepMillis;
+  if (total < POWER_REPORT_INTERVAL) {
+    return;
+  }
+  Serial.printf("LOG: awake %lu of %lu milliseconds (%.1f%%), %lu wakeups\n",
+    powerUsage.awakeMillis, total, 100.0 * powerUsage.awakeMillis / total,
+    powerUsage.wakeups);
+  Serial.printf("LOG: %lu sensor reads in %lu passes\n", sensorReads,
+    powerUsage.passes);
+  sensorReads = 0;
+  powerUsage.passes = 0;
+  powerUsage.awakeMillis = 0;
+  powerUsage.sleepMillis = 0;
+  powerUsage.wakeups = 0;
+} // end reportPowerUsage()
+
+/**
+ * wait until the state machines need attention again
+ *
+ * Uses the lowest power mode that is allowed by POWER_MODE, and safe for the
+ * current state of the zones. A deep sleep does not return: the sketch
+ * restarts when the timer wakes it up.
+ *
+ * Light sleep powers the radio down under the wifi stack, which drops the
+ * association, the status server, and the UDP sockets. With network features
+ * configured, the board waits awake instead (the wifi modem still saves power
+ * between beacons); deep sleep is still used, since the restart reconnects.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[out] checkpoint RTC memory array to save zone states for deep sleep
+ * @param[in] count the number of contexts in the arrays
+ */
+void powerNap(const irrigation_context_t * contexts,
+  zone_checkpoint_t * checkpoint, const size_t count)
+{
+  smart_time_t now = getSmartTime();
+  unsigned long wait = nextWakeupDelay(contexts, count, now);
+  bool loading = profileLoadPending();
+  if (loading) {
+    wait = READING_INTERVAL; // zone records are loaded one per pass
+  }
+  // the reply to an NTP request only arrives while the radio is up
+  bool atRest = zonesAtRest(contexts, count) && !clockAwaitingReply();
+  bool deepSleep = POWER_MODE == POWER_DEEP_SLEEP && wait >= DEEP_SLEEP_MIN && !loading;
+  bool lightSleep = POWER_MODE != POWER_ALWAYS_ON && !wifiConfigured();
+  powerUsage.awakeMillis += now.millis - awakeSince;
+  powerUsage.passes++;
+  reportPowerUsage();
+  recordPlannedWake(wait);
+
+  if (!atRest || !(deepSleep || lightSleep)) {
+    delay(wait);
+    powerUsage.awakeMillis += wait;
+    awakeSince = millis();
+    return;
+  }
+
+  Serial.flush(); // do not lose pending output while sleeping
+  esp_sleep_enable_timer_wakeup((uint64_t)wait * 1000);
+  if (deepSleep) {
+    checkpointZones(contexts, checkpoint, count, now);
+    powerUsage.sleepMillis += wait;
+    powerUsage.wakeups++;
+    powerUsage.deepSleepMillis = wait;
+    esp_deep_sleep_start();
+  }
+  unsigned long asleep = millis(); // keeps counting through light sleep
+  if (esp_light_sleep_start() != ESP_OK) {
+    delay(wait); // sleep rejected: wait awake
+    powerUsage.awakeMillis += wait;
+    awakeSince = millis();
+    return;
+  }
+  // a wake up source other than the timer can end the sleep early
+  awakeSince = millis();
+  powerUsage.sleepMillis += awakeSince - asleep;
+  powerUsage.wakeups++;
+} // end powerNap()
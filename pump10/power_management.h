@@ -0,0 +1,55 @@
+#ifndef power_management_h
+#define power_management_h
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include "smart_time.h"
+#include "watering_management.h"
+#include "irrigation_state.h"
+#include "zone_checkpoint.h"
+
+/**
+ * data structures and methods to sleep between irrigation state machine
+ * deadlines, instead of busy waiting for a fixed interval.
+ *
+ * Light sleep keeps everything in memory, and `millis()` keeps counting. Deep
+ * sleep restarts the sketch, so the runtime part of each irrigation context is
+ * checkpointed to RTC memory first, and restored by `setup()` after the wake up.
+ */
+
+/// how to wait between passes over the irrigation state machines
+enum power_mode_t {
+  /// `delay()` until the next pass
+  POWER_ALWAYS_ON = 0,
+  /// light sleep when no pump is running
+  POWER_LIGHT_SLEEP,
+  /// deep sleep when all zones are at rest and the wait is long enough
+  POWER_DEEP_SLEEP
+};
+
+/// accumulated awake and sleeping time for the current reporting period
+struct power_accounting_t {
+  unsigned long awakeMillis;
+  unsigned long sleepMillis;
+  unsigned long wakeups;
+  /// passes over the state machines
+  unsigned long passes;
+  /// milliseconds of the most recent deep sleep; 0 when not in deep sleep
+  unsigned long deepSleepMillis;
+};
+
+extern const power_mode_t POWER_MODE;
+extern const unsigned long READING_INTERVAL;
+extern const unsigned long SLEEP_INTERVAL_MAX;
+extern const unsigned long DEEP_SLEEP_MIN;
+extern const unsigned long POWER_REPORT_INTERVAL;
+
+unsigned long nextWakeupDelay(const irrigation_context_t *, const size_t,
+  const smart_time_t);
+bool zonesAtRest(const irrigation_context_t *, const size_t);
+bool wokeFromDeepSleep(void);
+void resumeFromDeepSleep(irrigation_context_t *, const zone_checkpoint_t *,
+  const size_t, const smart_time_t);
+void powerNap(const irrigation_context_t *, zone_checkpoint_t *, const size_t);
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * create and inspect pump10 configuration profile images
+ *
+ * Usage:
+ *   pump10_profile create «image» < zones.csv
+ *   pump10_profile dump «image»
+ *   pump10_profile nvs «image» «profile name» > profile.csv
+ *
+ * `create` reads one zone per line, in the order and units of the `dump`
+ * header line (a header line in the input is skipped), and writes the header
+ * and records the controller's `profile save` would. `dump` checks an image
+ * and prints its zones as CSV; a zone with a damaged record is reported and
+ * left out. `nvs` prints the image as input for ESP-IDF's nvs_partition_gen.py,
+ * which builds an NVS partition holding the profile as the active one.
+ */
+#include "profile_image.h"
+#include <cstring>
+
+/**
+ * read a whole image file
+ *
+ * @param[in] path image file
+ * @param[out] image its bytes
+ * @return false when the file can not be read
+ */
+bool readImage(const char * path, std::vector<uint8_t> * image)
+{
+  FILE * file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  image->clear();
+  uint8_t buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    image->insert(image->end(), buffer, buffer + length);
+  }
+  bool failed = ferror(file);
+  fclose(file);
+  if (failed) {
+    perror(path);
+  }
+  return !failed;
+} // end readImage()
+
+/**
+ * write a profile image from zones read from standard input
+ *
+ * @param[in] path image file
+ * @return process exit status
+ */
+int create(const char * path)
+{
+  profile_image_t profile;
+  std::string error;
+  char line[1024];
+  for (unsigned long number = 1; fgets(line, sizeof(line), stdin) != NULL; number++) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || strcmp(line, ZONE_CSV_HEADER) == 0) {
+      continue;
+    }
+    zone_profile_t zone;
+    if (!parseZone(line, &zone, &error)) {
+      fprintf(stderr, "line %lu: %s\n", number, error.c_str());
+      return 1;
+    }
+    if (profile.zones.size() == MAX_PROFILE_ZONES) {
+      fprintf(stderr, "line %lu: more than %zu zones\n", number, MAX_PROFILE_ZONES);
+      return 1;
+    }
+    profile.zones.push_back(zone);
+  }
+  std::vector<uint8_t> image = encodeImage(profile);
+  FILE * file = fopen(path, "wb");
+  if (file == NULL || fwrite(image.data(), 1, image.size(), file) != image.size() ||
+      fclose(file) != 0) {
+    perror(path);
+    return 1;
+  }
+  fprintf(stderr, "%zu zones, %zu bytes\n", profile.zones.size(), image.size());
+  return 0;
+} // end create()
+
+/**
+ * check an image, and print its zones
+ *
+ * @param[in] path image file
+ * @return process exit status: 0 when the whole image is valid
+ */
+int dump(const char * path)
+{
+  std::vector<uint8_t> image;
+  if (!readImage(path, &image)) {
+    return 1;
+  }
+  profile_image_t profile;
+  std::string error;
+  bool valid = decodeImage(image, &profile, &error);
+  if (valid) {
+    printf("%s\n", ZONE_CSV_HEADER);
+    for (const zone_profile_t & zone : profile.zones) {
+      printf("%s\n", formatZone(zone).c_str());
+    }
+  }
+  if (!error.empty()) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return 1;
+  }
+  return 0;
+} // end dump()
+
+/**
+ * print one nvs_partition_gen.py line holding a binary value
+ *
+ * @param[in] key NVS key
+ * @param[in] data value bytes
+ * @param[in] length number of bytes
+ */
+void printBlob(const std::string & key, const uint8_t * data, const size_t length)
+{
+  printf("%s,data,hex2bin,", key.c_str());
+  for (size_t i = 0; i < length; i++) {
+    printf("%02x", data[i]);
+  }
+  printf("\n");
+} // end printBlob()
+
+/**
+ * print a valid image as nvs_partition_gen.py input
+ *
+ * @param[in] path image file
+ * @param[in] name profile name on the controller
+ * @return process exit status
+ */
+int nvs(const char * path, const std::string & name)
+{
+  std::vector<uint8_t> image;
+  if (!validProfileName(name)) {
+    fprintf(stderr, "profile names are 1 to %zu characters, without '/' or ','\n",
+      PROFILE_NAME_SIZE - 1);
+    return 1;
+  }
+  if (!readImage(path, &image)) {
+    return 1;
+  }
+  profile_image_t profile;
+  std::string error;
+  if (!decodeImage(image, &profile, &error) || !error.empty()) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return 1;
+  }
+  printf("key,type,encoding,value\n%s,namespace,,\n", PROFILE_NAMESPACE);
+  printBlob("names", (const uint8_t *)name.data(), name.size());
+  printBlob("active", (const uint8_t *)name.data(), name.size());
+  printBlob(name + "/h", image.data(), PROFILE_HEADER_SIZE);
+  for (size_t i = 0; i < profile.zones.size(); i++) {
+    printBlob(name + "/" + std::to_string(i),
+      &image[PROFILE_HEADER_SIZE + i * PROFILE_RECORD_SIZE], PROFILE_RECORD_SIZE);
+  }
+  return 0;
+} // end nvs()
+
+int main(int argc, char ** argv)
+{
+  if (argc == 3 && strcmp(argv[1], "create") == 0) {
+    return create(argv[2]);
+  }
+  if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+    return dump(argv[2]);
+  }
+  if (argc == 4 && strcmp(argv[1], "nvs") == 0) {
+    return nvs(argv[2], argv[3]);
+  }
+  fprintf(stderr, "usage: %s create «image» < zones.csv\n"
+    "       %s dump «image»\n"
+    "       %s nvs «image» «profile name»\n", argv[0], argv[0], argv[0]);
+  return 2;
+} // end main()
@@ -0,0 +1,434 @@
+/**
+ * methods to encode, check, and decode profile images, and their zones as CSV
+ */
+#include "profile_image.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+const char ZONE_CSV_HEADER[] = "name,sensor_pin,air,water,sensor_device,sensor_channel,"
+  "moisture,watering,soaking,target,minimum,maximum,volume,pump_pin,speed,start_speed,ramp,"
+  "run_current,stall_current,pump_device,pump_channel,flow_pin,flow_unit,pulses_per_litre,"
+  "manifold,valve_pin,reservoir,schedule,enabled";
+const size_t ZONE_CSV_FIELDS = 29;
+
+// ESP32 offsets of the zone_config_frame_t fields in a profile_record_t
+const size_t AT_NAME = 0;
+const size_t AT_SENSOR = 16; // moisture_sensor_t, 8 bytes
+const size_t AT_RULES = 24; // watering_triggers_t, 28 bytes
+const size_t AT_PUMP = 52; // pump_motor_t, 32 bytes
+const size_t AT_VALVE = 84; // zone_valve_t, 2 bytes
+const size_t AT_RESERVOIR = 86;
+const size_t AT_SCHEDULE = 87;
+const size_t AT_ENABLED = 88;
+const size_t AT_RECORD_CRC = 89;
+
+/**
+ * CRC-16/CCITT-FALSE, as the controller computes it (metrics.cpp)
+ *
+ * @param[in] crc initial value; 0xFFFF to start
+ * @param[in] data bytes to add
+ * @param[in] length number of bytes
+ * @return updated CRC
+ */
+uint16_t crc16(uint16_t crc, const uint8_t * data, const size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+} // end crc16()
+
+/**
+ * check a profile name the way the controller does
+ *
+ * @param[in] name profile name
+ * @return true when 1 to 8 characters, without '/' or ','
+ */
+bool validProfileName(const std::string & name)
+{
+  return !name.empty() && name.size() < PROFILE_NAME_SIZE &&
+    name.find_first_of("/,") == std::string::npos;
+} // end validProfileName()
+
+static void put16(uint8_t * at, const uint16_t value)
+{
+  at[0] = value & 0xFF;
+  at[1] = value >> 8;
+}
+
+static void put32(uint8_t * at, const uint32_t value)
+{
+  put16(at, value & 0xFFFF);
+  put16(at + 2, value >> 16);
+}
+
+static void putFloat(uint8_t * at, const float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put32(at, bits);
+}
+
+static uint16_t get16(const uint8_t * at)
+{
+  return at[0] | (uint16_t)at[1] << 8;
+}
+
+static uint32_t get32(const uint8_t * at)
+{
+  return get16(at) | (uint32_t)get16(at + 2) << 16;
+}
+
+static float getFloat(const uint8_t * at)
+{
+  uint32_t bits = get32(at);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * encode a profile header
+ *
+ * @param[in] zones number of zone records that follow
+ * @param[out] header PROFILE_HEADER_SIZE bytes
+ */
+void encodeHeader(const size_t zones, uint8_t * header)
+{
+  put32(header, PROFILE_MAGIC);
+  header[4] = PROFILE_FORMAT;
+  header[5] = (uint8_t)zones;
+  put16(header + 6, PROFILE_RECORD_SIZE);
+  put16(header + 8, crc16(0xFFFF, header, PROFILE_HEADER_SIZE - 2));
+} // end encodeHeader()
+
+/**
+ * check and decode a profile header
+ *
+ * @param[in] header PROFILE_HEADER_SIZE bytes
+ * @param[out] zones number of zone records that follow
+ * @param[out] error why the header was rejected
+ * @return true when the controller would accept the header
+ */
+bool decodeHeader(const uint8_t * header, size_t * zones, std::string * error)
+{
+  if (get16(header + 8) != crc16(0xFFFF, header, PROFILE_HEADER_SIZE - 2)) {
+    *error = "header CRC mismatch";
+  } else if (get32(header) != PROFILE_MAGIC) {
+    *error = "not a profile header";
+  } else if (header[4] != PROFILE_FORMAT) {
+    *error = "profile format " + std::to_string(header[4]) + ", expected " +
+      std::to_string(PROFILE_FORMAT);
+  } else if (get16(header + 6) != PROFILE_RECORD_SIZE) {
+    *error = "record size " + std::to_string(get16(header + 6)) + ", expected " +
+      std::to_string(PROFILE_RECORD_SIZE);
+  } else {
+    *zones = header[5];
+    return true;
+  }
+  return false;
+} // end decodeHeader()
+
+/**
+ * encode one zone record, with the padding bytes zeroed like the controller
+ *
+ * @param[in] zone zone settings
+ * @param[out] record PROFILE_RECORD_SIZE bytes
+ */
+void encodeRecord(const zone_profile_t & zone, uint8_t * record)
+{
+  memset(record, 0, PROFILE_RECORD_SIZE);
+  memcpy(record + AT_NAME, zone.name.data(), std::min(zone.name.size(), ZONE_NAME_SIZE - 1));
+
+  uint8_t * sensor = record + AT_SENSOR;
+  sensor[0] = zone.sensorPin;
+  put16(sensor + 2, zone.airValue);
+  put16(sensor + 4, zone.waterValue);
+  sensor[6] = zone.sensorDevice;
+  sensor[7] = zone.sensorChannel;
+
+  uint8_t * rules = record + AT_RULES;
+  putFloat(rules, zone.moisturePercentage);
+  put32(rules + 4, zone.wateringInterval);
+  put32(rules + 8, zone.soakingInterval);
+  putFloat(rules + 12, zone.targetPercentage);
+  put32(rules + 16, zone.minimumWatering);
+  put32(rules + 20, zone.maximumWatering);
+  put32(rules + 24, zone.wateringVolume);
+
+  uint8_t * pump = record + AT_PUMP;
+  pump[0] = zone.pumpPin;
+  put32(pump + 4, zone.speed);
+  put32(pump + 8, zone.startSpeed);
+  put32(pump + 12, zone.rampMillis);
+  put32(pump + 16, zone.runCurrent);
+  put32(pump + 20, zone.stallCurrent);
+  pump[24] = zone.pumpDevice;
+  pump[25] = zone.pumpChannel;
+  pump[26] = zone.flowPin;
+  pump[27] = zone.flowUnit;
+  put16(pump + 28, zone.pulsesPerLitre);
+
+  record[AT_VALVE] = zone.manifold;
+  record[AT_VALVE + 1] = zone.valvePin;
+  record[AT_RESERVOIR] = zone.reservoir;
+  record[AT_SCHEDULE] = zone.schedule;
+  record[AT_ENABLED] = zone.enabled;
+  put16(record + AT_RECORD_CRC, crc16(0xFFFF, record, PROFILE_RECORD_SIZE - 2));
+} // end encodeRecord()
+
+/**
+ * check and decode one zone record
+ *
+ * @param[in] record PROFILE_RECORD_SIZE bytes
+ * @param[out] zone zone settings
+ * @return false when the CRC does not match
+ */
+bool decodeRecord(const uint8_t * record, zone_profile_t * zone)
+{
+  if (get16(record + AT_RECORD_CRC) != crc16(0xFFFF, record, PROFILE_RECORD_SIZE - 2)) {
+    return false;
+  }
+  const char * name = (const char *)record + AT_NAME;
+  zone->name.assign(name, strnlen(name, ZONE_NAME_SIZE));
+
+  const uint8_t * sensor = record + AT_SENSOR;
+  zone->sensorPin = sensor[0];
+  zone->airValue = get16(sensor + 2);
+  zone->waterValue = get16(sensor + 4);
+  zone->sensorDevice = sensor[6];
+  zone->sensorChannel = sensor[7];
+
+  const uint8_t * rules = record + AT_RULES;
+  zone->moisturePercentage = getFloat(rules);
+  zone->wateringInterval = get32(rules + 4);
+  zone->soakingInterval = get32(rules + 8);
+  zone->targetPercentage = getFloat(rules + 12);
+  zone->minimumWatering = get32(rules + 16);
+  zone->maximumWatering = get32(rules + 20);
+  zone->wateringVolume = get32(rules + 24);
+
+  const uint8_t * pump = record + AT_PUMP;
+  zone->pumpPin = pump[0];
+  zone->speed = get32(pump + 4);
+  zone->startSpeed = get32(pump + 8);
+  zone->rampMillis = get32(pump + 12);
+  zone->runCurrent = get32(pump + 16);
+  zone->stallCurrent = get32(pump + 20);
+  zone->pumpDevice = pump[24];
+  zone->pumpChannel = pump[25];
+  zone->flowPin = pump[26];
+  zone->flowUnit = pump[27];
+  zone->pulsesPerLitre = get16(pump + 28);
+
+  zone->manifold = record[AT_VALVE];
+  zone->valvePin = record[AT_VALVE + 1];
+  zone->reservoir = record[AT_RESERVOIR];
+  zone->schedule = record[AT_SCHEDULE];
+  zone->enabled = record[AT_ENABLED] != 0;
+  return true;
+} // end decodeRecord()
+
+/**
+ * encode a profile as an image: the header, then the records in zone order
+ *
+ * @param[in] profile the profile
+ * @return image bytes
+ */
+std::vector<uint8_t> encodeImage(const profile_image_t & profile)
+{
+  std::vector<uint8_t> image(PROFILE_HEADER_SIZE + profile.zones.size() * PROFILE_RECORD_SIZE);
+  encodeHeader(profile.zones.size(), image.data());
+  for (size_t i = 0; i < profile.zones.size(); i++) {
+    encodeRecord(profile.zones[i], &image[PROFILE_HEADER_SIZE + i * PROFILE_RECORD_SIZE]);
+  }
+  return image;
+} // end encodeImage()
+
+/**
+ * check and decode an image
+ *
+ * Like the controller, a bad header rejects the whole profile, and a bad
+ * record only that zone: it is skipped, and reported in `error`.
+ *
+ * @param[in] image image bytes
+ * @param[out] profile the zones with a valid record
+ * @param[out] error what was rejected; empty when nothing was
+ * @return false when the header is rejected, or the image is cut short
+ */
+bool decodeImage(const std::vector<uint8_t> & image, profile_image_t * profile,
+  std::string * error)
+{
+  profile->zones.clear();
+  error->clear();
+  size_t zones = 0;
+  if (image.size() < PROFILE_HEADER_SIZE) {
+    *error = "image shorter than a header";
+    return false;
+  }
+  if (!decodeHeader(image.data(), &zones, error)) {
+    return false;
+  }
+  if (image.size() != PROFILE_HEADER_SIZE + zones * PROFILE_RECORD_SIZE) {
+    *error = "image size does not match " + std::to_string(zones) + " zones";
+    return false;
+  }
+  for (size_t i = 0; i < zones; i++) {
+    zone_profile_t zone;
+    if (decodeRecord(&image[PROFILE_HEADER_SIZE + i * PROFILE_RECORD_SIZE], &zone)) {
+      profile->zones.push_back(zone);
+    } else {
+      *error += (error->empty() ? "" : ", ") + std::string("zone ") + std::to_string(i) +
+        " record CRC mismatch";
+    }
+  }
+  return true;
+} // end decodeImage()
+
+/**
+ * parse one unsigned CSV field
+ *
+ * @param[in] field field text
+ * @param[in] limit largest valid value
+ * @param[out] value parsed value
+ * @return false when not a number up to `limit`
+ */
+static bool parseUnsigned(const std::string & field, const unsigned long limit,
+  unsigned long * value)
+{
+  char * end;
+  errno = 0;
+  *value = strtoul(field.c_str(), &end, 10);
+  return !field.empty() && field[0] != '-' && *end == '\0' && errno == 0 && *value <= limit;
+}
+
+/**
+ * get the name of a CSV column
+ *
+ * @param[in] field column index
+ * @return its name in ZONE_CSV_HEADER
+ */
+static std::string csvColumn(const size_t field)
+{
+  std::string header = ZONE_CSV_HEADER;
+  size_t start = 0;
+  for (size_t i = 0; i < field; i++) {
+    start = header.find(',', start) + 1;
+  }
+  return header.substr(start, header.find(',', start) - start);
+}
+
+/**
+ * parse one CSV line of zone settings, in ZONE_CSV_HEADER order
+ *
+ * @param[in] line the line, without its end of line
+ * @param[out] zone zone settings
+ * @param[out] error which field is invalid
+ * @return true when every field is valid
+ */
+bool parseZone(const std::string & line, zone_profile_t * zone, std::string * error)
+{
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (size_t comma = line.find(','); comma != std::string::npos;
+      comma = line.find(',', start)) {
+    fields.push_back(line.substr(start, comma - start));
+    start = comma + 1;
+  }
+  fields.push_back(line.substr(start));
+  if (fields.size() != ZONE_CSV_FIELDS) {
+    *error = std::to_string(fields.size()) + " fields, expected " +
+      std::to_string(ZONE_CSV_FIELDS);
+    return false;
+  }
+  if (fields[0].empty() || fields[0].size() >= ZONE_NAME_SIZE) {
+    *error = "name must be 1 to " + std::to_string(ZONE_NAME_SIZE - 1) + " characters";
+    return false;
+  }
+  zone->name = fields[0];
+
+  // unsigned fields: where they go, and their largest value
+  struct { size_t field; unsigned long limit; } numbers[] = {
+    { 1, UINT8_MAX }, { 2, UINT16_MAX }, { 3, UINT16_MAX }, { 4, UINT8_MAX },
+    { 5, UINT8_MAX }, { 7, UINT32_MAX }, { 8, UINT32_MAX }, { 10, UINT32_MAX },
+    { 11, UINT32_MAX }, { 12, UINT32_MAX }, { 13, UINT8_MAX }, { 14, UINT32_MAX },
+    { 15, UINT32_MAX }, { 16, UINT32_MAX }, { 17, UINT32_MAX }, { 18, UINT32_MAX },
+    { 19, UINT8_MAX }, { 20, UINT8_MAX }, { 21, UINT8_MAX }, { 22, UINT8_MAX },
+    { 23, UINT16_MAX }, { 24, UINT8_MAX }, { 25, UINT8_MAX }, { 26, UINT8_MAX },
+    { 27, UINT8_MAX }, { 28, 1 }
+  };
+  unsigned long value[ZONE_CSV_FIELDS] = {};
+  for (const auto & number : numbers) {
+    if (!parseUnsigned(fields[number.field], number.limit, &value[number.field])) {
+      *error = "invalid " + csvColumn(number.field) + " \"" + fields[number.field] + "\"";
+      return false;
+    }
+  }
+  float percentage[ZONE_CSV_FIELDS] = {};
+  for (size_t field : { 6, 9 }) {
+    char * end;
+    percentage[field] = strtof(fields[field].c_str(), &end);
+    if (fields[field].empty() || *end != '\0') {
+      *error = "invalid " + csvColumn(field) + " \"" + fields[field] + "\"";
+      return false;
+    }
+  }
+
+  zone->sensorPin = value[1];
+  zone->airValue = value[2];
+  zone->waterValue = value[3];
+  zone->sensorDevice = value[4];
+  zone->sensorChannel = value[5];
+  zone->moisturePercentage = percentage[6];
+  zone->wateringInterval = value[7];
+  zone->soakingInterval = value[8];
+  zone->targetPercentage = percentage[9];
+  zone->minimumWatering = value[10];
+  zone->maximumWatering = value[11];
+  zone->wateringVolume = value[12];
+  zone->pumpPin = value[13];
+  zone->speed = value[14];
+  zone->startSpeed = value[15];
+  zone->rampMillis = value[16];
+  zone->runCurrent = value[17];
+  zone->stallCurrent = value[18];
+  zone->pumpDevice = value[19];
+  zone->pumpChannel = value[20];
+  zone->flowPin = value[21];
+  zone->flowUnit = value[22];
+  zone->pulsesPerLitre = value[23];
+  zone->manifold = value[24];
+  zone->valvePin = value[25];
+  zone->reservoir = value[26];
+  zone->schedule = value[27];
+  zone->enabled = value[28] != 0;
+  return true;
+} // end parseZone()
+
+/**
+ * format zone settings as a CSV line, in ZONE_CSV_HEADER order
+ *
+ * Percentages are printed with enough digits to parse back to the same float.
+ *
+ * @param[in] zone zone settings
+ * @return the line, without an end of line
+ */
+std::string formatZone(const zone_profile_t & zone)
+{
+  char line[512];
+  snprintf(line, sizeof(line),
+    "%s,%u,%u,%u,%u,%u,%.9g,%u,%u,%.9g,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+    zone.name.c_str(), zone.sensorPin, zone.airValue, zone.waterValue, zone.sensorDevice,
+    zone.sensorChannel, zone.moisturePercentage, zone.wateringInterval, zone.soakingInterval,
+    zone.targetPercentage, zone.minimumWatering, zone.maximumWatering, zone.wateringVolume,
+    zone.pumpPin, zone.speed, zone.startSpeed, zone.rampMillis, zone.runCurrent,
+    zone.stallCurrent, zone.pumpDevice, zone.pumpChannel, zone.flowPin, zone.flowUnit,
+    zone.pulsesPerLitre, zone.manifold, zone.valvePin, zone.reservoir, zone.schedule,
+    zone.enabled ? 1 : 0);
+  return line;
+} // end formatZone()
@@ -0,0 +1,89 @@
+#ifndef profile_image_h
+#define profile_image_h
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * data structures and methods to create and inspect pump10 configuration
+ * profile images on a host
+ *
+ * A profile on the controller is a profile_header_t, plus one
+ * profile_record_t per zone, each in its own NVS key (see config_profile.h).
+ * An image file holds the same blobs back to back: the header, then the
+ * records in zone order.
+ *
+ * The controller stores its structs as they are laid out by the ESP32
+ * compiler: little endian, `unsigned long` and `unsigned int` of 4 bytes, and
+ * natural alignment inside the nested structs of zone_config_frame_t. The
+ * host layout differs, so fields are written one by one at their ESP32
+ * offsets instead of copying host structs.
+ */
+
+const uint32_t PROFILE_MAGIC = 0x50313050; // "P01P"
+const uint8_t PROFILE_FORMAT = 1;
+const size_t PROFILE_NAME_SIZE = 9; // 8 characters; keys are limited to 15
+const size_t PROFILE_HEADER_SIZE = 10; // sizeof(profile_header_t)
+const size_t PROFILE_RECORD_SIZE = 91; // sizeof(profile_record_t)
+const size_t ZONE_NAME_SIZE = 16; // CONFIG_NAME_SIZE
+const size_t MAX_PROFILE_ZONES = 16; // MAX_CONFIG_ZONES
+const char PROFILE_NAMESPACE[] = "pump10prof";
+
+/// one zone of a profile: zone_config_frame_t, and whether it is enabled
+struct zone_profile_t {
+  std::string name;
+  // moisture_sensor_t
+  uint8_t sensorPin;
+  uint16_t airValue;
+  uint16_t waterValue;
+  uint8_t sensorDevice;
+  uint8_t sensorChannel;
+  // watering_triggers_t
+  float moisturePercentage;
+  uint32_t wateringInterval;
+  uint32_t soakingInterval;
+  float targetPercentage;
+  uint32_t minimumWatering;
+  uint32_t maximumWatering;
+  uint32_t wateringVolume;
+  // pump_motor_t
+  uint8_t pumpPin;
+  uint32_t speed;
+  uint32_t startSpeed;
+  uint32_t rampMillis;
+  uint32_t runCurrent;
+  uint32_t stallCurrent;
+  uint8_t pumpDevice;
+  uint8_t pumpChannel;
+  uint8_t flowPin;
+  uint8_t flowUnit;
+  uint16_t pulsesPerLitre;
+  // zone_valve_t
+  uint8_t manifold;
+  uint8_t valvePin;
+  uint8_t reservoir;
+  uint8_t schedule;
+  bool enabled;
+};
+
+/// a complete profile
+struct profile_image_t {
+  std::vector<zone_profile_t> zones;
+};
+
+extern const char ZONE_CSV_HEADER[];
+
+uint16_t crc16(uint16_t, const uint8_t *, const size_t);
+bool validProfileName(const std::string &);
+void encodeHeader(const size_t, uint8_t *);
+bool decodeHeader(const uint8_t *, size_t *, std::string *);
+void encodeRecord(const zone_profile_t &, uint8_t *);
+bool decodeRecord(const uint8_t *, zone_profile_t *);
+std::vector<uint8_t> encodeImage(const profile_image_t &);
+bool decodeImage(const std::vector<uint8_t> &, profile_image_t *, std::string *);
+bool parseZone(const std::string &, zone_profile_t *, std::string *);
+std::string formatZone(const zone_profile_t &);
+
+#endif
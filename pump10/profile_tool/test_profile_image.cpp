@@ -0,0 +1,140 @@
+/**
+ * tests for the profile image tool; exits non zero when any fails
+ */
+#include "profile_image.h"
+#include <cstring>
+
+unsigned int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+// two zones in `dump` format: a pump zone with a flow meter, and a manifold zone
+const char * ZONES[] = {
+  "sunflowers,32,3000,1200,0,0,35.5,60000,900000,41.25,5000,30000,250,"
+    "25,255,200,1500,400,900,0,0,26,1,450,0,0,1,0,1",
+  "tomatoes,33,2950,1180,2,5,30,60000,1800000,38,0,0,0,"
+    "27,180,180,0,0,0,3,7,0,0,0,2,14,0,3,0"
+};
+
+/**
+ * parse the test zones into a profile
+ *
+ * @return the profile
+ */
+profile_image_t testProfile()
+{
+  profile_image_t profile;
+  std::string error;
+  for (const char * line : ZONES) {
+    zone_profile_t zone;
+    CHECK(parseZone(line, &zone, &error));
+    profile.zones.push_back(zone);
+  }
+  return profile;
+} // end testProfile()
+
+void testCrc()
+{
+  // CRC-16/CCITT-FALSE check value
+  CHECK(crc16(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1);
+}
+
+void testLayout()
+{
+  profile_image_t profile = testProfile();
+  std::vector<uint8_t> image = encodeImage(profile);
+  CHECK(image.size() == 10 + 2 * 91);
+
+  // header: magic, format, zones, and record size, little endian
+  const uint8_t header[] = { 0x50, 0x30, 0x31, 0x50, 1, 2, 91, 0 };
+  CHECK(memcmp(image.data(), header, sizeof(header)) == 0);
+
+  // ESP32 offsets in the first record
+  const uint8_t * record = &image[PROFILE_HEADER_SIZE];
+  CHECK(strcmp((const char *)record, "sunflowers") == 0);
+  CHECK(record[16] == 32 && record[18] == 3000 % 256 && record[19] == 3000 / 256);
+  CHECK(record[28] == 60000 % 256 && record[29] == 60000 / 256 && record[30] == 0);
+  CHECK(record[48] == 250 && record[52] == 25 && record[56] == 255 && record[60] == 200);
+  CHECK(record[78] == 26 && record[79] == 1 && record[80] == 450 % 256);
+  CHECK(record[86] == 1 && record[88] == 1);
+  // padding is zero, like a record saved on the controller
+  CHECK(record[17] == 0 && record[53] == 0 && record[82] == 0 && record[83] == 0);
+  // second record: manifold valve
+  record += PROFILE_RECORD_SIZE;
+  CHECK(record[84] == 2 && record[85] == 14 && record[87] == 3 && record[88] == 0);
+}
+
+void testRoundTrip()
+{
+  profile_image_t decoded;
+  std::string error;
+  CHECK(decodeImage(encodeImage(testProfile()), &decoded, &error));
+  CHECK(error.empty());
+  CHECK(decoded.zones.size() == 2);
+  for (size_t i = 0; i < decoded.zones.size(); i++) {
+    CHECK(formatZone(decoded.zones[i]) == ZONES[i]);
+  }
+}
+
+void testDamage()
+{
+  profile_image_t decoded;
+  std::string error;
+  std::vector<uint8_t> image = encodeImage(testProfile());
+
+  // a damaged record only costs that zone
+  std::vector<uint8_t> damaged = image;
+  damaged[PROFILE_HEADER_SIZE + 30] ^= 0x10;
+  CHECK(decodeImage(damaged, &decoded, &error));
+  CHECK(decoded.zones.size() == 1 && decoded.zones[0].name == "tomatoes");
+  CHECK(error == "zone 0 record CRC mismatch");
+
+  // a damaged header rejects the profile
+  damaged = image;
+  damaged[5] = 3;
+  CHECK(!decodeImage(damaged, &decoded, &error) && error == "header CRC mismatch");
+
+  // as does a header with another record size, even with a good CRC
+  damaged = image;
+  damaged[6] = 92;
+  damaged[8] = crc16(0xFFFF, damaged.data(), PROFILE_HEADER_SIZE - 2) & 0xFF;
+  damaged[9] = crc16(0xFFFF, damaged.data(), PROFILE_HEADER_SIZE - 2) >> 8;
+  CHECK(!decodeImage(damaged, &decoded, &error) && error == "record size 92, expected 91");
+
+  // and a cut short image
+  damaged = image;
+  damaged.pop_back();
+  CHECK(!decodeImage(damaged, &decoded, &error));
+}
+
+void testParseErrors()
+{
+  zone_profile_t zone;
+  std::string error;
+  CHECK(!parseZone("sunflowers,32", &zone, &error) && error == "2 fields, expected 29");
+  std::string line = ZONES[0];
+  CHECK(!parseZone("sixteen letters!" + line.substr(10), &zone, &error));
+  CHECK(!parseZone(line.substr(0, 11) + "300" + line.substr(13), &zone, &error));
+  CHECK(error == "invalid sensor_pin \"300\"");
+  CHECK(!parseZone(line.substr(0, line.size() - 1) + "2", &zone, &error));
+  CHECK(error == "invalid enabled \"2\"");
+  CHECK(validProfileName("summer") && !validProfileName("") &&
+    !validProfileName("ninechars") && !validProfileName("a/b"));
+}
+
+int main()
+{
+  testCrc();
+  testLayout();
+  testRoundTrip();
+  testDamage();
+  testParseErrors();
+  printf("%u checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#ifndef PUMP10_H
+#define PUMP10_H
+
+// Using 'polyfill' library to allow standard `analogWrite()` function use.
+// With that, no ESP32 specific api libraries or methods are needed. for PWM
+// motor control or analog sensor reading.
+#include <analogWrite.h>
+#include "smart_time.h"
+#include "watering_window.h"
+#include "log_format.h"
+#include "instrumentation.h"
+#include "watering_management.h"
+#include "io_task.h"
+#include "external_adc.h"
+#include "pwm_expander.h"
+#include "valve_manifold.h"
+#include "flow_meter.h"
+#include "reservoir.h"
+#include "irrigation_state.h"
+#include "zone_checkpoint.h"
+#include "power_management.h"
+#include "sensor_calibration.h"
+#include "benchmark.h"
+#include "event_log.h"
+#include "metrics.h"
+#include "status_server.h"
+#include "wifi_link.h"
+#include "clock_sync.h"
+#include "mqtt_telemetry.h"
+#include "power_coordinator.h"
+#include "zone_config.h"
+#include "config_profile.h"
+
+#endif
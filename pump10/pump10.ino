@@ -0,0 +1,628 @@
+/* ESP32 Automatic Plant Watering
+
+  Capacitive moisture sensors combined with windshield washer pumps to supply
+  more water when the detected moisture falls below configured limits.
+
+  This version is using one state machine per sensor+pump pair in a single
+  thread. None of the statemachine code is `allowed` to block. Each state
+  machine can transition between states independent of the others. There is a
+  single power budget that is common between all of the pumps, but that has
+  its own state was well, and does not block. Pumps can only operate at the
+  same time while their combined peak current fits the shared power supply.
+ */
+#include "pump10.h"
+
+// declared here so the compiler checks each message format against its arguments
+void logStateInformation(const irrigation_context_t * const, const smart_time_t,
+  const char *, ...) __attribute__((format(printf, 3, 4)));
+
+const unsigned long SERIAL_BAUD = 115200;
+// reset to the first control pass; the console wait gets whatever setup leaves of it
+const unsigned long BOOT_CONTROL_DEADLINE = 2000;
+const uint32_t PWM_MAX_VALUE = 255;
+const unsigned long READING_INTERVAL = 450;
+const unsigned long RESOURCE_WAIT_TIMEOUT = 10000; // 10 seconds; better get power by then
+const unsigned int POWER_BUDGET = 5000; // milliamps available for pump motors
+const unsigned long DRYING_RATE_WINDOW = 60000; // 1 minute minimum to measure drying
+const unsigned long SAMPLE_INTERVAL_MIN = 0; // read on every pass when close to dry
+const unsigned long SAMPLE_INTERVAL_MAX = 900000; // 15 minutes between readings
+const unsigned long MUX_SETTLE_MICROS = 50;
+const unsigned long SCAN_STEP_MICROS = 250;
+const unsigned long EXTERNAL_READING_TIMEOUT = 50; // milliseconds
+const unsigned long PWM_EXPANDER_FREQUENCY = 1000; // Hz
+const unsigned long SENSOR_READING_TTL = 1000; // 1 second
+const unsigned long RESERVOIR_READING_INTERVAL = 10000; // 10 seconds
+const power_mode_t POWER_MODE = POWER_LIGHT_SLEEP;
+const unsigned long SLEEP_INTERVAL_MAX = 900000; // 15 minutes
+const unsigned long DEEP_SLEEP_MIN = 30000; // shorter waits use light sleep
+const unsigned long POWER_REPORT_INTERVAL = 3600000; // 1 hour
+const unsigned long CALIBRATION_MIN_SAMPLES = 100;
+const unsigned long CALIBRATION_MAX_SAMPLES = 100000;
+const unsigned long CALIBRATION_TIMEOUT = 10000; // 10 seconds
+const unsigned long CALIBRATION_SAMPLE_MICROS = 1000;
+const float CALIBRATION_TOLERANCE = 2.0; // raw reading units, at 95% confidence
+const size_t CONSOLE_LINE_MAX = 40;
+const char * BENCHMARK_REVISION = "pump10";
+const unsigned long BENCHMARK_ITERATIONS = 1000;
+const unsigned long BENCHMARK_LOG_ITERATIONS = 10; // each one writes a console line
+const unsigned long CLOCK_SYNC_INTERVAL = 3600000; // 1 hour between NTP syncs
+const unsigned long CLOCK_RETRY_INTERVAL = 60000; // after a failed sync
+const unsigned long CLOCK_REPLY_TIMEOUT = 2000;
+const unsigned long CLOCK_STEP_LIMIT = 2000; // larger errors are stepped, not slewed
+const unsigned long CLOCK_SLEW_DIVISOR = 2000; // slew 1 ms per 2 seconds (500 ppm)
+const unsigned long WINDOW_CLOCK_RETRY = 60000; // check again for a set clock
+const unsigned long WINDOW_RECHECK_LIMIT = 3600000; // evaluate windows at least hourly
+const unsigned long MQTT_PUBLISH_INTERVAL = 60000; // 1 minute batches
+const unsigned long MQTT_RETRY_INTERVAL = 30000; // connecting blocks the loop
+const size_t MQTT_DRAIN_BATCHES = 4; // queued batches sent per pass
+const uint16_t MQTT_KEEPALIVE_SECONDS = 15; // the broker drops quiet clients
+// boards sharing one power supply. Each board needs its own SITE_BOARD_ID
+const uint8_t SITE_BOARD_ID = 1;
+const size_t SITE_BOARDS = 1; // 1 to use only this board's POWER_BUDGET
+const unsigned int SITE_POWER_BUDGET = 5000; // milliamps for all boards
+const uint16_t COORD_PORT = 47810;
+const unsigned long COORD_HEARTBEAT_INTERVAL = 1000;
+const unsigned long COORD_PEER_TIMEOUT = 3500;
+const unsigned long COORD_REQUEST_INTERVAL = 500; // resend unanswered requests
+const unsigned long LEASE_MILLIS = 15000; // longer than maximumWatering
+const unsigned long LEASE_RENEW_MILLIS = 5000; // renew when less is left
+const unsigned long LEASE_MARGIN = 1000; // holder stops this much early
+
+// defaults; replaced by the active configuration profile, when there is one
+const struct watering_zone_t sunflowers = {
+  "zone 1",
+  {A2, {2000, 1210}, ONBOARD_ADC, 0}, // sensor on gpio 34 plus calibration data
+  // {MOISTURE_PERCENTAGE, 30.0, 1000, 5000}, // rules
+  {30.0, 1000, 5000, 45.0, 500, 8000, 0}, // rules; adaptive up to 45%
+  // pump control on gpio 32; soft start over 300 milliseconds
+  {32, PWM_MAX_VALUE >> 3, 0, 300, 3000, 12000, ONBOARD_PWM, 0, {0, 0, 0}},
+  {NO_MANIFOLD, 0}, // own pump, no valve
+  NO_RESERVOIR, // 1 to draw from the first reservoir
+  NO_SCHEDULE // 1 to water only in the cool hours of the first schedule
+};
+
+// external converters and multiplexers for sensors beyond the ADC1 pins
+const struct external_adc_t externalSensorInputs[] = {
+  // {ADC_ADS1115, 0x48, 0, {0, 0, 0, 0}, 4}, // converter at default address
+  // {ADC_ANALOG_MUX, 0, A4, {16, 17, 18, 19}, 16}, // multiplexer into gpio 32
+};
+const size_t EXTERNAL_ADCS = sizeof(externalSensorInputs) / sizeof(externalSensorInputs[0]);
+
+// PWM expanders for pump motor controllers beyond the available gpio pins
+const struct pwm_expander_t pumpOutputs[] = {
+  // {0x40}, // expander at default address
+};
+const size_t PWM_EXPANDERS = sizeof(pumpOutputs) / sizeof(pumpOutputs[0]);
+
+// pumps shared by several zones through solenoid valves
+const struct valve_manifold_t valveManifolds[] = {
+  // pump on gpio 33, flow meter on gpio 23 using pulse counter unit 0
+  // {{33, PWM_MAX_VALUE >> 2, 0, 300, 3000, 12000, ONBOARD_PWM, 0, {23, 0, 450}}},
+};
+const size_t VALVE_MANIFOLDS = sizeof(valveManifolds) / sizeof(valveManifolds[0]);
+
+// water supplies with level sensors
+const struct reservoir_t waterReservoirs[] = {
+  // level sensor on gpio 35; suspend below 10%, resume at 20%
+  // {{A7, {0, 4095}, ONBOARD_ADC, 0}, 10.0, 20.0},
+};
+const size_t RESERVOIRS = sizeof(waterReservoirs) / sizeof(waterReservoirs[0]);
+
+// times of day (local) when zones are allowed to water
+const struct watering_schedule_t wateringSchedules[] = {
+  // early morning every day, and evenings on weekends (Sunday and Saturday)
+  {{{EVERY_DAY, 5 * 60, 8 * 60}, {0x41, 19 * 60, 21 * 60}}, 2},
+};
+const size_t SCHEDULES = sizeof(wateringSchedules) / sizeof(wateringSchedules[0]);
+
+const size_t DEFINED_ZONES = 15;
+// const size_t DEFINED_ZONES = sizeof(allZones) / sizeof(allZones[0]);
+struct irrigation_context_t allZones[DEFINED_ZONES];
+struct irrigation_context_t benchZones[DEFINED_ZONES]; // scratch zones for benchmarks
+// irrigation state saved across deep sleep, and staging for NVS checkpoints
+RTC_DATA_ATTR struct zone_checkpoint_t zoneCheckpoint[DEFINED_ZONES];
+
+void setup() {
+  bool resuming = wokeFromDeepSleep();
+  Serial.begin(SERIAL_BAUD);      // open serial port, set the baud rate
+  if (!resuming) {
+    Serial.println("Start pump10 test sketch");
+  }
+  // hardware_initialize();
+  beginExternalAdcs(externalSensorInputs, EXTERNAL_ADCS);
+  beginPwmExpanders(pumpOutputs, PWM_EXPANDERS);
+  beginManifolds(valveManifolds, VALVE_MANIFOLDS);
+  beginFlowMeters();
+  beginReservoirs(waterReservoirs, RESERVOIRS, getSmartTime());
+  beginWateringWindows(wateringSchedules, SCHEDULES);
+  beginWifi(); // network details are in secrets.h
+  beginClock();
+  beginStatusServer();
+  beginTelemetry(getSmartTime());
+  beginPowerCoordinator();
+
+  beginInstrumentation();
+  preFillZones(allZones, DEFINED_ZONES);
+  // Initialize active irrigation zones
+  configureZone(&allZones[0], sunflowers);
+  for (size_t i = 0; i < DEFINED_ZONES; i++) {
+    if (allZones[i].state != ZONE_DISABLED && loadCalibration(&allZones[i], i)) {
+      Serial.printf("LOG: using saved sensor calibration for %s\n",
+        allZones[i].zone.name.c_str());
+    }
+  }
+  powerReserved = 0;
+  beginZoneConfig(allZones, DEFINED_ZONES);
+  beginProfiles(allZones, DEFINED_ZONES); // before zone states are restored
+  smart_time_t smartTime = getSmartTime();
+  if (resuming) {
+    resumeFromDeepSleep(allZones, zoneCheckpoint, DEFINED_ZONES, smartTime);
+  } else if (loadCheckpoint(zoneCheckpoint, DEFINED_ZONES)) {
+    // outage length is unknown: continue soak periods for their full remaining time
+    restoreZones(allZones, zoneCheckpoint, DEFINED_ZONES, smartTime, 0);
+    recoverInterruptedZones(allZones, DEFINED_ZONES, smartTime);
+    Serial.println("LOG: irrigation zones restored from checkpoint");
+  }
+  if (!resuming) {
+    if (millis() > BOOT_CONTROL_DEADLINE) {
+      Serial.printf("LOG: boot deadline missed by %lu milliseconds\n",
+        millis() - BOOT_CONTROL_DEADLINE);
+    }
+    // no wait for a console: input typed during boot stays buffered for the
+    // first pass, and a headless board starts control right away
+    Serial.printf("LOG: irrigation control started %lu milliseconds after boot\n",
+      millis());
+  }
+} // end setup()
+
+void loop() {
+  recordPassStart();
+  disciplineClock();
+  smart_time_t smartTime = getSmartTime();
+  bool saveNeeded = false;
+  bool stateChanged = false;
+  loadNextProfileZone();
+  applyZoneConfig(allZones, DEFINED_ZONES); // between passes: never half updated
+  startSensorScan(); // external sensor readings arrive while zones are processed
+  checkWaterLevel(allZones, DEFINED_ZONES, smartTime);
+  coordinatePower(allZones, DEFINED_ZONES, smartTime);
+  refreshSensorCache(allZones, DEFINED_ZONES, smartTime);
+  for (size_t i = 0; i < DEFINED_ZONES; i++) {
+    irrigation_state_t previousState = allZones[i].state;
+    if (!checkIrrigationZone(&allZones[i], smartTime)) {
+      emergencyShutdown(allZones, i, smartTime);
+    }
+    saveNeeded |= checkpointNeeded(previousState, allZones[i].state);
+    if (allZones[i].state != previousState) {
+      recordEvent(smartTime, i, allZones[i].state, allZones[i].reading.moisture);
+      stateChanged = true;
+    }
+  }
+  if (saveNeeded) {
+    saveCheckpoint(allZones, zoneCheckpoint, DEFINED_ZONES, smartTime);
+  }
+  flushPwmExpanders(); // all pump output changes from this pass together
+  updateMetrics(allZones, DEFINED_ZONES, smartTime);
+  updateStatusSnapshot(allZones, DEFINED_ZONES, smartTime, stateChanged);
+  collectTelemetry(allZones, DEFINED_ZONES, smartTime);
+  recordPassEnd();
+  checkConsole(allZones, DEFINED_ZONES);
+  powerNap(allZones, zoneCheckpoint, DEFINED_ZONES);
+} // end loop()
+
+bool checkIrrigationZone(irrigation_context_t * iZone, smart_time_t timeTick)
+{
+  // state transitions from processing are used to trigger events outside of
+  // the state machine. The state machine code handles the actual transitions
+  // and irrigation, but notifications are external. Possibly implemented as
+  // callbacks later.
+  irrigation_state_t handlerState = iZone->state;
+  if (handlerState == ZONE_DISABLED) {
+    return true; // nothing to do, and nothing worth timing
+  }
+  uint32_t started = cycleCount();
+  switch (iZone -> state) {
+    case MOISTURE_GOOD:
+      whenMoistureGood(iZone, timeTick);
+      if (iZone->state != MOISTURE_GOOD) {
+        logStateInformation(iZone, timeTick, "%s has gone dry", iZone->zone.name.c_str());
+      }
+      break;
+    case RESERVE_RESOURCES:
+      whenReserveResources(iZone, timeTick);
+      if (iZone->state == MOISTURE_GOOD) {
+        logStateInformation(iZone, timeTick, "watering canceled for %s",
+          iZone->zone.name.c_str());
+      }
+      if (iZone->state == DELIVERING_WATER) {
+        logStateInformation(iZone, timeTick, "water delivery started for %s",
+          iZone->zone.name.c_str());
+      }
+      break;
+    case RESOURCE_LOCK_TIMEOUT:
+      whenResourceTimeout(iZone, timeTick);
+      logResourceTimeout(iZone, timeTick);
+      break;
+    case DELIVERING_WATER:
+      whenDeliveringWater(iZone, timeTick);
+      if (iZone->state != DELIVERING_WATER) {
+        logStateInformation(iZone, timeTick, "watering event finished for %s",
+          iZone->zone.name.c_str());
+      }
+      break;
+    case SOAKING_IN:
+      whenSoakingIn(iZone, timeTick);
+      if (iZone->state != SOAKING_IN) {
+        logStateInformation(iZone, timeTick, "post watering soak period finished for %s",
+          iZone->zone.name.c_str());
+      }
+      break;
+    default:
+      logStateInformation(iZone, timeTick, "unhandled state %d for %s", iZone->state,
+        iZone->zone.name.c_str());
+      // shut everything down to a safe state, and scream for help
+      return false;
+  }
+  recordTiming(&handlerTimingRecords[handlerState], started);
+  return true;
+} // end checkIrrigationZone()
+
+/**
+ * emergency shutdown
+ *
+ * An impossible state has been detected. Shutdown all irrigation until the
+ * issue has been resolved.
+ *
+ * @param[in,out] contexts array irrigation state machine contexts
+ * @param[in] context index of context that triggered shutdown
+ * @param[in] tick reference time point for state processing
+ */
+void emergencyShutdown(irrigation_context_t * contexts,
+  size_t context, smart_time_t tick)
+{
+  size_t lowContext = 0;
+  size_t highContext = DEFINED_ZONES;
+  if (context < DEFINED_ZONES) {
+    Serial.printf("Emergency shutdown triggered by irrigation context %s\n",
+      contexts[context].zone.name.c_str());
+    // "as of %«timestamp»", tick
+    lowContext = context;
+    highContext = context + 1;
+  } else {
+    Serial.printf("Emergency shutdown triggered by unknown irrigation context %u\n",
+      (unsigned int)context);
+  }
+  for (size_t i = lowContext; i < highContext; i++) {
+    fullDebugDump(&contexts[i], i, tick);
+  }
+  // Full shutdown all contexts
+  releasePowerToken(powerReserved);
+  endSiteLease();
+  powerReserved = POWER_BUDGET; // lock: no pump can get power
+
+  for (size_t i = 0; i < DEFINED_ZONES; i++) {
+    cancelPumpTimer(contexts[i].pump_timer);
+    disarmFlowMeter(deliveryFlowMeter(&contexts[i]));
+    if (contexts[i].zone.valve.manifold == NO_MANIFOLD) {
+      stopPump(contexts[i].zone.pump);
+    } else {
+      closeValve(contexts[i].zone.valve);
+    }
+    contexts[i].state = ZONE_DISABLED;
+  }
+  shutdownManifolds();
+  flushPwmExpanders();
+  // send high priority notifications
+} // end emergencyShutdown()
+
+/**
+ * metric sink: write rendered text to the console
+ *
+ * @param[in] text rendered text
+ * @param[in] length number of characters
+ * @param arg not used
+ * @return true to keep rendering
+ */
+bool consoleSink(const char * text, size_t length, void * arg)
+{
+  Serial.write((const uint8_t *)text, length);
+  return true;
+} // end consoleSink()
+
+/**
+ * collect console input, and run completed command lines
+ *
+ * Does not block waiting for input. Commands:
+ *   calibrate «zone number» air|water
+ *   stats
+ *   bench
+ *   metrics [binary]
+ *   profile save|load «name»
+ *   profile list
+ *   clock
+ *
+ * @param[in,out] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ */
+void checkConsole(irrigation_context_t * contexts, const size_t count)
+{
+  static char line[CONSOLE_LINE_MAX + 1];
+  static size_t length = 0;
+  while (Serial.available() > 0) {
+    char next = Serial.read();
+    if (length == 0 && configFrameByte(next)) {
+      continue; // binary zone configuration command
+    }
+    if (next != '\n' && next != '\r') {
+      if (length < CONSOLE_LINE_MAX) {
+        line[length++] = next;
+      }
+      continue;
+    }
+    line[length] = '\0';
+    length = 0;
+
+    unsigned int zoneNumber;
+    char point[6];
+    char profileName[PROFILE_NAME_SIZE];
+    if (sscanf(line, "calibrate %u %5s", &zoneNumber, point) == 2) {
+      if (zoneNumber < 1 || zoneNumber > count ||
+          contexts[zoneNumber - 1].state == ZONE_DISABLED) {
+        Serial.printf("no active zone %u\n", zoneNumber);
+      } else if (strcmp(point, "air") == 0 || strcmp(point, "water") == 0) {
+        if (calibrateZone(&contexts[zoneNumber - 1], zoneNumber - 1,
+            strcmp(point, "air") == 0 ? CALIBRATE_AIR : CALIBRATE_WATER)) {
+          setZoneCalibration(zoneNumber - 1,
+            contexts[zoneNumber - 1].zone.sensor.moisture_calibration);
+        }
+      } else {
+        Serial.println("calibrate «zone number» air|water");
+      }
+    } else if (sscanf(line, "profile save %8s", profileName) == 1) {
+      Serial.println(saveProfile(profileName) ? "profile saved" : "profile not saved");
+    } else if (sscanf(line, "profile load %8s", profileName) == 1) {
+      Serial.println(activateProfile(profileName) ? "profile loading" : "no valid profile");
+    } else if (strcmp(line, "profile list") == 0) {
+      listProfiles();
+    } else if (strcmp(line, "metrics") == 0) {
+      renderPrometheus(consoleSink, NULL);
+    } else if (strcmp(line, "metrics binary") == 0) {
+      writeMetricFrame();
+    } else if (strcmp(line, "bench") == 0) {
+      runBenchmarks();
+    } else if (strcmp(line, "clock") == 0) {
+      printClockStatus();
+    } else if (strcmp(line, "stats") == 0) {
+      dumpInstrumentation();
+      Serial.println("pump usage:");
+      for (size_t i = 0; i < count; i++) {
+        if (contexts[i].state != ZONE_DISABLED) {
+          printPumpUsage(contexts[i].zone.name.c_str(), &contexts[i].usage);
+        }
+      }
+      for (size_t i = 0; i < VALVE_MANIFOLDS; i++) {
+        printPumpUsage(("manifold " + String((unsigned int)(i + 1))).c_str(),
+          &manifoldStates[i].usage);
+      }
+    } else if (line[0] != '\0') {
+      Serial.printf("unknown command: %s\n", line);
+    }
+  }
+} // end checkConsole()
+
+void benchEmpty(void * arg) {}
+
+void benchSoilMoisture(void * arg)
+{
+  getSoilMoisture(((irrigation_context_t *)arg)->zone.sensor);
+}
+
+void benchWaterNeeded(void * arg)
+{
+  irrigation_context_t * context = (irrigation_context_t *)arg;
+  waterNeeded(&context->zone, &context->response, 10.0); // dry
+}
+
+void benchGetSmartTime(void * arg)
+{
+  *(smart_time_t *)arg = getSmartTime();
+}
+
+void benchSmartOffset(void * arg)
+{
+  *(smart_time_t *)arg = smartOffsetMillis(*(smart_time_t *)arg, 1);
+}
+
+void benchSmartCompare(void * arg)
+{
+  smartTimeCompare(*(smart_time_t *)arg, NULL_TIME);
+}
+
+void benchSmartDelta(void * arg)
+{
+  smartDeltaMillis(NULL_TIME, *(smart_time_t *)arg);
+}
+
+void benchLogState(void * arg)
+{
+  irrigation_context_t * context = (irrigation_context_t *)arg;
+  logStateInformation(context, NULL_TIME, "benchmark for %s", context->zone.name.c_str());
+}
+
+// the String and printf log path used before log_line_t, for comparison
+void benchLogString(void * arg)
+{
+  irrigation_context_t * context = (irrigation_context_t *)arg;
+  String logFormat = "LOG: " + String("benchmark for %s") +
+    " as of time tick «%lu,%lu»¦%u|%f\n";
+  Serial.printf(logFormat.c_str(), context->zone.name.c_str(),
+    NULL_TIME.epoch, NULL_TIME.millis, context->reading.raw, context->reading.moisture);
+}
+
+// formatting only, without the console write
+void benchLogFormat(void * arg)
+{
+  irrigation_context_t * context = (irrigation_context_t *)arg;
+  log_line_t<LOG_LINE_SIZE> line;
+  line.append("LOG: benchmark for %s as of time tick «%lu,%lu»¦%u|%f\n",
+    context->zone.name.c_str(), NULL_TIME.epoch, NULL_TIME.millis,
+    context->reading.raw, context->reading.moisture);
+}
+
+void benchCheckZone(void * arg)
+{
+  irrigation_context_t * context = (irrigation_context_t *)arg;
+  smart_time_t tick = getSmartTime();
+  context->target_time = NULL_TIME; // reading due
+  context->reading = EMPTY_SENSOR_CACHE;
+  checkIrrigationZone(context, tick);
+}
+
+/**
+ * one full pass over a set of zones, with every zone reading its sensor
+ *
+ * @param arg the zones to process
+ */
+void benchTick(void * arg)
+{
+  bench_zones_t * zones = (bench_zones_t *)arg;
+  smart_time_t tick = getSmartTime();
+  for (size_t i = 0; i < zones->count; i++) {
+    zones->contexts[i].target_time = NULL_TIME;
+    zones->contexts[i].reading = EMPTY_SENSOR_CACHE;
+  }
+  // external sensors read from the live scan's cache: restarting it would
+  // throw away the live zones' next readings
+  refreshSensorCache(zones->contexts, zones->count, tick);
+  for (size_t i = 0; i < zones->count; i++) {
+    checkIrrigationZone(&zones->contexts[i], tick);
+  }
+}
+
+/**
+ * time the control path primitives, and full passes at increasing zone counts
+ *
+ * Uses scratch copies of the first zone's configuration, that never get dry
+ * enough to water. The copies do not set up the valve hardware, and timings
+ * and sensor read counts go to private records, so the live zones and their
+ * reports are not disturbed. Blocks until done; running deliveries are
+ * stopped by their own timers.
+ */
+void runBenchmarks()
+{
+  section_timing_t benchHandlerTimings[TIMED_HANDLERS] = {};
+  section_timing_t benchSensorReadTiming = {};
+  unsigned long liveSensorReads = sensorReads;
+  preFillZones(benchZones, DEFINED_ZONES);
+  for (size_t i = 0; i < DEFINED_ZONES; i++) {
+    benchZones[i].zone = allZones[0].zone;
+    benchZones[i].zone.rules.moisturePercentage = 0; // never starts watering
+    benchZones[i].state = MOISTURE_GOOD;
+  }
+  useTimingRecords(benchHandlerTimings, &benchSensorReadTiming);
+  smart_time_t tick = getSmartTime();
+  benchmarkHeader();
+  runBenchmark("empty", 0, BENCHMARK_ITERATIONS, benchEmpty, NULL);
+  runBenchmark("getSoilMoisture", 1, BENCHMARK_ITERATIONS, benchSoilMoisture, &benchZones[0]);
+  runBenchmark("waterNeeded", 1, BENCHMARK_ITERATIONS, benchWaterNeeded, &benchZones[0]);
+  runBenchmark("getSmartTime", 0, BENCHMARK_ITERATIONS, benchGetSmartTime, &tick);
+  runBenchmark("smartOffsetMillis", 0, BENCHMARK_ITERATIONS, benchSmartOffset, &tick);
+  runBenchmark("smartTimeCompare", 0, BENCHMARK_ITERATIONS, benchSmartCompare, &tick);
+  runBenchmark("smartDeltaMillis", 0, BENCHMARK_ITERATIONS, benchSmartDelta, &tick);
+  runBenchmark("checkIrrigationZone", 1, BENCHMARK_ITERATIONS, benchCheckZone, &benchZones[0]);
+  runBenchmark("logStateInformation", 1, BENCHMARK_LOG_ITERATIONS, benchLogState,
+    &benchZones[0]);
+  runBenchmark("logStringPrintf", 1, BENCHMARK_LOG_ITERATIONS, benchLogString,
+    &benchZones[0]);
+  runBenchmark("logLineFormat", 1, BENCHMARK_ITERATIONS, benchLogFormat, &benchZones[0]);
+  for (size_t count = 1; count <= DEFINED_ZONES; count *= 2) {
+    bench_zones_t zones = { benchZones, count };
+    runBenchmark("tick", count, BENCHMARK_ITERATIONS, benchTick, &zones);
+  }
+  bench_zones_t allBench = { benchZones, DEFINED_ZONES };
+  runBenchmark("tick", DEFINED_ZONES, BENCHMARK_ITERATIONS, benchTick, &allBench);
+  useTimingRecords(NULL, NULL);
+  sensorReads = liveSensorReads;
+} // end runBenchmarks()
+
+void fullDebugDump(irrigation_context_t * context,
+  size_t index, smart_time_t tick)
+{
+  Serial.printf("Dumping state information for irrigation context %s(%u)\n",
+    context->zone.name.c_str(), (unsigned int)index);
+  Serial.printf("State: %d\n", context->state);
+  // TODO add all of the context details
+}
+
+void logStateInformation(const irrigation_context_t * const iZone,
+  const smart_time_t tick, const char * format, ...)
+{
+  // built on the stack: state transitions do not touch the heap
+  log_line_t<LOG_LINE_SIZE> line;
+  line.append("LOG: ");
+  va_list args;
+  va_start(args, format);
+  line.appendList(format, args);
+  va_end(args);
+  // include the zone's latest raw and calibrated sensor reading
+  line.append(" as of time tick «%lu,%lu»¦%u|%f\n", tick.epoch, tick.millis,
+    iZone->reading.raw, iZone->reading.moisture);
+  Serial.write((const uint8_t *)line.text, line.length);
+}
+
+void logResourceTimeout(const irrigation_context_t * const iZone,
+  const smart_time_t tick)
+{
+  // manage reporting of long waits to access power for a pump
+  // (or other watering resources)
+  // possibilities: track and queue repeating reports
+  // possible multiple contexts (zone) waiting simultaneously
+  // possible serious problem: pump not shutting off, and creating a flood
+  logStateInformation(iZone, tick, "resource wait timeout for %s", iZone->zone.name.c_str());
+  Serial.printf("LOG: -- has now waited for resources %lu milliseconds\n",
+    smartDeltaMillis(iZone->gone_dry_time, tick));
+}
+
+/**
+ * populate an array of irrigation zones with empty data
+ *
+ * @param[out] context array of irrigation contexts
+ * @param[in] count the number of contexts in the array
+ */
+void preFillZones(irrigation_context_t * context, const size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    context[i].state = ZONE_DISABLED;
+    context[i].zone = UNUSED_ZONE;
+    context[i].gone_dry_time = NULL_TIME;
+    context[i].target_time = NULL_TIME;
+    context[i].response = UNKNOWN_RESPONSE;
+    context[i].drying = UNKNOWN_DRYING;
+    context[i].reading = EMPTY_SENSOR_CACHE;
+    context[i].window = UNKNOWN_WINDOW;
+    context[i].pump_timer = NULL;
+    context[i].timed_delivery = false;
+    context[i].delivery_started = NULL_TIME;
+    context[i].reserved_power = 0;
+    context[i].usage = { 0, 0 };
+  }
+} // end preFillZones()
+
+/**
+ * add data to an irrigation context, and make it active
+ *
+ * @param[out] context the irrigation context to use
+ * @param[in] zone populated watering zone configuration data
+ */
+void configureZone(irrigation_context_t * context, const watering_zone_t zone)
+{
+  context->zone = zone;
+  setupValve(zone.valve);
+  context->response = UNKNOWN_RESPONSE;
+  context->drying = UNKNOWN_DRYING;
+  context->reading = EMPTY_SENSOR_CACHE;
+  context->window = UNKNOWN_WINDOW;
+  context->target_time = NULL_TIME; // read the sensor on the first pass
+  context->state = MOISTURE_GOOD;
+} // end configureZone()
@@ -0,0 +1,159 @@
+/**
+ * methods to drive PCA9685 class I2C PWM expanders with batched register writes
+ */
+#include "pwm_expander.h"
+
+const uint8_t PCA9685_MODE1 = 0x00;
+const uint8_t PCA9685_MODE2 = 0x01;
+const uint8_t PCA9685_LED0_ON_L = 0x06;
+const uint8_t PCA9685_PRE_SCALE = 0xFE;
+const uint8_t MODE1_SLEEP = 0x10;
+const uint8_t MODE1_AUTO_INCREMENT = 0x20;
+const uint8_t MODE2_TOTEM_POLE = 0x04;
+// bit 4 of the ON_H or OFF_H register forces the output fully on or off
+const uint8_t FULL_ON_OFF = 0x10;
+const unsigned long PCA9685_OSCILLATOR = 25000000;
+
+const pwm_expander_t * pwmExpanders = NULL;
+size_t pwmExpanderCount = 0;
+// duty settings not sent yet, and the range of channels that changed
+uint16_t shadowDuty[MAX_PWM_EXPANDERS][PWM_EXPANDER_CHANNELS];
+uint8_t dirtyLow[MAX_PWM_EXPANDERS];
+uint8_t dirtyHigh[MAX_PWM_EXPANDERS];
+// changes made to the shadow copy, and the last of them sent to the expander
+uint32_t shadowGeneration[MAX_PWM_EXPANDERS];
+uint32_t sentGeneration[MAX_PWM_EXPANDERS];
+// pump timers change duty from the esp_timer task
+portMUX_TYPE shadowLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * write a single expander register
+ *
+ * @param[in] address I2C address of the expander
+ * @param[in] reg register number
+ * @param[in] value new register value
+ */
+void writeExpanderRegister(const uint8_t address, const uint8_t reg, const uint8_t value)
+{
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+} // end writeExpanderRegister()
+
+/**
+ * set up the PWM expanders, with all outputs off
+ *
+ * @param[in] expanders array of expander configurations; must stay in memory
+ * @param[in] count the number of expanders in the array
+ * @return true when all expanders responded
+ */
+bool beginPwmExpanders(const pwm_expander_t * expanders, const size_t count)
+{
+  pwmExpanders = expanders;
+  pwmExpanderCount = min(count, MAX_PWM_EXPANDERS);
+  if (pwmExpanderCount == 0) {
+    return true;
+  }
+  if (!beginIoTask()) {
+    return false;
+  }
+  lockBus();
+  Wire.begin();
+  Wire.setClock(400000);
+  uint8_t prescale = PCA9685_OSCILLATOR / (4096UL * PWM_EXPANDER_FREQUENCY) - 1;
+  bool found = true;
+  for (size_t i = 0; i < pwmExpanderCount; i++) {
+    uint8_t address = expanders[i].i2c_address;
+    // the prescaler can only be changed while the oscillator is asleep
+    writeExpanderRegister(address, PCA9685_MODE1, MODE1_SLEEP);
+    writeExpanderRegister(address, PCA9685_PRE_SCALE, prescale);
+    writeExpanderRegister(address, PCA9685_MODE2, MODE2_TOTEM_POLE);
+    Wire.beginTransmission(address);
+    Wire.write(PCA9685_MODE1);
+    Wire.write(MODE1_AUTO_INCREMENT);
+    found &= Wire.endTransmission() == 0;
+    for (uint8_t channel = 0; channel < PWM_EXPANDER_CHANNELS; channel++) {
+      shadowDuty[i][channel] = 0;
+    }
+    dirtyLow[i] = 0;
+    dirtyHigh[i] = PWM_EXPANDER_CHANNELS - 1;
+    shadowGeneration[i] = sentGeneration[i] + 1;
+  }
+  unlockBus();
+  delayMicroseconds(500); // oscillator start up
+  flushPwmExpanders();
+  return found;
+} // end beginPwmExpanders()
+
+/**
+ * change the duty setting for an expander channel
+ *
+ * Nothing is sent to the expander until the next `flushPwmExpanders()`.
+ *
+ * @param[in] expander index into the expander configurations
+ * @param[in] channel output channel on the expander
+ * @param[in] duty new setting, 0 to PWM_EXPANDER_MAX
+ */
+void setExpanderDuty(const uint8_t expander, const uint8_t channel, const uint16_t duty)
+{
+  if (expander >= pwmExpanderCount || channel >= PWM_EXPANDER_CHANNELS) {
+    return;
+  }
+  portENTER_CRITICAL(&shadowLock);
+  shadowDuty[expander][channel] = min(duty, PWM_EXPANDER_MAX);
+  shadowGeneration[expander]++;
+  if (dirtyLow[expander] > dirtyHigh[expander]) {
+    dirtyLow[expander] = channel;
+    dirtyHigh[expander] = channel;
+  } else {
+    dirtyLow[expander] = min(dirtyLow[expander], channel);
+    dirtyHigh[expander] = max(dirtyHigh[expander], channel);
+  }
+  portEXIT_CRITICAL(&shadowLock);
+} // end setExpanderDuty()
+
+/**
+ * send all pending duty changes
+ *
+ * One auto-increment write per expander with changes, starting at the lowest
+ * changed channel. Unchanged channels inside the range are rewritten with
+ * their current setting, which costs less than a separate transaction.
+ *
+ * Called from the control loop, and from the I/O task. The bus lock keeps
+ * the copy and the send together, so the expanders see the sends in order,
+ * and a copy that is not newer than the last one sent is never sent.
+ */
+void flushPwmExpanders()
+{
+  lockBus();
+  for (size_t i = 0; i < pwmExpanderCount; i++) {
+    uint16_t duty[PWM_EXPANDER_CHANNELS];
+    portENTER_CRITICAL(&shadowLock);
+    uint32_t generation = shadowGeneration[i];
+    uint8_t low = dirtyLow[i];
+    uint8_t high = dirtyHigh[i];
+    for (uint8_t channel = low; channel <= high && channel < PWM_EXPANDER_CHANNELS; channel++) {
+      duty[channel] = shadowDuty[i][channel];
+    }
+    dirtyLow[i] = PWM_EXPANDER_CHANNELS; // empty range
+    dirtyHigh[i] = 0;
+    portEXIT_CRITICAL(&shadowLock);
+    if ((int32_t)(generation - sentGeneration[i]) <= 0 || low > high) {
+      continue; // nothing changed since the last send
+    }
+    Wire.beginTransmission(pwmExpanders[i].i2c_address);
+    Wire.write(PCA9685_LED0_ON_L + 4 * low);
+    for (uint8_t channel = low; channel <= high; channel++) {
+      // output turns on at count 0, and off at the duty count
+      uint16_t value = duty[channel];
+      Wire.write(0);
+      Wire.write(value >= PWM_EXPANDER_MAX ? FULL_ON_OFF : 0);
+      Wire.write(value & 0xFF);
+      Wire.write(value == 0 ? FULL_ON_OFF : (value >> 8) & 0x0F);
+    }
+    Wire.endTransmission();
+    sentGeneration[i] = generation;
+  }
+  unlockBus();
+} // end flushPwmExpanders()
@@ -0,0 +1,35 @@
+#ifndef pwm_expander_h
+#define pwm_expander_h
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "io_task.h"
+
+/**
+ * data structures and methods to drive pump motor controllers from PCA9685
+ * class I2C PWM expanders, for more pumps than there are usable gpio pins.
+ *
+ * Duty changes only update a shadow copy of the expander registers. All of
+ * the changes for an expander are sent together by `flushPwmExpanders()`, in
+ * a single auto-increment write covering the changed channels. Timer
+ * callbacks ask the I/O task to flush, instead of using the bus themselves.
+ */
+
+const size_t MAX_PWM_EXPANDERS = 8;
+const uint8_t PWM_EXPANDER_CHANNELS = 16;
+/// full scale expander duty setting (12 bits)
+const uint16_t PWM_EXPANDER_MAX = 4095;
+
+/// configuration for a PWM expander
+struct pwm_expander_t {
+  /// I2C address of the expander
+  uint8_t i2c_address;
+};
+
+extern const unsigned long PWM_EXPANDER_FREQUENCY;
+
+bool beginPwmExpanders(const pwm_expander_t *, const size_t);
+void setExpanderDuty(const uint8_t, const uint8_t, const uint16_t);
+void flushPwmExpanders(void);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * methods to read reservoir levels, and suspend watering when a reservoir is low
+ */
+#include "reservoir.h"
+
+const reservoir_t * reservoirs = NULL;
+size_t reservoirCount = 0;
+reservoir_state_t reservoirStates[MAX_RESERVOIRS];
+
+/**
+ * set up reservoir monitoring, starting with a reading of every reservoir
+ *
+ * @param[in] config array of reservoir configurations; must stay in memory
+ * @param[in] count the number of reservoirs in the array
+ * @param[in] timeTick current time reference
+ * @return true when all reservoirs fit
+ */
+bool beginReservoirs(const reservoir_t * config, const size_t count,
+  const smart_time_t timeTick)
+{
+  reservoirs = config;
+  reservoirCount = min(count, MAX_RESERVOIRS);
+  for (size_t i = 0; i < reservoirCount; i++) {
+    reservoirStates[i].level = getSoilMoisture(reservoirs[i].level_sensor);
+    reservoirStates[i].available = reservoirStates[i].level >= reservoirs[i].minimumLevel;
+    reservoirStates[i].nextReading = smartOffsetMillis(timeTick,
+      RESERVOIR_READING_INTERVAL);
+  }
+  return reservoirCount == count;
+} // end beginReservoirs()
+
+/**
+ * check if a reservoir has enough water for its zones to be watered
+ *
+ * Uses the cached state only.
+ *
+ * @param[in] reservoir NO_RESERVOIR, or 1 + index of the reservoir
+ * @return true when watering can go ahead
+ */
+bool reservoirAvailable(const uint8_t reservoir)
+{
+  if (reservoir == NO_RESERVOIR || reservoir > reservoirCount) {
+    return true;
+  }
+  return reservoirStates[reservoir - 1].available;
+} // end reservoirAvailable()
+
+/**
+ * refresh reservoir levels that are due, and suspend or resume dependent zones
+ *
+ * When a reservoir runs low, zones delivering water from it are ended on the
+ * current pass, and a single notification covers all of the dependent zones.
+ * Zones that go dry while it is low wait in MOISTURE_GOOD.
+ *
+ * @param[in,out] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ */
+void checkWaterLevel(irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  for (size_t i = 0; i < reservoirCount; i++) {
+    reservoir_state_t * state = &reservoirStates[i];
+    if (smartTimeCompare(timeTick, state->nextReading) < 0) {
+      continue;
+    }
+    state->nextReading = smartOffsetMillis(timeTick, RESERVOIR_READING_INTERVAL);
+    state->level = getSoilMoisture(reservoirs[i].level_sensor);
+    bool wasAvailable = state->available;
+    if (wasAvailable && state->level < reservoirs[i].minimumLevel) {
+      state->available = false;
+    } else if (!wasAvailable && state->level >= reservoirs[i].resumeLevel) {
+      state->available = true;
+    }
+    if (state->available == wasAvailable) {
+      continue;
+    }
+
+    size_t dependent = 0;
+    for (size_t z = 0; z < count; z++) {
+      if (contexts[z].state == ZONE_DISABLED || contexts[z].zone.reservoir != i + 1) {
+        continue;
+      }
+      dependent++;
+      if (!state->available && contexts[z].state == DELIVERING_WATER) {
+        endDeliveryNow(&contexts[z], timeTick); // stop pumping on this pass
+      }
+    }
+    // send notifications
+    Serial.printf("LOG: reservoir %u level %.1f%%: watering %s for %u zones as of time tick «%lu,%lu»\n",
+      (unsigned int)(i + 1), state->level,
+      state->available ? "resumed" : "suspended", (unsigned int)dependent,
+      timeTick.epoch, timeTick.millis);
+  }
+} // end checkWaterLevel()
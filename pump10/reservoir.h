@@ -0,0 +1,46 @@
+#ifndef reservoir_h
+#define reservoir_h
+
+#include <Arduino.h>
+#include "smart_time.h"
+#include "watering_management.h"
+#include "irrigation_state.h"
+
+/**
+ * data structures and methods to keep pumps from running a reservoir dry
+ *
+ * Reservoir levels are read on their own schedule, and the result is cached.
+ * Zones check the cached availability when deciding to water, without reading
+ * the level sensor again.
+ */
+
+const size_t MAX_RESERVOIRS = 4;
+
+/// configuration for a water reservoir
+struct reservoir_t {
+  /// level sensor. The calibration `airValue` is the empty reading, and
+  /// `waterValue` the full reading
+  moisture_sensor_t level_sensor;
+  /// level percentage below which dependent pumps must not run
+  float minimumLevel;
+  /// level percentage needed to resume watering after running low
+  float resumeLevel;
+};
+
+/// cached reservoir level
+struct reservoir_state_t {
+  /// latest level percentage
+  float level;
+  /// enough water for dependent zones
+  bool available;
+  /// when to read the level sensor again
+  smart_time_t nextReading;
+};
+
+extern const unsigned long RESERVOIR_READING_INTERVAL;
+
+bool beginReservoirs(const reservoir_t *, const size_t, const smart_time_t);
+bool reservoirAvailable(const uint8_t);
+void checkWaterLevel(irrigation_context_t *, const size_t, const smart_time_t);
+
+#endif
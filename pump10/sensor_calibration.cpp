@@ -0,0 +1,148 @@
+/**
+ * methods to calibrate moisture sensors on the device, using streaming
+ * statistics that stop sampling as soon as the result is good enough
+ */
+#include "sensor_calibration.h"
+#include "external_adc.h"
+
+const char * CALIBRATION_NAMESPACE = "pump10cal";
+// 95% confidence that the true mean is within the half width
+const float CONFIDENCE_Z = 1.96;
+
+Preferences calibrationStore;
+
+/**
+ * update streaming mean and variance with a new sample (Welford's method)
+ *
+ * @param[in,out] stats statistics for the samples collected so far
+ * @param[in] sample new raw reading
+ */
+void addSample(sample_statistics_t * stats, const sensor_reading_t sample)
+{
+  stats->samples++;
+  float delta = sample - stats->mean;
+  stats->mean += delta / stats->samples;
+  stats->sumSquares += delta * (sample - stats->mean);
+  stats->minimum = min(stats->minimum, sample);
+  stats->maximum = max(stats->maximum, sample);
+} // end addSample()
+
+/**
+ * get the half width of the confidence interval for the mean
+ *
+ * @param[in] stats statistics for the samples collected so far
+ * @return raw reading units either side of the mean
+ */
+float confidenceHalfWidth(const sample_statistics_t * stats)
+{
+  if (stats->samples < 2) {
+    return INFINITY;
+  }
+  float variance = stats->sumSquares / (stats->samples - 1);
+  return CONFIDENCE_Z * sqrt(variance / stats->samples);
+} // end confidenceHalfWidth()
+
+/**
+ * build the storage key for a zone's calibration
+ *
+ * @param[in] zone index of the zone
+ * @return preferences key
+ */
+String calibrationKey(const size_t zone)
+{
+  return "zone" + String((unsigned int)zone);
+} // end calibrationKey()
+
+/**
+ * calibrate one end of the sensor range for a zone
+ *
+ * Blocks while sampling: up to CALIBRATION_TIMEOUT. Pumps that are running
+ * are stopped by their own timers. Each sample from an external converter
+ * comes from its own scan.
+ *
+ * @param[in,out] context irrigation state machine context for the zone
+ * @param[in] zone index of the zone, used to save the calibration
+ * @param[in] point the sensor is in air, or in water
+ * @return true when the calibration is accurate to CALIBRATION_TOLERANCE
+ */
+bool calibrateZone(irrigation_context_t * context, const size_t zone,
+  const calibration_point_t point)
+{
+  moisture_sensor_t sensor = context->zone.sensor;
+  sample_statistics_t stats = { 0, 0, 0, UINT16_MAX, 0 };
+  unsigned long started = millis();
+  float halfWidth = INFINITY;
+  bool external = sensor.device != ONBOARD_ADC;
+  // every sample from its own scan: the latest reading is not a new sample
+  uint8_t scan = external ? externalReadingScan(sensor.device - 1, sensor.channel) : 0;
+  sensor_reading_t sample;
+  while (stats.samples < CALIBRATION_MAX_SAMPLES &&
+      millis() - started < CALIBRATION_TIMEOUT) {
+    if (!external) {
+      sample = readSensor(sensor);
+    } else if (!nextExternalReading(sensor.device - 1, sensor.channel, &scan, &sample)) {
+      break; // the converter stopped answering
+    }
+    addSample(&stats, sample);
+    halfWidth = confidenceHalfWidth(&stats);
+    if (stats.samples >= CALIBRATION_MIN_SAMPLES && halfWidth <= CALIBRATION_TOLERANCE) {
+      break;
+    }
+    delayMicroseconds(CALIBRATION_SAMPLE_MICROS);
+  }
+  unsigned long elapsed = millis() - started;
+  bool converged = halfWidth <= CALIBRATION_TOLERANCE;
+  Serial.printf("LOG: %s calibration for %s: %lu samples in %lu milliseconds, "
+    "mean %.1f ±%.2f, range %u to %u%s\n",
+    point == CALIBRATE_AIR ? "air" : "water", context->zone.name.c_str(),
+    stats.samples, elapsed, stats.mean, halfWidth, stats.minimum, stats.maximum,
+    converged ? "" : ": NOT CONVERGED, calibration not changed");
+  if (!converged) {
+    return false;
+  }
+
+  moisture_calibration_t * calibration = &context->zone.sensor.moisture_calibration;
+  if (point == CALIBRATE_AIR) {
+    calibration->airValue = round(stats.mean);
+  } else {
+    calibration->waterValue = round(stats.mean);
+  }
+  context->reading = EMPTY_SENSOR_CACHE; // convert with the new calibration
+  calibrationStore.begin(CALIBRATION_NAMESPACE, false);
+  calibrationStore.putBytes(calibrationKey(zone).c_str(), calibration,
+    sizeof(moisture_calibration_t));
+  calibrationStore.end();
+  return true;
+} // end calibrateZone()
+
+/**
+ * get the on-device calibration saved for a zone
+ *
+ * @param[in] zone index of the zone
+ * @param[out] calibration the saved calibration; unchanged when there is none
+ * @return true when a saved calibration was found
+ */
+bool savedCalibration(const size_t zone, moisture_calibration_t * calibration)
+{
+  moisture_calibration_t saved;
+  calibrationStore.begin(CALIBRATION_NAMESPACE, true);
+  bool found = calibrationStore.getBytes(calibrationKey(zone).c_str(), &saved,
+    sizeof(saved)) == sizeof(saved);
+  calibrationStore.end();
+  if (found) {
+    *calibration = saved;
+  }
+  return found;
+} // end savedCalibration()
+
+/**
+ * replace the configured calibration for a zone with a saved one
+ *
+ * @param[in,out] context irrigation state machine context for the zone
+ * @param[in] zone index of the zone
+ * @return true when a saved calibration was found
+ */
+bool loadCalibration(irrigation_context_t * context, const size_t zone)
+{
+  return savedCalibration(zone, &context->zone.sensor.moisture_calibration);
+} // end loadCalibration()
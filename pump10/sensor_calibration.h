@@ -0,0 +1,47 @@
+#ifndef sensor_calibration_h
+#define sensor_calibration_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "watering_management.h"
+#include "irrigation_state.h"
+
+/**
+ * data structures and methods to calibrate moisture sensors on the device
+ *
+ * The sensor for a zone is held in air, or in water, and sampled until the
+ * confidence interval for the mean reading is narrow enough. The mean becomes
+ * the `airValue` or `waterValue` for the sensor, and is saved to persistent
+ * storage, so it does not need to be typed into the sketch.
+ */
+
+/// which end of the sensor range is being calibrated
+enum calibration_point_t {
+  CALIBRATE_AIR = 1,
+  CALIBRATE_WATER
+};
+
+/// streaming statistics for the samples collected so far
+struct sample_statistics_t {
+  unsigned long samples;
+  /// running mean of the raw readings
+  float mean;
+  /// running sum of squared differences from the mean
+  float sumSquares;
+  sensor_reading_t minimum;
+  sensor_reading_t maximum;
+};
+
+extern const unsigned long CALIBRATION_MIN_SAMPLES;
+extern const unsigned long CALIBRATION_MAX_SAMPLES;
+extern const unsigned long CALIBRATION_TIMEOUT;
+extern const unsigned long CALIBRATION_SAMPLE_MICROS;
+extern const float CALIBRATION_TOLERANCE;
+
+void addSample(sample_statistics_t *, const sensor_reading_t);
+float confidenceHalfWidth(const sample_statistics_t *);
+bool calibrateZone(irrigation_context_t *, const size_t, const calibration_point_t);
+bool savedCalibration(const size_t, moisture_calibration_t *);
+bool loadCalibration(irrigation_context_t *, const size_t);
+
+#endif
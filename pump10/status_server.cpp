@@ -0,0 +1,212 @@
+/**
+ * methods to serve zone status, and state change history, over http
+ */
+#include "status_server.h"
+#include "power_management.h"
+
+char snapshots[2][SNAPSHOT_SIZE];
+size_t snapshotLength[2] = { 0, 0 };
+volatile uint8_t frontSnapshot = 0;
+bool snapshotStale = true;
+SemaphoreHandle_t snapshotLock = NULL; // held while the front buffer is being sent
+httpd_handle_t statusServer = NULL;
+
+/**
+ * http handler: send the current status snapshot
+ *
+ * @param req the request
+ * @return ESP_OK when sent
+ */
+esp_err_t statusHandler(httpd_req_t * req)
+{
+  httpd_resp_set_type(req, "application/json");
+  xSemaphoreTake(snapshotLock, portMAX_DELAY);
+  esp_err_t result = httpd_resp_send(req, snapshots[frontSnapshot],
+    snapshotLength[frontSnapshot]);
+  xSemaphoreGive(snapshotLock);
+  return result;
+} // end statusHandler()
+
+/**
+ * http handler: stream the zone state change history
+ *
+ * @param req the request
+ * @return ESP_OK when sent
+ */
+esp_err_t historyHandler(httpd_req_t * req)
+{
+  char line[80];
+  httpd_resp_set_type(req, "text/csv");
+  httpd_resp_send_chunk(req, "sequence,epoch,millis,zone,state,moisture\n",
+    HTTPD_RESP_USE_STRLEN);
+  unsigned long last = eventCount();
+  unsigned long first = last > EVENT_LOG_SIZE ? last - EVENT_LOG_SIZE : 0;
+  zone_event_t event;
+  for (unsigned long sequence = first; sequence < last; sequence++) {
+    if (!readEvent(sequence, &event)) {
+      continue; // overwritten while streaming
+    }
+    int length = snprintf(line, sizeof(line), "%lu,%lu,%lu,%u,%u,%.1f\n", sequence,
+      event.time.epoch, event.time.millis, event.zone + 1, event.state, event.moisture);
+    if (httpd_resp_send_chunk(req, line, length) != ESP_OK) {
+      return ESP_FAIL;
+    }
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+} // end historyHandler()
+
+/**
+ * metric sink: send rendered text as the next chunk of an http response
+ *
+ * @param[in] text rendered text
+ * @param[in] length number of characters
+ * @param arg the request
+ * @return false when the client is gone
+ */
+bool chunkSink(const char * text, size_t length, void * arg)
+{
+  return httpd_resp_send_chunk((httpd_req_t *)arg, text, length) == ESP_OK;
+} // end chunkSink()
+
+/**
+ * http handler: render the metrics registry for Prometheus scraping
+ *
+ * @param req the request
+ * @return ESP_OK when sent
+ */
+esp_err_t metricsHandler(httpd_req_t * req)
+{
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  if (!renderPrometheus(chunkSink, req)) {
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+} // end metricsHandler()
+
+/**
+ * http handler: run a zone configuration command frame
+ *
+ * @param req the request, with the frame as the body
+ * @return ESP_OK when answered
+ */
+esp_err_t configHandler(httpd_req_t * req)
+{
+  uint8_t frame[7 + MAX_CONFIG_PAYLOAD];
+  if (req->content_len > sizeof(frame)) {
+    httpd_resp_set_status(req, "413 Payload Too Large");
+    return httpd_resp_send(req, NULL, 0);
+  }
+  size_t received = 0;
+  while (received < req->content_len) {
+    int length = httpd_req_recv(req, (char *)frame + received, req->content_len - received);
+    if (length <= 0) {
+      return ESP_FAIL;
+    }
+    received += length;
+  }
+  config_result_t result = configureFrame(frame, received);
+  char answer[4];
+  int length = snprintf(answer, sizeof(answer), "%u", result);
+  if (result != CONFIG_OK) {
+    httpd_resp_set_status(req, "400 Bad Request");
+  }
+  return httpd_resp_send(req, answer, length);
+} // end configHandler()
+
+/**
+ * start the http server
+ *
+ * The server answers once the wifi connection is up.
+ *
+ * @return true when the server was started; false when not configured
+ */
+bool beginStatusServer()
+{
+  if (!wifiConfigured()) {
+    return false;
+  }
+  snapshotLock = xSemaphoreCreateMutex();
+
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  if (snapshotLock == NULL || httpd_start(&statusServer, &config) != ESP_OK) {
+    statusServer = NULL;
+    Serial.println("LOG: unable to start the status server");
+    return false;
+  }
+  httpd_uri_t status = { "/status", HTTP_GET, statusHandler, NULL };
+  httpd_uri_t history = { "/history", HTTP_GET, historyHandler, NULL };
+  httpd_register_uri_handler(statusServer, &status);
+  httpd_uri_t metrics = { "/metrics", HTTP_GET, metricsHandler, NULL };
+  httpd_register_uri_handler(statusServer, &history);
+  httpd_uri_t configure = { "/config", HTTP_POST, configHandler, NULL };
+  httpd_register_uri_handler(statusServer, &metrics);
+  httpd_register_uri_handler(statusServer, &configure);
+  if (POWER_MODE != POWER_ALWAYS_ON) {
+    Serial.println("LOG: status server is not reachable while sleeping; use POWER_ALWAYS_ON");
+  }
+  return true;
+} // end beginStatusServer()
+
+/**
+ * serialize the zone status into a buffer
+ *
+ * @param[out] buffer where to put the JSON text
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick time of the snapshot
+ * @return length of the text; truncated to fit the buffer
+ */
+size_t serializeStatus(char * buffer, const irrigation_context_t * contexts,
+  const size_t count, const smart_time_t timeTick)
+{
+  size_t used = snprintf(buffer, SNAPSHOT_SIZE,
+    "{\"time\":[%lu,%lu],\"powerReserved\":%u,\"zones\":[", timeTick.epoch,
+    timeTick.millis, powerReserved);
+  bool first = true;
+  for (size_t i = 0; i < count && used < SNAPSHOT_SIZE; i++) {
+    const irrigation_context_t * context = &contexts[i];
+    if (context->state == ZONE_DISABLED) {
+      continue;
+    }
+    used += snprintf(buffer + used, SNAPSHOT_SIZE - used,
+      "%s{\"zone\":%u,\"name\":\"%s\",\"state\":%u,\"moisture\":%.1f,"
+      "\"deliveries\":%lu,\"deliveredMillis\":%lu}",
+      first ? "" : ",", (unsigned int)(i + 1), context->zone.name.c_str(),
+      context->state, context->reading.moisture, context->usage.starts,
+      context->usage.onMillis);
+    first = false;
+  }
+  if (used < SNAPSHOT_SIZE) {
+    used += snprintf(buffer + used, SNAPSHOT_SIZE - used, "]}");
+  }
+  return min(used, SNAPSHOT_SIZE - 1);
+} // end serializeStatus()
+
+/**
+ * refresh the status snapshot, when a zone state has changed
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ * @param[in] changed a zone state changed on this pass
+ */
+void updateStatusSnapshot(const irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick, const bool changed)
+{
+  if (statusServer == NULL) {
+    return;
+  }
+  wifiConnected(); // logs the server address once connected
+  snapshotStale |= changed;
+  if (!snapshotStale) {
+    return;
+  }
+  uint8_t back = 1 - frontSnapshot;
+  snapshotLength[back] = serializeStatus(snapshots[back], contexts, count, timeTick);
+  if (xSemaphoreTake(snapshotLock, 0) != pdTRUE) {
+    return; // a request is sending the front buffer; try again next pass
+  }
+  frontSnapshot = back;
+  xSemaphoreGive(snapshotLock);
+  snapshotStale = false;
+} // end updateStatusSnapshot()
@@ -0,0 +1,34 @@
+#ifndef status_server_h
+#define status_server_h
+
+#include <Arduino.h>
+#include <esp_http_server.h>
+#include "smart_time.h"
+#include "irrigation_state.h"
+#include "event_log.h"
+#include "wifi_link.h"
+#include "metrics.h"
+#include "zone_config.h"
+
+/**
+ * data structures and methods to serve zone status over http
+ *
+ * The http server runs in its own task. The control loop serializes the zone
+ * status into a back buffer only when a zone state changes, then swaps it to
+ * the front. Status requests send the front buffer as is, so they never wait
+ * for, or add work to, the control loop. The swap is skipped (and retried on
+ * the next pass) while a request is sending.
+ *
+ *   GET /status   zone status as JSON
+ *   GET /history  recent zone state changes as CSV, streamed from the event log
+ *   GET /metrics  the metrics registry in Prometheus text format
+ *   POST /config  a zone configuration command frame; answers the result code
+ */
+
+const size_t SNAPSHOT_SIZE = 2048;
+
+bool beginStatusServer(void);
+void updateStatusSnapshot(const irrigation_context_t *, const size_t,
+  const smart_time_t, const bool);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * runs the sketch's benchmarks against the simulated hardware
+ *
+ * Prints the same CSV lines as the console bench command on the device, in
+ * host cpu cycles, so control path changes can be compared without a board.
+ */
+#include "fakes.h"
+#include "sketch.h"
+
+int main()
+{
+  fakeReset();
+  fakeSerialInput("\n");
+  setup();
+  fakeSerialOutput().clear();
+  runBenchmarks();
+  // only the results: the log benchmarks write to the console as well
+  const std::string & output = fakeSerialOutput();
+  size_t start = 0;
+  while (start < output.size()) {
+    size_t end = output.find('\n', start);
+    if (end == std::string::npos) {
+      end = output.size();
+    }
+    if (output.compare(start, 6, "bench,") == 0) {
+      printf("%s\n", output.substr(start, end - start).c_str());
+    }
+    start = end + 1;
+  }
+  return 0;
+}
@@ -0,0 +1,1365 @@
+/**
+ * simulated ESP32 hardware and services for the host tests
+ */
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "fakes.h"
+
+// the Arduino min() and max() macros would break std::min() and std::max()
+#undef min
+#undef max
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+TwoWire Wire;
+
+/// thrown from a blocking queue read inside a task, to end the task's run
+struct fake_task_blocked_t {};
+
+struct fake_task_t {
+  void (*code)(void *);
+  void * arg;
+  uint32_t notifications;
+};
+
+struct fake_queue_t {
+  size_t itemSize;
+  size_t capacity;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+struct fake_semaphore_t {
+  std::timed_mutex lock;
+  std::atomic<std::thread::id> owner;
+};
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void * arg;
+  bool active;
+  uint64_t due;
+  uint64_t period; // 0 for a one-shot timer
+  bool deleted;
+};
+
+struct fake_ledc_t {
+  uint32_t duty; // 13 bit, as configured by the analogWrite polyfill
+  bool fading;
+  uint32_t fadeFrom;
+  uint32_t fadeTarget;
+  uint64_t fadeStart;
+  uint64_t fadeEnd;
+  uint32_t pendingTarget;
+  int pendingTime;
+};
+
+struct fake_pcnt_t {
+  int16_t count;
+  int16_t limit;
+  bool running;
+  int16_t threshold;
+  uint32_t events; // enabled events
+  uint32_t status; // events of the latest interrupt
+  void (*handler)(void *);
+  void * arg;
+  int sourcePin; // pump output that makes the water flow; -1 for none
+  double period; // microseconds between pulses
+  double nextPulse;
+  unsigned long delivered;
+};
+
+const size_t FAKE_PINS = 64;
+const size_t FAKE_LEDC_CHANNELS = 16;
+const uint32_t FAKE_DUTY_MAX = (1 << 13) - 1;
+
+std::atomic<uint64_t> nowMicros(0);
+std::thread::id mainThread;
+bool inTask = false;
+size_t runningTask = 0; // index of the task running, while inTask
+unsigned long taskWork = 0; // queue items taken by tasks
+std::vector<fake_task_t> tasks;
+std::vector<fake_queue_t *> queues;
+std::vector<esp_timer *> timers;
+
+int pinLevels[FAKE_PINS];
+uint16_t analogValues[FAKE_PINS];
+fake_analog_source_t analogSources[FAKE_PINS];
+unsigned long analogReads[FAKE_PINS];
+int pinChannels[FAKE_PINS];
+int channelsUsed = 0;
+fake_ledc_t ledcChannels[FAKE_LEDC_CHANNELS];
+fake_pcnt_t pcntUnits[PCNT_UNIT_MAX];
+
+bool wifiUp = false;
+std::vector<WiFiUDP *> sockets;
+fake_udp_drop_t udpDrop;
+std::map<std::string, fake_udp_server_t> udpServers;
+uint8_t loopbackBoard = 0; // 0 for the simulated network
+uint8_t loopbackBoards = 0;
+bool mqttUp = false;
+std::vector<std::string> fakeMqttMessages;
+std::vector<httpd_uri_t> httpHandlers;
+
+std::vector<std::vector<uint8_t>> fakeI2cWrites;
+std::map<uint8_t, std::deque<uint8_t>> i2cReplies;
+std::vector<uint8_t> i2cCurrent;
+std::deque<uint8_t> i2cReading;
+
+std::string serialOutput;
+std::deque<char> serialInput;
+bool serialEcho = getenv("PUMP10_TEST_VERBOSE") != NULL;
+
+esp_err_t fakeLightSleepResult = ESP_OK;
+unsigned long fakeLightSleepWake = 0; // wake early after this many ms; 0 for the timer
+unsigned long fakeLightSleeps = 0;
+esp_sleep_wakeup_cause_t fakeWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+uint64_t sleepWakeup = 0;
+int64_t wallOffset = 0; // wall clock microseconds minus nowMicros
+
+std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+long nvsWritesLeft = -1; // writes before the flash fails; -1 for no failure
+
+/**
+ * put the simulated peripherals back to their power on state
+ *
+ * The sketch's module globals keep their values between tests, so tasks,
+ * queues and timers that a module created once are kept too: queues are
+ * emptied, and timers stopped. NVS keeps its contents, like the flash of a
+ * real board.
+ */
+void fakeReset()
+{
+  nowMicros = 0;
+  mainThread = std::this_thread::get_id();
+  for (fake_queue_t * queue : queues) {
+    queue->items.clear();
+  }
+  for (esp_timer * timer : timers) {
+    timer->active = false;
+  }
+  for (fake_task_t & task : tasks) {
+    task.notifications = 0;
+  }
+  for (size_t i = 0; i < FAKE_PINS; i++) {
+    pinLevels[i] = LOW;
+    analogValues[i] = 0;
+    analogSources[i] = nullptr;
+    analogReads[i] = 0;
+    pinChannels[i] = -1;
+  }
+  channelsUsed = 0;
+  memset(ledcChannels, 0, sizeof(ledcChannels));
+  for (uint8_t unit = 0; unit < PCNT_UNIT_MAX; unit++) {
+    pcntUnits[unit] = {};
+    pcntUnits[unit].sourcePin = -1;
+  }
+  wifiUp = false;
+  udpDrop = nullptr;
+  udpServers.clear();
+  for (WiFiUDP * socket : sockets) {
+    socket->port = 0;
+    socket->inbox.clear();
+    if (socket->descriptor >= 0) {
+      close(socket->descriptor);
+      socket->descriptor = -1;
+    }
+  }
+  loopbackBoard = 0;
+  sockets.clear();
+  mqttUp = false;
+  fakeMqttMessages.clear();
+  httpHandlers.clear();
+  fakeI2cWrites.clear();
+  i2cReplies.clear();
+  serialOutput.clear();
+  serialInput.clear();
+  fakeLightSleepResult = ESP_OK;
+  fakeLightSleepWake = 0;
+  fakeLightSleeps = 0;
+  fakeWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  wallOffset = 0;
+  nvsWritesLeft = -1;
+} // end fakeReset()
+
+void fakeClearNvs()
+{
+  nvs.clear();
+}
+
+/**
+ * make NVS writes fail, as when power is lost part way through a save
+ *
+ * @param writes the number of writes that still succeed
+ */
+void fakeNvsFailAfter(const long writes)
+{
+  nvsWritesLeft = writes;
+}
+
+// ---------------------------------------------------------------- time
+
+unsigned long millis()
+{
+  return (uint32_t)(nowMicros / 1000);
+}
+
+unsigned long micros()
+{
+  return (uint32_t)nowMicros;
+}
+
+int64_t esp_timer_get_time()
+{
+  return nowMicros;
+}
+
+void fakeSetMillis(const unsigned long now)
+{
+  nowMicros = (uint64_t)now * 1000;
+}
+
+/**
+ * run every task until each one blocks on an empty queue
+ */
+void fakeRunTasks()
+{
+  if (inTask) {
+    return;
+  }
+  unsigned long before;
+  do {
+    before = taskWork;
+    for (size_t i = 0; i < tasks.size(); i++) {
+      inTask = true;
+      runningTask = i;
+      try {
+        tasks[i].code(tasks[i].arg);
+      } catch (const fake_task_blocked_t &) {
+      }
+      inTask = false;
+    }
+  } while (taskWork != before);
+} // end fakeRunTasks()
+
+/**
+ * count a pulse from a flow source, and raise the threshold and limit
+ * interrupts
+ *
+ * @param unit pulse counter unit
+ */
+void fakePulse(const uint8_t unit)
+{
+  fake_pcnt_t * pcnt = &pcntUnits[unit];
+  pcnt->nextPulse += pcnt->period;
+  if (fakePwmOutput(pcnt->sourcePin) == 0) {
+    return; // no flow
+  }
+  pcnt->delivered++;
+  if (!pcnt->running) {
+    return;
+  }
+  pcnt->count++;
+  pcnt->status = 0;
+  if ((pcnt->events & PCNT_EVT_THRES_0) != 0 && pcnt->count == pcnt->threshold) {
+    pcnt->status |= PCNT_EVT_THRES_0;
+  }
+  if (pcnt->count >= pcnt->limit) {
+    pcnt->count = 0; // the hardware wraps at the high limit
+    pcnt->status |= pcnt->events & PCNT_EVT_H_LIM;
+  }
+  if (pcnt->status != 0 && pcnt->handler != NULL) {
+    pcnt->handler(pcnt->arg);
+  }
+} // end fakePulse()
+
+/**
+ * move the clock forward, running timers, flow pulses and tasks as they come due
+ *
+ * @param micros time to move forward
+ */
+void fakeAdvanceMicros(const uint64_t micros)
+{
+  uint64_t target = nowMicros + micros;
+  for (;;) {
+    esp_timer * nextTimer = NULL;
+    for (esp_timer * timer : timers) {
+      if (!timer->deleted && timer->active && timer->due <= target &&
+          (nextTimer == NULL || timer->due < nextTimer->due)) {
+        nextTimer = timer;
+      }
+    }
+    int nextUnit = -1;
+    for (uint8_t unit = 0; unit < PCNT_UNIT_MAX; unit++) {
+      fake_pcnt_t * pcnt = &pcntUnits[unit];
+      if (pcnt->sourcePin >= 0 && pcnt->nextPulse <= target &&
+          (nextUnit < 0 || pcnt->nextPulse < pcntUnits[nextUnit].nextPulse)) {
+        nextUnit = unit;
+      }
+    }
+    if (nextUnit >= 0 && (nextTimer == NULL || pcntUnits[nextUnit].nextPulse < nextTimer->due)) {
+      nowMicros = std::max((uint64_t)nowMicros, (uint64_t)pcntUnits[nextUnit].nextPulse);
+      fakePulse(nextUnit);
+      fakeRunTasks();
+      continue;
+    }
+    if (nextTimer == NULL) {
+      break;
+    }
+    nowMicros = std::max((uint64_t)nowMicros, nextTimer->due);
+    if (nextTimer->period > 0) {
+      nextTimer->due += nextTimer->period;
+    } else {
+      nextTimer->active = false;
+    }
+    nextTimer->callback(nextTimer->arg);
+    fakeRunTasks();
+  }
+  nowMicros = target;
+  fakeRunTasks();
+} // end fakeAdvanceMicros()
+
+void fakeAdvance(const unsigned long millis)
+{
+  fakeAdvanceMicros((uint64_t)millis * 1000);
+}
+
+void delay(unsigned long wait)
+{
+  if (std::this_thread::get_id() != mainThread) {
+    std::this_thread::yield(); // a writer thread in a stress test
+    return;
+  }
+  fakeAdvance(wait);
+}
+
+void delayMicroseconds(unsigned int wait)
+{
+  if (std::this_thread::get_id() != mainThread) {
+    return;
+  }
+  fakeAdvanceMicros(wait);
+}
+
+void yield()
+{
+  if (std::this_thread::get_id() == mainThread) {
+    fakeRunTasks();
+  }
+}
+
+size_t fakeActiveTimers()
+{
+  size_t active = 0;
+  for (esp_timer * timer : timers) {
+    active += !timer->deleted && timer->active;
+  }
+  return active;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * args, esp_timer_handle_t * handle)
+{
+  esp_timer * timer = new esp_timer { args->callback, args->arg, false, 0, 0, false };
+  timers.push_back(timer);
+  *handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout)
+{
+  if (timer->deleted) {
+    fprintf(stderr, "fake: deleted timer started\n");
+    abort();
+  }
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = true;
+  timer->due = nowMicros + timeout;
+  timer->period = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = true;
+  timer->due = nowMicros + period;
+  timer->period = period;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  if (!timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->deleted = true; // kept until the next reset, to catch use after delete
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+  return timer->active;
+}
+
+// ---------------------------------------------------------------- FreeRTOS
+
+BaseType_t xTaskCreate(void (*code)(void *), const char * name, uint32_t stack, void * arg,
+  UBaseType_t priority, TaskHandle_t * handle)
+{
+  tasks.push_back({ code, arg, 0 });
+  if (handle != NULL) {
+    *handle = (TaskHandle_t)(uintptr_t)tasks.size();
+  }
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  fake_task_t * task = &tasks[runningTask];
+  if (!inTask || task->notifications == 0) {
+    if (inTask && wait != 0) {
+      throw fake_task_blocked_t();
+    }
+    return 0;
+  }
+  uint32_t count = task->notifications;
+  task->notifications = clear ? 0 : count - 1;
+  taskWork++;
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  tasks[(uintptr_t)handle - 1].notifications++;
+  return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t capacity, UBaseType_t itemSize)
+{
+  fake_queue_t * queue = new fake_queue_t { itemSize, capacity, {} };
+  queues.push_back(queue);
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void * item, TickType_t wait)
+{
+  fake_queue_t * queue = (fake_queue_t *)handle;
+  if (queue->items.size() >= queue->capacity) {
+    return pdFALSE;
+  }
+  const uint8_t * bytes = (const uint8_t *)item;
+  queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void * item, BaseType_t * woken)
+{
+  if (woken != NULL) {
+    *woken = pdTRUE;
+  }
+  return xQueueSend(handle, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void * item, TickType_t wait)
+{
+  fake_queue_t * queue = (fake_queue_t *)handle;
+  if (queue->items.empty()) {
+    if (inTask && wait != 0) {
+      throw fake_task_blocked_t();
+    }
+    return pdFALSE;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  taskWork++;
+  return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new fake_semaphore_t();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait)
+{
+  fake_semaphore_t * semaphore = (fake_semaphore_t *)handle;
+  if (semaphore->owner == std::this_thread::get_id()) {
+    // the holder is this thread: on the device another task would wait forever
+    fprintf(stderr, "fake: mutex taken again by its holder\n");
+    abort();
+  }
+  bool taken = wait == portMAX_DELAY ? (semaphore->lock.lock(), true) :
+    semaphore->lock.try_lock_for(std::chrono::milliseconds(wait));
+  if (taken) {
+    semaphore->owner = std::this_thread::get_id();
+  }
+  return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+  fake_semaphore_t * semaphore = (fake_semaphore_t *)handle;
+  semaphore->owner = std::thread::id();
+  semaphore->lock.unlock();
+  return pdTRUE;
+}
+
+// ---------------------------------------------------------------- cpu
+
+uint32_t EspClass::getCycleCount()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__builtin_ia32_rdtsc();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint32_t EspClass::getCpuFreqMHz()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static uint32_t measured = 0;
+  if (measured == 0) {
+    auto started = std::chrono::steady_clock::now();
+    uint64_t cycles = __builtin_ia32_rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started).count();
+    measured = std::max<uint64_t>(1, (__builtin_ia32_rdtsc() - cycles) / elapsed);
+  }
+  return measured;
+#else
+  return 1000;
+#endif
+}
+
+uint32_t esp_random()
+{
+  static uint32_t state = 1;
+  state = state * 1664525 + 1013904223;
+  return state;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// ---------------------------------------------------------------- gpio, adc, pwm
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+  pinLevels[pin % FAKE_PINS] = level;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pinLevels[pin % FAKE_PINS];
+}
+
+int fakePinLevel(const uint8_t pin)
+{
+  return pinLevels[pin % FAKE_PINS];
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+  analogReads[pin % FAKE_PINS]++;
+  if (analogSources[pin % FAKE_PINS]) {
+    return analogSources[pin % FAKE_PINS]();
+  }
+  return analogValues[pin % FAKE_PINS];
+}
+
+unsigned long fakeAnalogReads(const uint8_t pin)
+{
+  return analogReads[pin % FAKE_PINS];
+}
+
+void fakeSetAnalog(const uint8_t pin, const uint16_t value)
+{
+  analogValues[pin % FAKE_PINS] = value;
+  analogSources[pin % FAKE_PINS] = nullptr;
+}
+
+void fakeAnalogSource(const uint8_t pin, fake_analog_source_t source)
+{
+  analogSources[pin % FAKE_PINS] = source;
+}
+
+/**
+ * bring a fade up to date, finishing it once its time is over
+ *
+ * @param channel LEDC channel state
+ */
+void fakeUpdateFade(fake_ledc_t * channel)
+{
+  if (!channel->fading) {
+    return;
+  }
+  if (nowMicros >= channel->fadeEnd) {
+    channel->duty = channel->fadeTarget;
+    channel->fading = false;
+    return;
+  }
+  double done = (double)(nowMicros - channel->fadeStart) /
+    (channel->fadeEnd - channel->fadeStart);
+  channel->duty = channel->fadeFrom + (int64_t)(done *
+    ((int64_t)channel->fadeTarget - (int64_t)channel->fadeFrom));
+}
+
+void analogWrite(uint8_t pin, uint32_t value, uint32_t valueMax)
+{
+  pin %= FAKE_PINS;
+  if (pinChannels[pin] < 0) {
+    pinChannels[pin] = channelsUsed++ % FAKE_LEDC_CHANNELS;
+  }
+  fake_ledc_t * channel = &ledcChannels[pinChannels[pin]];
+  fakeUpdateFade(channel);
+  if (channel->fading) {
+    return; // the running hardware fade keeps control of the duty cycle
+  }
+  channel->duty = std::min(value, valueMax) * FAKE_DUTY_MAX / valueMax;
+}
+
+int analogWriteChannel(uint8_t pin)
+{
+  return pinChannels[pin % FAKE_PINS];
+}
+
+/**
+ * get the pwm output of a pin
+ *
+ * @param pin gpio pin
+ * @return duty cycle scaled to 0 - 255
+ */
+uint32_t fakePwmOutput(const uint8_t pin)
+{
+  int channel = pinChannels[pin % FAKE_PINS];
+  if (channel < 0) {
+    return 0;
+  }
+  fakeUpdateFade(&ledcChannels[channel]);
+  return (ledcChannels[channel].duty * 255 + FAKE_DUTY_MAX / 2) / FAKE_DUTY_MAX;
+}
+
+bool fakeFadeActive(const uint8_t pin)
+{
+  int channel = pinChannels[pin % FAKE_PINS];
+  if (channel < 0) {
+    return false;
+  }
+  fakeUpdateFade(&ledcChannels[channel]);
+  return ledcChannels[channel].fading;
+}
+
+esp_err_t ledc_fade_func_install(int flags)
+{
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t target,
+  int time)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  ledc->pendingTarget = target;
+  ledc->pendingTime = time;
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t wait)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  fakeUpdateFade(ledc);
+  ledc->fading = true;
+  ledc->fadeFrom = ledc->duty;
+  ledc->fadeTarget = ledc->pendingTarget;
+  ledc->fadeStart = nowMicros;
+  ledc->fadeEnd = nowMicros + (uint64_t)ledc->pendingTime * 1000;
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty,
+  uint32_t hpoint)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  ledc->fading = false; // waits for a running fade to end, then sets the duty
+  ledc->duty = duty;
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  fakeUpdateFade(ledc);
+  return ledc->duty;
+}
+
+esp_err_t ledc_fade_stop(ledc_mode_t mode, ledc_channel_t channel)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  fakeUpdateFade(ledc);
+  ledc->fading = false; // the duty stays where the fade had got to
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+  fake_ledc_t * ledc = &ledcChannels[mode * 8 + channel];
+  fakeUpdateFade(ledc);
+  ledc->fading = false;
+  ledc->pendingTarget = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+  ledcChannels[mode * 8 + channel].duty = ledcChannels[mode * 8 + channel].pendingTarget;
+  return ESP_OK;
+}
+
+// ---------------------------------------------------------------- pulse counter
+
+/**
+ * make water flow past a flow sensor while a pump output is on
+ *
+ * @param unit pulse counter unit the sensor is connected to
+ * @param pumpPin gpio pin of the pump that moves the water
+ * @param pulsesPerSecond pulse rate while the pump runs
+ */
+void fakeFlowSource(const uint8_t unit, const uint8_t pumpPin, const double pulsesPerSecond)
+{
+  fake_pcnt_t * pcnt = &pcntUnits[unit];
+  pcnt->sourcePin = pumpPin;
+  pcnt->period = 1000000.0 / pulsesPerSecond;
+  pcnt->nextPulse = nowMicros + pcnt->period;
+  pcnt->delivered = 0;
+}
+
+int16_t fakePulseCount(const uint8_t unit)
+{
+  return pcntUnits[unit].count;
+}
+
+unsigned long fakeFlowDelivered(const uint8_t unit)
+{
+  return pcntUnits[unit].delivered;
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t * config)
+{
+  fake_pcnt_t * pcnt = &pcntUnits[config->unit];
+  pcnt->limit = config->counter_h_lim;
+  pcnt->count = 0;
+  pcnt->events = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t value) { return ESP_OK; }
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) { return ESP_OK; }
+
+esp_err_t pcnt_set_event_value(pcnt_unit_t unit, pcnt_evt_type_t event, int16_t value)
+{
+  if (event == PCNT_EVT_THRES_0) {
+    pcntUnits[unit].threshold = value;
+  }
+  return ESP_OK;
+}
+
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t event)
+{
+  pcntUnits[unit].events |= event;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_event_disable(pcnt_unit_t unit, pcnt_evt_type_t event)
+{
+  pcntUnits[unit].events &= ~(uint32_t)event;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit)
+{
+  pcntUnits[unit].running = false;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit)
+{
+  pcntUnits[unit].running = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit)
+{
+  pcntUnits[unit].count = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t * count)
+{
+  *count = pcntUnits[unit].count;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_event_status(pcnt_unit_t unit, uint32_t * status)
+{
+  *status = pcntUnits[unit].status;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_isr_service_install(int flags) { return ESP_OK; }
+
+esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*handler)(void *), void * arg)
+{
+  pcntUnits[unit].handler = handler;
+  pcntUnits[unit].arg = arg;
+  return ESP_OK;
+}
+
+// ---------------------------------------------------------------- network
+
+void fakeWifiUp(const bool up)
+{
+  wifiUp = up;
+}
+
+int WiFiClass::begin(const char * ssid, const char * password)
+{
+  return 0;
+}
+
+int WiFiClass::status()
+{
+  return wifiUp ? WL_CONNECTED : 0;
+}
+
+IPAddress WiFiClass::localIP()
+{
+  IPAddress address;
+  address.address = 0x0204A8C0; // 192.168.4.2
+  return address;
+}
+
+String IPAddress::toString() const
+{
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", address & 0xFF, (address >> 8) & 0xFF,
+    (address >> 16) & 0xFF, address >> 24);
+  return String(text);
+}
+
+void fakeUdpDrop(fake_udp_drop_t drop)
+{
+  udpDrop = drop;
+}
+
+void fakeUdpServer(const char * host, fake_udp_server_t server)
+{
+  udpServers[host] = server;
+}
+
+/**
+ * use real UDP sockets on 127.0.0.1, for boards running in separate processes
+ *
+ * Each board binds its sockets to the requested port plus its board number,
+ * and a broadcast is sent to that port plus every other board number.
+ *
+ * @param board this process's board, from 1
+ * @param boards number of boards
+ */
+void fakeUdpLoopback(const uint8_t board, const uint8_t boards)
+{
+  loopbackBoard = board;
+  loopbackBoards = boards;
+}
+
+/**
+ * get a loopback address
+ *
+ * @param port UDP port
+ * @return the address
+ */
+sockaddr_in loopbackAddress(const uint16_t port)
+{
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return address;
+}
+
+WiFiUDP::~WiFiUDP()
+{
+  if (descriptor >= 0) {
+    close(descriptor);
+  }
+  sockets.erase(std::remove(sockets.begin(), sockets.end(), this), sockets.end());
+}
+
+uint8_t WiFiUDP::begin(uint16_t localPort)
+{
+  port = localPort;
+  if (std::find(sockets.begin(), sockets.end(), this) == sockets.end()) {
+    sockets.push_back(this);
+  }
+  if (loopbackBoard > 0) {
+    descriptor = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int reuse = 1;
+    setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = loopbackAddress(localPort + loopbackBoard);
+    if (bind(descriptor, (const sockaddr *)&address, sizeof(address)) != 0) {
+      close(descriptor);
+      descriptor = -1;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int WiFiUDP::beginPacket(const char * host, uint16_t remotePort)
+{
+  if (!wifiUp) {
+    return 0;
+  }
+  destinationHost = host;
+  destination = remotePort;
+  outgoing.clear();
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t * data, size_t length)
+{
+  outgoing.insert(outgoing.end(), data, data + length);
+  return length;
+}
+
+/**
+ * send the packet: to a simulated server by host name, or broadcast to every
+ * other socket bound to the destination port
+ */
+int WiFiUDP::endPacket()
+{
+  if (!wifiUp) {
+    return 0;
+  }
+  auto server = udpServers.find(destinationHost);
+  if (server != udpServers.end()) {
+    std::vector<uint8_t> reply = server->second(outgoing);
+    if (!reply.empty()) {
+      inbox.push_back(reply);
+    }
+    return 1;
+  }
+  if (descriptor >= 0) {
+    for (uint8_t board = 1; board <= loopbackBoards; board++) {
+      if (board != loopbackBoard) {
+        sockaddr_in address = loopbackAddress(destination + board);
+        sendto(descriptor, outgoing.data(), outgoing.size(), 0, (const sockaddr *)&address,
+          sizeof(address));
+      }
+    }
+    return 1;
+  }
+  for (WiFiUDP * socket : sockets) {
+    if (socket != this && socket->port == destination && (!udpDrop || !udpDrop(this, socket))) {
+      socket->inbox.push_back(outgoing);
+    }
+  }
+  return 1;
+}
+
+int WiFiUDP::parsePacket()
+{
+  if (descriptor >= 0) {
+    uint8_t packet[1500];
+    ssize_t length = recv(descriptor, packet, sizeof(packet), 0);
+    if (length > 0) {
+      inbox.emplace_back(packet, packet + length);
+    }
+  }
+  if (inbox.empty()) {
+    return 0;
+  }
+  current = inbox.front();
+  inbox.pop_front();
+  readPosition = 0;
+  return current.size();
+}
+
+int WiFiUDP::read(uint8_t * buffer, size_t length)
+{
+  size_t count = std::min(length, current.size() - readPosition);
+  memcpy(buffer, current.data() + readPosition, count);
+  readPosition += count;
+  return count;
+}
+
+IPAddress WiFiUDP::remoteIP()
+{
+  return IPAddress();
+}
+
+uint16_t WiFiUDP::remotePort()
+{
+  return 0;
+}
+
+void fakeMqttUp(const bool up)
+{
+  mqttUp = up;
+}
+
+bool PubSubClient::connect(const char * id)
+{
+  return mqttUp;
+}
+
+bool PubSubClient::connect(const char * id, const char * user, const char * password)
+{
+  return mqttUp;
+}
+
+bool PubSubClient::connected()
+{
+  return mqttUp;
+}
+
+bool PubSubClient::publish(const char * topic, const uint8_t * payload, unsigned int length,
+  bool retained)
+{
+  if (!mqttUp) {
+    return false;
+  }
+  fakeMqttMessages.push_back(std::string((const char *)payload, length));
+  return true;
+}
+
+esp_err_t httpd_start(httpd_handle_t * handle, const httpd_config_t * config)
+{
+  *handle = &httpHandlers;
+  return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t * uri)
+{
+  httpHandlers.push_back(*uri);
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t * req, const char * text, ssize_t length)
+{
+  req->response.append(text, length == HTTPD_RESP_USE_STRLEN ? strlen(text) : length);
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t * req, const char * text, ssize_t length)
+{
+  if (text != NULL) {
+    req->response.append(text, length == HTTPD_RESP_USE_STRLEN ? strlen(text) : length);
+  }
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t * req, const char * type) { return ESP_OK; }
+esp_err_t httpd_resp_set_status(httpd_req_t * req, const char * status) { return ESP_OK; }
+
+int httpd_req_recv(httpd_req_t * req, char * buffer, size_t length)
+{
+  size_t count = std::min(length, req->body.size());
+  memcpy(buffer, req->body.data(), count);
+  req->body.erase(0, count);
+  return count;
+}
+
+/**
+ * call a registered http handler
+ *
+ * @param uri the path
+ * @param method HTTP_GET or HTTP_POST
+ * @param body request body
+ * @param[out] response collected response body
+ * @return the handler result; ESP_FAIL when there is no handler
+ */
+esp_err_t fakeHttpRequest(const char * uri, httpd_method_t method, const std::string & body,
+  std::string * response)
+{
+  for (const httpd_uri_t & handler : httpHandlers) {
+    if (strcmp(handler.uri, uri) == 0 && handler.method == method) {
+      httpd_req_t req = { handler.user_ctx, uri, body.size(), body, "" };
+      esp_err_t result = handler.handler(&req);
+      *response = req.response;
+      return result;
+    }
+  }
+  return ESP_FAIL;
+}
+
+// ---------------------------------------------------------------- i2c
+
+void fakeI2cReply(const uint8_t address, const std::vector<uint8_t> & bytes)
+{
+  i2cReplies[address].insert(i2cReplies[address].end(), bytes.begin(), bytes.end());
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  i2cCurrent.assign(1, address);
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+  i2cCurrent.push_back(value);
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t * data, size_t length)
+{
+  i2cCurrent.insert(i2cCurrent.end(), data, data + length);
+  return length;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  fakeI2cWrites.push_back(i2cCurrent);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t count, bool sendStop)
+{
+  i2cReading.clear();
+  std::deque<uint8_t> & replies = i2cReplies[address];
+  while (count-- > 0) {
+    i2cReading.push_back(replies.empty() ? 0 : replies.front());
+    if (!replies.empty()) {
+      replies.pop_front();
+    }
+  }
+  return i2cReading.size();
+}
+
+int TwoWire::available()
+{
+  return i2cReading.size();
+}
+
+int TwoWire::read()
+{
+  if (i2cReading.empty()) {
+    return -1;
+  }
+  uint8_t value = i2cReading.front();
+  i2cReading.pop_front();
+  return value;
+}
+
+// ---------------------------------------------------------------- console
+
+size_t Print::printf(const char * format, ...)
+{
+  char text[512];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return write((const uint8_t *)text, std::min((size_t)std::max(length, 0), sizeof(text) - 1));
+}
+
+size_t HardwareSerial::write(const uint8_t * data, size_t length)
+{
+  serialOutput.append((const char *)data, length);
+  if (serialEcho) {
+    fwrite(data, 1, length, stdout);
+  }
+  return length;
+}
+
+int HardwareSerial::available()
+{
+  return serialInput.size();
+}
+
+int HardwareSerial::read()
+{
+  if (serialInput.empty()) {
+    return -1;
+  }
+  char next = serialInput.front();
+  serialInput.pop_front();
+  return (uint8_t)next;
+}
+
+std::string & fakeSerialOutput()
+{
+  return serialOutput;
+}
+
+void fakeSerialInput(const char * text)
+{
+  serialInput.insert(serialInput.end(), text, text + strlen(text));
+}
+
+// ---------------------------------------------------------------- sleep and wall clock
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t micros)
+{
+  sleepWakeup = micros;
+  return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start()
+{
+  if (fakeLightSleepResult != ESP_OK) {
+    return fakeLightSleepResult;
+  }
+  fakeLightSleeps++;
+  uint64_t slept = sleepWakeup;
+  if (fakeLightSleepWake > 0) {
+    slept = std::min(slept, (uint64_t)fakeLightSleepWake * 1000);
+  }
+  fakeAdvanceMicros(slept);
+  fakeWakeCause = slept < sleepWakeup ? ESP_SLEEP_WAKEUP_EXT0 : ESP_SLEEP_WAKEUP_TIMER;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+  throw fake_deep_sleep_t { sleepWakeup };
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+  return fakeWakeCause;
+}
+
+void fakeSetWallClock(const uint64_t epochMillis)
+{
+  wallOffset = (int64_t)(epochMillis * 1000) - (int64_t)nowMicros;
+}
+
+uint64_t fakeWallClock()
+{
+  return (nowMicros + wallOffset) / 1000;
+}
+
+extern "C" int gettimeofday(struct timeval * now, void * zone)
+{
+  uint64_t wall = nowMicros + wallOffset;
+  now->tv_sec = wall / 1000000;
+  now->tv_usec = wall % 1000000;
+  return 0;
+}
+
+extern "C" int settimeofday(const struct timeval * now, const struct timezone * zone)
+{
+  wallOffset = (int64_t)now->tv_sec * 1000000 + now->tv_usec - (int64_t)nowMicros;
+  return 0;
+}
+
+// ---------------------------------------------------------------- nvs
+
+bool Preferences::begin(const char * name, bool readOnly, const char * partition)
+{
+  space = name;
+  return true;
+}
+
+bool Preferences::clear()
+{
+  nvs[space].clear();
+  return true;
+}
+
+bool Preferences::remove(const char * key)
+{
+  return nvs[space].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char * key)
+{
+  return nvs[space].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char * key, const void * value, size_t length)
+{
+  if (nvsWritesLeft == 0) {
+    return 0;
+  }
+  if (nvsWritesLeft > 0) {
+    nvsWritesLeft--;
+  }
+  const uint8_t * bytes = (const uint8_t *)value;
+  nvs[space][key] = std::vector<uint8_t>(bytes, bytes + length);
+  return length;
+}
+
+size_t Preferences::getBytesLength(const char * key)
+{
+  auto entry = nvs[space].find(key);
+  return entry == nvs[space].end() ? 0 : entry->second.size();
+}
+
+size_t Preferences::getBytes(const char * key, void * buffer, size_t maxLength)
+{
+  auto entry = nvs[space].find(key);
+  if (entry == nvs[space].end() || entry->second.size() > maxLength) {
+    return 0;
+  }
+  memcpy(buffer, entry->second.data(), entry->second.size());
+  return entry->second.size();
+}
+
+size_t Preferences::putUChar(const char * key, uint8_t value)
+{
+  return putBytes(key, &value, sizeof(value));
+}
+
+uint8_t Preferences::getUChar(const char * key, uint8_t defaultValue)
+{
+  uint8_t value = defaultValue;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putULong(const char * key, uint32_t value)
+{
+  return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getULong(const char * key, uint32_t defaultValue)
+{
+  uint32_t value = defaultValue;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+/**
+ * get the space used by a Preferences namespace
+ *
+ * @param name the namespace
+ * @return bytes in all values, and their keys
+ */
+size_t fakeNvsBytes(const char * name)
+{
+  size_t bytes = 0;
+  for (const auto & entry : nvs[name]) {
+    bytes += entry.first.size() + entry.second.size();
+  }
+  return bytes;
+}
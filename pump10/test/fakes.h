@@ -0,0 +1,91 @@
+#ifndef fakes_h
+#define fakes_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <analogWrite.h>
+#include <esp_http_server.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/ledc.h>
+#include <driver/pcnt.h>
+
+/**
+ * controls for the simulated ESP32 that the host tests run the sketch on
+ *
+ * Everything runs on the test's thread. Time only moves when a test advances
+ * it (or the sketch calls delay()): timer callbacks, pulse counter events and
+ * the tasks they wake all run then, in time order. Tasks run until they block
+ * on an empty queue.
+ */
+
+/// thrown by esp_deep_sleep_start(), in place of the restart
+struct fake_deep_sleep_t {
+  uint64_t wakeupMicros;
+};
+
+/// produces each reading of an analog input
+typedef std::function<uint16_t(void)> fake_analog_source_t;
+
+/// decides if a UDP packet from one socket is lost on the way to another
+typedef std::function<bool(const WiFiUDP *, const WiFiUDP *)> fake_udp_drop_t;
+
+/// answers a UDP packet sent to a host name; an empty reply is lost
+typedef std::function<std::vector<uint8_t>(const std::vector<uint8_t> &)> fake_udp_server_t;
+
+void fakeReset(void);
+void fakeClearNvs(void);
+
+// time
+void fakeSetMillis(const unsigned long);
+void fakeAdvance(const unsigned long);
+void fakeAdvanceMicros(const uint64_t);
+void fakeRunTasks(void);
+size_t fakeActiveTimers(void);
+
+// gpio, adc and pwm
+int fakePinLevel(const uint8_t);
+void fakeSetAnalog(const uint8_t, const uint16_t);
+void fakeAnalogSource(const uint8_t, fake_analog_source_t);
+unsigned long fakeAnalogReads(const uint8_t);
+uint32_t fakePwmOutput(const uint8_t);
+bool fakeFadeActive(const uint8_t);
+
+// pulse counter
+void fakeFlowSource(const uint8_t, const uint8_t, const double);
+int16_t fakePulseCount(const uint8_t);
+unsigned long fakeFlowDelivered(const uint8_t);
+
+// network
+void fakeWifiUp(const bool);
+void fakeUdpDrop(fake_udp_drop_t);
+void fakeUdpServer(const char *, fake_udp_server_t);
+void fakeUdpLoopback(const uint8_t, const uint8_t);
+void fakeMqttUp(const bool);
+extern std::vector<std::string> fakeMqttMessages;
+esp_err_t fakeHttpRequest(const char *, httpd_method_t, const std::string &, std::string *);
+
+// i2c
+extern std::vector<std::vector<uint8_t>> fakeI2cWrites;
+void fakeI2cReply(const uint8_t, const std::vector<uint8_t> &);
+
+// console
+std::string & fakeSerialOutput(void);
+void fakeSerialInput(const char *);
+
+// sleep and the wall clock
+extern esp_err_t fakeLightSleepResult;
+extern unsigned long fakeLightSleepWake;
+extern unsigned long fakeLightSleeps;
+extern esp_sleep_wakeup_cause_t fakeWakeCause;
+void fakeSetWallClock(const uint64_t);
+uint64_t fakeWallClock(void);
+
+// nvs
+size_t fakeNvsBytes(const char *);
+void fakeNvsFailAfter(const long);
+
+#endif
@@ -0,0 +1,5 @@
+/**
+ * the sketch itself, compiled for the host tests
+ */
+#include "sketch.h"
+#include <pump10.ino>
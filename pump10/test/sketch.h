@@ -0,0 +1,32 @@
+#ifndef sketch_h
+#define sketch_h
+
+#include <pump10.h>
+
+/**
+ * the parts of pump10.ino that the host tests use
+ *
+ * The Arduino builder generates prototypes for the functions in a sketch;
+ * these are the ones the sketch needs before their definitions.
+ */
+
+extern const size_t DEFINED_ZONES;
+extern irrigation_context_t allZones[];
+extern zone_checkpoint_t zoneCheckpoint[];
+extern const watering_zone_t sunflowers;
+extern const unsigned int POWER_BUDGET;
+extern const unsigned long BOOT_CONTROL_DEADLINE;
+extern const watering_schedule_t wateringSchedules[];
+extern const size_t SCHEDULES;
+
+void setup(void);
+void loop(void);
+bool checkIrrigationZone(irrigation_context_t *, smart_time_t);
+void emergencyShutdown(irrigation_context_t *, size_t, smart_time_t);
+void checkConsole(irrigation_context_t *, const size_t);
+void runBenchmarks(void);
+void fullDebugDump(irrigation_context_t *, size_t, smart_time_t);
+void logResourceTimeout(const irrigation_context_t * const, const smart_time_t);
+void preFillZones(irrigation_context_t *, const size_t);
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * host stand-in for the parts of the ESP32 Arduino core used by pump10
+ *
+ * Declarations only; the fake implementations are in ../fakes.cpp. Time,
+ * pins, timers, tasks and the network are all simulated, and controlled by
+ * the tests through ../fakes.h.
+ */
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "esp_err.h"
+#include "esp_idf_version.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+inline void configTzTime(const char *, const char *, const char * = nullptr,
+  const char * = nullptr) {}
+
+class String {
+ public:
+  std::string s;
+  String() {}
+  String(const char * c) : s(c) {}
+  String(const std::string & c) : s(c) {}
+  explicit String(int v) : s(std::to_string(v)) {}
+  explicit String(unsigned int v) : s(std::to_string(v)) {}
+  explicit String(long v) : s(std::to_string(v)) {}
+  explicit String(unsigned long v) : s(std::to_string(v)) {}
+  explicit String(float v) : s(std::to_string(v)) {}
+  const char * c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  String operator+(const String & o) const { return String(s + o.s); }
+  friend String operator+(const char * a, const String & b) { return String(std::string(a) + b.s); }
+  String & operator+=(const String & o) { s += o.s; return *this; }
+  bool operator==(const String & o) const { return s == o.s; }
+  bool operator!=(const String & o) const { return s != o.s; }
+  int toInt() const { return atoi(s.c_str()); }
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *, size_t) = 0;
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char * text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t print(const String & text) { return print(text.c_str()); }
+  size_t println(const char * text = "") { return print(text) + print("\n"); }
+  size_t println(const String & text) { return println(text.c_str()); }
+};
+
+class HardwareSerial : public Print {
+ public:
+  using Print::write;
+  void begin(unsigned long) {}
+  int available();
+  int read();
+  void flush() {}
+  size_t write(const uint8_t *, size_t) override;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz();
+};
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void yield();
+uint16_t analogRead(uint8_t);
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+long map(long, long, long, long, long);
+uint32_t esp_random();
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define A0 36
+#define A2 34
+#define A3 39
+#define A4 32
+#define A5 33
+#define A6 34
+#define A7 35
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+// FreeRTOS, as used by the sketch
+typedef struct { int owner; int count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(m) ((void)(m))
+#define portEXIT_CRITICAL(m) ((void)(m))
+typedef void * QueueHandle_t;
+typedef void * TaskHandle_t;
+typedef void * SemaphoreHandle_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portYIELD_FROM_ISR() ((void)0)
+#define pdMS_TO_TICKS(x) (x)
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t);
+BaseType_t xQueueSendFromISR(QueueHandle_t, const void *, BaseType_t *);
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t);
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t);
+BaseType_t xTaskCreate(void (*)(void *), const char *, uint32_t, void *, UBaseType_t,
+  TaskHandle_t *);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t);
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * host stand-in for the ESP32 Preferences (NVS) library
+ *
+ * Keys are kept in memory by ../fakes.cpp, and survive simulated restarts.
+ */
+#ifndef Preferences_h
+#define Preferences_h
+
+#include <Arduino.h>
+
+class Preferences {
+ public:
+  bool begin(const char * name, bool readOnly = false, const char * partition = NULL);
+  void end() {}
+  bool clear();
+  bool remove(const char * key);
+  bool isKey(const char * key);
+  size_t putUChar(const char * key, uint8_t value);
+  uint8_t getUChar(const char * key, uint8_t defaultValue = 0);
+  size_t putULong(const char * key, uint32_t value);
+  uint32_t getULong(const char * key, uint32_t defaultValue = 0);
+  size_t putBytes(const char * key, const void * value, size_t length);
+  size_t getBytesLength(const char * key);
+  size_t getBytes(const char * key, void * buffer, size_t maxLength);
+
+  std::string space;
+};
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * host stand-in for the PubSubClient MQTT library; see ../fakes.cpp
+ */
+#ifndef PubSubClient_h
+#define PubSubClient_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+class PubSubClient {
+ public:
+  PubSubClient() {}
+  PubSubClient(WiFiClient &) {}
+  PubSubClient & setServer(const char *, uint16_t) { return *this; }
+  bool setBufferSize(uint16_t) { return true; }
+  PubSubClient & setKeepAlive(uint16_t) { return *this; }
+  bool connect(const char *);
+  bool connect(const char *, const char *, const char *);
+  bool publish(const char *, const uint8_t *, unsigned int, bool);
+  bool loop() { return connected(); }
+  bool connected();
+  int state() { return connected() ? 0 : -2; }
+  void disconnect() {}
+};
+
+#endif
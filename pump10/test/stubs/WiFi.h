@@ -0,0 +1,67 @@
+/**
+ * host stand-in for the ESP32 WiFi library
+ *
+ * UDP packets go over a simulated network in ../fakes.cpp: every socket bound
+ * to a port receives the broadcasts sent to that port, unless the test drops
+ * them. In loopback mode, sockets are real UDP sockets on 127.0.0.1 instead,
+ * so boards in separate processes can talk.
+ */
+#ifndef WiFi_h
+#define WiFi_h
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+#define WL_CONNECTED 3
+#define WIFI_STA 1
+
+class IPAddress {
+ public:
+  uint32_t address = 0;
+  String toString() const;
+};
+
+class WiFiClass {
+ public:
+  int begin(const char *, const char *);
+  int status();
+  IPAddress localIP();
+  bool setAutoReconnect(bool) { return true; }
+  bool mode(int) { return true; }
+};
+extern WiFiClass WiFi;
+
+class WiFiUDP {
+ public:
+  ~WiFiUDP();
+  uint8_t begin(uint16_t);
+  int beginPacket(const char *, uint16_t);
+  int endPacket();
+  size_t write(const uint8_t *, size_t);
+  int parsePacket();
+  int read(uint8_t *, size_t);
+  IPAddress remoteIP();
+  uint16_t remotePort();
+
+  uint16_t port = 0;
+  uint16_t destination = 0;
+  std::string destinationHost;
+  std::vector<uint8_t> outgoing;
+  std::deque<std::vector<uint8_t>> inbox;
+  std::vector<uint8_t> current;
+  size_t readPosition = 0;
+  int descriptor = -1; // real socket, in loopback mode
+};
+
+class WiFiClient {
+ public:
+  int connect(const char *, uint16_t) { return 0; }
+  size_t write(const uint8_t *, size_t length) { return length; }
+  int available() { return 0; }
+  int read() { return -1; }
+  void stop() {}
+  uint8_t connected() { return 0; }
+};
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * host stand-in for the Arduino Wire (I2C) library; see ../fakes.cpp
+ */
+#ifndef Wire_h
+#define Wire_h
+
+#include <Arduino.h>
+
+class TwoWire {
+ public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  bool setClock(uint32_t) { return true; }
+  void beginTransmission(uint8_t);
+  uint8_t endTransmission(bool sendStop = true);
+  uint8_t requestFrom(uint8_t, uint8_t, bool sendStop = true);
+  size_t write(uint8_t);
+  size_t write(const uint8_t *, size_t);
+  int available();
+  int read();
+};
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,12 @@
+/**
+ * host stand-in for the ESP32 analogWrite polyfill; see ../fakes.cpp
+ */
+#ifndef analogWrite_h
+#define analogWrite_h
+
+#include <Arduino.h>
+
+void analogWrite(uint8_t pin, uint32_t value, uint32_t valueMax = 255);
+int analogWriteChannel(uint8_t pin);
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * host stand-in for the ESP-IDF LEDC driver fade functions; see ../../fakes.cpp
+ */
+#ifndef ledc_h
+#define ledc_h
+
+#include <cstdint>
+#include "../esp_err.h"
+
+typedef enum { LEDC_HIGH_SPEED_MODE = 0, LEDC_LOW_SPEED_MODE, LEDC_SPEED_MODE_MAX } ledc_mode_t;
+typedef enum { LEDC_CHANNEL_0 = 0, LEDC_CHANNEL_7 = 7, LEDC_CHANNEL_MAX = 8 } ledc_channel_t;
+typedef enum { LEDC_FADE_NO_WAIT = 0, LEDC_FADE_WAIT_DONE } ledc_fade_mode_t;
+
+esp_err_t ledc_fade_func_install(int);
+esp_err_t ledc_set_fade_with_time(ledc_mode_t, ledc_channel_t, uint32_t, int);
+esp_err_t ledc_fade_start(ledc_mode_t, ledc_channel_t, ledc_fade_mode_t);
+esp_err_t ledc_set_duty_and_update(ledc_mode_t, ledc_channel_t, uint32_t, uint32_t);
+uint32_t ledc_get_duty(ledc_mode_t, ledc_channel_t);
+esp_err_t ledc_fade_stop(ledc_mode_t, ledc_channel_t);
+esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t, uint32_t);
+esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t);
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * host stand-in for the ESP-IDF pulse counter driver; see ../../fakes.cpp
+ */
+#ifndef pcnt_h
+#define pcnt_h
+#include <cstdint>
+#include "../esp_err.h"
+typedef enum { PCNT_UNIT_0 = 0, PCNT_UNIT_MAX = 8 } pcnt_unit_t;
+typedef enum { PCNT_CHANNEL_0 = 0, PCNT_CHANNEL_1 } pcnt_channel_t;
+typedef enum { PCNT_COUNT_DIS = 0, PCNT_COUNT_INC, PCNT_COUNT_DEC } pcnt_count_mode_t;
+typedef enum { PCNT_MODE_KEEP = 0, PCNT_MODE_REVERSE, PCNT_MODE_DISABLE } pcnt_ctrl_mode_t;
+typedef enum { PCNT_EVT_THRES_1 = 0x04, PCNT_EVT_THRES_0 = 0x08, PCNT_EVT_L_LIM = 0x10, PCNT_EVT_H_LIM = 0x20, PCNT_EVT_ZERO = 0x40 } pcnt_evt_type_t;
+#define PCNT_PIN_NOT_USED (-1)
+typedef struct { int pulse_gpio_num; int ctrl_gpio_num; pcnt_ctrl_mode_t lctrl_mode; pcnt_ctrl_mode_t hctrl_mode; pcnt_count_mode_t pos_mode; pcnt_count_mode_t neg_mode; int16_t counter_h_lim; int16_t counter_l_lim; pcnt_unit_t unit; pcnt_channel_t channel; } pcnt_config_t;
+esp_err_t pcnt_unit_config(const pcnt_config_t *);
+esp_err_t pcnt_set_filter_value(pcnt_unit_t, uint16_t);
+esp_err_t pcnt_filter_enable(pcnt_unit_t);
+esp_err_t pcnt_set_event_value(pcnt_unit_t, pcnt_evt_type_t, int16_t);
+esp_err_t pcnt_event_enable(pcnt_unit_t, pcnt_evt_type_t);
+esp_err_t pcnt_event_disable(pcnt_unit_t, pcnt_evt_type_t);
+esp_err_t pcnt_counter_pause(pcnt_unit_t);
+esp_err_t pcnt_counter_resume(pcnt_unit_t);
+esp_err_t pcnt_counter_clear(pcnt_unit_t);
+esp_err_t pcnt_get_counter_value(pcnt_unit_t, int16_t *);
+esp_err_t pcnt_get_event_status(pcnt_unit_t, uint32_t *);
+esp_err_t pcnt_isr_service_install(int);
+esp_err_t pcnt_isr_handler_add(pcnt_unit_t, void (*)(void *), void *);
+
+#endif
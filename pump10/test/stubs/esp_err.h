@@ -0,0 +1,12 @@
+/**
+ * host stand-in for the ESP-IDF error codes
+ */
+#ifndef esp_err_h
+#define esp_err_h
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * host stand-in for the ESP-IDF http server; see ../fakes.cpp
+ *
+ * Handlers are registered with the fake, and called directly by the tests.
+ */
+#ifndef esp_http_server_h
+#define esp_http_server_h
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include "esp_err.h"
+
+typedef void * httpd_handle_t;
+struct httpd_req_t {
+  void * user_ctx;
+  const char * uri;
+  size_t content_len;
+  /// request body, and the response collected by the fake
+  std::string body;
+  std::string response;
+};
+typedef enum { HTTP_GET = 1, HTTP_POST = 3 } httpd_method_t;
+typedef struct {
+  const char * uri;
+  httpd_method_t method;
+  esp_err_t (*handler)(httpd_req_t *);
+  void * user_ctx;
+} httpd_uri_t;
+typedef struct {
+  unsigned server_port;
+  unsigned max_uri_handlers;
+  unsigned stack_size;
+  unsigned task_priority;
+} httpd_config_t;
+#define HTTPD_DEFAULT_CONFIG() { 80, 8, 4096, 5 }
+#define HTTPD_RESP_USE_STRLEN -1
+
+esp_err_t httpd_start(httpd_handle_t *, const httpd_config_t *);
+esp_err_t httpd_register_uri_handler(httpd_handle_t, const httpd_uri_t *);
+esp_err_t httpd_resp_send(httpd_req_t *, const char *, ssize_t);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *, const char *, ssize_t);
+esp_err_t httpd_resp_set_type(httpd_req_t *, const char *);
+esp_err_t httpd_resp_set_status(httpd_req_t *, const char *);
+int httpd_req_recv(httpd_req_t *, char *, size_t);
+
+#endif
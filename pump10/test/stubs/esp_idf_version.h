@@ -0,0 +1,10 @@
+/**
+ * host stand-in for the ESP-IDF version macros; the fakes follow the 4.4 drivers
+ */
+#ifndef esp_idf_version_h
+#define esp_idf_version_h
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(4, 4, 0)
+
+#endif
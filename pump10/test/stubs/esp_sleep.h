@@ -0,0 +1,26 @@
+/**
+ * host stand-in for ESP-IDF sleep modes; see ../fakes.cpp
+ *
+ * Light sleep advances the simulated clock. Deep sleep throws
+ * fake_deep_sleep_t back to the test, in place of the restart.
+ */
+#ifndef esp_sleep_h
+#define esp_sleep_h
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER
+} esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t);
+esp_err_t esp_light_sleep_start(void);
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+
+#endif
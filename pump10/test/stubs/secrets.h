@@ -0,0 +1,26 @@
+// cSpell:disable
+#ifndef MY_SECRETS_H
+#define MY_SECRETS_H
+
+// Network settings for the host tests: no network features configured.
+
+// Standard information needed to connect to your wireless access point. An
+// empty WIFI_SSID runs the controller without any network features
+#define WIFI_SSID ""
+#define WIFI_PASSWORD "password_for_your_ap"
+
+// time server, and local time zone as a POSIX TZ rule string, which includes
+// the daylight savings time changes. Watering windows use local time
+#define NTP_SERVER "pool.ntp.org"
+#define TIME_ZONE "EST5EDT,M3.2.0,M11.1.0"
+
+// MQTT broker for telemetry. An empty MQTT_BROKER disables publishing
+#define MQTT_BROKER ""
+#define MQTT_PORT 1883
+#define MQTT_USER ""
+#define MQTT_PASSWORD ""
+// identifies this controller: part of the MQTT client id and topic
+#define MQTT_CLIENT_ID "pump10"
+
+#endif
+// cSpell:enable
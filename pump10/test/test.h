@@ -0,0 +1,48 @@
+#ifndef test_h
+#define test_h
+
+#include "fakes.h"
+#include "sketch.h"
+
+/**
+ * a minimal test runner for the host tests
+ *
+ *   TEST(name) { CHECK(condition); CHECK_EQUAL(expected, actual); }
+ *
+ * Every test starts from fakeReset(). A failed check ends the test.
+ */
+
+typedef void (*test_fn_t)(void);
+
+/// failed checks end the test by throwing this
+struct test_failure_t {};
+
+struct test_registration_t {
+  test_registration_t(const char *, test_fn_t);
+};
+
+void testFailure(const char *, int, const std::string &);
+
+#define TEST(name) \
+  static void name(void); \
+  static test_registration_t name##Registration(#name, name); \
+  static void name(void)
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      testFailure(__FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+  do { \
+    auto checkExpected = (expected); \
+    auto checkActual = (actual); \
+    if (!(checkExpected == checkActual)) { \
+      testFailure(__FILE__, __LINE__, std::string(#actual " is ") + \
+        std::to_string(checkActual) + ", expected " + std::to_string(checkExpected)); \
+    } \
+  } while (0)
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ * benchmarks leave the live zones alone (user-040)
+ */
+#include "test.h"
+
+TEST(benchmarksUsePrivateRecords)
+{
+  fakeSerialInput("\n");
+  setup();
+  checkIrrigationZone(&allZones[0], getSmartTime());
+  section_timing_t handlers[TIMED_HANDLERS];
+  memcpy(handlers, handlerTimings, sizeof(handlers));
+  section_timing_t sensorRead = sensorReadTiming;
+  unsigned long reads = sensorReads;
+  sensor_reading_t reading = allZones[0].reading.raw;
+
+  runBenchmarks();
+  CHECK(memcmp(handlers, handlerTimings, sizeof(handlers)) == 0);
+  CHECK_EQUAL(sensorRead.calls, sensorReadTiming.calls);
+  CHECK_EQUAL(reads, sensorReads);
+  CHECK_EQUAL(reading, allZones[0].reading.raw);
+  CHECK(handlerTimingRecords == handlerTimings);
+  CHECK(sensorReadTimingRecord == &sensorReadTiming);
+}
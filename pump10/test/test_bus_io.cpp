@@ -0,0 +1,186 @@
+/**
+ * bus work moved out of timer callbacks (user-032, user-033)
+ */
+#include "test.h"
+
+const uint8_t TEST_EXPANDER_ADDRESS = 0x40;
+const pwm_expander_t TEST_EXPANDERS[] = { { TEST_EXPANDER_ADDRESS } };
+const uint8_t TEST_CONVERTER_ADDRESS = 0x48;
+const external_adc_t TEST_CONVERTERS[] = {
+  {ADC_ADS1115, TEST_CONVERTER_ADDRESS, 0, {0, 0, 0, 0}, 1},
+};
+
+// pump on channel 3 of the expander, without a ramp
+const pump_motor_t EXPANDER_PUMP = {
+  0, 255, 0, 0, 1000, 3000, 1, 3, {0, 0, 0}
+};
+
+void scanTimerExpired(void *);
+
+/**
+ * count the I2C transactions sent to an address
+ */
+static size_t i2cWritesTo(const uint8_t address)
+{
+  return std::count_if(fakeI2cWrites.begin(), fakeI2cWrites.end(),
+    [address](const std::vector<uint8_t> & write) { return write[0] == address; });
+}
+
+TEST(pumpTimerLeavesTheBusToTheIoTask)
+{
+  CHECK(beginPwmExpanders(TEST_EXPANDERS, 1));
+  pump_motor_t pump = EXPANDER_PUMP;
+  esp_timer_handle_t timer = NULL;
+  CHECK(startPumpFor(&pump, &timer, 1000));
+  flushPwmExpanders();
+  fakeI2cWrites.clear();
+
+  pumpTimerExpired(&pump); // as the esp_timer task would
+  CHECK_EQUAL((size_t)0, fakeI2cWrites.size());
+  fakeRunTasks();
+  CHECK_EQUAL((size_t)1, i2cWritesTo(TEST_EXPANDER_ADDRESS));
+  cancelPumpTimer(timer);
+}
+
+TEST(flushSendsEachChangeOnce)
+{
+  CHECK(beginPwmExpanders(TEST_EXPANDERS, 1));
+  fakeI2cWrites.clear();
+  setExpanderDuty(0, 3, 2000);
+  requestIo(IO_PWM_FLUSH);
+  flushPwmExpanders(); // the control loop gets there first
+  fakeRunTasks();
+  flushPwmExpanders();
+  CHECK_EQUAL((size_t)1, i2cWritesTo(TEST_EXPANDER_ADDRESS));
+  // the burst starts at LED3_ON_L, and turns off at 2000
+  const std::vector<uint8_t> & burst = fakeI2cWrites.back();
+  CHECK_EQUAL(6 + 4 * 3, (int)burst[1]);
+  CHECK_EQUAL(2000 & 0xFF, (int)burst[4]);
+  CHECK_EQUAL(2000 >> 8, (int)burst[5]);
+}
+
+TEST(scanTimerLeavesTheBusToTheIoTask)
+{
+  CHECK(beginExternalAdcs(TEST_CONVERTERS, 1));
+  fakeI2cReply(TEST_CONVERTER_ADDRESS, {0x12, 0x34});
+  startSensorScan();
+  fakeI2cWrites.clear();
+  fakeAdvanceMicros(2000); // the conversion is ready
+
+  CHECK_EQUAL((sensor_reading_t)0x1234, externalAdcReading(0, 0));
+  // the pointer write, and no more, for the one conversion read
+  CHECK_EQUAL((size_t)1, i2cWritesTo(TEST_CONVERTER_ADDRESS));
+  fakeI2cWrites.clear();
+  scanTimerExpired(NULL); // a late timer after the scan finished
+  fakeRunTasks();
+  CHECK_EQUAL((size_t)0, fakeI2cWrites.size());
+}
+
+TEST(busTransactionsPerTickStayPerExpander)
+{
+  const size_t PUMP_COUNTS[] = { 16, 64, 128 };
+  static pwm_expander_t expanders[MAX_PWM_EXPANDERS];
+  for (size_t pumps : PUMP_COUNTS) {
+    size_t expanderCount = pumps / PWM_EXPANDER_CHANNELS;
+    for (size_t i = 0; i < expanderCount; i++) {
+      expanders[i] = { (uint8_t)(TEST_EXPANDER_ADDRESS + i) };
+    }
+    CHECK(beginPwmExpanders(expanders, expanderCount));
+    std::vector<pump_motor_t> motors(pumps, EXPANDER_PUMP);
+    for (size_t i = 0; i < pumps; i++) {
+      motors[i].device = 1 + i / PWM_EXPANDER_CHANNELS;
+      motors[i].channel = i % PWM_EXPANDER_CHANNELS;
+    }
+
+    // a tick that starts every pump, then one that stops every other pump
+    fakeI2cWrites.clear();
+    for (const pump_motor_t & motor : motors) {
+      startPump(motor);
+    }
+    flushPwmExpanders();
+    size_t allChanged = fakeI2cWrites.size();
+    fakeI2cWrites.clear();
+    for (size_t i = 0; i < pumps; i += 2) {
+      stopPump(motors[i]);
+    }
+    flushPwmExpanders();
+    size_t halfChanged = fakeI2cWrites.size();
+    // and a tick where one pump changes, and one where none do
+    fakeI2cWrites.clear();
+    stopPump(motors[pumps - 1]);
+    flushPwmExpanders();
+    size_t oneChanged = fakeI2cWrites.size();
+    fakeI2cWrites.clear();
+    flushPwmExpanders();
+    size_t noneChanged = fakeI2cWrites.size();
+
+    printf("  bus: %zu pumps on %zu expanders: %zu, %zu, %zu, %zu transactions per tick"
+      " (every, half, one, no pump changed); a write per change: %zu, %zu, 1, 0\n",
+      pumps, expanderCount, allChanged, halfChanged, oneChanged, noneChanged, pumps,
+      pumps / 2);
+    CHECK_EQUAL(expanderCount, allChanged);
+    CHECK_EQUAL(expanderCount, halfChanged);
+    CHECK_EQUAL((size_t)1, oneChanged);
+    CHECK_EQUAL((size_t)0, noneChanged);
+  }
+}
+
+TEST(fullScanOfEightySensorsOverlapsTheLanes)
+{
+  // 4 multiplexers with 16 sensors each, and 4 converters with 4 each
+  const size_t MUXES = 4;
+  const size_t CONVERTERS = 4;
+  const unsigned long CONVERSION_MICROS = 1300; // as in external_adc.cpp
+  static external_adc_t adcs[MUXES + CONVERTERS];
+  size_t sensors = 0;
+  unsigned long serialMicros = 0; // settling and converting one sensor at a time
+  for (size_t i = 0; i < MUXES; i++) {
+    uint8_t select = 12 + MUX_SELECT_PINS * i;
+    adcs[i] = { ADC_ANALOG_MUX, 0, (gpio_pin_t)(32 + i),
+      { select, (uint8_t)(select + 1), (uint8_t)(select + 2), (uint8_t)(select + 3) },
+      MAX_ADC_CHANNELS };
+    fakeSetAnalog(32 + i, 1000 + i);
+    sensors += MAX_ADC_CHANNELS;
+    serialMicros += MAX_ADC_CHANNELS * MUX_SETTLE_MICROS;
+  }
+  for (size_t i = 0; i < CONVERTERS; i++) {
+    uint8_t address = TEST_CONVERTER_ADDRESS + i;
+    adcs[MUXES + i] = { ADC_ADS1115, address, 0, {0, 0, 0, 0}, 4 };
+    for (int channel = 0; channel < 4; channel++) {
+      fakeI2cReply(address, {0x10, (uint8_t)(0x20 + channel)});
+    }
+    sensors += 4;
+    serialMicros += 4 * CONVERSION_MICROS;
+  }
+  CHECK(beginExternalAdcs(adcs, MUXES + CONVERTERS));
+  fakeI2cWrites.clear();
+
+  uint64_t started = micros();
+  startSensorScan();
+  size_t steps = 0;
+  while (externalReadingScan(MUXES + CONVERTERS - 1, 3) != externalReadingScan(0, 0) ||
+      fakeActiveTimers() > 0) {
+    fakeAdvanceMicros(SCAN_STEP_MICROS);
+    steps++;
+    CHECK(steps < 1000);
+  }
+  unsigned long scanMicros = micros() - started;
+  for (size_t i = 0; i < MUXES + CONVERTERS; i++) {
+    for (uint8_t channel = 0; channel < adcs[i].channels; channel++) {
+      CHECK_EQUAL(externalReadingScan(0, 0), externalReadingScan(i, channel));
+    }
+  }
+  CHECK_EQUAL((sensor_reading_t)1003, externalAdcReading(3, 15));
+  CHECK_EQUAL((sensor_reading_t)0x1023, externalAdcReading(MUXES + CONVERTERS - 1, 3));
+  printf("  scan: %zu sensors on %zu lanes in %lu us (%lu us measured by the scan),"
+    " %zu bus transactions; one at a time: %lu us\n", sensors, MUXES + CONVERTERS,
+    scanMicros, externalScanMicros, fakeI2cWrites.size(), serialMicros);
+  // the slowest lane sets the time, with each channel rounded up to scan steps
+  unsigned long muxSteps = (MUX_SETTLE_MICROS + SCAN_STEP_MICROS - 1) / SCAN_STEP_MICROS;
+  unsigned long converterSteps = (CONVERSION_MICROS + SCAN_STEP_MICROS - 1) / SCAN_STEP_MICROS;
+  unsigned long slowestLane = max(MAX_ADC_CHANNELS * muxSteps, 4 * converterSteps);
+  CHECK(externalScanMicros <= (slowestLane + 1) * SCAN_STEP_MICROS);
+  CHECK(externalScanMicros * 3 < serialMicros);
+  // a config write and a pointer write for each conversion
+  CHECK_EQUAL(CONVERTERS * 4 * 2, fakeI2cWrites.size());
+}
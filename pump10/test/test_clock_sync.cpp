@@ -0,0 +1,137 @@
+/**
+ * NTP disciplined wall clock (user-050)
+ *
+ * The host build has no network configured, so the sync tests use a copy of
+ * the clock compiled in its own namespace, with the wifi link configured.
+ */
+#include "test.h"
+
+namespace netclock {
+  bool wifiConfigured() { return true; }
+  bool wifiConnected() { return WiFi.status() == WL_CONNECTED; }
+#include <clock_sync.cpp>
+}
+
+extern bool clockSet;
+
+const uint64_t TEST_EPOCH_MILLIS = 1760000000000ULL;
+
+/**
+ * NTP server: answer with the simulated wall clock
+ */
+static std::vector<uint8_t> ntpReply(const std::vector<uint8_t> & request)
+{
+  std::vector<uint8_t> reply(NTP_PACKET_SIZE, 0);
+  reply[0] = 0x24; // version 4, server mode
+  reply[1] = 1; // stratum
+  std::copy(request.begin() + 40, request.begin() + 48, reply.begin() + 24);
+  netclock::millisToNtp(&reply[32], fakeWallClock());
+  netclock::millisToNtp(&reply[40], fakeWallClock());
+  return reply;
+}
+
+/**
+ * NTP server that never answers
+ */
+static std::vector<uint8_t> lostReply(const std::vector<uint8_t> &)
+{
+  return {};
+}
+
+TEST(smartTimeEpochFollowsMillisWrap)
+{
+  fakeSetMillis(0xFFFFFFFFUL - 500);
+  fakeSetWallClock(TEST_EPOCH_MILLIS);
+  beginClock();
+  smart_time_t before = getSmartTime();
+  CHECK_EQUAL((unsigned long)(TEST_EPOCH_MILLIS / 1000), before.epoch);
+
+  fakeAdvance(1000); // millis() wraps; no disciplineClock() pass in between
+  smart_time_t after = getSmartTime();
+  CHECK(after.millis < before.millis);
+  CHECK_EQUAL(before.epoch + 1, after.epoch);
+  CHECK_EQUAL(fakeWallClock(), wallClockMillis());
+
+  // leave the sketch's clock unset for the other tests
+  fakeReset();
+  beginClock();
+  clockSet = false;
+}
+
+TEST(pendingReplyNeedsTheNextPass)
+{
+  fakeWifiUp(true);
+  fakeUdpServer(NTP_SERVER, lostReply);
+  netclock::beginClock();
+  netclock::disciplineClock();
+  CHECK(netclock::clockAwaitingReply());
+  CHECK_EQUAL(0ul, netclock::nextClockSync(millis()));
+
+  fakeAdvance(CLOCK_REPLY_TIMEOUT);
+  netclock::disciplineClock();
+  CHECK(!netclock::clockAwaitingReply());
+  CHECK_EQUAL(1ul, netclock::clockStatus.failures);
+  CHECK_EQUAL(CLOCK_RETRY_INTERVAL - CLOCK_REPLY_TIMEOUT, netclock::nextClockSync(millis()));
+}
+
+TEST(nextSyncAfterSuccess)
+{
+  fakeWifiUp(true);
+  fakeSetWallClock(TEST_EPOCH_MILLIS);
+  fakeUdpServer(NTP_SERVER, ntpReply);
+  netclock::beginClock();
+  netclock::disciplineClock(); // request, answered at once
+  fakeAdvance(10);
+  netclock::disciplineClock(); // reply
+  CHECK(!netclock::clockAwaitingReply());
+  CHECK(netclock::clockSet);
+  CHECK_EQUAL(CLOCK_SYNC_INTERVAL - 10, netclock::nextClockSync(millis()));
+}
+
+TEST(lockFreeReadsFollowALocalTimeServer)
+{
+  // the local server runs 5 seconds ahead of the board's clock, then 600 ms
+  int64_t serverAhead = 5000;
+  fakeWifiUp(true);
+  fakeSetWallClock(TEST_EPOCH_MILLIS);
+  fakeUdpServer(NTP_SERVER, [&serverAhead](const std::vector<uint8_t> & request) {
+    std::vector<uint8_t> reply = ntpReply(request);
+    uint64_t now = fakeWallClock() + serverAhead;
+    netclock::millisToNtp(&reply[32], now);
+    netclock::millisToNtp(&reply[40], now);
+    return reply;
+  });
+  netclock::beginClock();
+  unsigned long syncs = netclock::clockStatus.syncs;
+  unsigned long ticks;
+  CHECK_EQUAL((unsigned long)(TEST_EPOCH_MILLIS / 1000), netclock::clockEpoch(&ticks));
+
+  // a large error is stepped, and readers see it at once
+  netclock::disciplineClock();
+  netclock::disciplineClock();
+  CHECK_EQUAL(syncs + 1, netclock::clockStatus.syncs);
+  CHECK_EQUAL(fakeWallClock(), netclock::wallClockMillis());
+  CHECK_EQUAL((unsigned long)(fakeWallClock() / 1000), netclock::clockEpoch(&ticks));
+  CHECK_EQUAL(millis(), ticks);
+
+  // a small error is slewed out, with a pass every second
+  serverAhead = 600;
+  fakeAdvance(CLOCK_SYNC_INTERVAL);
+  netclock::disciplineClock();
+  netclock::disciplineClock();
+  CHECK_EQUAL(syncs + 2, netclock::clockStatus.syncs);
+  CHECK_EQUAL(600l, (long)netclock::clockStatus.pendingSlew);
+  uint64_t lastWall = netclock::wallClockMillis();
+  unsigned long slewEnd = 600 * CLOCK_SLEW_DIVISOR + 1000;
+  for (unsigned long passed = 0; passed < slewEnd; passed += 1000) {
+    fakeAdvance(1000);
+    // between passes, the reads still follow the base from the last pass
+    uint64_t wall = netclock::wallClockMillis();
+    CHECK(wall >= lastWall + 1000 && wall <= lastWall + 1001);
+    CHECK_EQUAL((unsigned long)(wall / 1000), netclock::clockEpoch(&ticks));
+    netclock::disciplineClock();
+    lastWall = netclock::wallClockMillis();
+  }
+  CHECK_EQUAL(0l, (long)netclock::clockStatus.pendingSlew);
+  CHECK_EQUAL(fakeWallClock() + 600, netclock::wallClockMillis());
+}
@@ -0,0 +1,112 @@
+/**
+ * configuration profiles (user-047)
+ */
+#include "test.h"
+
+const moisture_calibration_t PROFILE_CALIBRATION = { 3000, 1200 };
+const moisture_calibration_t DEVICE_CALIBRATION = { 2800, 1100 };
+
+/**
+ * build a zone frame with the sunflowers rules, and the profile calibration
+ *
+ * @param name zone name
+ * @return the frame
+ */
+static zone_config_frame_t profileFrame(const char * name)
+{
+  zone_config_frame_t frame = {};
+  strncpy(frame.name, name, CONFIG_NAME_SIZE - 1);
+  frame.sensor = sunflowers.sensor;
+  frame.sensor.moisture_calibration = PROFILE_CALIBRATION;
+  frame.rules = sunflowers.rules;
+  frame.pump = sunflowers.pump;
+  frame.valve = { NO_MANIFOLD, 0 };
+  frame.reservoir = NO_RESERVOIR;
+  frame.schedule = NO_SCHEDULE;
+  return frame;
+}
+
+/**
+ * boot the sketch, without waiting for a console
+ */
+static void boot()
+{
+  fakeReset();
+  fakeSerialInput("\n");
+  setup();
+}
+
+/**
+ * save a profile with the sketch's first zone, and a second zone added at runtime
+ *
+ * @param name profile name
+ */
+static void saveTwoZoneProfile(const char * name)
+{
+  boot();
+  zone_config_frame_t frame = profileFrame("tomatoes");
+  CHECK_EQUAL(CONFIG_OK, configureCommand(CONFIG_SET_ZONE, 2, (const uint8_t *)&frame,
+    sizeof(frame)));
+  applyZoneConfig(allZones, DEFINED_ZONES);
+  CHECK(saveProfile(name));
+}
+
+TEST(profileIsAppliedBeforeZoneStatesAreRestored)
+{
+  fakeClearNvs();
+  saveTwoZoneProfile("summer");
+  CHECK(activateProfile("summer"));
+  // the second zone was soaking when the power failed
+  allZones[1].state = SOAKING_IN;
+  allZones[1].target_time = smartOffsetMillis(getSmartTime(), 60000);
+  saveCheckpoint(allZones, zoneCheckpoint, DEFINED_ZONES, getSmartTime());
+
+  boot();
+  CHECK(!profileLoadPending());
+  CHECK(allZones[1].zone.name == "tomatoes");
+  CHECK_EQUAL(SOAKING_IN, allZones[1].state);
+}
+
+TEST(deviceCalibrationWinsOverProfile)
+{
+  fakeClearNvs();
+  saveTwoZoneProfile("summer");
+  CHECK(activateProfile("summer"));
+  Preferences store;
+  store.begin("pump10cal", false);
+  store.putBytes("zone1", &DEVICE_CALIBRATION, sizeof(DEVICE_CALIBRATION));
+  store.end();
+
+  boot();
+  CHECK_EQUAL(DEVICE_CALIBRATION.airValue,
+    allZones[1].zone.sensor.moisture_calibration.airValue);
+  CHECK_EQUAL(DEVICE_CALIBRATION.waterValue,
+    allZones[1].zone.sensor.moisture_calibration.waterValue);
+}
+
+TEST(interruptedOverwriteInvalidatesProfile)
+{
+  fakeClearNvs();
+  saveTwoZoneProfile("summer");
+  CHECK(activateProfile("summer"));
+  while (loadNextProfileZone()) {}
+
+  fakeNvsFailAfter(1); // the first record is replaced, then the power fails
+  CHECK(!saveProfile("summer"));
+  fakeNvsFailAfter(-1);
+  CHECK(!activateProfile("summer"));
+}
+
+TEST(pendingProfileLoadShortensTheNap)
+{
+  fakeClearNvs();
+  saveTwoZoneProfile("summer");
+  CHECK(activateProfile("summer"));
+  CHECK(profileLoadPending());
+  unsigned long started = millis();
+  powerNap(allZones, zoneCheckpoint, DEFINED_ZONES);
+  CHECK_EQUAL(READING_INTERVAL, millis() - started);
+  while (profileLoadPending()) {
+    loadNextProfileZone();
+  }
+}
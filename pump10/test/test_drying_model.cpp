@@ -0,0 +1,83 @@
+/**
+ * predictive sensor reads, in a simulated day of drying soil (user-027)
+ */
+#include "test.h"
+
+const unsigned long MILLIS_PER_COUNT = 150000; // the sensor rises 1 count per 2.5 minutes
+const uint16_t WET_READING = 1526; // 60% with the sunflowers calibration
+
+/// what a simulated run measured
+struct drying_run_t {
+  unsigned long reads;
+  unsigned long passes;
+  unsigned long detectionDelay;
+};
+
+/**
+ * get the raw reading of the drying sensor
+ *
+ * @param[in] time milliseconds since the start of the run
+ * @return raw ADC reading
+ */
+static uint16_t dryingReading(const unsigned long time)
+{
+  return WET_READING + time / MILLIS_PER_COUNT;
+} // end dryingReading()
+
+/**
+ * get the time the drying sensor first reads below the trigger level
+ *
+ * @return milliseconds since the start of the run
+ */
+static unsigned long dryTime()
+{
+  uint16_t raw = WET_READING;
+  while (calibratedMoisture(sunflowers.sensor, raw) >= sunflowers.rules.moisturePercentage) {
+    raw++;
+  }
+  return (raw - WET_READING) * MILLIS_PER_COUNT;
+} // end dryTime()
+
+/**
+ * run a zone in MOISTURE_GOOD until it detects dry soil
+ *
+ * @param[in] predictive true to sleep until the zone's next reading, false to
+ *   read on every pass, as before the drying model
+ * @return reads, passes, and the time from dry soil to its detection
+ */
+static drying_run_t dryingRun(const bool predictive)
+{
+  fakeReset();
+  irrigation_context_t context;
+  preFillZones(&context, 1);
+  configureZone(&context, sunflowers);
+  drying_run_t run = { 0, 0, 0 };
+  while (context.state == MOISTURE_GOOD && millis() < 2 * dryTime()) {
+    fakeSetAnalog(sunflowers.sensor.gpio_pin, dryingReading(millis()));
+    smart_time_t tick = getSmartTime();
+    if (!predictive) {
+      context.target_time = NULL_TIME;
+    }
+    refreshSensorCache(&context, 1, tick);
+    checkIrrigationZone(&context, tick);
+    run.passes++;
+    if (context.state == MOISTURE_GOOD) {
+      fakeAdvance(predictive ? nextWakeupDelay(&context, 1, tick) : READING_INTERVAL);
+    }
+  }
+  run.reads = fakeAnalogReads(sunflowers.sensor.gpio_pin);
+  run.detectionDelay = millis() - dryTime();
+  return run;
+} // end dryingRun()
+
+TEST(dryingModelCutsReadsWithoutSlowerDetection)
+{
+  drying_run_t everyPass = dryingRun(false);
+  drying_run_t predicted = dryingRun(true);
+  printf("  drying: %lu reads %lu passes, %lu ms late; every pass: %lu reads %lu passes,"
+    " %lu ms late\n", predicted.reads, predicted.passes, predicted.detectionDelay,
+    everyPass.reads, everyPass.passes, everyPass.detectionDelay);
+  CHECK(predicted.reads * 20 < everyPass.reads);
+  CHECK(predicted.passes * 20 < everyPass.passes);
+  CHECK(predicted.detectionDelay <= everyPass.detectionDelay);
+}
@@ -0,0 +1,107 @@
+/**
+ * volume based delivery with the pulse counter (user-035)
+ */
+#include "test.h"
+
+const uint16_t TEST_PULSES_PER_LITRE = 450;
+
+// pump on gpio 32 without a ramp, flow meter on gpio 23 using unit 0
+const pump_motor_t METERED_PUMP = {
+  32, 255, 0, 0, 1000, 3000, ONBOARD_PWM, 0, {23, 0, TEST_PULSES_PER_LITRE}
+};
+
+/**
+ * set up a zone that delivers 1 litre with the metered pump
+ *
+ * @param[out] context the zone
+ */
+void meteredZone(irrigation_context_t * context)
+{
+  preFillZones(context, 1);
+  watering_zone_t zone = sunflowers;
+  zone.pump = METERED_PUMP;
+  zone.rules.wateringVolume = 1000;
+  configureZone(context, zone);
+}
+
+TEST(flowMeterEndsDeliveryOnVolumeAtHighPulseRates)
+{
+  CHECK(beginFlowMeters());
+  const double rates[] = { 45, 450, 4500, 45000 }; // pulses per second
+  for (double rate : rates) {
+    pump_motor_t pump = METERED_PUMP;
+    esp_timer_handle_t timer = NULL;
+    fakeFlowSource(0, pump.gpio_pin, rate);
+    unsigned long started = millis();
+    CHECK(startPumpFor(&pump, &timer, 60000)); // time cap
+    CHECK(armFlowMeter(pump.flow, 1000, pumpTimerExpired, &pump));
+    fakeAdvance(30000);
+    CHECK(flowTargetReached(pump.flow));
+    // every pulse up to the target, and none after the stop
+    CHECK_EQUAL((unsigned long)TEST_PULSES_PER_LITRE, fakeFlowDelivered(0));
+    CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+    long stopMillis = flowStopMillis(pump.flow) - started;
+    CHECK(labs(stopMillis - (long)(1000 * TEST_PULSES_PER_LITRE / rate)) <= 1);
+    cancelPumpTimer(timer);
+    disarmFlowMeter(pump.flow);
+  }
+}
+
+TEST(flowMeterCountsVolumesBeyondTheCounterLimit)
+{
+  CHECK(beginFlowMeters());
+  // one pulse per millilitre, so each volume is its pulse count
+  pump_motor_t pump = METERED_PUMP;
+  pump.flow.pulsesPerLitre = 1000;
+  const unsigned int volumes[] = { 32766, 32767, 32768, 65534, 100000 };
+  for (unsigned int volume : volumes) {
+    esp_timer_handle_t timer = NULL;
+    fakeFlowSource(0, pump.gpio_pin, 45000);
+    CHECK(startPumpFor(&pump, &timer, 60000)); // time cap
+    CHECK(armFlowMeter(pump.flow, volume, pumpTimerExpired, &pump));
+    fakeAdvance(5000);
+    CHECK(flowTargetReached(pump.flow));
+    CHECK_EQUAL((unsigned long)volume, fakeFlowDelivered(0));
+    CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+    cancelPumpTimer(timer);
+    disarmFlowMeter(pump.flow);
+  }
+}
+
+TEST(armingWithoutVolumeClearsEarlierTarget)
+{
+  CHECK(beginFlowMeters());
+  pump_motor_t pump = METERED_PUMP;
+  esp_timer_handle_t timer = NULL;
+  fakeFlowSource(0, pump.gpio_pin, 450);
+  startPumpFor(&pump, &timer, 60000);
+  armFlowMeter(pump.flow, 100, pumpTimerExpired, &pump);
+  fakeAdvance(1000);
+  CHECK(flowTargetReached(pump.flow));
+  cancelPumpTimer(timer);
+
+  // the next delivery is time based: the old target must not end it
+  CHECK(!armFlowMeter(pump.flow, 0, pumpTimerExpired, &pump));
+  CHECK(!flowTargetReached(pump.flow));
+}
+
+TEST(deliveryConsumesReachedTarget)
+{
+  CHECK(beginFlowMeters());
+  irrigation_context_t context;
+  meteredZone(&context);
+  fakeFlowSource(0, METERED_PUMP.gpio_pin, 450); // 1 litre per second
+  smart_time_t started = getSmartTime();
+  context.response.deliveredMillis = 60000;
+  context.state = DELIVERING_WATER;
+  startDelivery(&context, 60000);
+  context.delivery_started = started;
+  context.target_time = smartOffsetMillis(started, 60000);
+  fakeAdvance(1500);
+
+  whenDeliveringWater(&context, getSmartTime());
+  CHECK_EQUAL(SOAKING_IN, context.state);
+  CHECK(!flowTargetReached(context.zone.pump.flow));
+  CHECK_EQUAL(1000ul, context.response.deliveredMillis);
+  CHECK_EQUAL(0u, fakeActiveTimers());
+}
@@ -0,0 +1,69 @@
+/**
+ * instrumentation overhead, against the loop it measures (user-039)
+ */
+#include "test.h"
+
+const unsigned long MEASURED_PASSES = 2000;
+
+/**
+ * measure the cost of one timing record on this cpu
+ *
+ * @return cycles per record, from the fastest of several batches
+ */
+static double recordCost()
+{
+  const unsigned int RECORDS = 100;
+  section_timing_t scratch = { 0, 0, 0 };
+  uint32_t fastest = UINT32_MAX;
+  for (int batch = 0; batch < 100; batch++) {
+    uint32_t started = cycleCount();
+    for (unsigned int i = 0; i < RECORDS; i++) {
+      recordTiming(&scratch, cycleCount());
+    }
+    fastest = min(fastest, cycleCount() - started);
+  }
+  return (double)fastest / RECORDS;
+}
+
+TEST(instrumentationOverheadStaysUnderOnePercentOfTheLoop)
+{
+  // every zone dry, and waiting for its turn at the power budget: the state
+  // machines need a pass every READING_INTERVAL, the shortest loop there is
+  setup();
+  for (size_t i = 0; i < DEFINED_ZONES; i++) {
+    watering_zone_t zone = sunflowers;
+    zone.sensor.gpio_pin = A2 + i;
+    configureZone(&allZones[i], zone);
+    fakeSetAnalog(zone.sensor.gpio_pin, zone.sensor.moisture_calibration.airValue);
+  }
+  beginInstrumentation();
+  int64_t started = esp_timer_get_time();
+  for (unsigned long pass = 0; pass < MEASURED_PASSES; pass++) {
+    loop();
+  }
+  double loopCycles = (double)(esp_timer_get_time() - started) * ESP.getCpuFreqMHz() /
+    MEASURED_PASSES;
+
+  // every handler and sensor read is a record, and so are the pass start and end
+  unsigned long records = sensorReadTiming.calls + 2 * MEASURED_PASSES;
+  for (size_t i = 0; i < TIMED_HANDLERS; i++) {
+    records += handlerTimings[i].calls;
+  }
+  double perPass = (double)records / MEASURED_PASSES;
+  double overhead = 100.0 * perPass * recordCost() / loopCycles;
+
+  fakeSerialOutput().clear();
+  dumpInstrumentation();
+  const char * line = strstr(fakeSerialOutput().c_str(), "instrumentation overhead:");
+  float passShare = 0;
+  float loopShare = 0;
+  CHECK(line != NULL && sscanf(strchr(line, ',') + 2, "%f%% of pass time, %f%%",
+    &passShare, &loopShare) == 2);
+  // the simulated hardware takes no cpu time, so the share of the awake pass
+  // time on the host is an upper bound for the board
+  printf("  instrumentation: %.1f records of %.0f cycles per pass, %.4f%% of a %.0f ms loop"
+    " (reported %.4f%%); %.1f%% of the awake pass time on the host\n", perPass,
+    recordCost(), overhead, loopCycles / ESP.getCpuFreqMHz() / 1000, loopShare, passShare);
+  CHECK(overhead < 1.0);
+  CHECK(loopShare < 1.0);
+}
@@ -0,0 +1,50 @@
+/**
+ * runs every registered host test; exits non zero when any fails
+ *
+ * Usage: pump10_tests [name filter]
+ */
+#include "test.h"
+
+struct test_entry_t {
+  const char * name;
+  test_fn_t fn;
+};
+
+std::vector<test_entry_t> & registeredTests()
+{
+  static std::vector<test_entry_t> tests;
+  return tests;
+}
+
+test_registration_t::test_registration_t(const char * name, test_fn_t fn)
+{
+  registeredTests().push_back({ name, fn });
+}
+
+void testFailure(const char * file, int line, const std::string & message)
+{
+  printf("  %s:%d: check failed: %s\n", file, line, message.c_str());
+  throw test_failure_t();
+}
+
+int main(int argc, char ** argv)
+{
+  size_t run = 0;
+  size_t failed = 0;
+  for (const test_entry_t & test : registeredTests()) {
+    if (argc > 1 && strstr(test.name, argv[1]) == NULL) {
+      continue;
+    }
+    run++;
+    fakeReset();
+    try {
+      test.fn();
+      printf("ok   %s\n", test.name);
+    } catch (const test_failure_t &) {
+      failed++;
+      printf("FAIL %s\n", test.name);
+    }
+  }
+  printf("%zu tests, %zu failed\n", run, failed);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/**
+ * pumps shared through valve manifolds (user-034)
+ */
+#include "test.h"
+
+// shared pump on gpio 33, without a ramp
+const valve_manifold_t TEST_MANIFOLDS[] = {
+  {{33, 128, 0, 0, 1000, 3000, ONBOARD_PWM, 0, {0, 0, 0}}},
+};
+const uint8_t SHARED_PUMP_PIN = 33;
+
+TEST(valveTimerStopsSharedPump)
+{
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  zone_valve_t first = {1, 16};
+  zone_valve_t second = {1, 17};
+  esp_timer_handle_t firstTimer = NULL;
+  esp_timer_handle_t secondTimer = NULL;
+  setupValve(first);
+  setupValve(second);
+  joinManifoldQueue(first);
+  joinManifoldQueue(second);
+
+  CHECK(takeManifoldValve(first));
+  CHECK(startManifoldDelivery(&first, &firstTimer, 1000));
+  CHECK_EQUAL(HIGH, fakePinLevel(first.gpio_pin));
+  CHECK_EQUAL(128u, fakePwmOutput(SHARED_PUMP_PIN));
+
+  // the timer closes the only open valve: the pump must not run against it
+  fakeAdvance(1000);
+  CHECK_EQUAL(LOW, fakePinLevel(first.gpio_pin));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+
+  // the run, and its power, are kept for the waiting zone
+  releaseManifoldValve(first);
+  CHECK(manifoldStates[0].pumpRunning);
+  CHECK(powerReserved > 0);
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  CHECK(takeManifoldValve(second));
+  CHECK(startManifoldDelivery(&second, &secondTimer, 500));
+  CHECK_EQUAL(128u, fakePwmOutput(SHARED_PUMP_PIN));
+  fakeAdvance(500);
+  CHECK_EQUAL(LOW, fakePinLevel(second.gpio_pin));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+
+  releaseManifoldValve(second);
+  CHECK(!manifoldStates[0].pumpRunning);
+  CHECK_EQUAL(1ul, manifoldStates[0].usage.starts);
+  CHECK_EQUAL(0u, powerReserved);
+  cancelPumpTimer(firstTimer);
+  cancelPumpTimer(secondTimer);
+}
+
+TEST(earlyValveReleaseStopsSharedPump)
+{
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  zone_valve_t first = {1, 16};
+  zone_valve_t second = {1, 17};
+  esp_timer_handle_t timer = NULL;
+  joinManifoldQueue(first);
+  joinManifoldQueue(second);
+  CHECK(takeManifoldValve(first));
+  CHECK(startManifoldDelivery(&first, &timer, 1000));
+  cancelPumpTimer(timer);
+  releaseManifoldValve(first); // ended by the main loop, another zone waiting
+  CHECK_EQUAL(LOW, fakePinLevel(first.gpio_pin));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  leaveManifoldQueue(second);
+  CHECK(!manifoldStates[0].pumpRunning);
+  CHECK_EQUAL(0u, powerReserved);
+}
+
+// site power lease state of this board, from power_coordinator.cpp
+extern bool coordinating;
+extern unsigned int leasedMilliamps;
+extern unsigned long leaseValidUntil;
+
+/// holds a site lease for the length of a test, as if boards were coordinating
+struct test_site_lease_t {
+  test_site_lease_t()
+  {
+    coordinating = true;
+    leasedMilliamps = SITE_POWER_BUDGET;
+    leaseValidUntil = millis() + 3600000;
+  }
+  ~test_site_lease_t()
+  {
+    coordinating = false;
+    leasedMilliamps = 0;
+  }
+  void lapse()
+  {
+    leaseValidUntil = millis();
+  }
+  void renew()
+  {
+    leasedMilliamps = SITE_POWER_BUDGET;
+    leaseValidUntil = millis() + 3600000;
+  }
+};
+
+TEST(lapsedLeaseStopsManifoldAndKeepsQueue)
+{
+  test_site_lease_t lease;
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  zone_valve_t first = {1, 16};
+  zone_valve_t second = {1, 17};
+  esp_timer_handle_t timer = NULL;
+  joinManifoldQueue(first);
+  joinManifoldQueue(second);
+  CHECK(takeManifoldValve(first));
+  CHECK(startManifoldDelivery(&first, &timer, 5000));
+  CHECK(powerReserved > 0);
+
+  // the site lease lapses mid delivery
+  lease.lapse();
+  suspendManifolds();
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  CHECK_EQUAL(0u, powerReserved);
+  CHECK(!manifoldStates[0].pumpRunning);
+  cancelPumpTimer(timer);
+  releaseManifoldValve(first);
+  CHECK_EQUAL(1u, manifoldStates[0].waiting); // still queued
+
+  // no handoff without the lease
+  CHECK(!takeManifoldValve(second));
+  lease.renew();
+  CHECK(takeManifoldValve(second));
+  CHECK(powerReserved > 0);
+  releaseManifoldValve(second);
+  CHECK_EQUAL(0u, powerReserved);
+}
+
+TEST(handoffChecksSiteLease)
+{
+  test_site_lease_t lease;
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  zone_valve_t first = {1, 16};
+  zone_valve_t second = {1, 17};
+  esp_timer_handle_t timer = NULL;
+  joinManifoldQueue(first);
+  joinManifoldQueue(second);
+  CHECK(takeManifoldValve(first));
+  CHECK(startManifoldDelivery(&first, &timer, 1000));
+  fakeAdvance(1000);
+  releaseManifoldValve(first); // the run is kept for the second zone
+  CHECK(powerReserved > 0);
+  lease.lapse(); // not renewed
+  CHECK(!takeManifoldValve(second));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  leaveManifoldQueue(second);
+  CHECK_EQUAL(0u, powerReserved);
+  cancelPumpTimer(timer);
+}
+
+TEST(stagedZoneTakesTheValveWithoutStoppingThePump)
+{
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  zone_valve_t first = {1, 16};
+  zone_valve_t second = {1, 17};
+  esp_timer_handle_t firstTimer = NULL;
+  esp_timer_handle_t secondTimer = NULL;
+  joinManifoldQueue(first);
+  joinManifoldQueue(second);
+  CHECK(takeManifoldValve(first));
+  CHECK(startManifoldDelivery(&first, &firstTimer, 1000));
+  CHECK(stageManifoldDelivery(&second, &secondTimer, 500));
+  CHECK(manifoldStaged(second));
+  CHECK_EQUAL(0u, manifoldStates[0].waiting);
+
+  // the stop timer opens the staged valve before closing the current one
+  fakeAdvance(1000);
+  CHECK_EQUAL(LOW, fakePinLevel(first.gpio_pin));
+  CHECK_EQUAL(HIGH, fakePinLevel(second.gpio_pin));
+  CHECK_EQUAL(128u, fakePwmOutput(SHARED_PUMP_PIN));
+  releaseManifoldValve(first); // the handoff already moved the valve on
+  CHECK(manifoldStates[0].valveInUse);
+  manifold_handoff_t handoff;
+  CHECK(!takeManifoldHandoff(first, &handoff));
+  CHECK(takeManifoldHandoff(second, &handoff));
+  CHECK(handoff.timed);
+  CHECK_EQUAL(500ul, handoff.duration);
+
+  // nothing staged: the last valve stops the pump
+  fakeAdvance(500);
+  CHECK_EQUAL(LOW, fakePinLevel(second.gpio_pin));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  releaseManifoldValve(second);
+  CHECK(!manifoldStates[0].pumpRunning);
+  CHECK_EQUAL(0u, powerReserved);
+  cancelPumpTimer(firstTimer);
+  cancelPumpTimer(secondTimer);
+}
+
+TEST(manifoldRunStartsThePumpOnce)
+{
+  const size_t ZONES = 4;
+  powerReserved = 0;
+  CHECK(beginManifolds(TEST_MANIFOLDS, 1));
+  irrigation_context_t contexts[ZONES];
+  preFillZones(contexts, ZONES);
+  for (size_t i = 0; i < ZONES; i++) {
+    watering_zone_t zone = sunflowers;
+    zone.valve = { 1, (uint8_t)(16 + i) };
+    configureZone(&contexts[i], zone);
+  }
+  fakeSetAnalog(sunflowers.sensor.gpio_pin, sunflowers.sensor.moisture_calibration.airValue);
+
+  // run the passes until every zone has watered once, watching the pump
+  unsigned long pumpStarts = 0;
+  bool pumping = false;
+  unsigned long started = millis();
+  size_t watered = 0;
+  while (watered < ZONES && millis() - started < 60000) {
+    smart_time_t tick = getSmartTime();
+    refreshSensorCache(contexts, ZONES, tick);
+    watered = 0;
+    for (size_t i = 0; i < ZONES; i++) {
+      checkIrrigationZone(&contexts[i], tick);
+      watered += contexts[i].usage.starts > 0 ? 1 : 0;
+    }
+    unsigned long wait = nextWakeupDelay(contexts, ZONES, tick);
+    for (unsigned long slept = 0; slept < wait; slept += 10) {
+      fakeAdvance(10);
+      bool running = fakePwmOutput(SHARED_PUMP_PIN) > 0;
+      pumpStarts += running && !pumping ? 1 : 0;
+      pumping = running;
+    }
+  }
+  printf("  manifold: %u zones watered with %lu pump starts\n", (unsigned int)watered,
+    pumpStarts);
+  CHECK_EQUAL(ZONES, watered);
+  CHECK_EQUAL(1ul, pumpStarts);
+  CHECK_EQUAL(1ul, manifoldStates[0].usage.starts);
+  for (size_t i = 0; i < ZONES; i++) {
+    cancelPumpTimer(contexts[i].pump_timer);
+  }
+}
@@ -0,0 +1,49 @@
+/**
+ * metrics registry exports (user-043)
+ */
+#include "test.h"
+
+/**
+ * metric sink: append rendered text to a string
+ */
+static bool stringSink(const char * text, size_t length, void * arg)
+{
+  ((std::string *)arg)->append(text, length);
+  return true;
+}
+
+TEST(exportsRenderFromTheRegistryCopy)
+{
+  irrigation_context_t contexts[2];
+  preFillZones(contexts, 2);
+  configureZone(&contexts[0], sunflowers);
+  updateMetrics(contexts, 2, getSmartTime());
+
+  // a reconfiguration replaces the name string; exports keep the published one
+  contexts[0].zone.name = "renamed zone with a much longer name";
+  std::string text;
+  CHECK(renderPrometheus(stringSink, &text));
+  CHECK(text.find("irrigation_zone_state{zone=\"1\",name=\"zone 1\"}") != std::string::npos);
+  CHECK(text.find("zone=\"2\"") == std::string::npos); // disabled
+
+  updateMetrics(contexts, 2, getSmartTime());
+  text.clear();
+  CHECK(renderPrometheus(stringSink, &text));
+  CHECK(text.find("name=\"renamed zone wi\"") != std::string::npos); // truncated copy
+}
+
+TEST(binaryFrameCountsEnabledZones)
+{
+  irrigation_context_t contexts[3];
+  preFillZones(contexts, 3);
+  configureZone(&contexts[0], sunflowers);
+  configureZone(&contexts[2], sunflowers);
+  updateMetrics(contexts, 3, getSmartTime());
+  contexts[2].state = ZONE_DISABLED; // not published yet
+  fakeSerialOutput().clear();
+  writeMetricFrame();
+  const std::string & frame = fakeSerialOutput();
+  // 6 zone families for 2 zones, and 1 controller family
+  CHECK_EQUAL(13, (int)(uint8_t)frame[3]);
+  CHECK_EQUAL(4u + 13 * 6 + 2, frame.size());
+}
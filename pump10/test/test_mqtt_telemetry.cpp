@@ -0,0 +1,140 @@
+/**
+ * telemetry store and forward, and the wakeups it needs (user-042)
+ *
+ * The host build has no network configured, so a copy of the telemetry code
+ * is compiled in its own namespace, with a broker and a connected wifi link.
+ * The simulated broker is switched with fakeMqttUp().
+ */
+#include "test.h"
+
+namespace telemetry {
+  bool wifiConfigured() { return true; }
+  bool wifiConnected() { return true; }
+}
+#pragma push_macro("MQTT_BROKER")
+#undef MQTT_BROKER
+#define MQTT_BROKER "broker.test"
+namespace telemetry {
+#include <mqtt_telemetry.cpp>
+}
+#pragma pop_macro("MQTT_BROKER")
+
+// telemetry state of the sketch itself, which never publishes on the host
+extern bool telemetryRunning;
+extern smart_time_t windowEnd;
+
+/**
+ * start the telemetry copy with an empty flash queue
+ *
+ * @param[out] context a zone to report on
+ */
+static void startTelemetry(irrigation_context_t * context)
+{
+  fakeClearNvs();
+  telemetry::droppedBatches = 0;
+  telemetry::connectAttempted = false;
+  telemetry::nextEvent = eventCount();
+  preFillZones(context, 1);
+  configureZone(context, sunflowers);
+  CHECK(telemetry::beginTelemetry(getSmartTime()));
+}
+
+/**
+ * get the window end time from a published batch
+ *
+ * @param[in] message the batch
+ * @return millis() of the `t` line
+ */
+static unsigned long batchWindow(const std::string & message)
+{
+  unsigned long epoch = 0;
+  unsigned long window = 0;
+  CHECK_EQUAL(2, sscanf(message.c_str(), "t,%lu,%lu,", &epoch, &window));
+  return window;
+}
+
+/**
+ * add up the dropped batch counts reported in published batches
+ *
+ * @return batches reported as dropped
+ */
+static unsigned long reportedDrops()
+{
+  unsigned long dropped = 0;
+  for (const std::string & message : fakeMqttMessages) {
+    size_t line = message.find("\nd,");
+    if (line != std::string::npos) {
+      dropped += strtoul(message.c_str() + line + 3, NULL, 10);
+    }
+  }
+  return dropped;
+}
+
+TEST(telemetryQueueDropsOldestAndDrainsInOrder)
+{
+  irrigation_context_t context;
+  startTelemetry(&context);
+  unsigned long started = millis();
+  const size_t WINDOWS = TELEMETRY_QUEUE_SLOTS + 2;
+
+  // the broker is down: every window is queued in flash, up to the bound
+  for (size_t i = 0; i < WINDOWS; i++) {
+    fakeAdvance(MQTT_PUBLISH_INTERVAL);
+    telemetry::collectTelemetry(&context, 1, getSmartTime());
+  }
+  CHECK(fakeMqttMessages.empty());
+  CHECK_EQUAL(TELEMETRY_QUEUE_SLOTS, telemetry::queueTail - telemetry::queueHead);
+
+  // back up: the queue drains first, oldest first, and the two oldest are gone
+  fakeMqttUp(true);
+  fakeAdvance(MQTT_RETRY_INTERVAL);
+  telemetry::collectTelemetry(&context, 1, getSmartTime());
+  CHECK_EQUAL(min(TELEMETRY_QUEUE_SLOTS, MQTT_DRAIN_BATCHES), fakeMqttMessages.size());
+  CHECK_EQUAL(started + 3 * MQTT_PUBLISH_INTERVAL, batchWindow(fakeMqttMessages[0]));
+  for (size_t i = 1; i < fakeMqttMessages.size(); i++) {
+    CHECK_EQUAL(batchWindow(fakeMqttMessages[i - 1]) + MQTT_PUBLISH_INTERVAL,
+      batchWindow(fakeMqttMessages[i]));
+  }
+  CHECK_EQUAL(telemetry::queueHead, telemetry::queueTail);
+
+  // the next window goes straight out, after everything queued
+  fakeAdvance(MQTT_PUBLISH_INTERVAL);
+  telemetry::collectTelemetry(&context, 1, getSmartTime());
+  CHECK_EQUAL(TELEMETRY_QUEUE_SLOTS + 1, fakeMqttMessages.size());
+  CHECK(batchWindow(fakeMqttMessages.back()) >
+    batchWindow(fakeMqttMessages[fakeMqttMessages.size() - 2]));
+  CHECK_EQUAL((unsigned long)(WINDOWS - TELEMETRY_QUEUE_SLOTS), reportedDrops());
+  printf("  telemetry: %zu windows offline, %zu queued, %lu dropped, drained in order\n",
+    WINDOWS, TELEMETRY_QUEUE_SLOTS, reportedDrops());
+}
+
+TEST(telemetryNeedsWindowEndKeepaliveAndRetry)
+{
+  irrigation_context_t context;
+  startTelemetry(&context);
+  smart_time_t tick = getSmartTime();
+  CHECK_EQUAL(MQTT_PUBLISH_INTERVAL, telemetry::nextTelemetry(tick));
+
+  // connected: served again within half the keepalive
+  fakeMqttUp(true);
+  telemetry::collectTelemetry(&context, 1, tick);
+  CHECK_EQUAL(MQTT_KEEPALIVE_SECONDS * 500UL, telemetry::nextTelemetry(tick));
+  fakeAdvance(MQTT_KEEPALIVE_SECONDS * 500UL);
+  CHECK_EQUAL(0ul, telemetry::nextTelemetry(getSmartTime()));
+
+  // disconnected with a batch queued: back for the next connection attempt
+  fakeMqttUp(false);
+  telemetry::connectAttempted = false;
+  fakeAdvance(MQTT_PUBLISH_INTERVAL);
+  telemetry::collectTelemetry(&context, 1, getSmartTime());
+  CHECK(telemetry::queueTail != telemetry::queueHead);
+  CHECK_EQUAL(MQTT_RETRY_INTERVAL, telemetry::nextTelemetry(getSmartTime()));
+
+  // and the sketch's nap is cut short by the window end
+  const irrigation_context_t * none = NULL;
+  telemetryRunning = true;
+  windowEnd = smartOffsetMillis(getSmartTime(), 2 * READING_INTERVAL);
+  unsigned long wait = nextWakeupDelay(none, 0, getSmartTime());
+  telemetryRunning = false;
+  CHECK_EQUAL(2 * READING_INTERVAL, wait);
+}
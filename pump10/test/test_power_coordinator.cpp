@@ -0,0 +1,415 @@
+/**
+ * site power leases between boards (user-044)
+ *
+ * Three copies of the coordinator, one per simulated board, talk over the
+ * simulated UDP network. Each copy gets its own board id and state by being
+ * compiled in its own namespace. Boards pass as often as the sketch would:
+ * every READING_INTERVAL while waiting for power, otherwise when the
+ * coordination needs them.
+ *
+ * The handoff test runs each board in its own process instead, over real UDP
+ * sockets on the loopback interface.
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+#include "test.h"
+
+const size_t TEST_SITE_BOARDS = 3;
+
+#define SIMULATED_BOARD(name, id) \
+  namespace name { \
+    const uint8_t SITE_BOARD_ID = id; \
+    const size_t SITE_BOARDS = TEST_SITE_BOARDS; \
+    unsigned int powerReserved = 0; \
+    bool wifiConfigured() { return true; } \
+  }
+
+SIMULATED_BOARD(board1, 1)
+namespace board1 {
+#include <power_coordinator.cpp>
+}
+SIMULATED_BOARD(board2, 2)
+namespace board2 {
+#include <power_coordinator.cpp>
+}
+SIMULATED_BOARD(board3, 3)
+namespace board3 {
+#include <power_coordinator.cpp>
+}
+
+/// one simulated board: its coordinator, and the power it wants
+struct test_board_t {
+  WiFiUDP * socket;
+  bool (*begin)(void);
+  void (*coordinate)(irrigation_context_t *, const size_t, const smart_time_t);
+  bool (*available)(const unsigned int);
+  unsigned long (*nextCoordination)(const unsigned long);
+  unsigned int * reserved;
+  unsigned int * leased;
+  unsigned long * validUntil;
+  uint8_t * leader;
+  uint32_t * term;
+};
+
+#define BOARD_ENTRY(name) { \
+    &name::coordinationSocket, name::beginPowerCoordinator, name::coordinatePower, \
+    name::sitePowerAvailable, name::nextCoordination, &name::powerReserved, \
+    &name::leasedMilliamps, &name::leaseValidUntil, &name::leader, &name::term }
+
+test_board_t testBoards[TEST_SITE_BOARDS] = {
+  BOARD_ENTRY(board1), BOARD_ENTRY(board2), BOARD_ENTRY(board3)
+};
+
+/**
+ * put every simulated board back to its power up state
+ */
+void resetBoards()
+{
+#define RESET_BOARD(name) \
+  name::powerReserved = 0; name::leader = 0; name::term = 0; name::leaderTerm = 0; \
+  name::leasedMilliamps = 0; name::acceptedTerm = 0; name::acceptedToken = 0; \
+  name::requestPending = false; name::nextToken = 1; name::leaseValidUntil = 0; \
+  name::lastRequest = 0; name::pendingSince = 0; name::lastWanted = 0; name::lastHeartbeat = 0
+  RESET_BOARD(board1);
+  RESET_BOARD(board2);
+  RESET_BOARD(board3);
+}
+
+/**
+ * put every simulated board back to its power up state, and start them
+ */
+void startBoards()
+{
+  fakeWifiUp(true);
+  resetBoards();
+  for (test_board_t & board : testBoards) {
+    CHECK(board.begin());
+  }
+}
+
+/**
+ * check if a board is using site power under a lease it believes is valid
+ *
+ * @param board the simulated board
+ * @return milliamps in use
+ */
+unsigned int poweredMilliamps(const test_board_t & board)
+{
+  if (*board.reserved == 0 || *board.leased < *board.reserved ||
+      (long)(millis() - *board.validUntil) >= 0) {
+    return 0;
+  }
+  return *board.reserved;
+}
+
+/**
+ * get the time until a board's next pass, as nextWakeupDelay() would
+ *
+ * @param board the simulated board
+ * @param zoneWait milliseconds until the zones need a pass
+ * @return milliseconds
+ */
+unsigned long passDelay(const test_board_t & board, const unsigned long zoneWait)
+{
+  unsigned long wait = min(zoneWait, board.nextCoordination(millis()));
+  return max(wait, READING_INTERVAL);
+}
+
+/**
+ * run every board for a while, checking that the site budget is never
+ * exceeded
+ *
+ * @param duration milliseconds to run
+ * @param demand milliamps each board tries to reserve; 0 to release
+ * @return milliseconds during which at least one board was powered
+ */
+unsigned long runBoards(const unsigned long duration, const unsigned int demand)
+{
+  unsigned long powered = 0;
+  const unsigned long STEP = 10;
+  unsigned long nextPass[TEST_SITE_BOARDS];
+  for (size_t i = 0; i < TEST_SITE_BOARDS; i++) {
+    nextPass[i] = millis() + STEP * i;
+  }
+  for (unsigned long elapsed = 0; elapsed < duration; elapsed += STEP) {
+    fakeAdvance(STEP);
+    unsigned int total = 0;
+    for (size_t i = 0; i < TEST_SITE_BOARDS; i++) {
+      test_board_t & board = testBoards[i];
+      if ((long)(millis() - nextPass[i]) >= 0) {
+        // a pass: coordination first, then the zones reserve power
+        board.coordinate(NULL, 0, getSmartTime());
+        if (demand == 0) {
+          *board.reserved = 0;
+        } else if (*board.reserved == 0 && board.available(demand)) {
+          *board.reserved = demand;
+        }
+        bool waiting = demand > 0 && *board.reserved == 0;
+        nextPass[i] = millis() + passDelay(board, waiting ? READING_INTERVAL : SLEEP_INTERVAL_MAX);
+      }
+      total += poweredMilliamps(board);
+    }
+    CHECK(total <= SITE_POWER_BUDGET);
+    if (total > 0) {
+      powered += STEP;
+    }
+  }
+  return powered;
+}
+
+/**
+ * index of a simulated board from its socket
+ */
+size_t boardIndex(const WiFiUDP * socket)
+{
+  for (size_t i = 0; i < TEST_SITE_BOARDS; i++) {
+    if (testBoards[i].socket == socket) {
+      return i;
+    }
+  }
+  return TEST_SITE_BOARDS;
+}
+
+TEST(leasesStayWithinSiteBudget)
+{
+  startBoards();
+  // 3 boards each wanting 40% of the budget: at most 2 can hold a lease
+  unsigned long powered = runBoards(120000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK(powered > 60000);
+  CHECK_EQUAL(1u, (unsigned int)board2::leader);
+  CHECK_EQUAL(1u, (unsigned int)board3::leader);
+}
+
+TEST(leasesStayWithinSiteBudgetWithPacketLoss)
+{
+  startBoards();
+  std::mt19937 random(44);
+  std::bernoulli_distribution lost(0.3);
+  fakeUdpDrop([&](const WiFiUDP *, const WiFiUDP *) { return lost(random); });
+  unsigned long powered = runBoards(600000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK(powered > 0);
+  // bursts of heavy loss split and rejoin the boards
+  std::bernoulli_distribution burst(0.9);
+  for (int i = 0; i < 10; i++) {
+    fakeUdpDrop([&](const WiFiUDP *, const WiFiUDP *) { return burst(random); });
+    runBoards(10000, SITE_POWER_BUDGET * 2 / 5);
+    fakeUdpDrop([&](const WiFiUDP *, const WiFiUDP *) { return lost(random); });
+    runBoards(30000, SITE_POWER_BUDGET * 2 / 5);
+  }
+}
+
+TEST(staleLeaderStepsDownForNewerTerm)
+{
+  startBoards();
+  runBoards(30000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK_EQUAL(1u, (unsigned int)board1::leader);
+  uint32_t firstTerm = board1::term;
+
+  // board 1 is cut off: boards 2 and 3 elect board 2, in a newer term
+  fakeUdpDrop([](const WiFiUDP * from, const WiFiUDP * to) {
+    return boardIndex(from) == 0 || boardIndex(to) == 0;
+  });
+  runBoards(40000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK_EQUAL(2u, (unsigned int)board2::leader);
+  CHECK(board2::term > firstTerm);
+  CHECK_EQUAL(1u, (unsigned int)board1::leader); // still believes it leads
+  CHECK_EQUAL(0u, poweredMilliamps(testBoards[0])); // but can not grant alone
+
+  // one way link: board 1 hears the newer term, and stops being a leader
+  fakeUdpDrop([](const WiFiUDP * from, const WiFiUDP * to) {
+    return boardIndex(to) != 0 && boardIndex(from) == 0;
+  });
+  runBoards(COORD_HEARTBEAT_INTERVAL + 100, SITE_POWER_BUDGET * 2 / 5);
+  CHECK(board1::term >= board2::term);
+  for (size_t i = 0; i < MAX_SITE_BOARDS; i++) {
+    CHECK_EQUAL(0u, board1::leases[i].milliamps);
+  }
+
+  // healed: board 2 keeps the term it leads, and board 1 follows it
+  fakeUdpDrop(nullptr);
+  runBoards(60000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK_EQUAL(2u, (unsigned int)board1::leader);
+  CHECK_EQUAL(2u, (unsigned int)board2::leader);
+  CHECK_EQUAL(board2::term, board2::leaderTerm);
+}
+
+TEST(returningLowerBoardKeepsLeases)
+{
+  startBoards();
+  runBoards(10000, 0);
+  // board 1 is away long enough for boards 2 and 3 to elect board 2, and
+  // take leases from it
+  fakeUdpDrop([](const WiFiUDP * from, const WiFiUDP * to) {
+    return boardIndex(from) == 0 || boardIndex(to) == 0;
+  });
+  runBoards(COORD_PEER_TIMEOUT + LEASE_MILLIS + 5000, SITE_POWER_BUDGET * 2 / 5);
+  CHECK_EQUAL(2u, (unsigned int)board3::leader);
+  CHECK(poweredMilliamps(testBoards[1]) + poweredMilliamps(testBoards[2]) > 0);
+
+  // back again: board 1 follows board 2, and no lease is cut short
+  fakeUdpDrop(nullptr);
+  CHECK_EQUAL(60000ul, runBoards(60000, SITE_POWER_BUDGET * 2 / 5));
+  CHECK_EQUAL(2u, (unsigned int)board1::leader);
+  CHECK_EQUAL(2u, (unsigned int)board2::leader);
+  CHECK_EQUAL(2u, (unsigned int)board3::leader);
+}
+
+TEST(coordinationLimitsTheWait)
+{
+  startBoards();
+  runBoards(30000, 0);
+  for (test_board_t & board : testBoards) {
+    // idle boards still pass often enough to send every heartbeat
+    CHECK(board.nextCoordination(millis()) <= COORD_HEARTBEAT_INTERVAL);
+  }
+  CHECK(board1::nextCoordination(millis()) <= COORD_REQUEST_INTERVAL); // the leader
+  CHECK_EQUAL(ULONG_MAX, nextCoordination(millis())); // the sketch, on its own
+}
+
+TEST(leaderChangeExpiresHeldLease)
+{
+  startBoards();
+  runBoards(30000, SITE_POWER_BUDGET * 2 / 5);
+  // boards 2 and 3 hold leases from board 1
+  CHECK(poweredMilliamps(testBoards[1]) + poweredMilliamps(testBoards[2]) > 0);
+
+  // board 1 goes silent: the others elect board 2, and leases from board 1
+  // are no longer used
+  fakeUdpDrop([](const WiFiUDP * from, const WiFiUDP *) {
+    return boardIndex(from) == 0;
+  });
+  runBoards(COORD_PEER_TIMEOUT + 100, SITE_POWER_BUDGET * 2 / 5);
+  CHECK_EQUAL(2u, (unsigned int)board3::leader);
+  CHECK_EQUAL(0u, poweredMilliamps(testBoards[1]));
+  CHECK_EQUAL(0u, poweredMilliamps(testBoards[2]));
+}
+
+const unsigned long HANDOFF_SPEEDUP = 20; // simulated milliseconds per real one
+const unsigned long HANDOFF_DURATION = 100000;
+const unsigned long HANDOFF_DELIVERY = 5000;
+const unsigned long HANDOFF_REST = 1000; // before a board wants power again
+
+/// a delivery starting or ending on one board, reported to the test process
+struct handoff_event_t {
+  uint8_t board;
+  bool granted; // false when the delivery ended
+  unsigned long wantedAt; // when the board started waiting for the grant
+  unsigned long at;
+};
+
+/**
+ * run one board in a child process, over loopback UDP, against the real clock
+ *
+ * The board keeps wanting 60% of the site budget for a delivery, and passes as
+ * the sketch would: every READING_INTERVAL while waiting for power, otherwise
+ * when the delivery ends or the coordination needs it.
+ *
+ * @param index the board
+ * @param events pipe to report deliveries to
+ * @param start the time all boards start at
+ */
+void runHandoffBoard(const size_t index, const int events,
+  const std::chrono::steady_clock::time_point start)
+{
+  fakeReset();
+  fakeWifiUp(true);
+  fakeUdpLoopback(index + 1, TEST_SITE_BOARDS);
+  resetBoards();
+  test_board_t & board = testBoards[index];
+  if (!board.begin()) {
+    _exit(1);
+  }
+  unsigned int demand = SITE_POWER_BUDGET * 3 / 5;
+  unsigned long wantedAt = 0;
+  unsigned long deliveryEnd = 0;
+  unsigned long nextPass = 0;
+  for (;;) {
+    std::this_thread::sleep_until(start +
+      std::chrono::microseconds(nextPass * 1000 / HANDOFF_SPEEDUP));
+    unsigned long now = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count() * HANDOFF_SPEEDUP / 1000;
+    if (now >= HANDOFF_DURATION) {
+      break;
+    }
+    fakeAdvance(now - millis());
+    board.coordinate(NULL, 0, getSmartTime());
+    handoff_event_t event = { (uint8_t)(index + 1), false, wantedAt, now };
+    if (*board.reserved > 0 && (long)(now - deliveryEnd) >= 0) {
+      *board.reserved = 0;
+      wantedAt = now + HANDOFF_REST;
+      write(events, &event, sizeof(event));
+    } else if (*board.reserved == 0 && (long)(now - wantedAt) >= 0 && board.available(demand)) {
+      *board.reserved = demand;
+      deliveryEnd = now + HANDOFF_DELIVERY;
+      event.granted = true;
+      write(events, &event, sizeof(event));
+    }
+    unsigned long zoneWait = *board.reserved > 0 ? deliveryEnd - now :
+      (long)(now - wantedAt) >= 0 ? READING_INTERVAL : wantedAt - now;
+    nextPass = now + passDelay(board, zoneWait);
+  }
+  _exit(0);
+}
+
+TEST(handoffLatencyAcrossProcesses)
+{
+  int events[2];
+  CHECK_EQUAL(0, pipe(events));
+  auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+  fflush(stdout);
+  pid_t boards[TEST_SITE_BOARDS];
+  for (size_t i = 0; i < TEST_SITE_BOARDS; i++) {
+    boards[i] = fork();
+    if (boards[i] == 0) {
+      close(events[0]);
+      try {
+        runHandoffBoard(i, events[1], start);
+      } catch (...) {
+      }
+      _exit(1);
+    }
+  }
+  close(events[1]);
+  std::vector<handoff_event_t> deliveries;
+  handoff_event_t event;
+  while (read(events[0], &event, sizeof(event)) == sizeof(event)) {
+    deliveries.push_back(event);
+  }
+  close(events[0]);
+  for (pid_t board : boards) {
+    int status;
+    CHECK_EQUAL(board, waitpid(board, &status, 0));
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  // only one board at a time fits the budget: the latency of a handoff is from
+  // the end of the previous delivery to the grant for the board waiting for it
+  std::sort(deliveries.begin(), deliveries.end(),
+    [](const handoff_event_t & a, const handoff_event_t & b) { return a.at < b.at; });
+  uint8_t delivering = 0;
+  unsigned long lastEnd = 0;
+  std::vector<unsigned long> latencies;
+  for (const handoff_event_t & delivery : deliveries) {
+    if (!delivery.granted) {
+      CHECK_EQUAL(delivering, delivery.board);
+      delivering = 0;
+      lastEnd = delivery.at;
+      continue;
+    }
+    CHECK_EQUAL(0u, (unsigned int)delivering);
+    delivering = delivery.board;
+    if (lastEnd > delivery.wantedAt) {
+      latencies.push_back(delivery.at - lastEnd);
+    }
+  }
+  CHECK(latencies.size() >= 5);
+  unsigned long total = 0;
+  unsigned long longest = 0;
+  for (unsigned long latency : latencies) {
+    total += latency;
+    longest = max(longest, latency);
+  }
+  printf("  handoff: %zu between processes, %lu ms mean, %lu ms longest\n",
+    latencies.size(), total / latencies.size(), longest);
+  CHECK(longest < LEASE_RENEW_MILLIS);
+}
@@ -0,0 +1,58 @@
+/**
+ * light sleep between passes (user-028)
+ */
+#include "test.h"
+
+extern power_accounting_t powerUsage;
+extern unsigned long awakeSince;
+
+/**
+ * set up zones that can all be left alone, and clear the power accounting
+ *
+ * @param[out] contexts the zones
+ * @param[in] count number of zones
+ */
+static void restingZones(irrigation_context_t * contexts, const size_t count)
+{
+  preFillZones(contexts, count);
+  powerReserved = 0;
+  powerUsage = {};
+  awakeSince = 0;
+}
+
+TEST(lightSleepCountsMeasuredTime)
+{
+  irrigation_context_t contexts[2];
+  restingZones(contexts, 2);
+  fakeLightSleepWake = 1000; // a wake up source ends the sleep early
+  powerNap(contexts, zoneCheckpoint, 2);
+  CHECK_EQUAL(1ul, fakeLightSleeps);
+  CHECK_EQUAL(1000ul, millis());
+  CHECK_EQUAL(1000ul, powerUsage.sleepMillis);
+  CHECK_EQUAL(1ul, powerUsage.wakeups);
+}
+
+TEST(rejectedLightSleepWaitsAwake)
+{
+  irrigation_context_t contexts[2];
+  restingZones(contexts, 2);
+  fakeLightSleepResult = ESP_ERR_INVALID_STATE;
+  powerNap(contexts, zoneCheckpoint, 2);
+  CHECK_EQUAL(SLEEP_INTERVAL_MAX, millis()); // still waited for the next pass
+  CHECK_EQUAL(0ul, powerUsage.sleepMillis);
+  CHECK_EQUAL(0ul, powerUsage.wakeups);
+  CHECK_EQUAL(SLEEP_INTERVAL_MAX, powerUsage.awakeMillis);
+}
+
+TEST(runningPumpKeepsTheBoardAwake)
+{
+  irrigation_context_t contexts[2];
+  restingZones(contexts, 2);
+  configureZone(&contexts[0], sunflowers);
+  contexts[0].state = DELIVERING_WATER;
+  contexts[0].target_time = smartOffsetMillis(getSmartTime(), 3000);
+  powerNap(contexts, zoneCheckpoint, 2);
+  CHECK_EQUAL(0ul, fakeLightSleeps);
+  CHECK_EQUAL(3000ul, millis());
+  CHECK_EQUAL(3000ul, powerUsage.awakeMillis);
+}
@@ -0,0 +1,47 @@
+/**
+ * pump soft start with a hardware fade (user-031)
+ */
+#include "test.h"
+
+// pump on gpio 25, ramping from a kick to 128 over 2 seconds
+const pump_motor_t RAMPED_PUMP = {
+  25, 128, 255, 2000, 1000, 3000, ONBOARD_PWM, 0, {0, 0, 0}
+};
+
+TEST(rampReachesRunningSpeed)
+{
+  pump_motor_t pump = RAMPED_PUMP;
+  startPump(pump);
+  CHECK(fakeFadeActive(pump.gpio_pin));
+  fakeAdvance(2500);
+  CHECK(!fakeFadeActive(pump.gpio_pin));
+  CHECK_EQUAL(128u, fakePwmOutput(pump.gpio_pin));
+  stopPump(pump);
+  CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+}
+
+TEST(stopDuringRampStopsThePump)
+{
+  pump_motor_t pump = RAMPED_PUMP;
+  startPump(pump);
+  fakeAdvance(500);
+  CHECK(fakeFadeActive(pump.gpio_pin));
+  stopPump(pump);
+  CHECK(!fakeFadeActive(pump.gpio_pin));
+  CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+  fakeAdvance(2500); // the fade must not carry on to the running speed
+  CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+}
+
+TEST(shortDeliveryTimerStopsRampedPump)
+{
+  pump_motor_t pump = RAMPED_PUMP;
+  esp_timer_handle_t timer = NULL;
+  CHECK(startPumpFor(&pump, &timer, 600));
+  fakeAdvance(599);
+  CHECK(fakePwmOutput(pump.gpio_pin) > 0);
+  fakeAdvance(1);
+  CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+  fakeAdvance(3000);
+  CHECK_EQUAL(0u, fakePwmOutput(pump.gpio_pin));
+}
@@ -0,0 +1,42 @@
+/**
+ * dosing error with the hardware timer pump stop (user-030)
+ */
+#include "test.h"
+
+TEST(timerStopKeepsDosingErrorUnderOneMillisecond)
+{
+  const unsigned long durations[] = { 1000, 1234, 5000 };
+  for (unsigned long duration : durations) {
+    fakeReset();
+    irrigation_context_t context;
+    preFillZones(&context, 1);
+    configureZone(&context, sunflowers);
+    smart_time_t started = getSmartTime();
+    unsigned long startMillis = millis();
+    context.state = DELIVERING_WATER;
+    startDelivery(&context, duration);
+    context.delivery_started = started;
+    context.target_time = smartOffsetMillis(started, duration);
+    // the loop only looks every READING_INTERVAL; the pump is watched every ms
+    bool running = false;
+    unsigned long stopped = 0;
+    unsigned long nextPass = startMillis + READING_INTERVAL;
+    while (context.state == DELIVERING_WATER) {
+      fakeAdvance(1);
+      bool output = fakePwmOutput(sunflowers.pump.gpio_pin) > 0;
+      if (running && !output && stopped == 0) {
+        stopped = millis();
+      }
+      running |= output; // off at first, during the soft start
+      if (millis() >= nextPass) {
+        whenDeliveringWater(&context, getSmartTime());
+        nextPass += READING_INTERVAL;
+      }
+    }
+    long error = (long)(stopped - startMillis) - (long)duration;
+    CHECK(labs(error) <= 1);
+    // the pass that noticed the end is late by up to READING_INTERVAL
+    CHECK(millis() - startMillis > duration);
+    CHECK_EQUAL(duration, context.response.deliveredMillis);
+  }
+}
@@ -0,0 +1,55 @@
+/**
+ * reservoir level interlock (user-036)
+ */
+#include "test.h"
+
+// level sensor on gpio 35; suspend below 10%, resume at 20%
+const reservoir_t TEST_RESERVOIRS[] = {
+  {{A7, {0, 4095}, ONBOARD_ADC, 0}, 10.0, 20.0},
+};
+
+TEST(lowReservoirEndsDeliveryWithActualRunTime)
+{
+  fakeSetAnalog(A7, 4095);
+  CHECK(beginReservoirs(TEST_RESERVOIRS, 1, getSmartTime()));
+  irrigation_context_t context;
+  preFillZones(&context, 1);
+  watering_zone_t zone = sunflowers;
+  zone.reservoir = 1;
+  configureZone(&context, zone);
+  fakeAdvance(RESERVOIR_READING_INTERVAL - 2000);
+
+  smart_time_t started = getSmartTime();
+  context.state = DELIVERING_WATER;
+  startDelivery(&context, 5000);
+  context.delivery_started = started;
+  context.target_time = smartOffsetMillis(started, 5000);
+  fakeAdvance(2000);
+  CHECK(fakePwmOutput(zone.pump.gpio_pin) > 0);
+
+  fakeSetAnalog(A7, 100); // about 2%
+  checkWaterLevel(&context, 1, getSmartTime());
+  CHECK(!reservoirAvailable(1));
+  CHECK_EQUAL(0u, fakeActiveTimers()); // the stop timer is cancelled
+  whenDeliveringWater(&context, getSmartTime());
+  CHECK_EQUAL(SOAKING_IN, context.state);
+  CHECK_EQUAL(0u, fakePwmOutput(zone.pump.gpio_pin));
+  CHECK_EQUAL(2000ul, context.response.deliveredMillis);
+  CHECK_EQUAL(2000ul, context.usage.onMillis);
+}
+
+TEST(timedDeliveryCountsPlannedTimeWhenNoticedLate)
+{
+  irrigation_context_t context;
+  preFillZones(&context, 1);
+  configureZone(&context, sunflowers);
+  smart_time_t started = getSmartTime();
+  context.state = DELIVERING_WATER;
+  startDelivery(&context, 3000);
+  context.delivery_started = started;
+  context.target_time = smartOffsetMillis(started, 3000);
+  fakeAdvance(3450); // the next pass is late; the timer was not
+  CHECK_EQUAL(0u, fakePwmOutput(sunflowers.pump.gpio_pin));
+  whenDeliveringWater(&context, getSmartTime());
+  CHECK_EQUAL(3000ul, context.response.deliveredMillis);
+}
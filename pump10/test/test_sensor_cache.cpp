@@ -0,0 +1,91 @@
+/**
+ * sensor reads per pass, with and without the shared reading cache (user-037)
+ */
+#include "test.h"
+
+const size_t CACHE_ZONES = 4;
+const uint8_t CACHE_SENSOR_PINS[CACHE_ZONES] = { 34, 35, 36, 39 };
+const uint8_t CACHE_PUMP_PINS[CACHE_ZONES] = { 25, 26, 27, 32 };
+const uint16_t DRY_SOIL = 2000; // 0% with the sunflowers calibration
+const uint16_t WET_SOIL = 1526; // 60%
+const unsigned long CACHE_PASS_LIMIT = 2000;
+
+/// what a simulated run measured
+struct cache_run_t {
+  unsigned long reads;
+  unsigned long passes;
+  unsigned long busiestPass;
+};
+
+/**
+ * water four dry zones, until each has soaked in and reads good again
+ *
+ * Without the cache, each pass runs the state machines the way loop() did
+ * before it: twice per zone, with every handler reading the sensor itself.
+ *
+ * @param[in] cached true to fill the cache once per pass, as loop() does now
+ * @return reads, passes, and the most reads in one pass
+ */
+static cache_run_t wateringRun(const bool cached)
+{
+  fakeReset();
+  irrigation_context_t contexts[CACHE_ZONES];
+  preFillZones(contexts, CACHE_ZONES);
+  for (size_t i = 0; i < CACHE_ZONES; i++) {
+    watering_zone_t zone = sunflowers;
+    zone.sensor.gpio_pin = CACHE_SENSOR_PINS[i];
+    zone.pump.gpio_pin = CACHE_PUMP_PINS[i];
+    configureZone(&contexts[i], zone);
+    fakeSetAnalog(CACHE_SENSOR_PINS[i], DRY_SOIL);
+  }
+  fakeAdvance(READING_INTERVAL); // the first pass after booting
+  cache_run_t run = { 0, 0, 0 };
+  unsigned long started = sensorReads;
+  size_t soaked = 0;
+  while (run.passes < CACHE_PASS_LIMIT) {
+    unsigned long passStart = sensorReads;
+    smart_time_t tick = getSmartTime();
+    if (cached) {
+      refreshSensorCache(contexts, CACHE_ZONES, tick);
+    }
+    for (size_t i = 0; i < CACHE_ZONES; i++) {
+      for (int repeat = 0; repeat < (cached ? 1 : 2); repeat++) {
+        if (!cached) {
+          contexts[i].reading = EMPTY_SENSOR_CACHE;
+        }
+        checkIrrigationZone(&contexts[i], tick);
+      }
+      if (contexts[i].state == SOAKING_IN) {
+        soaked |= 1 << i; // the water reaches the sensor
+        fakeSetAnalog(CACHE_SENSOR_PINS[i], WET_SOIL);
+      }
+    }
+    flushPwmExpanders();
+    run.passes++;
+    run.busiestPass = max(run.busiestPass, sensorReads - passStart);
+    bool done = soaked == (1 << CACHE_ZONES) - 1;
+    for (size_t i = 0; i < CACHE_ZONES; i++) {
+      done &= contexts[i].state == MOISTURE_GOOD;
+    }
+    if (done) {
+      break;
+    }
+    fakeAdvance(READING_INTERVAL);
+  }
+  run.reads = sensorReads - started;
+  return run;
+} // end wateringRun()
+
+TEST(sensorCacheReadsEachSensorOncePerPass)
+{
+  cache_run_t before = wateringRun(false);
+  cache_run_t after = wateringRun(true);
+  printf("  sensor cache: %lu reads in %lu passes, at most %lu per pass;"
+    " before: %lu reads in %lu passes, at most %lu per pass\n", after.reads, after.passes,
+    after.busiestPass, before.reads, before.passes, before.busiestPass);
+  CHECK(after.passes < CACHE_PASS_LIMIT);
+  CHECK(before.passes < CACHE_PASS_LIMIT);
+  CHECK(after.busiestPass <= CACHE_ZONES);
+  CHECK(after.reads < before.reads);
+  CHECK(before.busiestPass > CACHE_ZONES);
+}
@@ -0,0 +1,95 @@
+/**
+ * on device sensor calibration (user-038)
+ */
+#include "test.h"
+#include <random>
+
+// 16 channel multiplexer into gpio 35, select pins on gpio 12 to 15
+const uint8_t MUX_CHANNELS = 16;
+const external_adc_t TEST_MUX[] = {
+  {ADC_ANALOG_MUX, 0, A7, {12, 13, 14, 15}, MUX_CHANNELS},
+};
+
+TEST(externalCalibrationTakesEachSampleFromItsOwnScan)
+{
+  CHECK(beginExternalAdcs(TEST_MUX, 1));
+  irrigation_context_t context;
+  preFillZones(&context, 1);
+  watering_zone_t zone = sunflowers;
+  zone.sensor = {A7, {2000, 1210}, 1, 0}; // channel 0 of the multiplexer
+  configureZone(&context, zone);
+  fakeSetAnalog(A7, 2100);
+  startSensorScan(); // the pass's scan is still running when calibration starts
+  fakeAdvance(1);
+
+  CHECK(calibrateZone(&context, 0, CALIBRATE_AIR));
+  CHECK_EQUAL((sensor_reading_t)2100, context.zone.sensor.moisture_calibration.airValue);
+  unsigned long samples = 0;
+  const char * log = strstr(fakeSerialOutput().c_str(), "air calibration");
+  CHECK(log != NULL && sscanf(strchr(log, ':') + 2, "%lu samples", &samples) == 1);
+  CHECK_EQUAL(CALIBRATION_MIN_SAMPLES, samples);
+  // a full scan of the multiplexer between samples
+  CHECK(fakeAnalogReads(A7) > (samples - 1) * MUX_CHANNELS);
+  fakeClearNvs();
+}
+
+/// what a simulated calibration measured
+struct calibration_run_t {
+  bool converged;
+  unsigned long samples;
+  unsigned long elapsed;
+  sensor_reading_t airValue;
+};
+
+/**
+ * calibrate the air end of an onboard sensor with gaussian reading noise
+ *
+ * @param[in] mean true sensor reading
+ * @param[in] noise standard deviation of the readings
+ * @return the result, and the samples and milliseconds it took, from the log
+ */
+static calibration_run_t noisyCalibration(const uint16_t mean, const double noise)
+{
+  fakeReset();
+  irrigation_context_t context;
+  preFillZones(&context, 1);
+  configureZone(&context, sunflowers);
+  std::mt19937 generator(1);
+  std::normal_distribution<double> reading(mean, noise);
+  fakeAnalogSource(sunflowers.sensor.gpio_pin,
+    [&]() { return (uint16_t)constrain(lround(reading(generator)), 0, 4095); });
+  calibration_run_t run = {};
+  run.converged = calibrateZone(&context, 0, CALIBRATE_AIR);
+  run.airValue = context.zone.sensor.moisture_calibration.airValue;
+  const char * log = strstr(fakeSerialOutput().c_str(), "air calibration");
+  CHECK(log != NULL && sscanf(strchr(log, ':') + 2, "%lu samples in %lu milliseconds",
+    &run.samples, &run.elapsed) == 2);
+  fakeClearNvs();
+  return run;
+} // end noisyCalibration()
+
+TEST(calibrationStopsOnceTheMeanIsKnown)
+{
+  const uint16_t AIR = 2800;
+  const double NOISE[] = { 5, 20, 50 };
+  for (double noise : NOISE) {
+    calibration_run_t run = noisyCalibration(AIR, noise);
+    printf("  calibration: noise %.0f: %lu samples in %.2f seconds, air %u\n", noise,
+      run.samples, run.elapsed / 1000.0, run.airValue);
+    CHECK(run.converged);
+    CHECK(abs(run.airValue - AIR) <= CALIBRATION_TOLERANCE);
+    // about (1.96 * noise / tolerance)^2 samples, one per sample interval
+    double needed = pow(1.96 * noise / CALIBRATION_TOLERANCE, 2);
+    CHECK(run.samples >= CALIBRATION_MIN_SAMPLES);
+    CHECK(run.samples < max(1.3 * needed, (double)CALIBRATION_MIN_SAMPLES + 1));
+    CHECK(run.elapsed <= run.samples * CALIBRATION_SAMPLE_MICROS / 1000 + 1);
+  }
+
+  // too noisy to converge before the timeout: the calibration is kept
+  calibration_run_t run = noisyCalibration(AIR, 150);
+  printf("  calibration: noise 150: %lu samples in %.2f seconds, not converged\n",
+    run.samples, run.elapsed / 1000.0);
+  CHECK(!run.converged);
+  CHECK_EQUAL(sunflowers.sensor.moisture_calibration.airValue, run.airValue);
+  CHECK(run.elapsed >= CALIBRATION_TIMEOUT);
+}
@@ -0,0 +1,66 @@
+/**
+ * status requests under load, against the control loop (user-041)
+ *
+ * The host build has no network configured, so the server is set up by hand.
+ * Requests run on their own thread, as in the esp-idf http server task.
+ */
+#include "test.h"
+
+extern httpd_handle_t statusServer;
+extern SemaphoreHandle_t snapshotLock;
+esp_err_t statusHandler(httpd_req_t *);
+
+TEST(statusRequestsUnderLoadNeverHoldUpTheLoop)
+{
+  static int server; // any handle: the fake server is not started
+  statusServer = &server;
+  snapshotLock = xSemaphoreCreateMutex();
+  irrigation_context_t contexts[2];
+  preFillZones(contexts, 2);
+  configureZone(&contexts[0], sunflowers);
+  updateStatusSnapshot(contexts, 2, getSmartTime(), true);
+
+  std::atomic<bool> loading(true);
+  std::atomic<unsigned long> requests(0);
+  std::atomic<unsigned long> torn(0);
+  std::thread client([&]() {
+    while (loading) {
+      httpd_req_t req = { NULL, "/status", 0, "", "" };
+      statusHandler(&req);
+      if (req.response.compare(0, 9, "{\"time\":[") != 0 ||
+          req.response.compare(req.response.size() - 2, 2, "]}") != 0) {
+        torn++;
+      }
+      requests++;
+    }
+  });
+
+  // every pass changes a zone state, so every pass has a new snapshot
+  const unsigned long PASSES = 20000;
+  auto started = std::chrono::steady_clock::now();
+  double slowest = 0;
+  for (unsigned long i = 0; i < PASSES; i++) {
+    contexts[0].state = i % 2 == 0 ? SOAKING_IN : MOISTURE_GOOD;
+    contexts[0].reading.moisture = i % 100;
+    auto passStarted = std::chrono::steady_clock::now();
+    updateStatusSnapshot(contexts, 2, getSmartTime(), true);
+    double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - passStarted).count();
+    slowest = elapsed > slowest ? elapsed : slowest;
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - started).count();
+  loading = false;
+  client.join();
+  printf("  status: %.0f requests/s during %lu snapshot updates, slowest update %.0f us\n",
+    requests / seconds, PASSES, slowest * 1e6);
+  CHECK(requests > 0);
+  CHECK_EQUAL(0ul, torn.load());
+  // a snapshot skipped while a request held the front buffer goes out next pass
+  contexts[0].state = SOAKING_IN;
+  updateStatusSnapshot(contexts, 2, getSmartTime(), true);
+  httpd_req_t req = { NULL, "/status", 0, "", "" };
+  statusHandler(&req);
+  CHECK(req.response.find("\"state\":5") != std::string::npos);
+  statusServer = NULL;
+}
@@ -0,0 +1,138 @@
+/**
+ * time of day watering windows, through daylight savings time (user-049)
+ *
+ * Local time is the TIME_ZONE of stubs/secrets.h: US Eastern, which springs
+ * forward on 2026-03-08 and falls back on 2026-11-01. Expected times are given
+ * in UTC, so they do not depend on the time zone rules under test.
+ */
+#include "test.h"
+
+bool evaluateSchedule(const watering_schedule_t *, const time_t, time_t *);
+
+/**
+ * get an epoch time from a UTC date and time
+ *
+ * @param[in] month 1 to 12, in 2026
+ * @param[in] day day of the month
+ * @param[in] hour UTC hour
+ * @param[in] minute UTC minute
+ * @return epoch time
+ */
+static time_t utc(const int month, const int day, const int hour, const int minute)
+{
+  struct tm date = {};
+  date.tm_year = 2026 - 1900;
+  date.tm_mon = month - 1;
+  date.tm_mday = day;
+  date.tm_hour = hour;
+  date.tm_min = minute;
+  return timegm(&date);
+}
+
+/**
+ * evaluate a schedule in the local time zone
+ *
+ * @param[in] schedule windows to check
+ * @param[in] now epoch time
+ * @param[out] nextChange next window start or end; a week ahead when none
+ * @return true when now is inside one of the windows
+ */
+static bool evaluateAt(const watering_schedule_t & schedule, const time_t now,
+  time_t * nextChange)
+{
+  setenv("TZ", TIME_ZONE, 1);
+  tzset();
+  *nextChange = now + 8 * 24 * 3600;
+  return evaluateSchedule(&schedule, now, nextChange);
+}
+
+TEST(multipleWindowsInADay)
+{
+  // 05:00 to 07:00, and 20:00 to 22:00; 2026-06-10 is a Wednesday, in EDT
+  const watering_schedule_t schedule = {
+    {{EVERY_DAY, 5 * 60, 7 * 60}, {EVERY_DAY, 20 * 60, 22 * 60}}, 2 };
+  time_t next;
+  CHECK(evaluateAt(schedule, utc(6, 10, 10, 0), &next)); // 06:00
+  CHECK_EQUAL(utc(6, 10, 11, 0), next);
+  CHECK(!evaluateAt(schedule, utc(6, 10, 12, 0), &next)); // 08:00
+  CHECK_EQUAL(utc(6, 11, 0, 0), next);
+  CHECK(evaluateAt(schedule, utc(6, 11, 1, 30), &next)); // 21:30
+  CHECK_EQUAL(utc(6, 11, 2, 0), next);
+  CHECK(!evaluateAt(schedule, utc(6, 11, 2, 0), &next)); // 22:00 ends the window
+  CHECK_EQUAL(utc(6, 11, 9, 0), next);
+}
+
+TEST(dayOfWeekMasks)
+{
+  // 06:00 to 08:00 on Monday, Wednesday, and Friday, and Saturday night from
+  // 22:00 to 02:00 on Sunday
+  const watering_schedule_t schedule = {
+    {{0x2A, 6 * 60, 8 * 60}, {0x40, 22 * 60, 2 * 60}}, 2 };
+  time_t next;
+  CHECK(!evaluateAt(schedule, utc(6, 9, 11, 0), &next)); // Tuesday 07:00
+  CHECK_EQUAL(utc(6, 10, 10, 0), next);
+  CHECK(evaluateAt(schedule, utc(6, 10, 11, 0), &next)); // Wednesday 07:00
+  CHECK_EQUAL(utc(6, 10, 12, 0), next);
+  CHECK(!evaluateAt(schedule, utc(6, 12, 13, 0), &next)); // Friday 09:00
+  CHECK_EQUAL(utc(6, 14, 2, 0), next);
+  // Sunday is not in the mask, but Saturday's window runs past midnight
+  CHECK(evaluateAt(schedule, utc(6, 14, 5, 0), &next)); // Sunday 01:00
+  CHECK_EQUAL(utc(6, 14, 6, 0), next);
+  CHECK(!evaluateAt(schedule, utc(6, 14, 7, 0), &next)); // Sunday 03:00
+  CHECK_EQUAL(utc(6, 15, 10, 0), next);
+}
+
+TEST(windowsFollowSpringForward)
+{
+  // 01:00 to 05:00 local; on 2026-03-08 02:00 EST becomes 03:00 EDT
+  const watering_schedule_t schedule = { {{EVERY_DAY, 1 * 60, 5 * 60}}, 1 };
+  time_t next;
+  CHECK(!evaluateAt(schedule, utc(3, 7, 11, 0), &next)); // Saturday 06:00 EST
+  CHECK_EQUAL(utc(3, 8, 6, 0), next); // Sunday 01:00 EST
+  CHECK(evaluateAt(schedule, utc(3, 8, 6, 30), &next)); // 01:30 EST
+  CHECK_EQUAL(utc(3, 8, 9, 0), next); // 05:00 EDT: 3 hours after the start
+  CHECK(evaluateAt(schedule, utc(3, 8, 7, 30), &next)); // 03:30 EDT
+  CHECK_EQUAL(utc(3, 8, 9, 0), next);
+  CHECK(!evaluateAt(schedule, utc(3, 8, 9, 0), &next));
+  CHECK_EQUAL(utc(3, 9, 5, 0), next); // Monday 01:00 EDT: 23 hours later
+}
+
+TEST(windowsFollowFallBack)
+{
+  // midnight to 04:00 local; on 2026-11-01 02:00 EDT becomes 01:00 EST
+  const watering_schedule_t schedule = { {{EVERY_DAY, 0, 4 * 60}}, 1 };
+  time_t next;
+  CHECK(evaluateAt(schedule, utc(11, 1, 4, 30), &next)); // 00:30 EDT
+  CHECK_EQUAL(utc(11, 1, 9, 0), next); // 04:00 EST: 5 hours after the start
+  CHECK(evaluateAt(schedule, utc(11, 1, 6, 30), &next)); // the second 01:30, EST
+  CHECK_EQUAL(utc(11, 1, 9, 0), next);
+  CHECK(!evaluateAt(schedule, utc(11, 1, 9, 0), &next));
+  CHECK_EQUAL(utc(11, 2, 5, 0), next); // Monday 00:00 EST
+  CHECK(!evaluateAt(schedule, utc(10, 31, 8, 0), &next)); // Saturday 04:00 EDT
+  CHECK_EQUAL(utc(11, 1, 4, 0), next); // 20 hours later, still EDT
+}
+
+TEST(cachedWindowChangesAtTheNextDeadline)
+{
+  const watering_schedule_t schedules[] = { {{{EVERY_DAY, 0, 4 * 60}}, 1} };
+  beginWateringWindows(schedules, 1);
+  setenv("TZ", TIME_ZONE, 1);
+  tzset();
+  // 03:30 EST, after falling back: open for another 30 minutes
+  smart_time_t tick = { (unsigned long)utc(11, 1, 8, 30), millis() };
+  window_state_t state = UNKNOWN_WINDOW;
+  CHECK(wateringAllowed(1, &state, tick));
+  CHECK_EQUAL(tick.millis + 30 * 60000UL, state.nextChange.millis);
+
+  // until then, the cached state is used, even with a wall clock that says otherwise
+  smart_time_t later = smartOffsetMillis(tick, 30 * 60000UL - 1);
+  later.epoch = utc(11, 1, 10, 0);
+  CHECK(wateringAllowed(1, &state, later));
+
+  // closed at the deadline; evaluated again within WINDOW_RECHECK_LIMIT
+  later = smartOffsetMillis(tick, 30 * 60000UL);
+  later.epoch = utc(11, 1, 9, 0);
+  CHECK(!wateringAllowed(1, &state, later));
+  CHECK_EQUAL(later.millis + WINDOW_RECHECK_LIMIT, state.nextChange.millis);
+  beginWateringWindows(wateringSchedules, SCHEDULES);
+}
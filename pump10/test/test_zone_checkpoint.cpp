@@ -0,0 +1,33 @@
+/**
+ * headless boot and checkpoint writes (user-029)
+ */
+#include "test.h"
+
+TEST(bootWithoutConsoleStartsControlWellBeforeTheDeadline)
+{
+  setup(); // no console input
+  printf("  boot: control started %lu ms after reset, deadline %lu ms\n", millis(),
+    BOOT_CONTROL_DEADLINE);
+  CHECK(millis() * 10 < BOOT_CONTROL_DEADLINE);
+}
+
+TEST(consoleInputDuringBootIsKeptForTheFirstPass)
+{
+  fakeSerialInput("\n");
+  setup();
+  CHECK(millis() * 10 < BOOT_CONTROL_DEADLINE);
+  CHECK(Serial.available() > 0);
+}
+
+TEST(checkpointOnlyForWateringEntryAndExit)
+{
+  CHECK(!checkpointNeeded(MOISTURE_GOOD, MOISTURE_GOOD));
+  CHECK(!checkpointNeeded(MOISTURE_GOOD, RESERVE_RESOURCES));
+  CHECK(!checkpointNeeded(RESERVE_RESOURCES, RESOURCE_LOCK_TIMEOUT));
+  CHECK(!checkpointNeeded(RESOURCE_LOCK_TIMEOUT, RESERVE_RESOURCES));
+  CHECK(!checkpointNeeded(RESERVE_RESOURCES, MOISTURE_GOOD));
+  CHECK(checkpointNeeded(RESERVE_RESOURCES, DELIVERING_WATER));
+  CHECK(checkpointNeeded(DELIVERING_WATER, SOAKING_IN));
+  CHECK(checkpointNeeded(SOAKING_IN, MOISTURE_GOOD));
+  CHECK(checkpointNeeded(DELIVERING_WATER, ZONE_DISABLED));
+}
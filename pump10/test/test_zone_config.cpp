@@ -0,0 +1,234 @@
+/**
+ * runtime zone configuration (user-046)
+ */
+#include "test.h"
+
+// shared pump on gpio 33, without a ramp
+const valve_manifold_t CONFIG_MANIFOLDS[] = {
+  {{33, 128, 0, 0, 1000, 3000, ONBOARD_PWM, 0, {0, 0, 0}}},
+};
+const uint8_t OWN_PUMP_PIN = 32;
+const uint8_t SHARED_PUMP_PIN = 33;
+const uint8_t VALVE_PIN = 16;
+const sensor_reading_t DRY_READING = 2000; // 0% with the sunflowers calibration
+
+/**
+ * build a zone frame with the sunflowers sensor and rules
+ *
+ * @param name zone name
+ * @param shared true to water through the manifold valve, false for the own pump
+ * @return the frame
+ */
+zone_config_frame_t zoneFrame(const char * name, const bool shared)
+{
+  zone_config_frame_t frame = {};
+  strncpy(frame.name, name, CONFIG_NAME_SIZE - 1);
+  frame.sensor = sunflowers.sensor;
+  frame.rules = sunflowers.rules;
+  frame.pump = sunflowers.pump;
+  frame.pump.rampMillis = 0;
+  frame.valve = { NO_MANIFOLD, 0 };
+  if (shared) {
+    frame.pump = UNUSED_ZONE.pump;
+    frame.valve = { 1, VALVE_PIN };
+  }
+  frame.reservoir = NO_RESERVOIR;
+  frame.schedule = NO_SCHEDULE;
+  return frame;
+}
+
+/**
+ * send a zone frame for the first zone
+ */
+config_result_t setZone(const zone_config_frame_t & frame)
+{
+  return configureCommand(CONFIG_SET_ZONE, 1, (const uint8_t *)&frame, sizeof(frame));
+}
+
+/**
+ * set up one zone on its own pump, with runtime configuration
+ *
+ * @param[out] context the zone
+ */
+void configuredZone(irrigation_context_t * context)
+{
+  powerReserved = 0;
+  CHECK(beginManifolds(CONFIG_MANIFOLDS, 1));
+  preFillZones(context, 1);
+  watering_zone_t zone = sunflowers;
+  zone.pump.rampMillis = 0;
+  configureZone(context, zone);
+  beginZoneConfig(context, 1);
+}
+
+/**
+ * run passes over the zone until it is back to MOISTURE_GOOD or SOAKING_IN
+ *
+ * @param[in,out] context the zone
+ * @param passes the most passes to run
+ */
+void runPasses(irrigation_context_t * context, const size_t passes)
+{
+  for (size_t i = 0; i < passes; i++) {
+    applyZoneConfig(context, 1);
+    checkIrrigationZone(context, getSmartTime());
+    fakeAdvance(READING_INTERVAL);
+  }
+}
+
+TEST(rulesApplyOnTheNextPass)
+{
+  irrigation_context_t context;
+  configuredZone(&context);
+  watering_triggers_t rules = sunflowers.rules;
+  rules.moisturePercentage = 12.5;
+  CHECK_EQUAL((int)CONFIG_OK, (int)configureCommand(CONFIG_SET_RULES, 1,
+    (const uint8_t *)&rules, sizeof(rules)));
+  CHECK(context.zone.rules.moisturePercentage != 12.5f);
+  CHECK(applyZoneConfig(&context, 1));
+  CHECK(context.zone.rules.moisturePercentage == 12.5f);
+  CHECK(!applyZoneConfig(&context, 1));
+}
+
+TEST(structuralChangeWaitsForIdleZone)
+{
+  irrigation_context_t context;
+  configuredZone(&context);
+  fakeSetAnalog(sunflowers.sensor.gpio_pin, DRY_READING);
+  for (size_t i = 0; i < 5 && context.state != DELIVERING_WATER; i++) {
+    runPasses(&context, 1);
+  }
+  CHECK_EQUAL(DELIVERING_WATER, context.state);
+
+  CHECK_EQUAL((int)CONFIG_OK, (int)setZone(zoneFrame("moved", true)));
+  CHECK(!applyZoneConfig(&context, 1));
+  CHECK(context.zone.valve.manifold == NO_MANIFOLD);
+  while (context.state == DELIVERING_WATER) {
+    runPasses(&context, 1);
+  }
+  CHECK(applyZoneConfig(&context, 1));
+  CHECK_EQUAL(1u, (unsigned int)context.zone.valve.manifold);
+  CHECK(context.zone.name == String("moved"));
+}
+
+TEST(structuralChangeReplacesStopTimer)
+{
+  irrigation_context_t context;
+  configuredZone(&context);
+  fakeSetAnalog(sunflowers.sensor.gpio_pin, DRY_READING);
+  // one delivery with the own pump creates the stop timer
+  for (size_t i = 0; i < 40 && context.state != SOAKING_IN; i++) {
+    runPasses(&context, 1);
+  }
+  CHECK_EQUAL(SOAKING_IN, context.state);
+  CHECK(context.pump_timer != NULL);
+
+  // move the zone to the manifold: the old timer would stop the wrong output
+  CHECK_EQUAL((int)CONFIG_OK, (int)setZone(zoneFrame("moved", true)));
+  CHECK(applyZoneConfig(&context, 1));
+  CHECK(context.pump_timer == NULL);
+  context.state = MOISTURE_GOOD;
+  context.target_time = NULL_TIME;
+  for (size_t i = 0; i < 5 && context.state != DELIVERING_WATER; i++) {
+    runPasses(&context, 1);
+  }
+  CHECK_EQUAL(DELIVERING_WATER, context.state);
+  CHECK_EQUAL(HIGH, fakePinLevel(VALVE_PIN));
+  CHECK(fakePwmOutput(SHARED_PUMP_PIN) > 0);
+  // the timer alone closes the valve, and stops the shared pump, on time
+  fakeAdvance(smartDeltaMillis(getSmartTime(), context.target_time));
+  CHECK_EQUAL(LOW, fakePinLevel(VALVE_PIN));
+  CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+  runPasses(&context, 1);
+  CHECK_EQUAL(SOAKING_IN, context.state);
+}
+
+TEST(reconfigurationWhileRunning)
+{
+  irrigation_context_t context;
+  configuredZone(&context);
+  fakeSetAnalog(sunflowers.sensor.gpio_pin, DRY_READING);
+  const zone_config_frame_t own = zoneFrame("own", false);
+  const zone_config_frame_t shared = zoneFrame("shared", true);
+
+  // a writer keeps changing the zone, as the console or http server task would
+  std::atomic<bool> running(true);
+  std::atomic<unsigned long> commands(0);
+  std::thread writer([&]() {
+    watering_triggers_t rules = sunflowers.rules;
+    for (unsigned long n = 0; running; n++) {
+      switch (n % 4) {
+        case 0:
+          setZone(own);
+          break;
+        case 1:
+          rules.moisturePercentage = 30 + n % 7;
+          configureCommand(CONFIG_SET_RULES, 1, (const uint8_t *)&rules, sizeof(rules));
+          break;
+        case 2:
+          setZone(shared);
+          break;
+        default:
+          configureCommand(n % 8 == 3 ? CONFIG_DISABLE_ZONE : CONFIG_SET_RULES, 1,
+            n % 8 == 3 ? NULL : (const uint8_t *)&rules, n % 8 == 3 ? 0 : sizeof(rules));
+          break;
+      }
+      commands++;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+
+  unsigned long deliveries = 0;
+  unsigned long structural = 0;
+  try {
+    for (size_t pass = 0; pass < 4000; pass++) {
+      String before = context.zone.name;
+      irrigation_state_t stateBefore = context.state;
+      if (applyZoneConfig(&context, 1) &&
+          (context.zone.name != before || (stateBefore == ZONE_DISABLED) !=
+          (context.state == ZONE_DISABLED))) {
+        structural++;
+        CHECK(context.pump_timer == NULL);
+      }
+      // every zone is a whole published zone, never a mix
+      if (context.zone.name == String("own")) {
+        CHECK(context.zone.valve.manifold == NO_MANIFOLD);
+        CHECK_EQUAL((unsigned int)OWN_PUMP_PIN, (unsigned int)context.zone.pump.gpio_pin);
+      } else if (context.zone.name == String("shared")) {
+        CHECK_EQUAL(1u, (unsigned int)context.zone.valve.manifold);
+        CHECK_EQUAL(0u, (unsigned int)context.zone.pump.gpio_pin);
+      }
+      CHECK(context.zone.rules.moisturePercentage >= 30 &&
+        context.zone.rules.moisturePercentage < 37);
+
+      irrigation_state_t was = context.state;
+      checkIrrigationZone(&context, getSmartTime());
+      deliveries += was != DELIVERING_WATER && context.state == DELIVERING_WATER;
+      for (int step = 0; step < 9; step++) {
+        fakeAdvance(READING_INTERVAL / 9);
+        bool over = context.state == DELIVERING_WATER && context.timed_delivery &&
+          smartTimeCompare(getSmartTime(), context.target_time) >= 0;
+        if (over || context.state != DELIVERING_WATER) {
+          // the stop timer has switched everything off
+          CHECK_EQUAL(LOW, fakePinLevel(VALVE_PIN));
+          CHECK_EQUAL(0u, fakePwmOutput(SHARED_PUMP_PIN));
+          CHECK_EQUAL(0u, fakePwmOutput(OWN_PUMP_PIN));
+        }
+      }
+      // the soil dries out again right away
+      if (context.state == SOAKING_IN) {
+        context.target_time = getSmartTime();
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  } catch (...) {
+    running = false;
+    writer.join();
+    throw;
+  }
+  running = false;
+  writer.join();
+  CHECK(commands > 100);
+  CHECK(structural > 10);
+  CHECK(deliveries > 10);
+}
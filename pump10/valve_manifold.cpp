@@ -0,0 +1,438 @@
+/**
+ * methods to share pumps between zones through valve manifolds
+ */
+#include "valve_manifold.h"
+#include "flow_meter.h"
+#include "irrigation_state.h"
+#include "pwm_expander.h"
+#include "power_coordinator.h"
+
+const valve_manifold_t * manifolds = NULL;
+size_t manifoldCount = 0;
+manifold_state_t manifoldStates[MAX_MANIFOLDS];
+// the valve owner, and the staged and handed off deliveries, change from the
+// timer task as well as the main loop
+portMUX_TYPE handoffLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * set up the valve manifolds, with all pumps stopped
+ *
+ * @param[in] config array of manifold configurations; must stay in memory
+ * @param[in] count the number of manifolds in the array
+ * @return true when all manifolds fit
+ */
+bool beginManifolds(const valve_manifold_t * config, const size_t count)
+{
+  manifolds = config;
+  manifoldCount = min(count, MAX_MANIFOLDS);
+  for (size_t i = 0; i < manifoldCount; i++) {
+    manifoldStates[i] = {};
+    stopPump(manifolds[i].pump);
+  }
+  return manifoldCount == count;
+} // end beginManifolds()
+
+/**
+ * stop a manifold pump, and count the run
+ *
+ * @param[in] index index of the manifold
+ */
+void stopManifoldPump(const size_t index)
+{
+  manifold_state_t * manifold = &manifoldStates[index];
+  stopPump(manifolds[index].pump);
+  if (manifold->pumpRunning) {
+    recordPumpRun(&manifold->usage, millis() - manifold->runStarted);
+  }
+  manifold->pumpRunning = false;
+} // end stopManifoldPump()
+
+/**
+ * configure the gpio pin for a zone valve, with the valve closed
+ *
+ * @param[in] valve zone valve configuration
+ */
+void setupValve(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD) {
+    return;
+  }
+  pinMode(valve.gpio_pin, OUTPUT);
+  closeValve(valve);
+} // end setupValve()
+
+/**
+ * record that a zone is waiting to water from a manifold
+ *
+ * Keeps the pump running after the current zone is finished.
+ *
+ * @param[in] valve zone valve configuration
+ */
+void joinManifoldQueue(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return;
+  }
+  manifoldStates[valve.manifold - 1].waiting++;
+} // end joinManifoldQueue()
+
+/**
+ * record that a zone is no longer waiting to water from a manifold
+ *
+ * A staged zone is taken off the stage instead.
+ *
+ * @param[in] valve zone valve configuration
+ */
+void leaveManifoldQueue(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve.manifold - 1];
+  portENTER_CRITICAL(&handoffLock);
+  bool staged = manifold->nextValve != NULL && manifold->nextValve->gpio_pin == valve.gpio_pin;
+  if (staged) {
+    manifold->nextValve = NULL;
+  }
+  portEXIT_CRITICAL(&handoffLock);
+  if (!staged && manifold->waiting > 0) {
+    manifold->waiting--;
+  }
+  if (manifold->waiting > 0 || manifold->valveInUse) {
+    return;
+  }
+  // the pump run was being kept going for this zone
+  if (manifold->pumpRunning) {
+    stopManifoldPump(valve.manifold - 1);
+  }
+  releasePowerToken(manifold->reservedPower);
+  manifold->reservedPower = 0;
+} // end leaveManifoldQueue()
+
+/**
+ * reserve the valve resource for a manifold
+ *
+ * The power for the pump is reserved by the first zone of a pump run, and
+ * stays reserved until the run is over.
+ *
+ * @param[in] valve zone valve configuration
+ * @return true when the zone can start watering
+ */
+bool takeManifoldValve(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return false;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve.manifold - 1];
+  if (manifold->valveInUse) {
+    return false;
+  }
+  if (manifold->reservedPower == 0) {
+    unsigned int peakCurrent = pumpPeakCurrent(manifolds[valve.manifold - 1].pump);
+    if (!takePowerToken(peakCurrent)) {
+      return false;
+    }
+    manifold->reservedPower = peakCurrent;
+  } else if (!sitePowerAvailable(powerReserved)) {
+    return false; // the pump run's power is no longer covered by the site lease
+  }
+  manifold->valveInUse = true;
+  manifold->owner = valve.gpio_pin;
+  if (manifold->waiting > 0) {
+    manifold->waiting--;
+  }
+  return true;
+} // end takeManifoldValve()
+
+/**
+ * get the configuration of the pump shared through a manifold
+ *
+ * @param[in] valve zone valve configuration
+ * @return the manifold pump configuration
+ */
+const pump_motor_t * manifoldPump(const zone_valve_t valve)
+{
+  return &manifolds[valve.manifold - 1].pump;
+} // end manifoldPump()
+
+/**
+ * hand the open valve over to the staged zone, keeping the pump running
+ *
+ * The staged zone's valve opens before the closing one, so the pump never runs
+ * against closed valves, and its stop timer starts now. Call with handoffLock
+ * held.
+ *
+ * @param[in] index index of the manifold
+ * @param[in] closing valve of the zone that is done
+ * @return true when the valve was handed over; false when no zone is staged
+ */
+bool handOffValve(const size_t index, const zone_valve_t closing)
+{
+  manifold_state_t * manifold = &manifoldStates[index];
+  zone_valve_t * next = manifold->nextValve;
+  if (next == NULL || manifold->owner != closing.gpio_pin) {
+    return false;
+  }
+  digitalWrite(next->gpio_pin, HIGH);
+  closeValve(closing);
+  manifold->handoff.started = getSmartTime();
+  manifold->handoff.duration = manifold->nextDuration;
+  manifold->handoff.timed = manifold->nextTimer != NULL &&
+    esp_timer_start_once(manifold->nextTimer, (uint64_t)manifold->nextDuration * 1000) == ESP_OK;
+  manifold->owner = next->gpio_pin;
+  manifold->handedOff = true;
+  manifold->nextValve = NULL;
+  return true;
+} // end handOffValve()
+
+/**
+ * one-shot timer (or flow meter) callback to close a zone valve
+ *
+ * With a zone staged, the valve is handed over to it. Otherwise no valve is
+ * left open for the pump, and it is stopped as well. The pump run itself (and
+ * its power) is ended later by the main loop.
+ *
+ * @param arg pointer to the zone valve configuration
+ */
+void valveTimerExpired(void * arg)
+{
+  zone_valve_t * valve = (zone_valve_t *)arg;
+  if (valve->manifold == NO_MANIFOLD || valve->manifold > manifoldCount) {
+    closeValve(*valve);
+    return;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve->manifold - 1];
+  portENTER_CRITICAL(&handoffLock);
+  bool owner = manifold->owner == valve->gpio_pin;
+  bool handedOver = handOffValve(valve->manifold - 1, *valve);
+  portEXIT_CRITICAL(&handoffLock);
+  closeValve(*valve);
+  if (!owner || handedOver) {
+    return; // another zone's delivery has the pump
+  }
+  stopPump(manifolds[valve->manifold - 1].pump);
+  requestIo(IO_PWM_FLUSH); // sent by the I/O task, without waiting for the main loop
+} // end valveTimerExpired()
+
+/**
+ * create the stop timer for a zone valve, when it does not exist yet
+ *
+ * @param[in] valve zone valve configuration
+ * @param[in,out] timer stop timer for the zone; NULL when it can not be created
+ */
+void createValveTimer(zone_valve_t * valve, esp_timer_handle_t * timer)
+{
+  if (*timer != NULL) {
+    return;
+  }
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = valveTimerExpired;
+  timerArgs.arg = valve;
+  timerArgs.name = "valve close";
+  if (esp_timer_create(&timerArgs, timer) != ESP_OK) {
+    *timer = NULL;
+  }
+} // end createValveTimer()
+
+/**
+ * open a zone valve, start the manifold pump, and schedule a hardware timer to
+ * close the valve
+ *
+ * Used by the first zone of a pump run, and by zones that could not be staged:
+ * the pump was stopped when the previous valve closed, so it is started again.
+ *
+ * @param[in] valve zone valve configuration
+ * @param[in,out] timer stop timer for the zone; created on first use
+ * @param[in] duration milliseconds to keep the valve open
+ * @return true when the timer will close the valve; false when the caller must
+ *   close it
+ */
+bool startManifoldDelivery(zone_valve_t * valve, esp_timer_handle_t * timer,
+  const unsigned long duration)
+{
+  manifold_state_t * manifold = &manifoldStates[valve->manifold - 1];
+  createValveTimer(valve, timer);
+  // open the valve first, so the pump never starts against closed valves
+  digitalWrite(valve->gpio_pin, HIGH);
+  startPump(manifolds[valve->manifold - 1].pump);
+  if (!manifold->pumpRunning) {
+    manifold->pumpRunning = true;
+    manifold->runStarted = millis();
+  }
+  if (*timer == NULL) {
+    return false;
+  }
+  esp_timer_stop(*timer);
+  return esp_timer_start_once(*timer, (uint64_t)duration * 1000) == ESP_OK;
+} // end startManifoldDelivery()
+
+/**
+ * queue a zone's delivery to start when the current zone's valve closes
+ *
+ * Only one zone is staged at a time, and only while the valve is in use.
+ * Staging commits the zone: it no longer waits for resources, and its delivery
+ * starts from the current zone's stop timer, or from the main loop when the
+ * current delivery ends early.
+ *
+ * @param[in] valve zone valve configuration
+ * @param[in,out] timer stop timer for the zone; created on first use
+ * @param[in] duration milliseconds to keep the valve open
+ * @return true when staged; the zone then waits for takeManifoldHandoff()
+ */
+bool stageManifoldDelivery(zone_valve_t * valve, esp_timer_handle_t * timer,
+  const unsigned long duration)
+{
+  if (valve->manifold == NO_MANIFOLD || valve->manifold > manifoldCount) {
+    return false;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve->manifold - 1];
+  if (!manifold->valveInUse || manifold->nextValve != NULL ||
+      hasFlowMeter(manifolds[valve->manifold - 1].pump.flow) ||
+      !sitePowerAvailable(powerReserved)) {
+    return false;
+  }
+  createValveTimer(valve, timer);
+  if (*timer != NULL) {
+    esp_timer_stop(*timer);
+  }
+  portENTER_CRITICAL(&handoffLock);
+  manifold->nextValve = valve;
+  manifold->nextTimer = *timer;
+  manifold->nextDuration = duration;
+  portEXIT_CRITICAL(&handoffLock);
+  if (manifold->waiting > 0) {
+    manifold->waiting--;
+  }
+  return true;
+} // end stageManifoldDelivery()
+
+/**
+ * check if a zone's delivery is staged, and waiting for the valve handoff
+ *
+ * @param[in] valve zone valve configuration
+ * @return true while staged
+ */
+bool manifoldStaged(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return false;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve.manifold - 1];
+  portENTER_CRITICAL(&handoffLock);
+  bool staged = manifold->nextValve != NULL && manifold->nextValve->gpio_pin == valve.gpio_pin;
+  portEXIT_CRITICAL(&handoffLock);
+  return staged;
+} // end manifoldStaged()
+
+/**
+ * take over a delivery that a valve handoff started for a zone
+ *
+ * @param[in] valve zone valve configuration
+ * @param[out] handoff when the delivery started, and for how long
+ * @return true once the zone's valve has been opened by a handoff
+ */
+bool takeManifoldHandoff(const zone_valve_t valve, manifold_handoff_t * handoff)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return false;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve.manifold - 1];
+  portENTER_CRITICAL(&handoffLock);
+  bool taken = manifold->handedOff && manifold->owner == valve.gpio_pin;
+  if (taken) {
+    *handoff = manifold->handoff;
+    manifold->handedOff = false;
+  }
+  portEXIT_CRITICAL(&handoffLock);
+  return taken;
+} // end takeManifoldHandoff()
+
+/**
+ * close a zone valve
+ *
+ * @param[in] valve zone valve configuration
+ */
+void closeValve(const zone_valve_t valve)
+{
+  digitalWrite(valve.gpio_pin, LOW);
+} // end closeValve()
+
+/**
+ * done with the valve resource for a manifold
+ *
+ * A delivery ended early by the main loop hands the valve to the staged zone,
+ * as the stop timer would. Without one, the pump run ends, and its power is
+ * released, when no other zone is waiting. Otherwise the run (and its power)
+ * is kept for the next zone, with the pump stopped until that zone's valve
+ * opens.
+ *
+ * @param[in] valve zone valve configuration
+ */
+void releaseManifoldValve(const zone_valve_t valve)
+{
+  if (valve.manifold == NO_MANIFOLD || valve.manifold > manifoldCount) {
+    return;
+  }
+  manifold_state_t * manifold = &manifoldStates[valve.manifold - 1];
+  portENTER_CRITICAL(&handoffLock);
+  bool handedOver = manifold->owner != valve.gpio_pin ||
+    handOffValve(valve.manifold - 1, valve);
+  portEXIT_CRITICAL(&handoffLock);
+  closeValve(valve);
+  if (handedOver) {
+    return; // the next zone has the valve, and the pump keeps running
+  }
+  manifold->valveInUse = false;
+  if (manifold->waiting > 0) {
+    stopPump(manifolds[valve.manifold - 1].pump); // never against closed valves
+    return;
+  }
+  if (manifold->pumpRunning) {
+    stopManifoldPump(valve.manifold - 1);
+  }
+  releasePowerToken(manifold->reservedPower);
+  manifold->reservedPower = 0;
+} // end releaseManifoldValve()
+
+/**
+ * stop all manifold pumps, and release their power, keeping the waiting zones
+ *
+ * Used when the site power lease lapses. A zone holding a valve still releases
+ * it, and the next zone to take a valve reserves the power again. A staged
+ * zone goes back to waiting, and a delivery already handed off ends as soon as
+ * its zone takes it over.
+ */
+void suspendManifolds()
+{
+  for (size_t i = 0; i < manifoldCount; i++) {
+    portENTER_CRITICAL(&handoffLock);
+    if (manifoldStates[i].nextValve != NULL) {
+      manifoldStates[i].nextValve = NULL;
+      manifoldStates[i].waiting++;
+    }
+    manifoldStates[i].handoff.duration = 0;
+    portEXIT_CRITICAL(&handoffLock);
+    stopManifoldPump(i);
+    releasePowerToken(manifoldStates[i].reservedPower);
+    manifoldStates[i].reservedPower = 0;
+  }
+} // end suspendManifolds()
+
+/**
+ * stop all manifold pumps, and forget all waiting zones
+ *
+ * Used for emergency shutdown. The zone valves are closed by the caller.
+ */
+void shutdownManifolds()
+{
+  for (size_t i = 0; i < manifoldCount; i++) {
+    stopManifoldPump(i);
+    portENTER_CRITICAL(&handoffLock);
+    manifoldStates[i].nextValve = NULL;
+    manifoldStates[i].handedOff = false;
+    portEXIT_CRITICAL(&handoffLock);
+    manifoldStates[i].valveInUse = false;
+    manifoldStates[i].waiting = 0;
+    manifoldStates[i].reservedPower = 0;
+  }
+} // end shutdownManifolds()
@@ -0,0 +1,90 @@
+#ifndef valve_manifold_h
+#define valve_manifold_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "smart_time.h"
+#include "watering_management.h"
+#include "instrumentation.h"
+
+/**
+ * data structures and methods to share a pump between zones through solenoid
+ * valves on a manifold
+ *
+ * The manifold pump and one valve are resources reserved by the zone state
+ * machines. The pump (and its power) is held for as long as zones on the
+ * manifold are waiting to be watered, and the valves open one at a time. All of
+ * the dry zones on a manifold are watered in sequence from a single pump run.
+ * The pump only turns while a valve is open.
+ *
+ * A zone waiting for the valve stages its delivery. When the current zone's
+ * stop timer fires, the staged zone's valve opens before the current one
+ * closes, and its own stop timer starts, so the pump keeps running: a run over
+ * several zones starts the motor once. The pump stops when a valve closes with
+ * no zone staged. Manifolds with a flow meter stop and start the pump for each
+ * zone instead, since the pulse counter measures one delivery at a time.
+ */
+
+const size_t MAX_MANIFOLDS = 8;
+
+/// configuration for a pump shared through a valve manifold
+struct valve_manifold_t {
+  /// the shared pump
+  pump_motor_t pump;
+};
+
+/// a delivery started by a valve handoff, for its zone to take over
+struct manifold_handoff_t {
+  /// when the valve opened
+  smart_time_t started;
+  /// milliseconds the valve stays open
+  unsigned long duration;
+  /// the stop timer will close the valve
+  bool timed;
+};
+
+/// runtime state of a valve manifold
+struct manifold_state_t {
+  /// a pump run is in progress; the pump may be stopped between valves
+  bool pumpRunning;
+  /// a zone holds the valve resource
+  bool valveInUse;
+  /// valve pin of the zone holding the valve resource
+  gpio_pin_t owner;
+  /// zones waiting for the valve resource, other than the staged one
+  unsigned int waiting;
+  /// zone whose delivery starts when the current valve closes; NULL for none
+  zone_valve_t * nextValve;
+  esp_timer_handle_t nextTimer;
+  unsigned long nextDuration;
+  /// a handoff started the owner's delivery, and the zone has not taken it yet
+  bool handedOff;
+  manifold_handoff_t handoff;
+  /// milliamps of the shared power supply held for the pump
+  unsigned int reservedPower;
+  /// millis() when the current pump run started
+  unsigned long runStarted;
+  /// pump runs, and how long the shared pump has been running
+  pump_usage_t usage;
+};
+
+extern manifold_state_t manifoldStates[MAX_MANIFOLDS];
+
+bool beginManifolds(const valve_manifold_t *, const size_t);
+void setupValve(const zone_valve_t);
+void joinManifoldQueue(const zone_valve_t);
+void leaveManifoldQueue(const zone_valve_t);
+bool takeManifoldValve(const zone_valve_t);
+const pump_motor_t * manifoldPump(const zone_valve_t);
+void valveTimerExpired(void *);
+bool startManifoldDelivery(zone_valve_t *, esp_timer_handle_t *, const unsigned long);
+bool stageManifoldDelivery(zone_valve_t *, esp_timer_handle_t *, const unsigned long);
+bool manifoldStaged(const zone_valve_t);
+bool takeManifoldHandoff(const zone_valve_t, manifold_handoff_t *);
+void closeValve(const zone_valve_t);
+void releaseManifoldValve(const zone_valve_t);
+void stopManifoldPump(const size_t);
+void suspendManifolds(void);
+void shutdownManifolds(void);
+
+#endif
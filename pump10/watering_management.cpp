@@ -0,0 +1,382 @@
+/**
+ * methods to access analog sensors and PWM motor controls using self contained
+ * data structures
+ */
+#include "watering_management.h"
+#include "external_adc.h"
+#include "pwm_expander.h"
+#include "instrumentation.h"
+
+// count of actual sensor reads, for reporting; kept through deep sleep
+RTC_DATA_ATTR unsigned long sensorReads = 0;
+
+// weight given to the newest measured response when updating the estimate
+const float RESPONSE_SMOOTHING = 0.5;
+// duty cycle resolution the analogWrite polyfill configures for LEDC channels
+const uint8_t LEDC_DUTY_BITS = 13;
+bool fadeInstalled = false;
+
+/**
+ * read the raw value from a moisture sensor
+ *
+ * @param sensor configuration data for a moisture sensor
+ * @return raw ADC reading
+ */
+sensor_reading_t readSensor(const moisture_sensor_t sensor)
+{
+  uint32_t started = cycleCount();
+  sensor_reading_t rawADC;
+  sensorReads++;
+  if (sensor.device == ONBOARD_ADC) {
+    lockBus(); // the I/O task reads multiplexers through ADC1
+    rawADC = analogRead(sensor.gpio_pin);
+    unlockBus();
+  } else {
+    rawADC = externalAdcReading(sensor.device - 1, sensor.channel);
+  }
+  recordTiming(sensorReadTimingRecord, started);
+  return rawADC;
+} // end readSensor()
+
+/**
+ * convert a raw sensor reading to a moisture percentage
+ *
+ * @param sensor configuration data for a moisture sensor
+ * @param rawADC raw reading from the sensor
+ * @return soil moisture percentage
+ */
+float calibratedMoisture(const moisture_sensor_t sensor, const sensor_reading_t rawADC)
+{
+  float moisturePercent = map(rawADC, sensor.moisture_calibration.airValue,
+    sensor.moisture_calibration.waterValue, 0, 100);
+  // Serial.printf("gpio %d reads as %d for %f%% soil moisture\n",
+  //   sensor.gpio_pin, rawADC, moisturePercent); // DEBUG // LOG
+  return constrain(moisturePercent, 0, 100);
+} // end calibratedMoisture()
+
+/**
+ * get moisture percentage for a zone, directly from the sensor
+ *
+ * @param sensor configuration data for a moisture sensor
+ * @return soil moisture percentage
+ */
+float getSoilMoisture(const moisture_sensor_t sensor)
+{
+  return calibratedMoisture(sensor, readSensor(sensor));
+} // end getSoilMoisture()
+
+/**
+ * check if a cached sensor reading can still be used
+ *
+ * @param[in] cache latest reading from the sensor
+ * @param[in] timeTick current time reference
+ * @return true when the reading is younger than SENSOR_READING_TTL
+ */
+bool readingFresh(const sensor_cache_t * cache, const smart_time_t timeTick)
+{
+  return smartTimeCompare(cache->readTime, NULL_TIME) != 0 &&
+    smartDeltaMillis(cache->readTime, timeTick) < SENSOR_READING_TTL;
+} // end readingFresh()
+
+/**
+ * get moisture percentage for a zone, reading the sensor only when the cached
+ * reading is stale
+ *
+ * @param sensor configuration data for a moisture sensor
+ * @param[in,out] cache latest reading from the sensor
+ * @param[in] timeTick current time reference
+ * @return soil moisture percentage
+ */
+float cachedMoisture(const moisture_sensor_t sensor, sensor_cache_t * cache,
+  const smart_time_t timeTick)
+{
+  if (!readingFresh(cache, timeTick)) {
+    cache->raw = readSensor(sensor);
+    cache->moisture = calibratedMoisture(sensor, cache->raw);
+    cache->readTime = timeTick;
+  }
+  return cache->moisture;
+} // end cachedMoisture()
+
+/**
+ * determine the amount of water that is currently needed
+ *
+ * The moisture reading and size of the watering event are remembered in the
+ * response data, so the actual moisture gain can be measured after the water
+ * has soaked in.
+ *
+ * @param[in] zone configuration data for a watering zone
+ * @param[in,out] response learned moisture response for the zone
+ * @param[in] moisture current soil moisture percentage for the zone
+ * @return length of time to pump water
+ */
+unsigned long waterNeeded(const watering_zone_t * zone, moisture_response_t * response,
+  const float moisture)
+{
+  if (moisture < zone->rules.moisturePercentage) {
+    unsigned long duration = wateringDuration(zone->rules, response, moisture);
+    response->startMoisture = moisture;
+    response->deliveredMillis = duration;
+    return duration;
+  }
+  return 0; // No water needed at this time
+}
+
+/**
+ * size a watering event from the learned moisture response
+ *
+ * Falls back to the fixed watering interval until adaptive watering is
+ * configured for the zone, and a response has been measured.
+ *
+ * @param[in] rules watering trigger criteria
+ * @param[in] response learned moisture response for the zone
+ * @param[in] moisture current soil moisture percentage
+ * @return length of time to pump water
+ */
+unsigned long wateringDuration(const watering_triggers_t rules,
+  const moisture_response_t * response, const float moisture)
+{
+  if (rules.targetPercentage <= rules.moisturePercentage ||
+      rules.maximumWatering == 0 || response->gainPerSecond <= 0) {
+    return rules.wateringInterval;
+  }
+  float needed = (rules.targetPercentage - moisture) * 1000 / response->gainPerSecond;
+  if (needed >= rules.maximumWatering) {
+    return rules.maximumWatering;
+  }
+  if (needed <= rules.minimumWatering) {
+    return rules.minimumWatering;
+  }
+  return (unsigned long)needed;
+} // end wateringDuration()
+
+/**
+ * update the moisture response estimate after a watering event has soaked in
+ *
+ * A watering event that shows no moisture gain (empty reservoir, blocked line,
+ * saturated sensor) is not used. It would drive the following event sizes to
+ * the maximum limit.
+ *
+ * @param[in,out] response learned moisture response for the zone
+ * @param[in] moisture soil moisture percentage after soaking in
+ */
+void learnMoistureResponse(moisture_response_t * response, const float moisture)
+{
+  if (response->deliveredMillis == 0) {
+    return; // no watering event to learn from
+  }
+  float gain = (moisture - response->startMoisture) * 1000 / response->deliveredMillis;
+  response->deliveredMillis = 0;
+  if (gain <= 0) {
+    return;
+  }
+  if (response->gainPerSecond <= 0) {
+    response->gainPerSecond = gain;
+  } else {
+    response->gainPerSecond += RESPONSE_SMOOTHING * (gain - response->gainPerSecond);
+  }
+} // end learnMoistureResponse()
+
+/**
+ * set the pwm output for a pump motor controller
+ *
+ * Settings for PWM expander pumps are sent by the next `flushPwmExpanders()`.
+ *
+ * @param pump pump configuration data
+ * @param speed pwm setting, 0 to PWM_MAX_VALUE
+ */
+void setPumpSpeed(const pump_motor_t pump, const pwm_setting_t speed)
+{
+  if (pump.device == ONBOARD_PWM) {
+    analogWrite(pump.gpio_pin, speed);
+    return;
+  }
+  setExpanderDuty(pump.device - 1, pump.channel,
+    (uint32_t)speed * PWM_EXPANDER_MAX / PWM_MAX_VALUE);
+} // end setPumpSpeed()
+
+/**
+ * check if a pump starts with a hardware ramp
+ *
+ * @param pump pump configuration data
+ * @return true when a ramp is configured, and the pump output can fade
+ */
+bool pumpRamps(const pump_motor_t pump)
+{
+  return pump.rampMillis > 0 && pump.device == ONBOARD_PWM;
+} // end pumpRamps()
+
+/**
+ * start a pump at its configured speed
+ *
+ * Uses the configured ramp when there is one.
+ *
+ * @param pump pump configuration data
+ */
+void startPump(pump_motor_t pump)
+{
+  if (pumpRamps(pump)) {
+    rampPump(pump, pump.rampMillis);
+    return;
+  }
+  setPumpSpeed(pump, pump.speed);
+} // end startPump()
+
+/**
+ * start a pump with a hardware (LEDC) fade from its start speed to its speed
+ *
+ * The fade runs without any help from the main loop. Falls back to going
+ * straight to the configured speed if the fade can not be set up.
+ *
+ * @param pump pump configuration data
+ * @param rampTime milliseconds to fade to the running speed
+ */
+void rampPump(const pump_motor_t pump, const unsigned long rampTime)
+{
+  // let the polyfill attach a channel to the pin, and set the initial duty
+  analogWrite(pump.gpio_pin, pump.startSpeed);
+  int channel = analogWriteChannel(pump.gpio_pin);
+  if (!fadeInstalled) {
+    fadeInstalled = ledc_fade_func_install(0) == ESP_OK;
+  }
+  if (channel < 0 || rampTime == 0 || !fadeInstalled) {
+    analogWrite(pump.gpio_pin, pump.speed);
+    return;
+  }
+  // arduino LEDC channels 0-7 are the high speed group, 8-15 the low speed group
+  ledc_mode_t mode = (ledc_mode_t)(channel / 8);
+  ledc_channel_t ledcChannel = (ledc_channel_t)(channel % 8);
+  uint32_t duty = pump.speed * ((1 << LEDC_DUTY_BITS) - 1) / PWM_MAX_VALUE;
+  if (ledc_set_fade_with_time(mode, ledcChannel, duty, rampTime) != ESP_OK ||
+      ledc_fade_start(mode, ledcChannel, LEDC_FADE_NO_WAIT) != ESP_OK) {
+    analogWrite(pump.gpio_pin, pump.speed);
+  }
+} // end rampPump()
+
+/**
+ * estimate the highest current a pump will draw while starting and running
+ *
+ * Motor current is treated as proportional to the pwm setting. Going straight
+ * to speed draws the stall current for that setting. A ramp only draws stall
+ * current for the start speed, then running current up to the higher of the
+ * start and running speeds.
+ *
+ * @param pump pump configuration data
+ * @return milliamps to reserve from the shared power supply
+ */
+unsigned int pumpPeakCurrent(const pump_motor_t pump)
+{
+  if (!pumpRamps(pump)) {
+    return (unsigned long)pump.stallCurrent * pump.speed / PWM_MAX_VALUE;
+  }
+  unsigned long kick = (unsigned long)pump.stallCurrent * pump.startSpeed / PWM_MAX_VALUE;
+  unsigned long running = (unsigned long)pump.runCurrent *
+    max(pump.startSpeed, pump.speed) / PWM_MAX_VALUE;
+  return max(kick, running);
+} // end pumpPeakCurrent()
+
+/**
+ * stop a hardware (LEDC) fade that may still be running on a pump output
+ *
+ * A running fade keeps control of the duty cycle, so a plain write of 0 would
+ * be lost until the fade finished.
+ *
+ * @param pump pump configuration data
+ */
+void stopPumpFade(const pump_motor_t pump)
+{
+  int channel = analogWriteChannel(pump.gpio_pin);
+  if (!fadeInstalled || pump.device != ONBOARD_PWM || channel < 0) {
+    return;
+  }
+  ledc_mode_t mode = (ledc_mode_t)(channel / 8);
+  ledc_channel_t ledcChannel = (ledc_channel_t)(channel % 8);
+#ifdef ESP_IDF_VERSION_VAL
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+#define PUMP_FADE_STOP
+#endif
+#endif
+#ifdef PUMP_FADE_STOP
+  ledc_fade_stop(mode, ledcChannel);
+#else
+  // older drivers: a direct duty update replaces the fade settings
+  ledc_set_duty(mode, ledcChannel, 0);
+  ledc_update_duty(mode, ledcChannel);
+#endif
+} // end stopPumpFade()
+
+/**
+ * stop a pump
+ *
+ * Also stops a ramp that is still running.
+ *
+ * @param pump pump configuration data
+ */
+void stopPump(pump_motor_t pump)
+{
+  stopPumpFade(pump);
+  setPumpSpeed(pump, 0);
+} // end stopPump()
+
+/**
+ * one-shot timer (or flow meter) callback to stop a pump
+ *
+ * Runs from the esp_timer (or flow stop) task, not from the main loop.
+ *
+ * @param arg pointer to the configuration data of the pump to stop
+ */
+void pumpTimerExpired(void * arg)
+{
+  stopPump(*(pump_motor_t *)arg);
+  requestIo(IO_PWM_FLUSH); // sent by the I/O task, without waiting for the main loop
+} // end pumpTimerExpired()
+
+/**
+ * start a pump, and schedule a hardware timer to stop it
+ *
+ * The timer stops the pump on time, no matter how long it is until the main
+ * loop notices that the delivery time is over. The pump configuration must
+ * stay at the same address until the timer has expired.
+ *
+ * @param[in] pump pump configuration data
+ * @param[in,out] timer stop timer for the pump; created on first use
+ * @param[in] duration milliseconds to run the pump
+ * @return true when the timer will stop the pump; false when the caller must
+ *   stop it
+ */
+bool startPumpFor(pump_motor_t * pump, esp_timer_handle_t * timer,
+  const unsigned long duration)
+{
+  if (*timer == NULL) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = pumpTimerExpired;
+    timerArgs.arg = pump;
+    timerArgs.name = "pump stop";
+    if (esp_timer_create(&timerArgs, timer) != ESP_OK) {
+      *timer = NULL;
+    }
+  }
+  if (pumpRamps(*pump)) {
+    // the fade must be finished before the timer stops the pump
+    rampPump(*pump, min(pump->rampMillis, duration / 2));
+  } else {
+    startPump(*pump);
+  }
+  if (*timer == NULL) {
+    return false;
+  }
+  esp_timer_stop(*timer); // in case an earlier delivery was cut short
+  return esp_timer_start_once(*timer, (uint64_t)duration * 1000) == ESP_OK;
+} // end startPumpFor()
+
+/**
+ * cancel a scheduled pump stop
+ *
+ * @param[in] timer stop timer for the pump; may be NULL
+ */
+void cancelPumpTimer(esp_timer_handle_t timer)
+{
+  if (timer != NULL) {
+    esp_timer_stop(timer);
+  }
+} // end cancelPumpTimer()
@@ -0,0 +1,226 @@
+#ifndef watering_management_h
+#define watering_management_h
+
+#include <Arduino.h>
+// Using 'polyfill' library to allow standard `analogWrite()` function use.
+// With that, no ESP32 specific api libraries or methods are needed. for PWM
+// motor control or analog sensor reading.
+#include <analogWrite.h>
+#include <esp_timer.h>
+#include <driver/ledc.h>
+#include "smart_time.h"
+#include "watering_window.h"
+
+/**
+ * data structures and methods to access analog sensors and PWM motor controls
+ */
+
+/// Sensor values are currently 16 bits, but in case that changes, use a custom type
+typedef uint16_t sensor_reading_t;
+typedef uint32_t pwm_setting_t;
+typedef uint8_t gpio_pin_t;
+
+/**
+ * capacitive moisture sensor calibration data
+ *
+ * unique for each sensor
+ */
+struct moisture_calibration_t {
+  // raw in air «dry = 0%» reading
+  sensor_reading_t airValue;
+  // raw in water «wet = 100%» reading
+  sensor_reading_t waterValue;
+};
+
+/// `device` for a sensor connected directly to an ADC1 gpio pin
+const uint8_t ONBOARD_ADC = 0;
+
+/// information for acquiring moisture values
+struct moisture_sensor_t {
+  /// source gpio pin number for analog moisture readings
+  gpio_pin_t gpio_pin;
+  /// data needed for accurate translation of raw reading to moisture percentage
+  moisture_calibration_t moisture_calibration;
+  /// ONBOARD_ADC, or 1 + index of the external converter or multiplexer
+  uint8_t device;
+  /// channel on the external device
+  uint8_t channel;
+};
+
+/// pulse output flow sensor on a pump outlet
+struct flow_meter_t {
+  /// source gpio pin number for flow sensor pulses
+  gpio_pin_t gpio_pin;
+  /// pulse counter (PCNT) unit, 0 to 7; unique for each flow meter
+  uint8_t unit;
+  /// flow sensor pulses for each litre of water; 0 when there is no flow meter
+  uint16_t pulsesPerLitre;
+};
+
+/// `device` for a pump motor controller connected directly to a gpio pin
+const uint8_t ONBOARD_PWM = 0;
+
+/// information for controlling a water pump
+struct pump_motor_t {
+  /// target gpio pin number for motor controller PWM signals
+  gpio_pin_t gpio_pin;
+  /// pwm setting while running the pump
+  pwm_setting_t speed;
+  /// pwm setting at the start of the ramp to `speed`. Lower to soft start,
+  /// higher to kick start then throttle back
+  pwm_setting_t startSpeed;
+  /// milliseconds for the hardware to fade from `startSpeed` to `speed`; 0 to
+  /// go straight to `speed`. Only available for ONBOARD_PWM pumps
+  unsigned long rampMillis;
+  /// milliamps drawn while running at full pwm setting
+  unsigned int runCurrent;
+  /// milliamps drawn at full pwm setting before the motor starts turning
+  unsigned int stallCurrent;
+  /// ONBOARD_PWM, or 1 + index of the PWM expander
+  uint8_t device;
+  /// output channel on the PWM expander
+  uint8_t channel;
+  /// optional flow sensor, for volume based delivery
+  flow_meter_t flow;
+};
+
+/// `manifold` for a zone that has its own pump
+const uint8_t NO_MANIFOLD = 0;
+
+/// solenoid valve connecting a zone to a pump shared through a manifold
+struct zone_valve_t {
+  /// NO_MANIFOLD, or 1 + index of the valve manifold
+  uint8_t manifold;
+  /// target gpio pin number for the valve solenoid driver
+  gpio_pin_t gpio_pin;
+};
+
+/// `reservoir` for a zone with a water supply that never runs out
+const uint8_t NO_RESERVOIR = 0;
+
+/** data used to control when (and how much) to pump water
+ *
+ * For some of the envisioned (far future) scenarios, this will need to be a class
+ * a struct is not sufficent to directly handle variable numbers of «array» members
+*/
+struct watering_triggers_t {
+  /// lowest desired soil moisture percentage
+  float moisturePercentage;
+  /* future ideas
+    float ambientTemperature;
+    float ambientHumidity;
+    float ambientLight;
+    time_t previousWatering;
+    // // multiple versions in the future; weather forecast
+  */
+  /// milliseconds to continue watering once started
+  unsigned long wateringInterval;
+  /// milliseconds to continue ignoring sensor readings after watering finished
+  unsigned long soakingInterval;
+  /// soil moisture percentage to aim for when sizing adaptive watering events.
+  /// At or below `moisturePercentage` every event uses `wateringInterval`
+  float targetPercentage;
+  /// shortest adaptive watering event (milliseconds)
+  unsigned long minimumWatering;
+  /// longest adaptive watering event (milliseconds). Safety limit for a bad
+  /// response estimate. Zero disables adaptive watering
+  unsigned long maximumWatering;
+  /// millilitres to deliver when the pump has a flow meter. The watering time
+  /// becomes a safety limit. Zero for time based delivery
+  unsigned int wateringVolume;
+};
+
+/**
+ * learned soil moisture response to watering
+ *
+ * Runtime data, not configuration. Updated after each watering event has
+ * soaked in, and used to size the next watering event for the zone.
+ */
+struct moisture_response_t {
+  /// estimated moisture percentage gained per second of pumping; 0 until learned
+  float gainPerSecond;
+  /// moisture percentage measured when the latest watering event was sized
+  float startMoisture;
+  /// milliseconds the pump actually ran for the latest watering event
+  unsigned long deliveredMillis;
+};
+
+/**
+ * latest reading from a moisture sensor
+ *
+ * Every consumer of a zone's moisture uses the cached reading while it is
+ * younger than SENSOR_READING_TTL, instead of reading the sensor again.
+ */
+struct sensor_cache_t {
+  /// raw ADC value
+  sensor_reading_t raw;
+  /// calibrated soil moisture percentage
+  float moisture;
+  /// when the reading was taken; NULL_TIME when there is no reading
+  smart_time_t readTime;
+};
+
+/**
+ * Storage for all of the unique information needed to manage a single `zone`
+ *
+ * A zone uses a single moisture sensor, and either its own pump or a valve on
+ * a manifold shared with other zones.
+ */
+struct watering_zone_t {
+  /// human readable identification for the zone
+  String name;
+  /// information about the moisture sensor
+  moisture_sensor_t sensor;
+  /// information to determine when and how much to water
+  watering_triggers_t rules;
+  /// information about the water pump motor
+  pump_motor_t pump;
+  /// information about the manifold valve; replaces `pump` when used
+  zone_valve_t valve;
+  /// NO_RESERVOIR, or 1 + index of the reservoir the zone draws water from
+  uint8_t reservoir;
+  /// NO_SCHEDULE, or 1 + index of the watering windows the zone is limited to
+  uint8_t schedule;
+};
+
+// an empty configuration to clone when a zone is not being used
+const struct watering_zone_t UNUSED_ZONE = {
+  "unused",
+  {0, {4095, 0}, ONBOARD_ADC, 0}, // sensor
+  {0, 0, 0, 0, 0, 0, 0}, // rules
+  {0, 0, 0, 0, 0, 0, ONBOARD_PWM, 0, {0, 0, 0}}, // pump
+  {NO_MANIFOLD, 0}, // valve
+  NO_RESERVOIR,
+  NO_SCHEDULE
+};
+
+// nothing learned yet about how a zone responds to watering
+const struct moisture_response_t UNKNOWN_RESPONSE = { 0, 0, 0 };
+// no sensor reading cached yet
+const struct sensor_cache_t EMPTY_SENSOR_CACHE = { 0, 0, { 0, 0 } };
+
+extern const uint32_t PWM_MAX_VALUE;
+extern const unsigned long SENSOR_READING_TTL;
+extern unsigned long sensorReads;
+
+sensor_reading_t readSensor(const moisture_sensor_t);
+float calibratedMoisture(const moisture_sensor_t, const sensor_reading_t);
+float getSoilMoisture(const moisture_sensor_t);
+bool readingFresh(const sensor_cache_t *, const smart_time_t);
+float cachedMoisture(const moisture_sensor_t, sensor_cache_t *, const smart_time_t);
+unsigned long waterNeeded(const watering_zone_t *, moisture_response_t *, const float);
+unsigned long wateringDuration(const watering_triggers_t, const moisture_response_t *,
+  const float);
+void learnMoistureResponse(moisture_response_t *, const float);
+void setPumpSpeed(const pump_motor_t, const pwm_setting_t);
+bool pumpRamps(const pump_motor_t);
+void startPump(pump_motor_t);
+void rampPump(const pump_motor_t, const unsigned long);
+unsigned int pumpPeakCurrent(const pump_motor_t);
+void stopPumpFade(const pump_motor_t);
+void stopPump(pump_motor_t);
+void pumpTimerExpired(void *);
+bool startPumpFor(pump_motor_t *, esp_timer_handle_t *, const unsigned long);
+void cancelPumpTimer(esp_timer_handle_t);
+
+#endif
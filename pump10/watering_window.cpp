@@ -0,0 +1,122 @@
+/**
+ * methods to check the time of day watering windows for zones
+ */
+#include "watering_window.h"
+
+const watering_schedule_t * scheduleConfig = NULL;
+size_t scheduleCount = 0;
+bool clockNotSetLogged = false;
+
+/**
+ * record the schedules available to zones
+ *
+ * @param[in] schedules array of schedule configurations
+ * @param[in] count number of schedules in the array
+ */
+void beginWateringWindows(const watering_schedule_t * schedules, const size_t count)
+{
+  scheduleConfig = schedules;
+  scheduleCount = min(count, MAX_SCHEDULES);
+} // end beginWateringWindows()
+
+/**
+ * get the epoch time of a number of minutes after a local midnight
+ *
+ * mktime applies the time zone rules, including daylight savings time, for
+ * the resulting date and time.
+ *
+ * @param[in] midnight local date; time of day fields ignored
+ * @param[in] minutes minutes to add, can be more than a day
+ * @return epoch time
+ */
+time_t localMinutes(const struct tm midnight, const unsigned int minutes)
+{
+  struct tm local = midnight;
+  local.tm_hour = 0;
+  local.tm_min = minutes;
+  local.tm_sec = 0;
+  local.tm_isdst = -1;
+  return mktime(&local);
+} // end localMinutes()
+
+/**
+ * evaluate a schedule at a point in time
+ *
+ * @param[in] schedule windows to check
+ * @param[in] now epoch time
+ * @param[out] nextChange earliest window start or end after now; unchanged
+ *   when there is none in the coming week
+ * @return true when now is inside one of the windows
+ */
+bool evaluateSchedule(const watering_schedule_t * schedule, const time_t now,
+  time_t * nextChange)
+{
+  bool open = false;
+  struct tm today;
+  localtime_r(&now, &today);
+  // from yesterday, for windows that run past midnight, through a week ahead
+  for (int day = -1; day <= 7; day++) {
+    struct tm date = today;
+    date.tm_mday += day;
+    date.tm_hour = 12; // away from daylight savings changes while normalizing
+    date.tm_isdst = -1;
+    mktime(&date); // normalize, and set tm_wday
+    for (size_t i = 0; i < schedule->count; i++) {
+      const watering_window_t * window = &schedule->windows[i];
+      if ((window->days & (1 << date.tm_wday)) == 0) {
+        continue;
+      }
+      unsigned int endMinutes = window->end > window->start ? window->end :
+        window->end + 24 * 60;
+      time_t start = localMinutes(date, window->start);
+      time_t end = localMinutes(date, endMinutes);
+      if (start <= now && now < end) {
+        open = true;
+      }
+      if (start > now && start < *nextChange) {
+        *nextChange = start;
+      }
+      if (end > now && end < *nextChange) {
+        *nextChange = end;
+      }
+    }
+  }
+  return open;
+} // end evaluateSchedule()
+
+/**
+ * check if a zone is allowed to water now
+ *
+ * The schedule is only evaluated once the cached state is due to change, or
+ * at least every WINDOW_RECHECK_LIMIT, to pick up clock adjustments. Watering
+ * is allowed while the clock has not been set.
+ *
+ * @param[in] schedule NO_SCHEDULE, or 1 + index of the zone's schedule
+ * @param[in,out] state cached window state for the zone
+ * @param[in] tick current time
+ * @return true when watering is allowed
+ */
+bool wateringAllowed(const uint8_t schedule, window_state_t * state,
+  const smart_time_t tick)
+{
+  if (schedule == NO_SCHEDULE || schedule > scheduleCount) {
+    return true;
+  }
+  if (smartTimeCompare(tick, state->nextChange) < 0) {
+    return state->open;
+  }
+  if (tick.epoch == 0) {
+    if (!clockNotSetLogged) {
+      Serial.println("LOG: clock not set; watering windows are not being enforced");
+      clockNotSetLogged = true;
+    }
+    state->open = true;
+    state->nextChange = smartOffsetMillis(tick, WINDOW_CLOCK_RETRY);
+    return true;
+  }
+  time_t now = tick.epoch;
+  time_t nextChange = now + WINDOW_RECHECK_LIMIT / 1000;
+  state->open = evaluateSchedule(&scheduleConfig[schedule - 1], now, &nextChange);
+  state->nextChange = smartOffsetMillis(tick, (nextChange - now) * 1000);
+  return state->open;
+} // end wateringAllowed()
@@ -0,0 +1,59 @@
+#ifndef watering_window_h
+#define watering_window_h
+
+#include <Arduino.h>
+#include <time.h>
+#include "smart_time.h"
+
+/**
+ * data structures and methods to limit watering to allowed times of day
+ *
+ * A zone can use one of the schedules defined in the sketch. A schedule is a
+ * list of windows in local time, each for a set of days of the week. Windows
+ * are evaluated against `smart_time_t::epoch`, through the time zone rules, so
+ * they follow daylight savings time changes.
+ *
+ * Evaluating the windows is done only when the cached result can change. Each
+ * zone keeps the time of its next window start or end, so the per pass check
+ * is a single time comparison.
+ */
+
+const uint8_t NO_SCHEDULE = 0; // water at any time of day
+const size_t MAX_SCHEDULES = 4;
+const size_t MAX_WINDOWS = 4; // per schedule
+const uint8_t EVERY_DAY = 0x7F;
+
+/// a daily period when watering is allowed
+struct watering_window_t {
+  /// days the window starts on; bit 0 is Sunday, through bit 6 for Saturday
+  uint8_t days;
+  /// start time in minutes after local midnight
+  uint16_t start;
+  /// end time in minutes after local midnight. An end at or before the start
+  /// ends the next day
+  uint16_t end;
+};
+
+/// windows for one or more zones
+struct watering_schedule_t {
+  watering_window_t windows[MAX_WINDOWS];
+  size_t count;
+};
+
+/// cached window state for a zone
+struct window_state_t {
+  /// watering allowed now
+  bool open;
+  /// when `open` has to be evaluated again
+  smart_time_t nextChange;
+};
+
+const struct window_state_t UNKNOWN_WINDOW = { true, { 0, 0 } };
+
+extern const unsigned long WINDOW_CLOCK_RETRY;
+extern const unsigned long WINDOW_RECHECK_LIMIT;
+
+void beginWateringWindows(const watering_schedule_t *, const size_t);
+bool wateringAllowed(const uint8_t, window_state_t *, const smart_time_t);
+
+#endif
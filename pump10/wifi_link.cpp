@@ -0,0 +1,51 @@
+/**
+ * methods to connect to the local wifi network
+ */
+#include "wifi_link.h"
+
+bool addressLogged = false;
+
+/**
+ * check if the network is configured
+ *
+ * @return true when WIFI_SSID has been set
+ */
+bool wifiConfigured()
+{
+  return WIFI_SSID[0] != '\0';
+} // end wifiConfigured()
+
+/**
+ * start connecting to the configured network
+ *
+ * @return true when a connection was started
+ */
+bool beginWifi()
+{
+  if (!wifiConfigured()) {
+    return false;
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  return true;
+} // end beginWifi()
+
+/**
+ * check if the network connection is up
+ *
+ * Logs the address the first time the connection is seen.
+ *
+ * @return true when connected
+ */
+bool wifiConnected()
+{
+  if (!wifiConfigured() || WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  if (!addressLogged) {
+    Serial.printf("LOG: wifi connected as %s\n", WiFi.localIP().toString().c_str());
+    addressLogged = true;
+  }
+  return true;
+} // end wifiConnected()
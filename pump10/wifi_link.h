@@ -0,0 +1,21 @@
+#ifndef wifi_link_h
+#define wifi_link_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+// secrets.h is not included in the repository. Copy template_secrets.h to
+// secrets.h, then fill in the details for the local network.
+#include "secrets.h"
+
+/**
+ * methods to connect to the local wifi network, shared by all network features
+ *
+ * The connection is started without waiting for it. The WiFi library keeps
+ * reconnecting in the background.
+ */
+
+bool beginWifi(void);
+bool wifiConfigured(void);
+bool wifiConnected(void);
+
+#endif
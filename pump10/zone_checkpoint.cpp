@@ -0,0 +1,169 @@
+/**
+ * methods to save and restore the runtime state of irrigation state machines
+ */
+#include "zone_checkpoint.h"
+
+const uint8_t CHECKPOINT_VERSION = 1; // change when zone_checkpoint_t changes
+const char * CHECKPOINT_NAMESPACE = "pump10";
+const char * CHECKPOINT_VERSION_KEY = "ckpt_ver";
+const char * CHECKPOINT_ZONES_KEY = "zones";
+
+Preferences checkpointStore;
+
+/**
+ * save the runtime state of irrigation contexts
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[out] checkpoint array of saved zone states
+ * @param[in] count the number of contexts in the arrays
+ * @param[in] timeTick current time reference
+ */
+void checkpointZones(const irrigation_context_t * contexts,
+  zone_checkpoint_t * checkpoint, const size_t count, const smart_time_t timeTick)
+{
+  for (size_t i = 0; i < count; i++) {
+    checkpoint[i].state = contexts[i].state;
+    checkpoint[i].remaining = 0;
+    if (smartTimeCompare(timeTick, contexts[i].target_time) < 0) {
+      checkpoint[i].remaining = smartDeltaMillis(timeTick, contexts[i].target_time);
+    }
+    checkpoint[i].response = contexts[i].response;
+    checkpoint[i].drying = contexts[i].drying;
+    checkpoint[i].dryingAge = smartDeltaMillis(contexts[i].drying.baseTime, timeTick);
+  }
+} // end checkpointZones()
+
+/**
+ * load saved runtime state into configured irrigation contexts
+ *
+ * Contexts that are not configured now stay disabled. Deadlines that passed
+ * while the state was saved are due immediately.
+ *
+ * @param[in,out] contexts array of configured irrigation state machine contexts
+ * @param[in] checkpoint array of saved zone states
+ * @param[in] count the number of contexts in the arrays
+ * @param[in] timeTick current time reference
+ * @param[in] elapsed milliseconds between checkpoint and now
+ */
+void restoreZones(irrigation_context_t * contexts,
+  const zone_checkpoint_t * checkpoint, const size_t count,
+  const smart_time_t timeTick, const unsigned long elapsed)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (contexts[i].state == ZONE_DISABLED) {
+      continue;
+    }
+    contexts[i].state = checkpoint[i].state;
+    contexts[i].target_time = timeTick;
+    if (checkpoint[i].remaining > elapsed) {
+      contexts[i].target_time = smartOffsetMillis(timeTick,
+        checkpoint[i].remaining - elapsed);
+    }
+    contexts[i].response = checkpoint[i].response;
+    contexts[i].drying = checkpoint[i].drying;
+    if (smartTimeCompare(checkpoint[i].drying.baseTime, NULL_TIME) != 0) {
+      // window start is in the past (before millis() restarted); wraps around
+      contexts[i].drying.baseTime.millis = timeTick.millis -
+        (checkpoint[i].dryingAge + elapsed);
+    }
+  }
+} // end restoreZones()
+
+/**
+ * save the runtime state of irrigation contexts to NVS
+ *
+ * Only call this when zone states change. Flash has limited write cycles.
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[out] checkpoint working storage for the saved zone states
+ * @param[in] count the number of contexts in the arrays
+ * @param[in] timeTick current time reference
+ */
+void saveCheckpoint(const irrigation_context_t * contexts,
+  zone_checkpoint_t * checkpoint, const size_t count, const smart_time_t timeTick)
+{
+  checkpointZones(contexts, checkpoint, count, timeTick);
+  checkpointStore.begin(CHECKPOINT_NAMESPACE, false);
+  if (checkpointStore.getUChar(CHECKPOINT_VERSION_KEY, 0) != CHECKPOINT_VERSION) {
+    checkpointStore.putUChar(CHECKPOINT_VERSION_KEY, CHECKPOINT_VERSION);
+  }
+  checkpointStore.putBytes(CHECKPOINT_ZONES_KEY, checkpoint,
+    count * sizeof(zone_checkpoint_t));
+  checkpointStore.end();
+} // end saveCheckpoint()
+
+/**
+ * read the runtime state of irrigation contexts from NVS
+ *
+ * A checkpoint from a different version, or with a different number of zones
+ * is ignored.
+ *
+ * @param[out] checkpoint array of saved zone states
+ * @param[in] count the number of contexts in the array
+ * @return true when a usable checkpoint was loaded
+ */
+bool loadCheckpoint(zone_checkpoint_t * checkpoint, const size_t count)
+{
+  size_t expected = count * sizeof(zone_checkpoint_t);
+  bool loaded = false;
+  checkpointStore.begin(CHECKPOINT_NAMESPACE, true);
+  if (checkpointStore.getUChar(CHECKPOINT_VERSION_KEY, 0) == CHECKPOINT_VERSION &&
+      checkpointStore.getBytesLength(CHECKPOINT_ZONES_KEY) == expected) {
+    loaded = checkpointStore.getBytes(CHECKPOINT_ZONES_KEY, checkpoint,
+      expected) == expected;
+  }
+  checkpointStore.end();
+  return loaded;
+} // end loadCheckpoint()
+
+/**
+ * check if a state transition changes what would be restored after a reset
+ *
+ * Only entering or leaving DELIVERING_WATER or SOAKING_IN is worth a flash
+ * write, so writes grow with watering events, not with state changes. Other
+ * states are restored as MOISTURE_GOOD anyway, and leaving SOAKING_IN saves
+ * the response learned from the delivery.
+ *
+ * @param[in] before zone state before processing
+ * @param[in] after zone state after processing
+ * @return true when the checkpoint in NVS should be updated
+ */
+bool checkpointNeeded(const irrigation_state_t before, const irrigation_state_t after)
+{
+  return before != after &&
+    (before == DELIVERING_WATER || before == SOAKING_IN ||
+      after == DELIVERING_WATER || after == SOAKING_IN);
+} // end checkpointNeeded()
+
+/**
+ * move restored zones that were interrupted by a reset to a safe state
+ *
+ * The length of the outage is not known. Zones that were pumping go straight
+ * to soaking in, since an unknown amount of water was delivered. Zones waiting
+ * for resources start over, since no resources are held after a reset.
+ *
+ * @param[in,out] contexts array of restored irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @param[in] timeTick current time reference
+ */
+void recoverInterruptedZones(irrigation_context_t * contexts, const size_t count,
+  const smart_time_t timeTick)
+{
+  for (size_t i = 0; i < count; i++) {
+    switch (contexts[i].state) {
+      case DELIVERING_WATER:
+        contexts[i].state = SOAKING_IN;
+        contexts[i].target_time = smartOffsetMillis(timeTick,
+          contexts[i].zone.rules.soakingInterval);
+        contexts[i].response.deliveredMillis = 0; // nothing to learn from
+        break;
+      case RESERVE_RESOURCES:
+      case RESOURCE_LOCK_TIMEOUT:
+        contexts[i].state = MOISTURE_GOOD;
+        contexts[i].target_time = timeTick;
+        break;
+      default:
+        break;
+    }
+  }
+} // end recoverInterruptedZones()
@@ -0,0 +1,49 @@
+#ifndef zone_checkpoint_h
+#define zone_checkpoint_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "smart_time.h"
+#include "watering_management.h"
+#include "irrigation_state.h"
+
+/**
+ * data structures and methods to save and restore the runtime state of the
+ * irrigation state machines
+ *
+ * RTC memory keeps a checkpoint across deep sleep. NVS keeps a checkpoint
+ * across reset and power loss, so zones that were soaking in (or pumping) do
+ * not start watering again as soon as the controller restarts.
+ */
+
+/**
+ * runtime state of an irrigation context that must survive deep sleep or reset
+ *
+ * The zone configuration is not included. The `String` name can not be kept
+ * in RTC memory, and the configuration is loaded again by `setup()` anyway.
+ * Deadlines are stored as offsets, since `millis()` restarts from zero.
+ */
+struct zone_checkpoint_t {
+  irrigation_state_t state;
+  /// milliseconds from checkpoint to the context target time
+  unsigned long remaining;
+  moisture_response_t response;
+  drying_model_t drying;
+  /// milliseconds from the drying measurement window start to checkpoint
+  unsigned long dryingAge;
+};
+
+extern const uint8_t CHECKPOINT_VERSION;
+
+void checkpointZones(const irrigation_context_t *, zone_checkpoint_t *,
+  const size_t, const smart_time_t);
+void restoreZones(irrigation_context_t *, const zone_checkpoint_t *,
+  const size_t, const smart_time_t, const unsigned long);
+void saveCheckpoint(const irrigation_context_t *, zone_checkpoint_t *,
+  const size_t, const smart_time_t);
+bool loadCheckpoint(zone_checkpoint_t *, const size_t);
+bool checkpointNeeded(const irrigation_state_t, const irrigation_state_t);
+void recoverInterruptedZones(irrigation_context_t *, const size_t,
+  const smart_time_t);
+
+#endif
@@ -0,0 +1,282 @@
+/**
+ * methods to edit, publish, and apply the double buffered zone configuration
+ */
+#include "zone_config.h"
+#include "valve_manifold.h"
+#include "metrics.h"
+
+zone_table_t zoneTables[2];
+zone_table_t * volatile publishedTable = NULL;
+// table the control loop is copying from; writers must not reuse it
+zone_table_t * volatile tableInUse = NULL;
+SemaphoreHandle_t configWriters = NULL; // one editor at a time
+// per zone: the layout applied to the context
+uint32_t appliedLayout[MAX_CONFIG_ZONES];
+uint32_t appliedVersion = 0;
+
+// console frame collection
+uint8_t frameBuffer[7 + MAX_CONFIG_PAYLOAD];
+size_t frameUsed = 0;
+
+/**
+ * build the first table from the zones configured in the sketch
+ *
+ * @param[in] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ */
+void beginZoneConfig(const irrigation_context_t * contexts, const size_t count)
+{
+  zone_table_t * table = &zoneTables[0];
+  table->version = 1;
+  table->count = min(count, MAX_CONFIG_ZONES);
+  for (size_t i = 0; i < table->count; i++) {
+    table->zones[i] = contexts[i].zone;
+    table->enabled[i] = contexts[i].state != ZONE_DISABLED;
+    table->layout[i] = 0;
+    appliedLayout[i] = 0;
+  }
+  zoneTables[1] = *table;
+  configWriters = xSemaphoreCreateMutex();
+  appliedVersion = table->version;
+  publishedTable = table;
+} // end beginZoneConfig()
+
+/**
+ * get the latest published zone table
+ *
+ * @return the table; NULL before beginZoneConfig()
+ */
+const zone_table_t * currentZoneTable()
+{
+  return publishedTable;
+} // end currentZoneTable()
+
+/**
+ * check if a zone can take a structural change now
+ *
+ * @param[in] context irrigation state machine context
+ * @return true when the zone holds no resources
+ */
+bool zoneIdle(const irrigation_context_t * context)
+{
+  return context->state == ZONE_DISABLED || context->state == MOISTURE_GOOD ||
+    context->state == SOAKING_IN;
+} // end zoneIdle()
+
+/**
+ * delete the stop timer of a zone that is changing structure
+ *
+ * The timer was created for the old pump (or valve), with that stop callback.
+ * The next delivery creates a new one for the new layout.
+ *
+ * @param[in,out] context irrigation state machine context; idle
+ */
+void dropPumpTimer(irrigation_context_t * context)
+{
+  if (context->pump_timer != NULL) {
+    esp_timer_stop(context->pump_timer);
+    esp_timer_delete(context->pump_timer);
+    context->pump_timer = NULL;
+  }
+  context->timed_delivery = false;
+} // end dropPumpTimer()
+
+/**
+ * pick up a newly published table
+ *
+ * Called at the start of a pass. Never waits: when a changed zone is busy, the
+ * whole table waits for a later pass.
+ *
+ * @param[in,out] contexts array of irrigation state machine contexts
+ * @param[in] count the number of contexts in the array
+ * @return true when a new table was applied
+ */
+bool applyZoneConfig(irrigation_context_t * contexts, const size_t count)
+{
+  zone_table_t * table = publishedTable;
+  if (table == NULL || table->version == appliedVersion) {
+    return false;
+  }
+  tableInUse = table;
+  __sync_synchronize(); // make the claim visible before checking again
+  if (publishedTable != table) {
+    tableInUse = NULL; // replaced while starting; take the newer one next pass
+    return false;
+  }
+  size_t zones = min(count, table->count);
+  for (size_t i = 0; i < zones; i++) {
+    if (table->layout[i] != appliedLayout[i] && !zoneIdle(&contexts[i])) {
+      tableInUse = NULL;
+      return false; // apply everything together, once the zone is idle
+    }
+  }
+  for (size_t i = 0; i < zones; i++) {
+    irrigation_context_t * context = &contexts[i];
+    if (table->layout[i] != appliedLayout[i]) {
+      appliedLayout[i] = table->layout[i];
+      dropPumpTimer(context);
+      if (!table->enabled[i]) {
+        context->state = ZONE_DISABLED;
+      } else if (context->state == ZONE_DISABLED) {
+        configureZone(context, table->zones[i]);
+      } else {
+        context->zone = table->zones[i];
+        setupValve(context->zone.valve);
+        context->reading = EMPTY_SENSOR_CACHE;
+        context->window = UNKNOWN_WINDOW;
+      }
+      continue;
+    }
+    context->zone.rules = table->zones[i].rules;
+    if (memcmp(&context->zone.sensor.moisture_calibration,
+        &table->zones[i].sensor.moisture_calibration, sizeof(moisture_calibration_t)) != 0) {
+      context->zone.sensor.moisture_calibration = table->zones[i].sensor.moisture_calibration;
+      context->reading = EMPTY_SENSOR_CACHE;
+    }
+  }
+  appliedVersion = table->version;
+  tableInUse = NULL;
+  Serial.printf("LOG: zone configuration version %lu applied\n",
+    (unsigned long)appliedVersion);
+  return true;
+} // end applyZoneConfig()
+
+/**
+ * get the buffer to build the next table in, starting as a copy of the
+ * published table
+ *
+ * Waits (writers only) while the control loop is still copying from it.
+ *
+ * @return the table to edit
+ */
+zone_table_t * startEdit()
+{
+  zone_table_t * back = publishedTable == &zoneTables[0] ? &zoneTables[1] : &zoneTables[0];
+  __sync_synchronize();
+  while (tableInUse == back) {
+    delay(1); // the control loop finishes copying within a pass
+  }
+  *back = *publishedTable;
+  back->version++;
+  return back;
+} // end startEdit()
+
+/**
+ * run a configuration command
+ *
+ * @param[in] command config_command_t
+ * @param[in] zoneNumber 1 + index of the zone
+ * @param[in] payload command data
+ * @param[in] length bytes in the payload
+ * @return CONFIG_OK when the new table was published
+ */
+config_result_t configureCommand(const uint8_t command, const uint8_t zoneNumber,
+  const uint8_t * payload, const size_t length)
+{
+  if (publishedTable == NULL || zoneNumber < 1 || zoneNumber > publishedTable->count) {
+    return CONFIG_BAD_ZONE;
+  }
+  size_t zone = zoneNumber - 1;
+  config_result_t result = CONFIG_OK;
+  xSemaphoreTake(configWriters, portMAX_DELAY);
+  zone_table_t * table = startEdit();
+  if (command == CONFIG_SET_ZONE && length == sizeof(zone_config_frame_t)) {
+    zone_config_frame_t frame;
+    memcpy(&frame, payload, sizeof(frame));
+    frame.name[CONFIG_NAME_SIZE - 1] = '\0';
+    watering_zone_t * target = &table->zones[zone];
+    target->name = frame.name;
+    target->sensor = frame.sensor;
+    target->rules = frame.rules;
+    target->pump = frame.pump;
+    target->valve = frame.valve;
+    target->reservoir = frame.reservoir;
+    target->schedule = frame.schedule;
+    table->enabled[zone] = true;
+    table->layout[zone]++;
+  } else if (command == CONFIG_SET_RULES && length == sizeof(watering_triggers_t)) {
+    memcpy(&table->zones[zone].rules, payload, sizeof(watering_triggers_t));
+  } else if (command == CONFIG_DISABLE_ZONE && length == 0) {
+    table->enabled[zone] = false;
+    table->layout[zone]++;
+  } else {
+    result = CONFIG_BAD_COMMAND;
+  }
+  if (result == CONFIG_OK) {
+    __sync_synchronize(); // the whole table is written before it is published
+    publishedTable = table;
+  }
+  xSemaphoreGive(configWriters);
+  return result;
+} // end configureCommand()
+
+/**
+ * publish a new sensor calibration for a zone
+ *
+ * @param[in] zone index of the zone
+ * @param[in] calibration new calibration data
+ * @return CONFIG_OK when published
+ */
+config_result_t setZoneCalibration(const size_t zone, const moisture_calibration_t calibration)
+{
+  if (publishedTable == NULL || zone >= publishedTable->count) {
+    return CONFIG_BAD_ZONE;
+  }
+  xSemaphoreTake(configWriters, portMAX_DELAY);
+  zone_table_t * table = startEdit();
+  table->zones[zone].sensor.moisture_calibration = calibration;
+  __sync_synchronize();
+  publishedTable = table;
+  xSemaphoreGive(configWriters);
+  return CONFIG_OK;
+} // end setZoneCalibration()
+
+/**
+ * check and run a complete command frame
+ *
+ * @param[in] frame the frame, starting with the sync bytes
+ * @param[in] length bytes in the frame
+ * @return result of the command
+ */
+config_result_t configureFrame(const uint8_t * frame, const size_t length)
+{
+  if (length < 7 || frame[0] != CONFIG_SYNC_1 || frame[1] != CONFIG_SYNC_2 ||
+      length != 7 + (size_t)frame[4]) {
+    return CONFIG_BAD_FRAME;
+  }
+  size_t payload = frame[4];
+  uint16_t crc = crc16(0xFFFF, frame + 2, 3 + payload);
+  if (frame[5 + payload] != (crc & 0xFF) || frame[6 + payload] != (crc >> 8)) {
+    return CONFIG_BAD_FRAME;
+  }
+  return configureCommand(frame[2], frame[3], frame + 5, payload);
+} // end configureFrame()
+
+/**
+ * collect a command frame from the console, one byte at a time
+ *
+ * @param[in] next byte received
+ * @return true when the byte belongs to a frame; false for console text
+ */
+bool configFrameByte(const uint8_t next)
+{
+  if (frameUsed == 0 && next != CONFIG_SYNC_1) {
+    return false;
+  }
+  if (frameUsed == 1 && next != CONFIG_SYNC_2) {
+    frameUsed = 0;
+    return false; // not a frame after all
+  }
+  frameBuffer[frameUsed++] = next;
+  if (frameUsed == 5 && frameBuffer[4] > MAX_CONFIG_PAYLOAD) {
+    frameUsed = 0;
+    Serial.printf("config result %u\n", CONFIG_BAD_FRAME);
+    return true;
+  }
+  if (frameUsed >= 5 && frameUsed == 7 + (size_t)frameBuffer[4]) {
+    config_result_t result = configureFrame(frameBuffer, frameUsed);
+    frameUsed = 0;
+    Serial.printf("config result %u\n", result);
+  }
+  return true;
+} // end configFrameByte()
@@ -0,0 +1,87 @@
+#ifndef zone_config_h
+#define zone_config_h
+
+#include <Arduino.h>
+#include "watering_management.h"
+#include "irrigation_state.h"
+
+/**
+ * data structures and methods to change the zone configuration at runtime
+ *
+ * The configuration is a table of all zones, double buffered. Commands (from
+ * the console, or http) copy the published table to the other buffer, edit
+ * the copy, then publish it with a single pointer store. The control loop
+ * picks up a new table at the start of a pass, so no state machine ever sees
+ * a partly updated zone, and the loop never waits for a lock.
+ *
+ * Settings (watering rules and sensor calibration) are applied on the next
+ * pass. Structural changes (pins, devices, valve, reservoir, name, enabling
+ * or disabling) wait until every changed zone is idle: not waiting for
+ * resources, and not delivering water.
+ *
+ * Command frame, little endian:
+ *   0xA5 0xC3 «command» «zone number» «payload length» «payload»
+ *   CRC-16/CCITT-FALSE of command to the end of the payload
+ */
+
+const uint8_t CONFIG_SYNC_1 = 0xA5;
+const uint8_t CONFIG_SYNC_2 = 0xC3;
+const size_t MAX_CONFIG_ZONES = 16;
+const size_t CONFIG_NAME_SIZE = 16;
+const size_t MAX_CONFIG_PAYLOAD = 160;
+
+/// configuration commands
+enum config_command_t {
+  /// payload zone_config_frame_t: add (or replace) a zone, and enable it
+  CONFIG_SET_ZONE = 1,
+  /// payload watering_triggers_t
+  CONFIG_SET_RULES,
+  /// no payload
+  CONFIG_DISABLE_ZONE
+};
+
+/// result codes returned for a command
+enum config_result_t {
+  CONFIG_OK = 0,
+  CONFIG_BAD_FRAME,
+  CONFIG_BAD_ZONE,
+  CONFIG_BAD_COMMAND
+};
+
+/// zone configuration as sent in a CONFIG_SET_ZONE payload
+struct __attribute__((packed)) zone_config_frame_t {
+  char name[CONFIG_NAME_SIZE];
+  moisture_sensor_t sensor;
+  watering_triggers_t rules;
+  pump_motor_t pump;
+  zone_valve_t valve;
+  uint8_t reservoir;
+  uint8_t schedule;
+};
+
+static_assert(sizeof(zone_config_frame_t) <= MAX_CONFIG_PAYLOAD,
+  "zone configuration must fit a command frame");
+
+/// one buffer of the double buffered configuration
+struct zone_table_t {
+  uint32_t version;
+  size_t count;
+  watering_zone_t zones[MAX_CONFIG_ZONES];
+  bool enabled[MAX_CONFIG_ZONES];
+  /// incremented on every structural change to the zone
+  uint32_t layout[MAX_CONFIG_ZONES];
+};
+
+/// configureZone() is provided by the sketch
+void configureZone(irrigation_context_t *, const watering_zone_t);
+
+void beginZoneConfig(const irrigation_context_t *, const size_t);
+bool applyZoneConfig(irrigation_context_t *, const size_t);
+config_result_t configureCommand(const uint8_t, const uint8_t, const uint8_t *,
+  const size_t);
+config_result_t configureFrame(const uint8_t *, const size_t);
+config_result_t setZoneCalibration(const size_t, const moisture_calibration_t);
+bool configFrameByte(const uint8_t);
+const zone_table_t * currentZoneTable(void);
+
+#endif